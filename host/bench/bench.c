@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+#ifndef KVASS_BENCH_BUILD_TYPE
+#define KVASS_BENCH_BUILD_TYPE "unknown"
+#endif
+
+uint64_t benchNowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t timeRun(const struct Bench *bench, uint64_t n)
+{
+    uint64_t startNs = 0;
+
+    bench->setup();
+    startNs = benchNowNs();
+    bench->run(n);
+    return benchNowNs() - startNs;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Grows n until one repeat takes about minTimeMs, timer resolution stops mattering by then
+static uint64_t calibrate(const struct Bench *bench, uint32_t minTimeMs)
+{
+    uint64_t targetNs = (uint64_t)minTimeMs * 1000000ULL;
+    uint64_t n = 1;
+    uint64_t elapsedNs = 0;
+
+    while (n < BENCH_MAX_ITERATIONS)
+    {
+        elapsedNs = timeRun(bench, n);
+        if (elapsedNs >= targetNs)
+        {
+            break;
+        }
+        if (elapsedNs < targetNs / 100)
+        {
+            n *= 10;
+            continue;
+        }
+        // Close enough to scale, with a little headroom so the next run lands above the target
+        n = (uint64_t)((double)n * (double)targetNs * 1.2 / (double)elapsedNs) + 1;
+    }
+    return n < BENCH_MAX_ITERATIONS ? n : BENCH_MAX_ITERATIONS;
+}
+
+void benchRun(const struct Bench *bench, uint32_t minTimeMs, struct BenchResult *result)
+{
+    double nsPerOp[BENCH_REPEATS];
+    uint64_t n = calibrate(bench, minTimeMs);
+
+    memset(result, 0, sizeof(*result));
+    result->name = bench->name;
+    result->iterations = n;
+
+    for (int r = 0; r < BENCH_REPEATS; r++)
+    {
+        nsPerOp[r] = (double)timeRun(bench, n) / (double)n;
+    }
+    qsort(nsPerOp, BENCH_REPEATS, sizeof(nsPerOp[0]), compareDoubles);
+    result->nsMin = nsPerOp[0];
+    result->nsMax = nsPerOp[BENCH_REPEATS - 1];
+    result->nsPerOp = nsPerOp[BENCH_REPEATS / 2];
+
+    if (bench->report != NULL)
+    {
+        bench->report(result, n, result->nsPerOp * (double)n);
+    }
+}
+
+void benchMetric(struct BenchResult *result, const char *name, const char *unit, double value)
+{
+    if (result->metricCount >= BENCH_METRICS)
+    {
+        return;
+    }
+    result->metrics[result->metricCount].name = name;
+    result->metrics[result->metricCount].unit = unit;
+    result->metrics[result->metricCount].value = value;
+    result->metricCount++;
+}
+
+void benchPrintTable(FILE *out, const struct BenchResult *results, int count)
+{
+    const struct BenchResult *result = NULL;
+
+    fprintf(out, "%-28s %12s %12s %12s %12s\n", "benchmark", "ns/op", "min", "max", "iterations");
+    for (int i = 0; i < count; i++)
+    {
+        result = &results[i];
+        fprintf(out, "%-28s %12.1f %12.1f %12.1f %12llu\n", result->name, result->nsPerOp, result->nsMin,
+                result->nsMax, (unsigned long long)result->iterations);
+        for (int m = 0; m < result->metricCount; m++)
+        {
+            fprintf(out, "    %-24s %14.2f %s\n", result->metrics[m].name, result->metrics[m].value, result->metrics[m].unit);
+        }
+    }
+}
+
+// Only names from this program and the version string end up in here
+static void writeString(FILE *out, const char *text)
+{
+    fputc('"', out);
+    for (; *text; text++)
+    {
+        if (*text == '"' || *text == '\\')
+        {
+            fputc('\\', out);
+        }
+        if ((unsigned char)*text >= 0x20)
+        {
+            fputc(*text, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/*
+Schema 1, tools/bench_compare.py reads it:
+{"schema": 1, "version": ..., "build_type": ..., "compiler": ..., "date": ...,
+ "benchmarks": [{"name", "iterations", "ns_per_op", "ns_min", "ns_max", "ops_per_sec",
+                 "metrics": {name: {"value", "unit"}}}]}
+*/
+void benchWriteJson(FILE *out, const char *version, const struct BenchResult *results, int count)
+{
+    const struct BenchResult *result = NULL;
+    char date[32];
+    time_t now = time(NULL);
+
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(out, "{\n  \"schema\": 1,\n  \"version\": ");
+    writeString(out, version);
+    fprintf(out, ",\n  \"build_type\": ");
+    writeString(out, KVASS_BENCH_BUILD_TYPE);
+    fprintf(out, ",\n  \"compiler\": ");
+    writeString(out, __VERSION__);
+    fprintf(out, ",\n  \"date\": ");
+    writeString(out, date);
+    fprintf(out, ",\n  \"benchmarks\": [");
+
+    for (int i = 0; i < count; i++)
+    {
+        result = &results[i];
+        fprintf(out, "%s\n    {\"name\": ", i ? "," : "");
+        writeString(out, result->name);
+        fprintf(out, ", \"iterations\": %llu, \"ns_per_op\": %.3f, \"ns_min\": %.3f, \"ns_max\": %.3f, \"ops_per_sec\": %.1f",
+                (unsigned long long)result->iterations, result->nsPerOp, result->nsMin, result->nsMax,
+                result->nsPerOp > 0 ? 1e9 / result->nsPerOp : 0.0);
+        fprintf(out, ", \"metrics\": {");
+        for (int m = 0; m < result->metricCount; m++)
+        {
+            fprintf(out, "%s", m ? ", " : "");
+            writeString(out, result->metrics[m].name);
+            fprintf(out, ": {\"value\": %.3f, \"unit\": ", result->metrics[m].value);
+            writeString(out, result->metrics[m].unit);
+            fprintf(out, "}");
+        }
+        fprintf(out, "}}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define BENCH_REPEATS 5
+#define BENCH_METRICS 8
+#define BENCH_MAX_ITERATIONS 100000000ULL
+
+struct BenchMetric
+{
+    const char *name;
+    const char *unit;
+    double value;
+};
+
+struct BenchResult
+{
+    const char *name;
+    uint64_t iterations; // per repeat
+    double nsPerOp;      // median of the repeats
+    double nsMin;
+    double nsMax;
+
+    struct BenchMetric metrics[BENCH_METRICS];
+    int metricCount;
+};
+
+/*
+One benchmark. Every repeat starts from setup, which is not timed, then runs
+n operations. Runs have to be deterministic, the simulated board only moves
+when run moves it, so every repeat does the same work and metrics may come
+from any of them.
+*/
+struct Bench
+{
+    const char *name;
+    void (*setup)(void);
+    void (*run)(uint64_t n);
+    // Optional, adds metrics after the last repeat, elapsedNs is the median repeat
+    void (*report)(struct BenchResult *result, uint64_t n, double elapsedNs);
+};
+
+uint64_t benchNowNs(void);
+void benchRun(const struct Bench *bench, uint32_t minTimeMs, struct BenchResult *result);
+void benchMetric(struct BenchResult *result, const char *name, const char *unit, double value);
+void benchPrintTable(FILE *out, const struct BenchResult *results, int count);
+void benchWriteJson(FILE *out, const char *version, const struct BenchResult *results, int count);
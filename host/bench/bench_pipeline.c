@@ -0,0 +1,506 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "common_kvass.h"
+#include "gpio_manager.h"
+#include "comms_manager.h"
+#include "report_scheduler.h"
+#include "keymap.h"
+#include "dongle_link.h"
+#include "host_sim.h"
+#include "bench.h"
+
+#ifndef KVASS_BENCH_VERSION
+#define KVASS_BENCH_VERSION "unknown"
+#endif
+
+#define SCAN_PERIOD_US (1000000 / KB_MATRIX_SCAN_RATE_HZ)
+// Scan timer and host frames run off different clocks, the pipeline benches walk the scan through every frame phase
+#define SCAN_DRIFT_US 7
+#define DEFAULT_MIN_TIME_MS 200
+
+// Plain keycodes on the default base layer, no layer, tap-hold or combo keys among them
+static const uint8_t typingKeys[][2] = {
+    {0, 1}, {0, 2}, {0, 3}, {0, 4}, {0, 5},
+    {1, 1}, {1, 2}, {1, 3}, {1, 4}, {1, 5},
+    {2, 1}, {2, 2}, {2, 3}, {2, 4}, {2, 5},
+    {3, 1}, {3, 2}, {3, 3}, {3, 4}, {3, 5},
+};
+#define TYPING_KEYS (sizeof(typingKeys) / sizeof(typingKeys[0]))
+
+// Rolling typing, a stroke every 8 ms and each key held for three strokes, a fast typist's burst
+#define TYPING_STROKE_TICKS 8
+#define TYPING_OVERLAP 3
+
+// Chords of 4 to 10 keys pressed in the same scan, held for half the period
+#define CHORD_PERIOD_TICKS 16
+#define CHORD_MIN_KEYS 4
+#define CHORD_MAX_KEYS 10
+
+static struct EventRing ring;
+static TaskHandle_t commsTask = NULL;
+static struct CommsParameters comms;
+static struct GodParameters god;
+static uint32_t tick = 0;
+static uint32_t rng = 0;
+static uint32_t keysPressed = 0;
+
+// Both tasks in one thread: a USB frame, then what the GPIO task does on a scan tick, then the comms task
+static void runComms(void *ctx)
+{
+    (void)ctx;
+    sendPendingEvents(&comms);
+}
+
+static void pipelineTick(void)
+{
+    hostClockAdvance(SCAN_PERIOD_US + SCAN_DRIFT_US);
+    // Host polls first, reports sent this tick wait for the next frame like on the bus
+    captureTransportAdvance(hostUsbCapture(), (uint32_t)hostClockNow());
+    scanKeys(&god);
+    releaseKeyEvents(&comms);
+    eventRingFlush(&ring);
+    sendPendingEvents(&comms);
+    hostDlogDrain();
+    tick++;
+}
+
+static void setupPipeline(void)
+{
+    hostReset();
+    eventRingInit(&ring);
+    memset(&comms, 0, sizeof(comms));
+    comms.commsTask = &commsTask;
+    comms.protocol = USB;
+    comms.commsData.eventRing = &ring;
+    god.commsParameters = &comms;
+
+    ESP_ERROR_CHECK(initMatrixIo());
+    initKeyProcessing(&comms);
+    initComms(&comms);
+    // A producer waiting on a full ring gets the comms task run, as it would on the board
+    hostSetYield(runComms, NULL);
+
+    tick = 0;
+    rng = 0x2545F491;
+    keysPressed = 0;
+}
+
+static uint32_t nextRandom(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static void pressTypingKey(uint32_t index, bool pressed)
+{
+    const uint8_t *key = typingKeys[index % TYPING_KEYS];
+
+    hostMatrixKey(key[0], key[1], pressed);
+    keysPressed += pressed;
+}
+
+// Stride 7 is coprime with the key count, strokes wander over every key without repeating early
+static void typingScript(void)
+{
+    uint32_t stroke = tick / TYPING_STROKE_TICKS;
+
+    if (tick % TYPING_STROKE_TICKS != 0)
+    {
+        return;
+    }
+    pressTypingKey(stroke * 7, true);
+    if (stroke >= TYPING_OVERLAP)
+    {
+        pressTypingKey((stroke - TYPING_OVERLAP) * 7, false);
+    }
+}
+
+static void chordScript(void)
+{
+    static const matrix_row_t released[KB_ROWS] = {0};
+    uint32_t phase = tick % CHORD_PERIOD_TICKS;
+    uint32_t count = 0;
+
+    if (phase == CHORD_PERIOD_TICKS / 2)
+    {
+        hostMatrixSet(released);
+        return;
+    }
+    if (phase != 0)
+    {
+        return;
+    }
+    count = CHORD_MIN_KEYS + nextRandom() % (CHORD_MAX_KEYS - CHORD_MIN_KEYS + 1);
+    for (uint32_t k = 0; k < count; k++)
+    {
+        // Repeats just land on a key that is already down, chords end up a little smaller
+        pressTypingKey(nextRandom(), true);
+    }
+}
+
+// scanKeys alone, nothing pressed: matrix scan and debounce of a quiet matrix
+static void runScanIdle(uint64_t n)
+{
+    for (uint64_t i = 0; i < n; i++)
+    {
+        hostClockAdvance(SCAN_PERIOD_US);
+        scanKeys(&god);
+    }
+}
+
+// Held keys are debounced and reported before timing starts, scans then only confirm them
+static void setupScanHeld(void)
+{
+    setupPipeline();
+    for (uint32_t k = 0; k < 6; k++)
+    {
+        pressTypingKey(k * 3, true);
+    }
+    for (int i = 0; i < 20; i++)
+    {
+        pipelineTick();
+    }
+}
+
+static KeySet keys6;
+static KeySet keysChord;
+
+static void setupPopulate(void)
+{
+    keySetClear(&keys6);
+    keySetClear(&keysChord);
+    for (uint8_t k = 0; k < 6; k++)
+    {
+        keySetAdd(0x04 + k * 3, &keys6);
+    }
+    // Past the 6KRO order, with modifiers, so the NKRO bitmap carries most of it
+    for (uint8_t k = 0; k < 18; k++)
+    {
+        keySetAdd(0x04 + k, &keysChord);
+    }
+    keySetAdd(0xE0, &keysChord);
+    keySetAdd(0xE1, &keysChord);
+}
+
+static void runPopulate(const KeySet *keys, uint64_t n)
+{
+    struct KeyboardData data;
+    volatile uint8_t sink = 0;
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        populateKeyboard(&data, keys);
+        sink = data.keycode[0];
+    }
+    (void)sink;
+}
+
+static void runPopulate6(uint64_t n)
+{
+    runPopulate(&keys6, n);
+}
+
+static void runPopulateChord(uint64_t n)
+{
+    runPopulate(&keysChord, n);
+}
+
+// One keycode change drained from the ring, built into a report, sent and polled by the host
+static void runReportBuild(uint64_t n)
+{
+    struct InputEvent event = {
+        .type = INPUT_EVENT_KEY,
+        .keycode = 0x04,
+    };
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        hostClockAdvance(SCAN_PERIOD_US);
+        captureTransportAdvance(hostUsbCapture(), (uint32_t)hostClockNow());
+        event.pressed = !event.pressed;
+        event.scan_us = (uint32_t)hostClockNow();
+        event.queue_us = event.scan_us;
+        eventRingPushKey(&ring, &event);
+        sendPendingEvents(&comms);
+    }
+}
+
+static void runTyping(uint64_t n)
+{
+    for (uint64_t i = 0; i < n; i++)
+    {
+        typingScript();
+        pipelineTick();
+    }
+}
+
+static void runChordStorm(uint64_t n)
+{
+    for (uint64_t i = 0; i < n; i++)
+    {
+        chordScript();
+        pipelineTick();
+    }
+}
+
+static void reportReports(struct BenchResult *result, uint64_t n, double elapsedNs)
+{
+    const struct CaptureTransport *usb = hostUsbCapture();
+
+    benchMetric(result, "reports_per_op", "reports", (double)usb->stats.keyboardReports / (double)n);
+    benchMetric(result, "ns_per_report", "ns", usb->stats.keyboardReports ? elapsedNs / usb->stats.keyboardReports : 0);
+}
+
+// Per scan and per report, so the numbers do not move with how many scans a repeat ran
+static void reportPipeline(struct BenchResult *result, uint64_t n, double elapsedNs)
+{
+    const struct CaptureTransport *usb = hostUsbCapture();
+    struct ReportStats stats;
+    uint32_t reports = usb->stats.keyboardReports;
+
+    getReportStats(&stats);
+    benchMetric(result, "reports_per_scan", "reports", (double)reports / (double)n);
+    benchMetric(result, "ns_per_report", "ns", reports ? elapsedNs / reports : 0);
+    benchMetric(result, "merged_per_report", "events", reports ? (double)stats.merged / reports : 0);
+    // Simulated time over every frame phase, moves when scheduling or coalescing changes
+    benchMetric(result, "scan_to_host_min_us", "us", reports ? usb->stats.minLatencyUs : 0);
+    benchMetric(result, "scan_to_host_mean_us", "us", reports ? (double)usb->stats.totalLatencyUs / reports : 0);
+    benchMetric(result, "scan_to_host_max_us", "us", usb->stats.maxLatencyUs);
+}
+
+/*
+Keymap resolution on the default keymap, one op is a press and a release. With
+the Fn layer held most keys are transparent there and fall through to the base
+layer.
+*/
+#define KEY_FN KEYMAP_KEY_INDEX(0, 4, 1)
+
+static struct Keymap benchKeymap;
+
+static void setupKeymapBase(void)
+{
+    keymapInit(&benchKeymap, defaultKeymap, defaultKeymapLayers);
+}
+
+static void setupKeymapFn(void)
+{
+    struct KeyOutput out[KEYMAP_MAX_OUTPUT];
+
+    setupKeymapBase();
+    keymapProcess(&benchKeymap, KEY_FN, true, out);
+}
+
+static void runKeymap(uint64_t n)
+{
+    struct KeyOutput out[KEYMAP_MAX_OUTPUT];
+    volatile uint8_t sink = 0;
+    const uint8_t *key = NULL;
+    uint8_t position = 0;
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        key = typingKeys[(i * 7) % TYPING_KEYS];
+        position = KEYMAP_KEY_INDEX(0, key[0], key[1]);
+        keymapProcess(&benchKeymap, position, true, out);
+        sink = out[0].keycode;
+        keymapProcess(&benchKeymap, position, false, out);
+    }
+    (void)sink;
+}
+
+/*
+Keyboard to dongle over the lossy channel, one op is a 50 us step of sender,
+air and receiver. The state changes every 5 ms, latency is from the change to
+the receiver showing it, bucketed by step.
+*/
+#define DONGLE_STEP_US 50
+#define DONGLE_CHANGE_STEPS 100
+#define DONGLE_LATENCY_BUCKETS 1024
+
+static struct DongleChannel dongleChannel;
+static struct DongleRadio dongleRadio;
+static struct DongleSender dongleSender;
+static struct DongleReceiver dongleReceiver;
+static struct KeyboardData dongleData;
+static uint32_t dongleNowUs;
+static uint32_t dongleChangeUs;
+static bool dongleWaiting;
+static uint32_t dongleChanges;
+static uint32_t dongleLatencies[DONGLE_LATENCY_BUCKETS];
+
+static void setupDongle(void)
+{
+    dongleChannelInit(&dongleChannel, &dongleRadio);
+    dongleChannel.delayUs = 400;
+    dongleChannel.jitterUs = 100;
+    dongleChannel.lossPermille = 50;
+    dongleChannel.burstPercent = 20;
+    dongleSenderInit(&dongleSender, &dongleRadio, 7);
+    dongleReceiverInit(&dongleReceiver);
+    memset(&dongleData, 0, sizeof(dongleData));
+    memset(dongleLatencies, 0, sizeof(dongleLatencies));
+    dongleNowUs = 0;
+    dongleWaiting = false;
+    dongleChanges = 0;
+}
+
+static void runDongle(uint64_t n)
+{
+    uint8_t frame[DONGLE_FRAME_MAX];
+    struct DongleReport report;
+    size_t length = 0;
+    uint32_t bucket = 0;
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        if (i % DONGLE_CHANGE_STEPS == 0)
+        {
+            dongleData.bitmap[0] ^= (uint8_t)(1u << (4 + dongleChanges % 4));
+            dongleSenderKeyboard(&dongleSender, &dongleData, dongleNowUs);
+            dongleChangeUs = dongleNowUs;
+            dongleWaiting = true;
+            dongleChanges++;
+        }
+        dongleNowUs += DONGLE_STEP_US;
+        dongleChannel.nowUs = dongleNowUs;
+        dongleSenderPoll(&dongleSender, dongleNowUs);
+        while ((length = dongleChannelReceive(&dongleChannel, frame, sizeof(frame))) > 0)
+        {
+            dongleReceiverPush(&dongleReceiver, frame, length, dongleNowUs, &report);
+        }
+        dongleReceiverPoll(&dongleReceiver, dongleNowUs, &report);
+        if (dongleWaiting && dongleReceiver.bitmap[0] == dongleData.bitmap[0])
+        {
+            bucket = (dongleNowUs - dongleChangeUs) / DONGLE_STEP_US;
+            dongleLatencies[bucket < DONGLE_LATENCY_BUCKETS ? bucket : DONGLE_LATENCY_BUCKETS - 1]++;
+            dongleWaiting = false;
+        }
+    }
+}
+
+static double dongleLatencyPercentile(uint32_t percent)
+{
+    uint32_t seen = 0, total = 0;
+
+    for (uint32_t b = 0; b < DONGLE_LATENCY_BUCKETS; b++)
+    {
+        total += dongleLatencies[b];
+    }
+    for (uint32_t b = 0; b < DONGLE_LATENCY_BUCKETS; b++)
+    {
+        seen += dongleLatencies[b];
+        if (total > 0 && seen * 100ULL >= (uint64_t)total * percent)
+        {
+            return (double)b * DONGLE_STEP_US;
+        }
+    }
+    return 0;
+}
+
+static void reportDongle(struct BenchResult *result, uint64_t n, double elapsedNs)
+{
+    (void)n;
+    (void)elapsedNs;
+    benchMetric(result, "latency_p50_us", "us", dongleLatencyPercentile(50));
+    benchMetric(result, "latency_p99_us", "us", dongleLatencyPercentile(99));
+    benchMetric(result, "air_frames_per_change", "frames", dongleChanges ? (double)dongleChannel.sent / dongleChanges : 0);
+    benchMetric(result, "lost_per_change", "frames", dongleChanges ? (double)dongleChannel.lost / dongleChanges : 0);
+}
+
+static const struct Bench benches[] = {
+    {"scan_keys/idle", setupPipeline, runScanIdle, NULL},
+    {"scan_keys/held_6", setupScanHeld, runScanIdle, NULL},
+    {"populate_keyboard/6kro", setupPopulate, runPopulate6, NULL},
+    {"populate_keyboard/chord_20", setupPopulate, runPopulateChord, NULL},
+    {"report/build_send", setupPipeline, runReportBuild, reportReports},
+    {"pipeline/typing", setupPipeline, runTyping, reportPipeline},
+    {"pipeline/chord_storm", setupPipeline, runChordStorm, reportPipeline},
+    {"keymap/process_base", setupKeymapBase, runKeymap, NULL},
+    {"keymap/process_fn", setupKeymapFn, runKeymap, NULL},
+    {"dongle/lossy_channel", setupDongle, runDongle, reportDongle},
+};
+#define BENCH_COUNT (sizeof(benches) / sizeof(benches[0]))
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [--json FILE|-] [--filter TEXT] [--min-time-ms N] [--list]\n", program);
+}
+
+int main(int argc, char **argv)
+{
+    struct BenchResult results[BENCH_COUNT];
+    const char *jsonPath = NULL;
+    const char *filter = NULL;
+    uint32_t minTimeMs = DEFAULT_MIN_TIME_MS;
+    FILE *json = NULL;
+    FILE *table = stdout;
+    int count = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            jsonPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--min-time-ms") == 0 && i + 1 < argc)
+        {
+            minTimeMs = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--list") == 0)
+        {
+            for (size_t b = 0; b < BENCH_COUNT; b++)
+            {
+                printf("%s\n", benches[b].name);
+            }
+            return 0;
+        }
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    // JSON on stdout keeps the table out of the way
+    if (jsonPath != NULL && strcmp(jsonPath, "-") == 0)
+    {
+        table = stderr;
+    }
+
+    for (size_t b = 0; b < BENCH_COUNT; b++)
+    {
+        if (filter != NULL && strstr(benches[b].name, filter) == NULL)
+        {
+            continue;
+        }
+        benchRun(&benches[b], minTimeMs, &results[count]);
+        count++;
+    }
+    benchPrintTable(table, results, count);
+
+    if (jsonPath == NULL)
+    {
+        return 0;
+    }
+    json = strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w");
+    if (json == NULL)
+    {
+        perror(jsonPath);
+        return 1;
+    }
+    benchWriteJson(json, KVASS_BENCH_VERSION, results, count);
+    if (json != stdout)
+    {
+        fclose(json);
+    }
+    return 0;
+}
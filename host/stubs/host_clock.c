@@ -0,0 +1,46 @@
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "host_sim.h"
+#include "host_stubs.h"
+
+static uint64_t nowUs = 0;
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)nowUs;
+}
+
+uint64_t hostClockNow(void)
+{
+    return nowUs;
+}
+
+void hostClockAdvance(uint32_t us)
+{
+    nowUs += us;
+}
+
+void hostClockReset(void)
+{
+    nowUs = 0;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    default:
+        return "ESP_FAIL";
+    }
+}
@@ -0,0 +1,192 @@
+#include <string.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "config_manager.h"
+#include "kb_interconnect_manager.h"
+#include "led_manager.h"
+#include "display_manager.h"
+#include "telemetry_manager.h"
+#include "dlog_manager.h"
+#include "keymap_store.h"
+#include "transport_usb.h"
+#include "transport_espnow.h"
+#include "espnow_radio.h"
+#include "host_sim.h"
+#include "host_stubs.h"
+
+/*
+Stand-ins for the firmware modules that only make sense next to real
+hardware. The scan to report path calls into them, none of them is measured.
+*/
+
+static struct KbConfig config = {
+    .side = CFG_KB_SIDE_LEFT,
+    .protocol = 0, // USB
+};
+static struct CaptureTransport usb;
+static struct DlogRing dlogRing;
+
+void hostReset(void)
+{
+    hostClockReset();
+    hostMatrixReset();
+    hostTasksReset();
+    captureTransportInit(&usb, USB_HID_POLL_INTERVAL_MS * 1000);
+    dlogRingInit(&dlogRing);
+}
+
+struct CaptureTransport *hostUsbCapture(void)
+{
+    return &usb;
+}
+
+uint32_t hostDlogDrain(void)
+{
+    struct DlogRecord record;
+    uint32_t n = 0;
+
+    while (dlogRead(&dlogRing, &record))
+    {
+        n++;
+    }
+    return n;
+}
+
+// Config, a single left half talking USB
+
+esp_err_t initConfigManager()
+{
+    return ESP_OK;
+}
+
+const struct KbConfig *getConfig(void)
+{
+    return &config;
+}
+
+int8_t getKbSide(void)
+{
+    return config.side;
+}
+
+void setKbSide(int8_t side)
+{
+    config.side = side;
+}
+
+void setDefaultProtocol(uint8_t protocol)
+{
+    config.protocol = protocol;
+}
+
+// Interconnect, no second half plugged in
+
+bool interconnectIsPrimary()
+{
+    return true;
+}
+
+bool interconnectIsConnected()
+{
+    return false;
+}
+
+void interconnectSendMatrix(const matrix_row_t rows[KB_ROWS], uint32_t scanUs)
+{
+    (void)rows;
+    (void)scanUs;
+}
+
+bool interconnectTakeRemoteMatrix(matrix_row_t rows[KB_ROWS], uint32_t *timeUs)
+{
+    (void)rows;
+    (void)timeUs;
+    return false;
+}
+
+// Status output, nothing to light up or draw
+
+void ledKeyPressed(uint8_t key)
+{
+    (void)key;
+}
+
+void getLedStats(struct LedStats *stats, uint32_t *fpsMilli)
+{
+    memset(stats, 0, sizeof(*stats));
+    *fpsMilli = 0;
+}
+
+void getDisplayStats(struct DisplayStats *stats, uint32_t *fpsMilli)
+{
+    memset(stats, 0, sizeof(*stats));
+    *fpsMilli = 0;
+}
+
+void telemetrySendSnapshot(void)
+{
+}
+
+// One ring for the one task, records are dropped by hostDlogDrain instead of printed
+void dlogRecord(enum DlogId id, const uint32_t args[DLOG_MAX_ARGS])
+{
+    dlogWrite(&dlogRing, (uint16_t)id, (uint32_t)esp_timer_get_time(), args);
+}
+
+void getDlogStats(struct DlogStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->written = dlogRing.written;
+    stats->dropped = dlogRing.dropped;
+    stats->rings = 1;
+}
+
+// Keymap partition, the built in keymap stays
+
+esp_err_t keymapStoreInit(void)
+{
+    return ESP_OK;
+}
+
+bool keymapStoreTake(const keyaction_t (**actions)[KEYMAP_KEYS], uint8_t *layers)
+{
+    (void)actions;
+    (void)layers;
+    return false;
+}
+
+esp_err_t keymapUploadApply(void)
+{
+    return ESP_ERR_INVALID_STATE;
+}
+
+void getKeymapStoreStats(struct KeymapStoreStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->activeSlot = -1;
+}
+
+// Transports, USB is the capture backend polled at the real interval
+
+esp_err_t usbInstall()
+{
+    return ESP_OK;
+}
+
+const struct Transport *getUsbTransport()
+{
+    return &usb.transport;
+}
+
+// No radio either, ESP-NOW reports land in the same capture
+const struct Transport *getEspnowTransport()
+{
+    return &usb.transport;
+}
+
+esp_err_t espnowRadioPrepare()
+{
+    return ESP_OK;
+}
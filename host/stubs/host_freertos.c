@@ -0,0 +1,147 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "host_sim.h"
+#include "host_stubs.h"
+
+struct HostTask
+{
+    const char *name;
+    uint32_t notifyValue;
+    bool notified;
+};
+
+struct HostSemaphore
+{
+    int taken;
+};
+
+static struct HostTask harness = {"host", 0, false};
+static struct HostSemaphore mutexes[4];
+static int mutexCount = 0;
+static uint32_t notifications = 0;
+static void (*yieldFn)(void *ctx) = NULL;
+static void *yieldCtx = NULL;
+
+void hostTasksReset(void)
+{
+    mutexCount = 0;
+    notifications = 0;
+    harness.notifyValue = 0;
+    harness.notified = false;
+    yieldFn = NULL;
+    yieldCtx = NULL;
+}
+
+void hostSetYield(void (*yield)(void *ctx), void *ctx)
+{
+    yieldFn = yield;
+    yieldCtx = ctx;
+}
+
+uint32_t hostNotifications(void)
+{
+    return notifications;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return &harness;
+}
+
+// Other tasks are only counted, the harness keeps its bits for xTaskNotifyWait
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    notifications++;
+    if (task != &harness)
+    {
+        return pdPASS;
+    }
+    if (action == eSetBits)
+    {
+        harness.notifyValue |= value;
+    }
+    harness.notified = true;
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken)
+{
+    *woken = pdFALSE;
+    return xTaskNotify(task, value, action);
+}
+
+/*
+The task being waited for runs in the yield hook. If it sent nothing the wait
+times out, simulated time moves on and it gets one more turn. Waits without a
+timeout would never end here.
+*/
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value, TickType_t wait)
+{
+    configASSERT(wait != portMAX_DELAY);
+
+    harness.notifyValue &= ~clearOnEntry;
+    if (!harness.notified && wait > 0 && yieldFn != NULL)
+    {
+        yieldFn(yieldCtx);
+        if (!harness.notified)
+        {
+            vTaskDelay(wait);
+        }
+    }
+
+    *value = harness.notifyValue;
+    if (!harness.notified)
+    {
+        return pdFALSE;
+    }
+    harness.notified = false;
+    harness.notifyValue &= ~clearOnExit;
+    return pdTRUE;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    hostClockAdvance(ticks * (1000000 / configTICK_RATE_HZ));
+    if (yieldFn != NULL)
+    {
+        yieldFn(yieldCtx);
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(hostClockNow() / (1000000 / configTICK_RATE_HZ));
+}
+
+const char *pcTaskGetName(TaskHandle_t task)
+{
+    return task != NULL ? task->name : harness.name;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    if (mutexCount >= (int)(sizeof(mutexes) / sizeof(mutexes[0])))
+    {
+        return NULL;
+    }
+    mutexes[mutexCount].taken = 0;
+    return &mutexes[mutexCount++];
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait)
+{
+    (void)wait;
+    configASSERT(semaphore->taken == 0);
+    semaphore->taken = 1;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    semaphore->taken = 0;
+    return pdTRUE;
+}
@@ -0,0 +1,215 @@
+#include <string.h>
+#include "driver/gpio.h"
+#include "driver/dedic_gpio.h"
+#include "driver/gptimer.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_oneshot.h"
+
+#include "host_sim.h"
+#include "host_stubs.h"
+
+// Column bundle drives, row bundle reads, in the order initMatrixIo creates them
+struct HostBundle
+{
+    bool output;
+    uint32_t value;
+};
+
+static struct HostBundle bundles[2];
+static int bundleCount = 0;
+static uint32_t selectedCols = 0;
+static matrix_row_t switches[KB_ROWS] = {0};
+
+void hostMatrixReset(void)
+{
+    bundleCount = 0;
+    selectedCols = 0;
+    memset(switches, 0, sizeof(switches));
+}
+
+void hostMatrixSet(const matrix_row_t rows[KB_ROWS])
+{
+    memcpy(switches, rows, sizeof(switches));
+}
+
+void hostMatrixKey(uint8_t row, uint8_t col, bool pressed)
+{
+    if (pressed)
+    {
+        switches[row] |= (matrix_row_t)(1u << col);
+    }
+    else
+    {
+        switches[row] &= (matrix_row_t)~(1u << col);
+    }
+}
+
+esp_err_t dedic_gpio_new_bundle(const dedic_gpio_bundle_config_t *config, dedic_gpio_bundle_handle_t *bundle)
+{
+    if (bundleCount >= 2)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    bundles[bundleCount].output = config->flags.out_en;
+    bundles[bundleCount].value = 0;
+    *bundle = &bundles[bundleCount++];
+    return ESP_OK;
+}
+
+void dedic_gpio_bundle_write(dedic_gpio_bundle_handle_t bundle, uint32_t mask, uint32_t value)
+{
+    bundle->value = (bundle->value & ~mask) | (value & mask);
+    if (bundle->output)
+    {
+        selectedCols = bundle->value;
+    }
+}
+
+// A row reads high when a closed switch connects it to any driven column
+uint32_t dedic_gpio_bundle_read_in(dedic_gpio_bundle_handle_t bundle)
+{
+    uint32_t rows = 0;
+
+    (void)bundle;
+    for (int j = 0; j < KB_ROWS; j++)
+    {
+        if (switches[j] & selectedCols)
+        {
+            rows |= 1u << j;
+        }
+    }
+    return rows;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags)
+{
+    (void)flags;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t handler, void *arg)
+{
+    (void)gpio;
+    (void)handler;
+    (void)arg;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio)
+{
+    (void)gpio;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio)
+{
+    (void)gpio;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_new_timer(const gptimer_config_t *config, gptimer_handle_t *timer)
+{
+    (void)config;
+    *timer = NULL;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_register_event_callbacks(gptimer_handle_t timer, const gptimer_event_callbacks_t *callbacks, void *user_data)
+{
+    (void)timer;
+    (void)callbacks;
+    (void)user_data;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_enable(gptimer_handle_t timer)
+{
+    (void)timer;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_start(gptimer_handle_t timer)
+{
+    (void)timer;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_stop(gptimer_handle_t timer)
+{
+    (void)timer;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_set_alarm_action(gptimer_handle_t timer, const gptimer_alarm_config_t *config)
+{
+    (void)timer;
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_new_handle(const adc_continuous_handle_cfg_t *config, adc_continuous_handle_t *handle)
+{
+    (void)config;
+    *handle = NULL;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_config(adc_continuous_handle_t handle, const adc_continuous_config_t *config)
+{
+    (void)handle;
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_register_event_callbacks(adc_continuous_handle_t handle, const adc_continuous_evt_cbs_t *callbacks, void *user_data)
+{
+    (void)handle;
+    (void)callbacks;
+    (void)user_data;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_start(adc_continuous_handle_t handle)
+{
+    (void)handle;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_read(adc_continuous_handle_t handle, uint8_t *buf, uint32_t length_max, uint32_t *out_length, uint32_t timeout_ms)
+{
+    (void)handle;
+    (void)buf;
+    (void)length_max;
+    (void)timeout_ms;
+    *out_length = 0;
+    return ESP_ERR_TIMEOUT;
+}
+
+esp_err_t adc_oneshot_new_unit(const adc_oneshot_unit_init_cfg_t *config, adc_oneshot_unit_handle_t *unit)
+{
+    (void)config;
+    *unit = NULL;
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_config_channel(adc_oneshot_unit_handle_t unit, adc_channel_t channel, const adc_oneshot_chan_cfg_t *config)
+{
+    (void)unit;
+    (void)channel;
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_read(adc_oneshot_unit_handle_t unit, adc_channel_t channel, int *raw)
+{
+    (void)unit;
+    (void)channel;
+    *raw = 0;
+    return ESP_ERR_TIMEOUT;
+}
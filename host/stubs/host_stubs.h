@@ -0,0 +1,6 @@
+#pragma once
+
+// Reset hooks of the individual stand-ins, hostReset calls them all
+void hostClockReset(void);
+void hostMatrixReset(void);
+void hostTasksReset(void);
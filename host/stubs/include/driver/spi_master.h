@@ -0,0 +1,8 @@
+#pragma once
+
+typedef enum
+{
+    SPI1_HOST,
+    SPI2_HOST,
+    SPI3_HOST,
+} spi_host_device_t;
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef enum
+{
+    ADC_UNIT_1,
+    ADC_UNIT_2,
+} adc_unit_t;
+
+typedef enum
+{
+    ADC_CHANNEL_0, ADC_CHANNEL_1, ADC_CHANNEL_2, ADC_CHANNEL_3, ADC_CHANNEL_4,
+    ADC_CHANNEL_5, ADC_CHANNEL_6, ADC_CHANNEL_7, ADC_CHANNEL_8, ADC_CHANNEL_9,
+} adc_channel_t;
+
+typedef enum
+{
+    ADC_ATTEN_DB_0,
+    ADC_ATTEN_DB_2_5,
+    ADC_ATTEN_DB_6,
+    ADC_ATTEN_DB_12,
+} adc_atten_t;
+
+typedef enum
+{
+    ADC_BITWIDTH_DEFAULT = 0,
+    ADC_BITWIDTH_12 = 12,
+} adc_bitwidth_t;
+
+typedef struct HostAdcUnit *adc_oneshot_unit_handle_t;
+
+typedef struct
+{
+    adc_unit_t unit_id;
+} adc_oneshot_unit_init_cfg_t;
+
+typedef struct
+{
+    adc_atten_t atten;
+    adc_bitwidth_t bitwidth;
+} adc_oneshot_chan_cfg_t;
+
+esp_err_t adc_oneshot_new_unit(const adc_oneshot_unit_init_cfg_t *config, adc_oneshot_unit_handle_t *unit);
+esp_err_t adc_oneshot_config_channel(adc_oneshot_unit_handle_t unit, adc_channel_t channel, const adc_oneshot_chan_cfg_t *config);
+esp_err_t adc_oneshot_read(adc_oneshot_unit_handle_t unit, adc_channel_t channel, int *raw);
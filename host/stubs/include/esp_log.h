@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "esp_err.h"
+
+// Errors and warnings reach stderr, the rest would only add noise to benchmark output
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+// Never printed, still type checked against the format like on the board
+#define ESP_LOG_SILENT(tag, format, ...)              \
+    do                                                \
+    {                                                 \
+        if (0)                                        \
+        {                                             \
+            printf("%s" format, tag, ##__VA_ARGS__);  \
+        }                                             \
+    } while (0)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_SILENT(tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_SILENT(tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_SILENT(tag, format, ##__VA_ARGS__)
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+// Matrix settle delays cost nothing on the host, the simulated matrix has no capacitance
+static inline void esp_rom_delay_us(uint32_t us)
+{
+    (void)us;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// Simulated microsecond clock, it only moves when the host harness advances it
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp_attr.h"
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+// Stays on in release builds, a failed assert on the board would stop it too
+#define configASSERT(x)                                                          \
+    do                                                                           \
+    {                                                                            \
+        if (!(x))                                                                \
+        {                                                                        \
+            fprintf(stderr, "%s:%d assert failed: %s\n", __FILE__, __LINE__, #x); \
+            abort();                                                             \
+        }                                                                        \
+    } while (0)
+#define portYIELD_FROM_ISR(x) ((void)(x))
+
+static inline BaseType_t xPortInIsrContext(void)
+{
+    return pdFALSE;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct HostSemaphore *SemaphoreHandle_t;
+
+// Uncontended on the host, the cost left is the call itself
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct HostTask *TaskHandle_t;
+
+typedef enum
+{
+    eNoAction,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+    eSetValueWithoutOverwrite,
+} eNotifyAction;
+
+/*
+One simulated task, the harness. Notifications to other tasks are only
+counted, whoever would have woken up is called by the harness itself.
+vTaskDelay and xTaskNotifyWait call the yield hook, a producer waiting for
+ring space gets the consumer run that way.
+*/
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken);
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value, TickType_t wait);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+const char *pcTaskGetName(TaskHandle_t task);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "matrix_scanner.h"
+#include "transport_capture.h"
+
+/*
+Controls for the simulated board the firmware runs on in host builds. Nothing
+moves by itself: the clock, the switch matrix and the emulated USB host only
+change when the harness says so.
+*/
+
+// Puts every stand-in back to power-on state, USB polls every USB_HID_POLL_INTERVAL_MS
+void hostReset(void);
+
+uint64_t hostClockNow(void);
+void hostClockAdvance(uint32_t us);
+
+// rows[j] bit i is the switch at row j, column i of the local half
+void hostMatrixSet(const matrix_row_t rows[KB_ROWS]);
+void hostMatrixKey(uint8_t row, uint8_t col, bool pressed);
+
+// Called from vTaskDelay, where the firmware waits for another task to make progress
+void hostSetYield(void (*yield)(void *ctx), void *ctx);
+uint32_t hostNotifications(void);
+
+// Emulated host behind getUsbTransport()
+struct CaptureTransport *hostUsbCapture(void);
+
+// Records DLOG() left for the deferred log task, drained without formatting
+uint32_t hostDlogDrain(void);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+Minimal checks for the host tests, one executable per firmware module. A
+failed check prints where and keeps going, main returns testResult() so ctest
+sees the failure.
+*/
+
+static int testFailures = 0;
+static const char *testCurrent = "";
+
+#define CHECK(cond)                                                                        \
+    do                                                                                     \
+    {                                                                                      \
+        if (!(cond))                                                                       \
+        {                                                                                  \
+            fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, testCurrent, #cond); \
+            testFailures++;                                                                \
+        }                                                                                  \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                         \
+    do                                                                                     \
+    {                                                                                      \
+        long long actual_ = (long long)(actual);                                           \
+        long long expected_ = (long long)(expected);                                       \
+        if (actual_ != expected_)                                                          \
+        {                                                                                  \
+            fprintf(stderr, "%s:%d: %s: %s is %lld, expected %lld\n", __FILE__, __LINE__, testCurrent, #actual, \
+                    actual_, expected_);                                                   \
+            testFailures++;                                                                \
+        }                                                                                  \
+    } while (0)
+
+#define RUN_TEST(fn)       \
+    do                     \
+    {                      \
+        testCurrent = #fn; \
+        fn();              \
+    } while (0)
+
+static inline int testResult(void)
+{
+    if (testFailures)
+    {
+        fprintf(stderr, "%d check(s) failed\n", testFailures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,341 @@
+#include <string.h>
+
+#include "action_engine.h"
+#include "test.h"
+
+#define KEY_A 0x04
+#define KEY_B 0x05
+#define KEY_C 0x06
+#define KEY_D 0x07
+#define KEY_E 0x08
+#define KEY_F 0x09
+#define KEY_1 0x1E
+#define KEY_LEFT_CTRL 0xE0
+#define KEY_LEFT_SHIFT 0xE1
+
+#define MS 1000
+#define TAPPING_TERM_US (200 * MS)
+#define COMBO_TERM_US (30 * MS)
+#define ONESHOT_TIMEOUT_US (1000 * MS)
+
+enum
+{
+    POS_MT,
+    POS_LT,
+    POS_C,
+    POS_D,
+    POS_OSM,
+    POS_COMBO_A,
+    POS_COMBO_B,
+    POS_FREE,
+};
+
+static const keyaction_t testKeymap[2][KEYMAP_KEYS] = {
+    {
+        [POS_MT] = MT(MOD_CTRL, KEY_A),
+        [POS_LT] = LT(1, KEY_B),
+        [POS_C] = KC(KEY_C),
+        [POS_D] = KC(KEY_D),
+        [POS_OSM] = OSM(MOD_SHIFT),
+        [POS_COMBO_A] = KC(KEY_F),
+        [POS_COMBO_B] = KC(KEY_D),
+    },
+    {
+        [POS_C] = KC(KEY_1),
+    },
+};
+
+// Example combo, both keys within the combo term give E
+static const struct Combo testCombos[] = {
+    {{POS_COMBO_A, POS_COMBO_B}, KC(KEY_E)},
+};
+
+struct Emitted
+{
+    uint8_t keycode;
+    bool pressed;
+    uint32_t atUs;
+};
+
+static struct Keymap keymap;
+static struct ActionEngine engine;
+static struct ActionConfig config;
+static struct Emitted emitted[64];
+static uint32_t emittedCount;
+static uint32_t nowUs;
+
+static void record(void *ctx, const struct InputEvent *event)
+{
+    (void)ctx;
+    if (emittedCount < sizeof(emitted) / sizeof(emitted[0]))
+    {
+        emitted[emittedCount].keycode = event->keycode;
+        emitted[emittedCount].pressed = event->pressed;
+        emitted[emittedCount].atUs = nowUs;
+    }
+    emittedCount++;
+}
+
+static void setupWith(bool holdOnOtherPress, bool permissiveHold, uint32_t maxDelayUs)
+{
+    config.tappingTermUs = TAPPING_TERM_US;
+    config.comboTermUs = COMBO_TERM_US;
+    config.oneshotTimeoutUs = ONESHOT_TIMEOUT_US;
+    config.maxDelayUs = maxDelayUs;
+    config.holdOnOtherPress = holdOnOtherPress;
+    config.permissiveHold = permissiveHold;
+    keymapInit(&keymap, testKeymap, 2);
+    actionEngineInit(&engine, &keymap, &config, testCombos, 1, record, NULL);
+    memset(emitted, 0, sizeof(emitted));
+    emittedCount = 0;
+    nowUs = 0;
+}
+
+static void setup(void)
+{
+    setupWith(false, true, 1000 * MS);
+}
+
+// Ticks every millisecond like the matrix scan, then the key changes
+static void keyAt(uint32_t atUs, uint8_t position, bool pressed)
+{
+    struct InputEvent event = {
+        .type = INPUT_EVENT_KEY,
+        .position = position,
+        .pressed = pressed,
+    };
+
+    while (nowUs + MS <= atUs)
+    {
+        nowUs += MS;
+        actionEngineTick(&engine, nowUs);
+    }
+    nowUs = atUs;
+    event.scan_us = atUs;
+    actionEngineProcess(&engine, &event, atUs);
+}
+
+static void tickUntil(uint32_t atUs)
+{
+    while (nowUs < atUs)
+    {
+        nowUs += MS;
+        actionEngineTick(&engine, nowUs);
+    }
+}
+
+static void checkEmitted(uint32_t index, uint8_t keycode, bool pressed, uint32_t atUs)
+{
+    CHECK_EQ(emitted[index].keycode, keycode);
+    CHECK_EQ(emitted[index].pressed, pressed);
+    CHECK_EQ(emitted[index].atUs, atUs);
+}
+
+static void testTapGoesOutOnRelease(void)
+{
+    setup();
+    keyAt(0, POS_MT, true);
+    CHECK_EQ(emittedCount, 0);
+    CHECK(actionEnginePending(&engine));
+
+    // Not on the next tick, at the release that decides it
+    keyAt(50 * MS + 300, POS_MT, false);
+    CHECK_EQ(emittedCount, 2);
+    checkEmitted(0, KEY_A, true, 50 * MS + 300);
+    checkEmitted(1, KEY_A, false, 50 * MS + 300);
+    CHECK_EQ(engine.stats.taps, 1);
+    CHECK_EQ(engine.stats.maxDelayUs, 50 * MS + 300);
+    CHECK(!actionEnginePending(&engine));
+}
+
+static void testHoldAfterTappingTerm(void)
+{
+    setup();
+    keyAt(0, POS_MT, true);
+    tickUntil(TAPPING_TERM_US - MS);
+    CHECK_EQ(emittedCount, 0);
+    tickUntil(TAPPING_TERM_US);
+    CHECK_EQ(emittedCount, 1);
+    checkEmitted(0, KEY_LEFT_CTRL, true, TAPPING_TERM_US);
+
+    keyAt(300 * MS, POS_MT, false);
+    checkEmitted(1, KEY_LEFT_CTRL, false, 300 * MS);
+    CHECK_EQ(engine.stats.holds, 1);
+    CHECK_EQ(engine.stats.forced, 0);
+}
+
+static void testPermissiveHold(void)
+{
+    setup();
+    keyAt(0, POS_MT, true);
+    keyAt(10 * MS, POS_C, true);
+    CHECK_EQ(emittedCount, 0);
+
+    // Another key tapped inside the held one makes it a modifier right away
+    keyAt(20 * MS, POS_C, false);
+    CHECK_EQ(emittedCount, 3);
+    checkEmitted(0, KEY_LEFT_CTRL, true, 20 * MS);
+    checkEmitted(1, KEY_C, true, 20 * MS);
+    checkEmitted(2, KEY_C, false, 20 * MS);
+
+    keyAt(30 * MS, POS_MT, false);
+    checkEmitted(3, KEY_LEFT_CTRL, false, 30 * MS);
+}
+
+static void testRollingTapsKeepOrder(void)
+{
+    setup();
+    keyAt(0, POS_MT, true);
+    keyAt(10 * MS, POS_C, true);
+    keyAt(20 * MS, POS_MT, false);
+    keyAt(30 * MS, POS_C, false);
+
+    CHECK_EQ(emittedCount, 4);
+    checkEmitted(0, KEY_A, true, 20 * MS);
+    checkEmitted(1, KEY_C, true, 20 * MS);
+    checkEmitted(2, KEY_A, false, 20 * MS);
+    checkEmitted(3, KEY_C, false, 30 * MS);
+}
+
+static void testHoldOnOtherPress(void)
+{
+    setupWith(true, false, 1000 * MS);
+    keyAt(0, POS_MT, true);
+    keyAt(10 * MS, POS_C, true);
+    CHECK_EQ(emittedCount, 2);
+    checkEmitted(0, KEY_LEFT_CTRL, true, 10 * MS);
+    checkEmitted(1, KEY_C, true, 10 * MS);
+}
+
+static void testLatencyBoundForcesHold(void)
+{
+    setupWith(false, true, 50 * MS);
+    keyAt(0, POS_MT, true);
+    keyAt(10 * MS, POS_C, true);
+    tickUntil(50 * MS);
+    CHECK_EQ(emittedCount, 2);
+    checkEmitted(0, KEY_LEFT_CTRL, true, 50 * MS);
+    checkEmitted(1, KEY_C, true, 50 * MS);
+    CHECK_EQ(engine.stats.forced, 1);
+    CHECK_EQ(engine.stats.maxDelayUs, 50 * MS);
+}
+
+static void testLayerTapHoldsLayer(void)
+{
+    setup();
+    keyAt(0, POS_LT, true);
+    keyAt(10 * MS, POS_C, true);
+    keyAt(20 * MS, POS_C, false);
+    CHECK_EQ(emittedCount, 2);
+    checkEmitted(0, KEY_1, true, 20 * MS);
+    checkEmitted(1, KEY_1, false, 20 * MS);
+
+    keyAt(30 * MS, POS_LT, false);
+    CHECK_EQ(emittedCount, 2);
+    CHECK_EQ(keymapActiveLayers(&keymap), 0x1);
+}
+
+static void testComboFires(void)
+{
+    setup();
+    keyAt(0, POS_COMBO_A, true);
+    keyAt(10 * MS, POS_COMBO_B, true);
+    CHECK_EQ(emittedCount, 1);
+    checkEmitted(0, KEY_E, true, 10 * MS);
+
+    // First key up ends the combo, the second is swallowed
+    keyAt(40 * MS, POS_COMBO_B, false);
+    checkEmitted(1, KEY_E, false, 40 * MS);
+    keyAt(50 * MS, POS_COMBO_A, false);
+    CHECK_EQ(emittedCount, 2);
+    CHECK_EQ(engine.stats.combos, 1);
+}
+
+static void testComboTimesOut(void)
+{
+    setup();
+    keyAt(0, POS_COMBO_A, true);
+    tickUntil(COMBO_TERM_US);
+    CHECK_EQ(emittedCount, 1);
+    checkEmitted(0, KEY_F, true, COMBO_TERM_US);
+
+    // Too late to pair, and it waits for a partner of its own
+    keyAt(40 * MS, POS_COMBO_B, true);
+    CHECK_EQ(emittedCount, 1);
+    tickUntil(40 * MS + COMBO_TERM_US);
+    CHECK_EQ(emittedCount, 2);
+    checkEmitted(1, KEY_D, true, 40 * MS + COMBO_TERM_US);
+    CHECK_EQ(engine.stats.combos, 0);
+}
+
+static void testComboBrokenByOtherKey(void)
+{
+    setup();
+    keyAt(0, POS_COMBO_A, true);
+    keyAt(5 * MS, POS_C, true);
+    CHECK_EQ(emittedCount, 2);
+    checkEmitted(0, KEY_F, true, 5 * MS);
+    checkEmitted(1, KEY_C, true, 5 * MS);
+}
+
+static void testOneshotAppliesToNextKey(void)
+{
+    setup();
+    keyAt(0, POS_OSM, true);
+    keyAt(20 * MS, POS_OSM, false);
+    CHECK_EQ(emittedCount, 1);
+    checkEmitted(0, KEY_LEFT_SHIFT, true, 0);
+    CHECK(actionEnginePending(&engine));
+
+    keyAt(300 * MS, POS_C, true);
+    CHECK_EQ(emittedCount, 3);
+    checkEmitted(1, KEY_C, true, 300 * MS);
+    checkEmitted(2, KEY_LEFT_SHIFT, false, 300 * MS);
+    CHECK_EQ(engine.stats.oneshots, 1);
+}
+
+static void testOneshotTimesOut(void)
+{
+    setup();
+    keyAt(0, POS_OSM, true);
+    keyAt(20 * MS, POS_OSM, false);
+    tickUntil(20 * MS + ONESHOT_TIMEOUT_US);
+    CHECK_EQ(emittedCount, 2);
+    checkEmitted(1, KEY_LEFT_SHIFT, false, 20 * MS + ONESHOT_TIMEOUT_US);
+    CHECK(!actionEnginePending(&engine));
+}
+
+static void testFullQueueForcesDecision(void)
+{
+    setup();
+    keyAt(0, POS_MT, true);
+    // Presses only, none of them settles the pending key
+    for (uint32_t i = 0; i < ACTION_QUEUE_SIZE - 1; i++)
+    {
+        keyAt((i + 1) * 100, POS_FREE + i, true);
+    }
+    CHECK_EQ(emittedCount, 0);
+    keyAt(ACTION_QUEUE_SIZE * 100, POS_D, true);
+    CHECK_EQ(engine.stats.forced, 1);
+    CHECK_EQ(emittedCount, 2);
+    checkEmitted(0, KEY_LEFT_CTRL, true, ACTION_QUEUE_SIZE * 100);
+    checkEmitted(1, KEY_D, true, ACTION_QUEUE_SIZE * 100);
+}
+
+int main(void)
+{
+    RUN_TEST(testTapGoesOutOnRelease);
+    RUN_TEST(testHoldAfterTappingTerm);
+    RUN_TEST(testPermissiveHold);
+    RUN_TEST(testRollingTapsKeepOrder);
+    RUN_TEST(testHoldOnOtherPress);
+    RUN_TEST(testLatencyBoundForcesHold);
+    RUN_TEST(testLayerTapHoldsLayer);
+    RUN_TEST(testComboFires);
+    RUN_TEST(testComboTimesOut);
+    RUN_TEST(testComboBrokenByOtherKey);
+    RUN_TEST(testOneshotAppliesToNextKey);
+    RUN_TEST(testOneshotTimesOut);
+    RUN_TEST(testFullQueueForcesDecision);
+    return testResult();
+}
@@ -0,0 +1,212 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "kb_interconnect_manager.h"
+#include "event_merge.h"
+#include "split_link.h"
+#include "test.h"
+
+#define TICK_US 100
+#define REMOTE_OFFSET_US 123456
+#define REMOTE_PPM 50
+
+static int32_t absolute(int32_t value)
+{
+    return value < 0 ? -value : value;
+}
+
+// Secondary clock in terms of the primary one, started elsewhere and running fast
+static uint32_t remoteClock(uint32_t localUs)
+{
+    return REMOTE_OFFSET_US + localUs + (uint32_t)((uint64_t)localUs * REMOTE_PPM / 1000000);
+}
+
+static void testSymmetricDelayCancels(void)
+{
+    struct ClockSync clock;
+    uint32_t t1 = 1000;
+
+    clockSyncInit(&clock);
+    // 800 us each way, 30 us spent on the remote side
+    for (int i = 0; i < 10; i++)
+    {
+        CHECK(clockSyncSample(&clock, t1, t1 + 800 + 5000, t1 + 830 + 5000, t1 + 1630));
+        t1 += 100000;
+    }
+    CHECK_EQ(clockSyncOffsetAt(&clock, t1), 5000);
+    CHECK_EQ(clock.minRttUs, 1600);
+    CHECK_EQ(clock.maxSkewUs, 0);
+}
+
+static void testDriftIsTracked(void)
+{
+    struct ClockSync clock;
+    uint32_t t1 = 0;
+
+    clockSyncInit(&clock);
+    for (int i = 0; i < 300; i++)
+    {
+        t1 = i * 100000u;
+        clockSyncSample(&clock, t1, remoteClock(t1 + 400), remoteClock(t1 + 420), t1 + 820);
+    }
+    // A second after the last sample the estimate still follows the faster clock
+    t1 += 1000000;
+    CHECK(absolute(clockSyncOffsetAt(&clock, t1) - (int32_t)(remoteClock(t1) - t1)) <= 5);
+    CHECK(absolute(clock.drift / 256 - REMOTE_PPM) <= 5);
+}
+
+static void testCongestedRoundTripsRejected(void)
+{
+    struct ClockSync clock;
+    uint32_t t1 = 0;
+
+    clockSyncInit(&clock);
+    for (int i = 0; i < 5; i++)
+    {
+        t1 = i * 100000u;
+        CHECK(clockSyncSample(&clock, t1, t1 + 5300, t1 + 5310, t1 + 610));
+    }
+    // Held up 3 ms on the way back only, trusting it would move the offset by 1.5 ms
+    t1 += 100000;
+    CHECK(!clockSyncSample(&clock, t1, t1 + 5300, t1 + 5310, t1 + 3610));
+    CHECK_EQ(clock.rejected, 1);
+    CHECK_EQ(clockSyncOffsetAt(&clock, t1), 5000);
+
+    // A path that stays slow is accepted after a few in a row
+    for (int i = 2; i < CLOCK_SYNC_MAX_REJECTS; i++)
+    {
+        CHECK(!clockSyncSample(&clock, t1, t1 + 6800, t1 + 6810, t1 + 3610));
+    }
+    CHECK(clockSyncSample(&clock, t1, t1 + 6800, t1 + 6810, t1 + 3610));
+}
+
+/*
+Both halves over the loopback with a slow link. A remote key scanned shortly
+before a local one must come out of the merge first, however long the remote
+state took to arrive.
+*/
+struct Simulation
+{
+    struct SplitLoopback loop;
+    struct SplitTransport secondaryTransport;
+    struct SplitTransport primaryTransport;
+    struct SplitLink secondary;
+    struct SplitLink primary;
+    struct EventMerge merge;
+    uint32_t nowUs;
+    int32_t maxErrorUs;
+    uint32_t scannedUs;
+};
+
+static struct Simulation sim;
+
+static void remoteState(void *ctx, const matrix_row_t rows[KB_ROWS], uint32_t timeUs)
+{
+    struct Simulation *s = (struct Simulation *)ctx;
+    struct InputEvent event = {
+        .type = INPUT_EVENT_KEY,
+        .keycode = 0xE1,
+        .pressed = rows[0] & 1,
+    };
+    int32_t error = absolute((int32_t)(timeUs - s->scannedUs));
+
+    s->maxErrorUs = error > s->maxErrorUs ? error : s->maxErrorUs;
+    eventMergeAdd(&s->merge, &event, timeUs);
+}
+
+static void simulate(uint32_t us)
+{
+    for (uint32_t end = sim.nowUs + us; sim.nowUs != end;)
+    {
+        sim.nowUs += TICK_US;
+        sim.loop.nowUs = sim.nowUs;
+        splitLinkPoll(&sim.secondary, remoteClock(sim.nowUs));
+        splitLinkPoll(&sim.primary, sim.nowUs);
+    }
+}
+
+static void setupSimulation(uint32_t delayUs, uint32_t jitterUs)
+{
+    memset(&sim, 0, sizeof(sim));
+    splitLoopbackInit(&sim.loop, &sim.secondaryTransport, &sim.primaryTransport);
+    sim.loop.delayUs = delayUs;
+    sim.loop.jitterUs = jitterUs;
+    splitLinkInit(&sim.secondary, SPLIT_ROLE_SECONDARY, &sim.secondaryTransport, 1);
+    splitLinkInit(&sim.primary, SPLIT_ROLE_PRIMARY, &sim.primaryTransport, 2);
+    splitLinkSetRemoteHandler(&sim.primary, remoteState, &sim);
+    eventMergeInit(&sim.merge, INTERCONNECT_MERGE_WINDOW_US);
+    // Enough pings to settle offset and drift
+    simulate(5000000);
+    sim.maxErrorUs = 0;
+}
+
+static void runChord(uint32_t leadUs)
+{
+    matrix_row_t rows[KB_ROWS] = {0};
+    struct InputEvent local = {
+        .type = INPUT_EVENT_KEY,
+        .keycode = 0x04,
+        .pressed = true,
+    };
+    struct InputEvent event;
+    uint8_t order[2] = {0};
+    int popped = 0;
+
+    // Shift on the secondary, the letter on the primary leadUs later
+    rows[0] = 1;
+    sim.scannedUs = sim.nowUs;
+    splitLinkSendState(&sim.secondary, rows, remoteClock(sim.nowUs));
+    simulate(leadUs);
+    CHECK(eventMergeAdd(&sim.merge, &local, sim.nowUs));
+
+    while (popped < 2 && sim.nowUs < sim.scannedUs + 20000)
+    {
+        simulate(TICK_US);
+        while (popped < 2 && eventMergePop(&sim.merge, sim.nowUs, &event))
+        {
+            order[popped++] = event.keycode;
+        }
+    }
+    CHECK_EQ(popped, 2);
+    CHECK_EQ(order[0], 0xE1);
+    CHECK_EQ(order[1], 0x04);
+
+    rows[0] = 0;
+    sim.scannedUs = sim.nowUs;
+    splitLinkSendState(&sim.secondary, rows, remoteClock(sim.nowUs));
+    simulate(10000);
+    while (eventMergePop(&sim.merge, sim.nowUs, &event))
+    {
+    }
+}
+
+static void testRemoteTimesMatchScanTime(void)
+{
+    const uint32_t delays[] = {100, 600, 1500};
+
+    for (size_t i = 0; i < sizeof(delays) / sizeof(delays[0]); i++)
+    {
+        setupSimulation(delays[i], 200);
+        CHECK(sim.primary.clock.synced);
+        CHECK(sim.primary.clock.samples > 10);
+
+        for (int chord = 0; chord < 20; chord++)
+        {
+            runChord(300);
+            simulate(37000);
+        }
+        // Poll ticks and jitter are all that is left, not the link delay
+        CHECK(sim.maxErrorUs <= TICK_US);
+        CHECK_EQ(sim.merge.late, 0);
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(testSymmetricDelayCancels);
+    RUN_TEST(testDriftIsTracked);
+    RUN_TEST(testCongestedRoundTripsRejected);
+    RUN_TEST(testRemoteTimesMatchScanTime);
+    return testResult();
+}
@@ -0,0 +1,118 @@
+#include <string.h>
+
+#include "common_utils.h"
+#include "test.h"
+
+#define KEY_A 0x04
+#define KEY_LEFT_CTRL 0xE0
+#define KEY_LEFT_SHIFT 0xE1
+
+static void testAddRemoveContains(void)
+{
+    KeySet set;
+
+    keySetClear(&set);
+    CHECK(keySetAdd(KEY_A, &set));
+    CHECK(!keySetAdd(KEY_A, &set));
+    CHECK(keySetContains(KEY_A, &set));
+    CHECK(!keySetContains(KEY_A + 1, &set));
+    CHECK(keySetRemove(KEY_A, &set));
+    CHECK(!keySetRemove(KEY_A, &set));
+    CHECK(!keySetContains(KEY_A, &set));
+    CHECK_EQ(set.orderCount, 0);
+}
+
+static void testOrderIsOldestFirst(void)
+{
+    KeySet set;
+    uint8_t keys[6];
+
+    keySetClear(&set);
+    keySetAdd(KEY_A + 2, &set);
+    keySetAdd(KEY_A, &set);
+    keySetAdd(KEY_A + 1, &set);
+    keySetRemove(KEY_A, &set);
+
+    CHECK_EQ(keySetOldest(keys, 6, &set), 2);
+    CHECK_EQ(keys[0], KEY_A + 2);
+    CHECK_EQ(keys[1], KEY_A + 1);
+    CHECK_EQ(keys[2], 0);
+    CHECK_EQ(keys[5], 0);
+}
+
+static void testModifiersOnlyInBitmap(void)
+{
+    KeySet set;
+
+    keySetClear(&set);
+    keySetAdd(KEY_LEFT_CTRL, &set);
+    keySetAdd(KEY_LEFT_SHIFT, &set);
+    keySetAdd(KEY_A, &set);
+    CHECK_EQ(set.orderCount, 1);
+    CHECK_EQ(KEYSET_MODIFIERS(&set), 0x03);
+
+    keySetRemove(KEY_LEFT_CTRL, &set);
+    CHECK_EQ(KEYSET_MODIFIERS(&set), 0x02);
+    CHECK_EQ(set.orderCount, 1);
+    CHECK_EQ(set.unordered, 0);
+}
+
+// 16 keys fill the order, two more only land in the bitmap
+static void fillPastOrder(KeySet *set)
+{
+    keySetClear(set);
+    for (uint8_t k = 0; k < KEYSET_ORDER_SIZE + 2; k++)
+    {
+        keySetAdd(KEY_A + k, set);
+    }
+}
+
+static void testOverflowJoinsOrderWhenSlotFrees(void)
+{
+    KeySet set;
+
+    fillPastOrder(&set);
+    CHECK_EQ(set.orderCount, KEYSET_ORDER_SIZE);
+    CHECK_EQ(set.unordered, 2);
+
+    keySetRemove(KEY_A + 3, &set);
+    CHECK_EQ(set.orderCount, KEYSET_ORDER_SIZE);
+    CHECK_EQ(set.unordered, 1);
+    CHECK_EQ(set.order[KEYSET_ORDER_SIZE - 1], KEY_A + KEYSET_ORDER_SIZE);
+
+    keySetRemove(KEY_A, &set);
+    CHECK_EQ(set.unordered, 0);
+    CHECK_EQ(set.order[KEYSET_ORDER_SIZE - 1], KEY_A + KEYSET_ORDER_SIZE + 1);
+
+    // Nothing is waiting any more, the order just shrinks
+    keySetRemove(KEY_A + 1, &set);
+    CHECK_EQ(set.orderCount, KEYSET_ORDER_SIZE - 1);
+}
+
+static void testReleasedOverflowIsNotBackfilled(void)
+{
+    KeySet set;
+
+    fillPastOrder(&set);
+    keySetRemove(KEY_A + KEYSET_ORDER_SIZE, &set);
+    CHECK_EQ(set.unordered, 1);
+    CHECK_EQ(set.orderCount, KEYSET_ORDER_SIZE);
+
+    keySetRemove(KEY_A, &set);
+    CHECK_EQ(set.unordered, 0);
+    CHECK_EQ(set.order[KEYSET_ORDER_SIZE - 1], KEY_A + KEYSET_ORDER_SIZE + 1);
+    for (int i = 0; i < set.orderCount; i++)
+    {
+        CHECK(set.order[i] != KEY_A + KEYSET_ORDER_SIZE);
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(testAddRemoveContains);
+    RUN_TEST(testOrderIsOldestFirst);
+    RUN_TEST(testModifiersOnlyInBitmap);
+    RUN_TEST(testOverflowJoinsOrderWhenSlotFrees);
+    RUN_TEST(testReleasedOverflowIsNotBackfilled);
+    return testResult();
+}
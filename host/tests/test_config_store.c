@@ -0,0 +1,236 @@
+#include <string.h>
+
+#include "config_store.h"
+#include "test.h"
+
+#define MS 1000
+
+static struct ConfigRamBackend ram;
+static struct ConfigStore store;
+
+// Same FNV-1a as the store, to build blobs by hand
+static uint32_t checksum(const uint8_t *data, size_t length)
+{
+    uint32_t hash = 0x811C9DC5;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ data[i]) * 0x01000193;
+    }
+    return hash;
+}
+
+static void putBlob(uint8_t version, const uint8_t *payload, uint8_t size)
+{
+    struct ConfigBlobHeader header = {
+        .magic = CONFIG_STORE_MAGIC,
+        .version = version,
+        .size = size,
+        .checksum = checksum(payload, size),
+    };
+
+    memcpy(ram.blob, &header, sizeof(header));
+    memcpy(&ram.blob[sizeof(header)], payload, size);
+    ram.length = sizeof(header) + size;
+}
+
+static void testEmptyFlashGetsDefaults(void)
+{
+    configRamBackendInit(&ram);
+    configStoreLoad(&store, &ram.backend, 0);
+    CHECK(store.stats.defaulted);
+    CHECK_EQ(store.config.side, configDefaults.side);
+    CHECK_EQ(store.config.protocol, configDefaults.protocol);
+    // Written once so the next boot finds a blob
+    CHECK_EQ(ram.writes, 1);
+    CHECK(!store.dirty);
+
+    configStoreLoad(&store, &ram.backend, 0);
+    CHECK(!store.stats.defaulted);
+    CHECK_EQ(store.stats.loadedVersion, CONFIG_STORE_VERSION);
+    CHECK_EQ(ram.writes, 1);
+}
+
+static void testLegacyKeyMigrated(void)
+{
+    configRamBackendInit(&ram);
+    ram.legacyPresent = true;
+    ram.legacySide = 5;
+    configStoreLoad(&store, &ram.backend, 0);
+    CHECK_EQ(store.config.side, 1);
+    CHECK_EQ(ram.writes, 1);
+    CHECK(!ram.legacyPresent);
+
+    configStoreLoad(&store, &ram.backend, 0);
+    CHECK_EQ(store.config.side, 1);
+}
+
+static void testLegacyKeptWhenWriteFails(void)
+{
+    configRamBackendInit(&ram);
+    ram.legacyPresent = true;
+    ram.legacySide = 1;
+    ram.failWrites = true;
+    configStoreLoad(&store, &ram.backend, 0);
+    CHECK_EQ(store.config.side, 1);
+    CHECK(ram.legacyPresent);
+    CHECK(store.dirty);
+    CHECK_EQ(store.stats.failed, 1);
+}
+
+static void testBurstIsOneWrite(void)
+{
+    uint32_t waitUs = 0;
+    uint32_t nowUs = 0;
+
+    configRamBackendInit(&ram);
+    configStoreLoad(&store, &ram.backend, 0);
+    ram.writes = 0;
+
+    for (int i = 0; i < 10; i++)
+    {
+        nowUs += 100 * MS;
+        store.config.protocol = (uint8_t)(i % 2 + 1);
+        configStoreTouch(&store, nowUs);
+        CHECK(!configStoreFlushDue(&store, nowUs, &waitUs));
+        CHECK_EQ(waitUs, CONFIG_STORE_QUIET_MS * MS);
+    }
+    CHECK(!configStoreFlushDue(&store, nowUs + CONFIG_STORE_QUIET_MS * MS - 1, &waitUs));
+    CHECK_EQ(waitUs, 1);
+    CHECK(configStoreFlushDue(&store, nowUs + CONFIG_STORE_QUIET_MS * MS, &waitUs));
+    CHECK_EQ(waitUs, 0);
+
+    CHECK(configStoreFlush(&store));
+    CHECK_EQ(ram.writes, 1);
+    CHECK_EQ(store.stats.coalesced, 9);
+    CHECK(!configStoreFlushDue(&store, nowUs + 60000 * MS, &waitUs));
+
+    configStoreLoad(&store, &ram.backend, 0);
+    CHECK_EQ(store.config.protocol, 2);
+}
+
+static void testSteadyChangesFlushAtMaxDirty(void)
+{
+    uint32_t waitUs = 0;
+    uint32_t nowUs = 1000 * MS;
+    uint32_t firstUs = nowUs;
+
+    configRamBackendInit(&ram);
+    configStoreLoad(&store, &ram.backend, 0);
+
+    // Never quiet long enough, the max dirty time still gets it out
+    while (!configStoreFlushDue(&store, nowUs, &waitUs))
+    {
+        store.config.protocol ^= 1;
+        store.config.side = 1;
+        configStoreTouch(&store, nowUs);
+        nowUs += CONFIG_STORE_QUIET_MS * MS / 2;
+    }
+    CHECK(nowUs - firstUs >= CONFIG_STORE_MAX_DIRTY_MS * MS);
+    CHECK(nowUs - firstUs < CONFIG_STORE_MAX_DIRTY_MS * MS + CONFIG_STORE_QUIET_MS * MS);
+}
+
+static void testChangeBackCostsNothing(void)
+{
+    uint32_t waitUs = 0;
+
+    configRamBackendInit(&ram);
+    configStoreLoad(&store, &ram.backend, 0);
+    ram.writes = 0;
+
+    store.config.side = 1;
+    configStoreTouch(&store, 10 * MS);
+    CHECK(store.dirty);
+    store.config.side = 0;
+    configStoreTouch(&store, 20 * MS);
+    CHECK(!store.dirty);
+    CHECK(!configStoreFlushDue(&store, 60000 * MS, &waitUs));
+    CHECK(configStoreFlush(&store));
+    CHECK_EQ(store.stats.skipped, 1);
+    CHECK_EQ(ram.writes, 0);
+}
+
+static void testFailedWriteRetried(void)
+{
+    configRamBackendInit(&ram);
+    configStoreLoad(&store, &ram.backend, 0);
+
+    ram.failWrites = true;
+    store.config.protocol = 1;
+    configStoreTouch(&store, 0);
+    CHECK(!configStoreFlush(&store));
+    CHECK(store.dirty);
+    CHECK_EQ(store.stats.failed, 1);
+    CHECK_EQ(configStoreRetryUs(&store), CONFIG_STORE_RETRY_MS * MS);
+
+    // Backs off while flash keeps refusing, up to the max
+    CHECK(!configStoreFlush(&store));
+    CHECK_EQ(configStoreRetryUs(&store), 2 * CONFIG_STORE_RETRY_MS * MS);
+    for (int i = 0; i < 300; i++)
+    {
+        configStoreFlush(&store);
+    }
+    CHECK_EQ(configStoreRetryUs(&store), CONFIG_STORE_RETRY_MAX_MS * MS);
+
+    ram.failWrites = false;
+    CHECK(configStoreFlush(&store));
+    CHECK(!store.dirty);
+    CHECK_EQ(configStoreRetryUs(&store), CONFIG_STORE_RETRY_MS * MS);
+    configStoreLoad(&store, &ram.backend, 0);
+    CHECK_EQ(store.config.protocol, 1);
+}
+
+static void testCorruptBlobFallsBack(void)
+{
+    configRamBackendInit(&ram);
+    configStoreLoad(&store, &ram.backend, 0);
+    store.config.protocol = 1;
+    configStoreTouch(&store, 0);
+    configStoreFlush(&store);
+
+    ram.blob[ram.length - 1] ^= 0x40;
+    configStoreLoad(&store, &ram.backend, 0);
+    CHECK(store.stats.defaulted);
+    CHECK_EQ(store.config.protocol, configDefaults.protocol);
+
+    // Too short for its header's size
+    ram.length = sizeof(struct ConfigBlobHeader) + 1;
+    configStoreLoad(&store, &ram.backend, 0);
+    CHECK(store.stats.defaulted);
+}
+
+static void testNewerBlobReadAndLeftAlone(void)
+{
+    uint8_t payload[sizeof(struct KbConfig) + 4];
+    struct KbConfig config = {
+        .side = 1,
+        .protocol = 1,
+    };
+
+    configRamBackendInit(&ram);
+    memset(payload, 0xAA, sizeof(payload));
+    memcpy(payload, &config, sizeof(config));
+    putBlob(CONFIG_STORE_VERSION + 1, payload, sizeof(payload));
+
+    configStoreLoad(&store, &ram.backend, 0);
+    CHECK_EQ(store.stats.loadedVersion, CONFIG_STORE_VERSION + 1);
+    CHECK_EQ(store.config.side, 1);
+    CHECK_EQ(store.config.protocol, 1);
+    // Fields this version does not know stay in flash until a setting changes
+    CHECK_EQ(ram.writes, 0);
+    CHECK(!store.dirty);
+}
+
+int main(void)
+{
+    RUN_TEST(testEmptyFlashGetsDefaults);
+    RUN_TEST(testLegacyKeyMigrated);
+    RUN_TEST(testLegacyKeptWhenWriteFails);
+    RUN_TEST(testBurstIsOneWrite);
+    RUN_TEST(testSteadyChangesFlushAtMaxDirty);
+    RUN_TEST(testChangeBackCostsNothing);
+    RUN_TEST(testFailedWriteRetried);
+    RUN_TEST(testCorruptBlobFallsBack);
+    RUN_TEST(testNewerBlobReadAndLeftAlone);
+    return testResult();
+}
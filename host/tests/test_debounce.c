@@ -0,0 +1,162 @@
+#include <string.h>
+
+#include "debounce.h"
+#include "test.h"
+
+#define MAX_EDGES 8
+
+struct Trace
+{
+    int edges;
+    uint32_t edgeMs[MAX_EDGES];
+    bool level;
+};
+
+/*
+Feeds a recorded bounce trace for the key at row 1, column 3, one sample per
+millisecond starting at startMs. '1' is contact closed, anything else open.
+*/
+static void runTrace(struct Debouncer *db, const char *samples, uint32_t startMs, struct Trace *trace)
+{
+    matrix_row_t raw[KB_ROWS] = {0};
+    matrix_row_t changes[KB_ROWS];
+
+    memset(trace, 0, sizeof(*trace));
+    for (uint32_t i = 0; samples[i] != '\0'; i++)
+    {
+        raw[1] = samples[i] == '1' ? 1u << 3 : 0;
+        if (debounceUpdate(db, raw, startMs + i, changes))
+        {
+            CHECK_EQ(changes[1], 1u << 3);
+            if (trace->edges < MAX_EDGES)
+            {
+                trace->edgeMs[trace->edges] = startMs + i;
+            }
+            trace->edges++;
+        }
+    }
+    trace->level = (db->stable[1] >> 3) & 1;
+}
+
+static void testEagerPressGoesThroughAtOnce(void)
+{
+    struct Debouncer db;
+    struct Trace trace;
+
+    debounceInit(&db, DEBOUNCE_EAGER, 5, 0);
+    runTrace(&db, "1010011111111", 0, &trace);
+    CHECK_EQ(trace.edges, 1);
+    CHECK_EQ(trace.edgeMs[0], 0);
+    CHECK(trace.level);
+}
+
+static void testEagerReleaseWaitsForStableSamples(void)
+{
+    struct Debouncer db;
+    struct Trace trace;
+
+    debounceInit(&db, DEBOUNCE_EAGER, 5, 0);
+    runTrace(&db, "1", 0, &trace);
+    // Open for four samples, bounces closed, then open for good
+    runTrace(&db, "000010100000", 1, &trace);
+    CHECK_EQ(trace.edges, 1);
+    CHECK_EQ(trace.edgeMs[0], 1 + 11);
+    CHECK(!trace.level);
+}
+
+static void testDeferWaitsOnBothEdges(void)
+{
+    struct Debouncer db;
+    struct Trace trace;
+
+    debounceInit(&db, DEBOUNCE_DEFER, 4, 0);
+    runTrace(&db, "110101111", 0, &trace);
+    CHECK_EQ(trace.edges, 1);
+    CHECK_EQ(trace.edgeMs[0], 8);
+    CHECK(trace.level);
+
+    runTrace(&db, "0010000", 20, &trace);
+    CHECK_EQ(trace.edges, 1);
+    CHECK_EQ(trace.edgeMs[0], 20 + 6);
+    CHECK(!trace.level);
+}
+
+static void testDeferIgnoresShortGlitch(void)
+{
+    struct Debouncer db;
+    struct Trace trace;
+
+    debounceInit(&db, DEBOUNCE_DEFER, 3, 0);
+    runTrace(&db, "0110110010000000", 0, &trace);
+    CHECK_EQ(trace.edges, 0);
+    CHECK(!trace.level);
+}
+
+static void testTimeoutLocksKeyAfterEdge(void)
+{
+    struct Debouncer db;
+    struct Trace trace;
+
+    debounceInit(&db, DEBOUNCE_TIMEOUT, 1, 5);
+    // Press at once, bounces inside the 5 ms lock are ignored, release after it goes through
+    runTrace(&db, "1010111000", 0, &trace);
+    CHECK_EQ(trace.edges, 2);
+    CHECK_EQ(trace.edgeMs[0], 0);
+    CHECK_EQ(trace.edgeMs[1], 7);
+    CHECK(!trace.level);
+}
+
+static void testTimeoutSurvivesClockWrap(void)
+{
+    struct Debouncer db;
+    struct Trace trace;
+
+    debounceInit(&db, DEBOUNCE_TIMEOUT, 1, 5);
+    runTrace(&db, "1110000", 0xFFFEu, &trace);
+    CHECK_EQ(trace.edges, 2);
+    CHECK_EQ(trace.edgeMs[0], 0xFFFEu);
+    CHECK_EQ(trace.edgeMs[1], 0xFFFEu + 5);
+}
+
+static void testKeysCountIndependently(void)
+{
+    struct Debouncer db;
+    matrix_row_t raw[KB_ROWS] = {0};
+    matrix_row_t changes[KB_ROWS];
+    uint32_t now = 0;
+
+    debounceInit(&db, DEBOUNCE_DEFER, 3, 0);
+    raw[2] = 0x01;
+    debounceUpdate(&db, raw, now++, changes);
+    raw[2] = 0x03;
+    debounceUpdate(&db, raw, now++, changes);
+    CHECK_EQ(changes[2], 0);
+    debounceUpdate(&db, raw, now++, changes);
+    CHECK_EQ(changes[2], 0x01);
+    debounceUpdate(&db, raw, now++, changes);
+    CHECK_EQ(changes[2], 0x02);
+    CHECK_EQ(db.stable[2], 0x03);
+}
+
+static void testSamplesAreClamped(void)
+{
+    struct Debouncer db;
+
+    debounceInit(&db, DEBOUNCE_DEFER, 0, 0);
+    CHECK_EQ(db.samples, 1);
+    debounceInit(&db, DEBOUNCE_DEFER, 50, 0);
+    CHECK_EQ(db.samples, DEBOUNCE_MAX_SAMPLES);
+}
+
+int main(void)
+{
+    RUN_TEST(testEagerPressGoesThroughAtOnce);
+    RUN_TEST(testEagerReleaseWaitsForStableSamples);
+    RUN_TEST(testDeferWaitsOnBothEdges);
+    RUN_TEST(testDeferIgnoresShortGlitch);
+    RUN_TEST(testTimeoutLocksKeyAfterEdge);
+    RUN_TEST(testTimeoutSurvivesClockWrap);
+    RUN_TEST(testKeysCountIndependently);
+    RUN_TEST(testSamplesAreClamped);
+    return testResult();
+}
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "display_fb.h"
+#include "display_ui.h"
+#include "test.h"
+
+#define WIDTH 128
+#define HEIGHT 64
+#define RGB_WIDTH 40
+#define RGB_HEIGHT 30
+#define SCRATCH_SIZE 512
+
+static uint8_t pixels[WIDTH * HEIGHT * 2];
+static uint8_t mirrorPixels[WIDTH * HEIGHT * 2];
+static uint8_t scratch[SCRATCH_SIZE];
+static struct DisplayFb fb;
+static struct DisplayPgmPanel pgm;
+static struct DisplayUi ui;
+static bool failDraws;
+
+static void setup(enum DisplayFormat format, uint16_t width, uint16_t height)
+{
+    displayFbInit(&fb, format, width, height, pixels);
+    displayPgmPanelInit(&pgm, format, width, height, mirrorPixels, NULL);
+    failDraws = false;
+}
+
+static uint32_t flush(void)
+{
+    return displayFbFlush(&fb, &pgm.panel, scratch, sizeof(scratch));
+}
+
+// The panel shows exactly what the framebuffer holds
+static bool mirrored(void)
+{
+    return memcmp(pixels, mirrorPixels, displayFbSize(fb.format, fb.width, fb.height)) == 0;
+}
+
+static void testFirstFlushSendsEverything(void)
+{
+    setup(DISPLAY_MONO, WIDTH, HEIGHT);
+    CHECK(displayFbDirty(&fb));
+    CHECK_EQ(flush(), WIDTH * HEIGHT / 8);
+    CHECK_EQ(pgm.frames, 1);
+    CHECK(!displayFbDirty(&fb));
+
+    // Nothing changed, nothing sent and nothing presented
+    CHECK_EQ(flush(), 0);
+    CHECK_EQ(pgm.frames, 1);
+    CHECK_EQ(fb.stats.frames, 2);
+    CHECK_EQ(fb.stats.flushed, 1);
+}
+
+static void testUiOnlySendsChangedLines(void)
+{
+    struct DisplayStatus status = {
+        .layer = "Base",
+        .protocol = "USB",
+        .batteryPercent = DISPLAY_BATTERY_NONE,
+        .wpm = 0,
+    };
+    uint32_t redraws = 0;
+    uint32_t draws = 0;
+
+    setup(DISPLAY_MONO, WIDTH, HEIGHT);
+    displayUiInit(&ui, &fb);
+    displayUiRender(&ui, &status);
+    flush();
+    CHECK(mirrored());
+    CHECK_EQ(ui.redraws, DISPLAY_WIDGETS);
+
+    // Same status, no widget is redrawn
+    redraws = ui.redraws;
+    displayUiRender(&ui, &status);
+    CHECK_EQ(ui.redraws, redraws);
+    CHECK(!displayFbDirty(&fb));
+
+    // One line changes, one page of it goes out
+    status.wpm = 42;
+    draws = pgm.draws;
+    displayUiRender(&ui, &status);
+    CHECK_EQ(ui.redraws, redraws + 1);
+    CHECK_EQ(fb.dirtyCount, 1);
+    CHECK_EQ(fb.dirty[0].y0, 4 * 8);
+    CHECK_EQ(fb.dirty[0].y1, 5 * 8);
+    CHECK(flush() <= WIDTH);
+    CHECK_EQ(pgm.draws, draws + 1);
+    CHECK(mirrored());
+
+    // Drawing the old text back is a change too
+    status.wpm = 0;
+    status.layer = "Fn";
+    displayUiRender(&ui, &status);
+    for (uint8_t i = 0; i < fb.dirtyCount; i++)
+    {
+        CHECK(fb.dirty[i].y0 == 0 || fb.dirty[i].y0 == 4 * 8);
+        CHECK_EQ(fb.dirty[i].y1 - fb.dirty[i].y0, 8);
+    }
+    CHECK(flush() <= 2 * WIDTH);
+    CHECK(mirrored());
+}
+
+static void testRgbBandsFitScratch(void)
+{
+    uint32_t transfers = 0;
+
+    setup(DISPLAY_RGB565, RGB_WIDTH, RGB_HEIGHT);
+    CHECK_EQ(flush(), RGB_WIDTH * RGB_HEIGHT * 2);
+    // 80 bytes a row, six rows a band
+    CHECK_EQ(fb.stats.transfers, (RGB_HEIGHT + 5) / 6);
+
+    transfers = fb.stats.transfers;
+    displayFbFill(&fb, &(struct DisplayRect){5, 5, 15, 25}, 0xF800);
+    CHECK_EQ(fb.dirtyCount, 1);
+    CHECK_EQ(flush(), 10 * 20 * 2);
+    CHECK_EQ(fb.stats.transfers, transfers + (20 + 24) / 25);
+    CHECK(mirrored());
+    CHECK_EQ(pixels[(5 * RGB_WIDTH + 5) * 2], 0xF8);
+
+    // Filling with what is there already marks nothing
+    displayFbFill(&fb, &(struct DisplayRect){5, 5, 15, 25}, 0xF800);
+    CHECK(!displayFbDirty(&fb));
+}
+
+static void testDirtyRegionsMerge(void)
+{
+    setup(DISPLAY_RGB565, RGB_WIDTH, RGB_HEIGHT);
+    flush();
+
+    // Touching regions become one
+    displayFbFill(&fb, &(struct DisplayRect){0, 0, 4, 4}, DISPLAY_WHITE);
+    displayFbFill(&fb, &(struct DisplayRect){4, 0, 8, 4}, DISPLAY_WHITE);
+    CHECK_EQ(fb.dirtyCount, 1);
+    CHECK_EQ(fb.dirty[0].x1, 8);
+
+    // Far more spots than slots, the list stays bounded and still covers them all
+    for (int16_t i = 0; i < 12; i++)
+    {
+        displayFbFill(&fb, &(struct DisplayRect){(int16_t)(3 * i), 10 + (i % 3) * 6, (int16_t)(3 * i + 1), 11 + (i % 3) * 6}, DISPLAY_WHITE);
+    }
+    CHECK(fb.dirtyCount <= DISPLAY_DIRTY_RECTS);
+    flush();
+    CHECK(mirrored());
+}
+
+static bool failingDraw(void *ctx, const struct DisplayRect *rect, const void *data, size_t length)
+{
+    return !failDraws && pgm.panel.draw(ctx, rect, data, length);
+}
+
+static void testFailedDrawStaysDirty(void)
+{
+    struct DisplayPanel panel = {
+        .ctx = &pgm,
+        .draw = failingDraw,
+    };
+
+    setup(DISPLAY_MONO, WIDTH, HEIGHT);
+    failDraws = true;
+    CHECK_EQ(displayFbFlush(&fb, &panel, scratch, sizeof(scratch)), 0);
+    CHECK_EQ(fb.stats.failed, 1);
+    CHECK(displayFbDirty(&fb));
+
+    failDraws = false;
+    CHECK_EQ(displayFbFlush(&fb, &panel, scratch, sizeof(scratch)), WIDTH * HEIGHT / 8);
+    CHECK(!displayFbDirty(&fb));
+    CHECK(mirrored());
+
+    // A row that does not fit the scratch buffer cannot be sent at all
+    setup(DISPLAY_RGB565, RGB_WIDTH, RGB_HEIGHT);
+    CHECK_EQ(displayFbFlush(&fb, &pgm.panel, scratch, RGB_WIDTH * 2 - 1), 0);
+    CHECK_EQ(fb.stats.failed, 1);
+    CHECK(displayFbDirty(&fb));
+}
+
+static void testTextClipped(void)
+{
+    setup(DISPLAY_MONO, WIDTH, HEIGHT);
+    flush();
+    // Half the glyph is off the right edge, the rest is drawn
+    CHECK_EQ(displayFbText(&fb, WIDTH - 3, 0, "#", DISPLAY_WHITE, DISPLAY_BLACK), WIDTH + 3);
+    CHECK_EQ(fb.dirtyCount, 1);
+    CHECK(fb.dirty[0].x0 >= WIDTH - 3);
+    CHECK_EQ(fb.dirty[0].x1, WIDTH);
+    displayFbText(&fb, -100, -100, "off screen", DISPLAY_WHITE, DISPLAY_BLACK);
+    CHECK_EQ(fb.dirtyCount, 1);
+}
+
+static void testPgmShowsPanel(void)
+{
+    const char *path = "test_display.pgm";
+    char header[16] = {0};
+    uint8_t grey[16 * 8];
+    FILE *file = NULL;
+
+    setup(DISPLAY_MONO, 16, 8);
+    displayFbFill(&fb, &(struct DisplayRect){3, 2, 4, 3}, DISPLAY_WHITE);
+    flush();
+    CHECK(displayPgmWrite(&pgm, path));
+
+    file = fopen(path, "rb");
+    CHECK(file != NULL);
+    if (file == NULL)
+    {
+        return;
+    }
+    CHECK(fread(header, 1, 11, file) == 11);
+    CHECK(strcmp(header, "P5\n16 8\n255") == 0);
+    fgetc(file);
+    CHECK(fread(grey, 1, sizeof(grey), file) == sizeof(grey));
+    fclose(file);
+    remove(path);
+    for (int i = 0; i < 16 * 8; i++)
+    {
+        CHECK_EQ(grey[i], i == 2 * 16 + 3 ? 255 : 0);
+    }
+}
+
+static void testWpmMeter(void)
+{
+    struct WpmMeter meter;
+    uint32_t presses = 1000;
+    uint16_t wpm = 0;
+
+    wpmMeterInit(&meter);
+    wpmMeterUpdate(&meter, presses, 0);
+    // Five presses a second is one word a second
+    for (uint32_t t = 0; t < WPM_BUCKETS * 5; t++)
+    {
+        presses++;
+        wpm = wpmMeterUpdate(&meter, presses, t * WPM_BUCKET_US / 5);
+    }
+    CHECK_EQ(wpm, 60);
+
+    // The window slides a bucket at a time, half of it idle halves the rate and a whole window clears it
+    CHECK_EQ(wpmMeterUpdate(&meter, presses, (WPM_BUCKETS * 3 / 2 - 1) * WPM_BUCKET_US), 30);
+    CHECK_EQ(wpmMeterUpdate(&meter, presses, 3 * WPM_BUCKETS * WPM_BUCKET_US), 0);
+}
+
+int main(void)
+{
+    RUN_TEST(testFirstFlushSendsEverything);
+    RUN_TEST(testUiOnlySendsChangedLines);
+    RUN_TEST(testRgbBandsFitScratch);
+    RUN_TEST(testDirtyRegionsMerge);
+    RUN_TEST(testFailedDrawStaysDirty);
+    RUN_TEST(testTextClipped);
+    RUN_TEST(testPgmShowsPanel);
+    RUN_TEST(testWpmMeter);
+    return testResult();
+}
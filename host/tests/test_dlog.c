@@ -0,0 +1,118 @@
+#include <string.h>
+
+#include "dlog.h"
+#include "test.h"
+
+static struct DlogRing ring;
+
+static bool logKey(uint32_t row, uint32_t col)
+{
+    const uint32_t args[DLOG_MAX_ARGS] = {row, col, 1};
+
+    return dlogWrite(&ring, DLOG_KEY_PRESSED, row * 1000 + col, args);
+}
+
+static void testRecordsComeOutInOrder(void)
+{
+    struct DlogRecord record;
+
+    dlogRingInit(&ring);
+    CHECK(!dlogRead(&ring, &record));
+    for (uint32_t i = 0; i < 5; i++)
+    {
+        CHECK(logKey(i, 2));
+    }
+    for (uint32_t i = 0; i < 5; i++)
+    {
+        CHECK(dlogRead(&ring, &record));
+        CHECK_EQ(record.id, DLOG_KEY_PRESSED);
+        CHECK_EQ(record.timeUs, i * 1000 + 2);
+        CHECK_EQ(record.args[0], i);
+    }
+    CHECK(!dlogRead(&ring, &record));
+    CHECK_EQ(ring.written, 5);
+    CHECK_EQ(ring.dropped, 0);
+}
+
+static void testFullRingDropsNewest(void)
+{
+    struct DlogRecord record;
+
+    dlogRingInit(&ring);
+    for (uint32_t i = 0; i < DLOG_RING_SIZE; i++)
+    {
+        CHECK(logKey(i, 0));
+    }
+    // Nothing waits, the new record is counted and left out
+    CHECK(!logKey(99, 0));
+    CHECK(!logKey(98, 0));
+    CHECK_EQ(ring.dropped, 2);
+    CHECK_EQ(ring.written, DLOG_RING_SIZE);
+
+    // One read frees one slot, the oldest records are all still there
+    CHECK(dlogRead(&ring, &record));
+    CHECK_EQ(record.args[0], 0);
+    CHECK(logKey(100, 0));
+    for (uint32_t i = 1; i < DLOG_RING_SIZE; i++)
+    {
+        CHECK(dlogRead(&ring, &record));
+        CHECK_EQ(record.args[0], i);
+    }
+    CHECK(dlogRead(&ring, &record));
+    CHECK_EQ(record.args[0], 100);
+    CHECK(!dlogRead(&ring, &record));
+}
+
+static void testIndexWrap(void)
+{
+    struct DlogRecord record;
+
+    dlogRingInit(&ring);
+    // Head and tail are free running, only the slot index is masked
+    ring.head = ring.tail = UINT32_MAX - 1;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        CHECK(logKey(i, 0));
+    }
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        CHECK(dlogRead(&ring, &record));
+        CHECK_EQ(record.args[0], i);
+    }
+    CHECK(!dlogRead(&ring, &record));
+}
+
+static void testFormatting(void)
+{
+    struct DlogRecord record = {
+        .id = DLOG_KEY_PRESSED,
+        .args = {3, 4, 1},
+    };
+    char text[64];
+
+    dlogFormat(&record, text, sizeof(text));
+    CHECK(strcmp(text, "Key [3,4] on side 1 is pressed") == 0);
+
+    record.id = DLOG_LOCK_STATE;
+    record.args[0] = 0x5;
+    dlogFormat(&record, text, sizeof(text));
+    CHECK(strcmp(text, "Host lock state: 0x05") == 0);
+    CHECK_EQ(dlogFormats[DLOG_LOCK_STATE].level, 'I');
+    CHECK(strcmp(dlogFormats[DLOG_KEYBOARD_SILENT].tag, "dongle") == 0);
+
+    // Truncated like snprintf, and an id from a newer build is still shown
+    CHECK_EQ(dlogFormat(&record, text, 8), (int)strlen("Host lock state: 0x05"));
+    CHECK(strcmp(text, "Host lo") == 0);
+    record.id = DLOG_COUNT + 3;
+    dlogFormat(&record, text, sizeof(text));
+    CHECK(strncmp(text, "Unknown log id", 14) == 0);
+}
+
+int main(void)
+{
+    RUN_TEST(testRecordsComeOutInOrder);
+    RUN_TEST(testFullRingDropsNewest);
+    RUN_TEST(testIndexWrap);
+    RUN_TEST(testFormatting);
+    return testResult();
+}
@@ -0,0 +1,170 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include "dongle_link.h"
+#include "test.h"
+
+#define STEP_US 50
+#define CHANGE_PERIOD_US 100000
+#define CHANGES 400
+#define AIR_DELAY_US 400
+#define AIR_JITTER_US 100
+// Last copy, then a keepalive after DONGLE_KEEPALIVE_MS of silence
+#define KEEPALIVE_LATENCY_US ((DONGLE_COPIES - 1) * DONGLE_COPY_SPACING_US + DONGLE_KEEPALIVE_MS * 1000 + AIR_DELAY_US + AIR_JITTER_US + STEP_US)
+
+struct Simulation
+{
+    struct DongleChannel channel;
+    struct DongleRadio radio;
+    struct DongleSender sender;
+    struct DongleReceiver receiver;
+    uint32_t nowUs;
+    uint32_t keyboardReports;
+    uint32_t latencies[CHANGES];
+};
+
+static struct Simulation sim;
+
+static void setup(uint16_t lossPermille, uint8_t burstPercent)
+{
+    memset(&sim, 0, sizeof(sim));
+    dongleChannelInit(&sim.channel, &sim.radio);
+    sim.channel.delayUs = AIR_DELAY_US;
+    sim.channel.jitterUs = AIR_JITTER_US;
+    sim.channel.lossPermille = lossPermille;
+    sim.channel.burstPercent = burstPercent;
+    dongleSenderInit(&sim.sender, &sim.radio, 7);
+    dongleReceiverInit(&sim.receiver);
+}
+
+static void step(void)
+{
+    uint8_t frame[DONGLE_FRAME_MAX];
+    struct DongleReport report;
+    size_t length = 0;
+
+    sim.nowUs += STEP_US;
+    sim.channel.nowUs = sim.nowUs;
+    dongleSenderPoll(&sim.sender, sim.nowUs);
+    while ((length = dongleChannelReceive(&sim.channel, frame, sizeof(frame))) > 0)
+    {
+        if (dongleReceiverPush(&sim.receiver, frame, length, sim.nowUs, &report) & DONGLE_REPORT_KEYBOARD)
+        {
+            sim.keyboardReports++;
+        }
+    }
+    dongleReceiverPoll(&sim.receiver, sim.nowUs, &report);
+}
+
+static int compareUs(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t percentile(const uint32_t *sorted, uint32_t count, uint32_t p)
+{
+    return sorted[(count - 1) * p / 100];
+}
+
+// Toggles one key per period, the latency is how long the dongle took to show that state
+static void runChanges(void)
+{
+    struct KeyboardData data = {0};
+    uint32_t startUs = 0;
+
+    for (uint32_t i = 0; i < CHANGES; i++)
+    {
+        data.bitmap[0] ^= (uint8_t)(1u << (4 + i % 4));
+        startUs = sim.nowUs;
+        CHECK(dongleSenderKeyboard(&sim.sender, &data, sim.nowUs));
+        sim.latencies[i] = UINT32_MAX;
+        while (sim.nowUs - startUs < CHANGE_PERIOD_US)
+        {
+            step();
+            if (sim.latencies[i] == UINT32_MAX && sim.receiver.bitmap[0] == data.bitmap[0])
+            {
+                sim.latencies[i] = sim.nowUs - startUs;
+            }
+        }
+    }
+    qsort(sim.latencies, CHANGES, sizeof(sim.latencies[0]), compareUs);
+}
+
+static void testCleanAirReportsOnce(void)
+{
+    setup(0, 0);
+    runChanges();
+
+    // One report per change, the other copies are dropped as duplicates
+    CHECK_EQ(sim.keyboardReports, CHANGES);
+    CHECK_EQ(sim.receiver.stats.missed, 0);
+    CHECK_EQ(sim.receiver.stats.recovered, 0);
+    CHECK(sim.receiver.stats.duplicates >= CHANGES * (DONGLE_COPIES - 1));
+    CHECK(percentile(sim.latencies, CHANGES, 100) <= AIR_DELAY_US + AIR_JITTER_US + STEP_US);
+}
+
+static void testModerateLossHiddenByCopies(void)
+{
+    setup(50, 20);
+    runChanges();
+
+    CHECK(sim.channel.lost > 0);
+    CHECK_EQ(sim.keyboardReports, CHANGES);
+    CHECK(percentile(sim.latencies, CHANGES, 50) <= AIR_DELAY_US + AIR_JITTER_US + STEP_US);
+    // A lost first copy costs one spacing, rarely two
+    CHECK(percentile(sim.latencies, CHANGES, 99) <= AIR_DELAY_US + AIR_JITTER_US + 2 * DONGLE_COPY_SPACING_US + STEP_US);
+    CHECK(percentile(sim.latencies, CHANGES, 100) <= KEEPALIVE_LATENCY_US);
+    CHECK_EQ(sim.receiver.stats.timeouts, 0);
+}
+
+static void testHeavyLossRecoveredByKeepalive(void)
+{
+    setup(250, 50);
+    runChanges();
+
+    // Every copy of some changes is lost, the next keepalive carries the state
+    CHECK(sim.receiver.stats.recovered > 0);
+    CHECK(percentile(sim.latencies, CHANGES, 50) <= AIR_DELAY_US + AIR_JITTER_US + DONGLE_COPY_SPACING_US + STEP_US);
+    // Changes the copies missed wait for a keepalive, a lost keepalive leaves them for the next one
+    CHECK(percentile(sim.latencies, CHANGES, 95) <= KEEPALIVE_LATENCY_US);
+    CHECK(percentile(sim.latencies, CHANGES, 95) > DONGLE_KEEPALIVE_MS * 1000);
+    CHECK(percentile(sim.latencies, CHANGES, 90) < DONGLE_KEEPALIVE_MS * 1000);
+}
+
+static void testSilenceReleasesKeys(void)
+{
+    struct KeyboardData data = {0};
+
+    setup(0, 0);
+    data.bitmap[0] = 0x10;
+    dongleSenderKeyboard(&sim.sender, &data, sim.nowUs);
+    for (int i = 0; i < 20; i++)
+    {
+        step();
+    }
+    CHECK(dongleReceiverConnected(&sim.receiver));
+    CHECK_EQ(sim.receiver.bitmap[0], 0x10);
+
+    // Keyboard gone, nothing arrives any more
+    sim.channel.lossPermille = 1000;
+    sim.channel.burstPercent = 100;
+    while (sim.nowUs < (DONGLE_TIMEOUT_MS + DONGLE_KEEPALIVE_MS) * 1000)
+    {
+        step();
+    }
+    CHECK(!dongleReceiverConnected(&sim.receiver));
+    CHECK_EQ(sim.receiver.bitmap[0], 0);
+    CHECK_EQ(sim.receiver.stats.timeouts, 1);
+}
+
+int main(void)
+{
+    RUN_TEST(testCleanAirReportsOnce);
+    RUN_TEST(testModerateLossHiddenByCopies);
+    RUN_TEST(testHeavyLossRecoveredByKeepalive);
+    RUN_TEST(testSilenceReleasesKeys);
+    return testResult();
+}
@@ -0,0 +1,264 @@
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "event_ring.h"
+#include "test.h"
+
+static struct InputEvent keyEvent(uint32_t seq)
+{
+    struct InputEvent event = {
+        .type = INPUT_EVENT_KEY,
+        .keycode = (uint8_t)(0x04 + seq % 26),
+        .pressed = seq & 1,
+        .scan_us = seq,
+    };
+    return event;
+}
+
+static struct InputEvent mouseEvent(int16_t dx, int16_t dy, uint8_t buttons)
+{
+    struct InputEvent event = {
+        .type = INPUT_EVENT_MOUSE,
+        .buttons = buttons,
+        .delta_x = dx,
+        .delta_y = dy,
+    };
+    return event;
+}
+
+static void testKeysOverflowIntoBacklogInOrder(void)
+{
+    static struct EventRing ring;
+    struct InputEvent event;
+    struct InputEvent key;
+    uint32_t total = EVENT_RING_SIZE + EVENT_BACKLOG_SIZE;
+
+    eventRingInit(&ring);
+    for (uint32_t i = 0; i < total; i++)
+    {
+        key = keyEvent(i);
+        CHECK(eventRingPushKey(&ring, &key));
+    }
+    key = keyEvent(total);
+    CHECK(!eventRingPushKey(&ring, &key));
+    CHECK(!eventRingPushKey(&ring, &key));
+    CHECK_EQ(ring.backlogCount, EVENT_BACKLOG_SIZE);
+    // Only what went through the backlog counts, retries of a refused event do not
+    CHECK_EQ(ring.deferred, EVENT_BACKLOG_SIZE);
+
+    // The consumer frees slots, the producer moves the backlog over on its next flush
+    for (uint32_t i = 0; i < total; i++)
+    {
+        if (!eventRingPop(&ring, &event))
+        {
+            eventRingFlush(&ring);
+            CHECK(eventRingPop(&ring, &event));
+        }
+        CHECK_EQ(event.scan_us, i);
+    }
+    CHECK(eventRingFlush(&ring));
+    CHECK(!eventRingPop(&ring, &event));
+}
+
+static void testMotionCoalescesAndSaturates(void)
+{
+    static struct EventRing ring;
+    struct InputEvent event;
+    struct InputEvent key = keyEvent(0);
+    struct InputEvent motion;
+
+    eventRingInit(&ring);
+    // Motion only takes slots while the key reserve stays free
+    for (uint32_t i = 0; i < EVENT_RING_SIZE - EVENT_RING_MOUSE_RESERVE; i++)
+    {
+        CHECK(eventRingPushKey(&ring, &key));
+    }
+
+    motion = mouseEvent(30000, -30000, 0);
+    CHECK(eventRingPushMouse(&ring, &motion));
+    CHECK(ring.mousePending);
+    motion = mouseEvent(30000, -30000, 0);
+    CHECK(eventRingPushMouse(&ring, &motion));
+    motion.scroll_vertical = 100;
+    motion.delta_x = 5;
+    motion.delta_y = 0;
+    CHECK(eventRingPushMouse(&ring, &motion));
+    CHECK(eventRingPushMouse(&ring, &motion));
+
+    CHECK_EQ(ring.mouseCoalesced, 3);
+    CHECK_EQ(ring.pendingMouse.delta_x, INT16_MAX);
+    CHECK_EQ(ring.pendingMouse.delta_y, INT16_MIN);
+    CHECK_EQ(ring.pendingMouse.scroll_vertical, INT8_MAX);
+
+    while (eventRingPop(&ring, &event))
+    {
+    }
+    CHECK(eventRingFlush(&ring));
+    CHECK(eventRingPop(&ring, &event));
+    CHECK_EQ(event.type, INPUT_EVENT_MOUSE);
+    CHECK_EQ(event.delta_x, INT16_MAX);
+}
+
+static void testButtonChangeWaitsForBacklog(void)
+{
+    static struct EventRing ring;
+    struct InputEvent event;
+    struct InputEvent key;
+    struct InputEvent motion = mouseEvent(1, 0, 0);
+    struct InputEvent click = mouseEvent(0, 0, 1);
+    uint32_t keys = 0;
+    uint32_t clicks = 0;
+
+    eventRingInit(&ring);
+    key = keyEvent(keys);
+    while (eventRingPushKey(&ring, &key))
+    {
+        key = keyEvent(++keys);
+    }
+    // The refused key went nowhere, the producer would retry it
+    CHECK_EQ(ring.backlogCount, EVENT_BACKLOG_SIZE);
+
+    // Motion waits as the pending event, the click would need a backlog slot for it
+    CHECK(eventRingPushMouse(&ring, &motion));
+    CHECK(!eventRingPushMouse(&ring, &click));
+    CHECK(ring.mousePending);
+    CHECK_EQ(ring.pendingMouse.buttons, 0);
+    CHECK_EQ(ring.pendingMouse.delta_x, 1);
+
+    eventRingPop(&ring, &event);
+    CHECK(eventRingPushMouse(&ring, &click));
+
+    while (!eventRingFlush(&ring) || eventRingCount(&ring) > 0)
+    {
+        while (eventRingPop(&ring, &event))
+        {
+            clicks += event.type == INPUT_EVENT_MOUSE && event.buttons == 1;
+        }
+    }
+    CHECK_EQ(clicks, 1);
+}
+
+/*
+Two threads, like the GPIO and comms tasks on separate cores. Keys carry a
+sequence number that has to come out in order and without gaps, motion has
+to add up to what was pushed and every button change has to be seen.
+*/
+#define STRESS_EVENTS 200000
+
+struct Stress
+{
+    struct EventRing ring;
+    uint32_t keysPushed;
+    int64_t motionPushed;
+    uint32_t buttonChanges;
+    atomic_bool done;
+
+    uint32_t keysSeen;
+    uint32_t outOfOrder;
+    int64_t motionSeen;
+    uint32_t buttonChangesSeen;
+};
+
+static void *stressProducer(void *arg)
+{
+    struct Stress *stress = (struct Stress *)arg;
+    struct InputEvent event;
+    uint8_t buttons = 0;
+
+    for (uint32_t i = 0; i < STRESS_EVENTS; i++)
+    {
+        if (i % 3 == 0)
+        {
+            if (i % 301 == 0)
+            {
+                buttons ^= 1;
+                stress->buttonChanges++;
+            }
+            event = mouseEvent(1, 0, buttons);
+            while (!eventRingPushMouse(&stress->ring, &event))
+            {
+                sched_yield();
+            }
+            stress->motionPushed++;
+            continue;
+        }
+        event = keyEvent(stress->keysPushed);
+        while (!eventRingPushKey(&stress->ring, &event))
+        {
+            sched_yield();
+        }
+        stress->keysPushed++;
+    }
+    while (!eventRingFlush(&stress->ring))
+    {
+        sched_yield();
+    }
+    atomic_store(&stress->done, true);
+    return NULL;
+}
+
+static void *stressConsumer(void *arg)
+{
+    struct Stress *stress = (struct Stress *)arg;
+    struct InputEvent event;
+    uint8_t buttons = 0;
+    bool done = false;
+
+    while (1)
+    {
+        // Checked before popping, events pushed ahead of the flag are still drained
+        done = atomic_load(&stress->done);
+
+        while (eventRingPop(&stress->ring, &event))
+        {
+            if (event.type == INPUT_EVENT_KEY)
+            {
+                stress->outOfOrder += event.scan_us != stress->keysSeen;
+                stress->keysSeen++;
+                continue;
+            }
+            stress->motionSeen += event.delta_x;
+            if (event.buttons != buttons)
+            {
+                buttons = event.buttons;
+                stress->buttonChangesSeen++;
+            }
+        }
+        if (done)
+        {
+            return NULL;
+        }
+        sched_yield();
+    }
+}
+
+static void testTwoThreadStress(void)
+{
+    static struct Stress stress;
+    pthread_t producer;
+    pthread_t consumer;
+
+    memset(&stress, 0, sizeof(stress));
+    eventRingInit(&stress.ring);
+    atomic_init(&stress.done, false);
+
+    pthread_create(&consumer, NULL, stressConsumer, &stress);
+    pthread_create(&producer, NULL, stressProducer, &stress);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    CHECK_EQ(stress.keysSeen, stress.keysPushed);
+    CHECK_EQ(stress.outOfOrder, 0);
+    CHECK_EQ(stress.motionSeen, stress.motionPushed);
+    CHECK_EQ(stress.buttonChangesSeen, stress.buttonChanges);
+}
+
+int main(void)
+{
+    RUN_TEST(testKeysOverflowIntoBacklogInOrder);
+    RUN_TEST(testMotionCoalescesAndSaturates);
+    RUN_TEST(testButtonChangeWaitsForBacklog);
+    RUN_TEST(testTwoThreadStress);
+    return testResult();
+}
@@ -0,0 +1,126 @@
+#include <string.h>
+
+#include "joystick_filter.h"
+#include "test.h"
+
+static struct JoystickFilter filter;
+static struct JoystickFakeSource fake;
+static struct JoystickSampleSource source;
+
+static void setup(uint16_t lr, uint16_t ud, uint16_t btn, uint16_t noise)
+{
+    joystickFilterInit(&filter);
+    joystickFakeSourceInit(&source, &fake);
+    fake.level[JOYSTICK_CH_LR] = lr;
+    fake.level[JOYSTICK_CH_UD] = ud;
+    fake.level[JOYSTICK_CH_BTN] = btn;
+    fake.noise = noise;
+}
+
+static void testReadyAfterFullWindow(void)
+{
+    setup(2048, 1000, 0, 0);
+
+    // Round robin, every channel gets one sample short of the window
+    joystickFakeFeed(&fake, (JOYSTICK_FILTER_DEPTH - 1) * JOYSTICK_CH_COUNT);
+    CHECK_EQ(joystickFilterDrain(&filter, &source), (JOYSTICK_FILTER_DEPTH - 1) * JOYSTICK_CH_COUNT);
+    CHECK(!joystickFilterReady(&filter, JOYSTICK_CH_LR));
+
+    joystickFakeFeed(&fake, JOYSTICK_CH_COUNT);
+    joystickFilterDrain(&filter, &source);
+    CHECK(joystickFilterReady(&filter, JOYSTICK_CH_LR));
+    CHECK(joystickFilterReady(&filter, JOYSTICK_CH_BTN));
+    CHECK_EQ(joystickFilterValue(&filter, JOYSTICK_CH_LR), 2048 * JOYSTICK_FILTER_SCALE);
+    CHECK_EQ(joystickFilterValue(&filter, JOYSTICK_CH_UD), 1000 * JOYSTICK_FILTER_SCALE);
+    CHECK_EQ(filter.samples[JOYSTICK_CH_UD], JOYSTICK_FILTER_DEPTH);
+}
+
+static void testDrainEmptiesSourceAcrossBatches(void)
+{
+    setup(100, 200, 300, 0);
+    joystickFakeFeed(&fake, 1000);
+    CHECK_EQ(joystickFilterDrain(&filter, &source), 1000);
+    CHECK_EQ(fake.pending, 0);
+    CHECK_EQ(joystickFilterDrain(&filter, &source), 0);
+    CHECK_EQ(filter.samples[JOYSTICK_CH_LR] + filter.samples[JOYSTICK_CH_UD] + filter.samples[JOYSTICK_CH_BTN], 1000);
+}
+
+static void testAveragingRemovesNoise(void)
+{
+    const uint16_t level = 1800;
+    const uint16_t noise = 60;
+    uint32_t value = 0;
+    uint32_t low = UINT32_MAX;
+    uint32_t high = 0;
+
+    setup(level, level, 0, noise);
+    joystickFakeFeed(&fake, JOYSTICK_FILTER_DEPTH * JOYSTICK_CH_COUNT);
+    joystickFilterDrain(&filter, &source);
+
+    // Every further sample moves the window by one, the average has to stay close
+    for (int i = 0; i < 500; i++)
+    {
+        joystickFakeFeed(&fake, JOYSTICK_CH_COUNT);
+        joystickFilterDrain(&filter, &source);
+        value = joystickFilterValue(&filter, JOYSTICK_CH_LR);
+        low = value < low ? value : low;
+        high = value > high ? value : high;
+    }
+    CHECK(high - low < noise * JOYSTICK_FILTER_SCALE / 2);
+    CHECK(low > (level - noise / 4) * JOYSTICK_FILTER_SCALE);
+    CHECK(high < (level + noise / 4) * JOYSTICK_FILTER_SCALE);
+}
+
+static void testStepSettlesAfterOneWindow(void)
+{
+    setup(1000, 0, 0, 0);
+    joystickFakeFeed(&fake, JOYSTICK_FILTER_DEPTH * JOYSTICK_CH_COUNT);
+    joystickFilterDrain(&filter, &source);
+
+    fake.level[JOYSTICK_CH_LR] = 3000;
+    joystickFakeFeed(&fake, JOYSTICK_FILTER_DEPTH / 2 * JOYSTICK_CH_COUNT);
+    joystickFilterDrain(&filter, &source);
+    CHECK_EQ(joystickFilterValue(&filter, JOYSTICK_CH_LR), 2000 * JOYSTICK_FILTER_SCALE);
+
+    joystickFakeFeed(&fake, JOYSTICK_FILTER_DEPTH / 2 * JOYSTICK_CH_COUNT);
+    joystickFilterDrain(&filter, &source);
+    CHECK_EQ(joystickFilterValue(&filter, JOYSTICK_CH_LR), 3000 * JOYSTICK_FILTER_SCALE);
+}
+
+static void testDepthRoundsToPowerOfTwo(void)
+{
+    setup(0, 0, 0, 0);
+    joystickFilterSetDepth(&filter, JOYSTICK_CH_UD, 5);
+    CHECK_EQ(filter.depth[JOYSTICK_CH_UD], 4);
+    joystickFilterSetDepth(&filter, JOYSTICK_CH_UD, 0);
+    CHECK_EQ(filter.depth[JOYSTICK_CH_UD], JOYSTICK_FILTER_DEPTH);
+
+    joystickFilterSetDepth(&filter, JOYSTICK_CH_UD, 4);
+    for (int i = 0; i < 4; i++)
+    {
+        joystickFilterPush(&filter, JOYSTICK_CH_UD, 400);
+    }
+    CHECK(joystickFilterReady(&filter, JOYSTICK_CH_UD));
+    CHECK_EQ(joystickFilterValue(&filter, JOYSTICK_CH_UD), 400 * JOYSTICK_FILTER_SCALE);
+}
+
+static void testBadSamplesDropped(void)
+{
+    setup(0, 0, 0, 0);
+    joystickFilterPush(&filter, JOYSTICK_CH_COUNT, 100);
+    joystickFilterPush(&filter, JOYSTICK_CH_LR, JOYSTICK_SAMPLE_MAX + 1);
+    CHECK_EQ(filter.dropped, 2);
+    CHECK_EQ(filter.count[JOYSTICK_CH_LR], 0);
+    CHECK_EQ(joystickFilterValue(&filter, JOYSTICK_CH_LR), 0);
+}
+
+int main(void)
+{
+    RUN_TEST(testReadyAfterFullWindow);
+    RUN_TEST(testDrainEmptiesSourceAcrossBatches);
+    RUN_TEST(testAveragingRemovesNoise);
+    RUN_TEST(testStepSettlesAfterOneWindow);
+    RUN_TEST(testDepthRoundsToPowerOfTwo);
+    RUN_TEST(testBadSamplesDropped);
+    return testResult();
+}
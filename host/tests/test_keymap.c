@@ -0,0 +1,234 @@
+#include <string.h>
+
+#include "keymap.h"
+#include "test.h"
+
+#define KEY_A 0x04
+#define KEY_B 0x05
+#define KEY_1 0x1E
+#define KEY_LEFT_CTRL 0xE0
+#define KEY_LEFT_SHIFT 0xE1
+
+// Positions used below, everything else is left empty
+enum
+{
+    POS_A,
+    POS_B,
+    POS_SHIFT,
+    POS_SHIFTED,
+    POS_MO1,
+    POS_TG2,
+    POS_DF2,
+    POS_DF0,
+    POS_EMPTY,
+    POS_LAST = KEYMAP_KEYS - 1,
+};
+
+static const keyaction_t testKeymap[3][KEYMAP_KEYS] = {
+    {
+        [POS_A] = KC(KEY_A),
+        [POS_B] = KC(KEY_B),
+        [POS_SHIFT] = KC(KEY_LEFT_SHIFT),
+        [POS_SHIFTED] = KM(MOD_SHIFT, KEY_1),
+        [POS_MO1] = MO(1),
+        [POS_TG2] = TG(2),
+        [POS_DF2] = DF(2),
+        [POS_EMPTY] = XXXX,
+        [POS_LAST] = KC(KEY_B),
+    },
+    {
+        [POS_A] = KC(KEY_1),
+        [POS_B] = ____,
+        [POS_SHIFT] = ____,
+        [POS_SHIFTED] = KM(MOD_CTRL | MOD_SHIFT, KEY_A),
+        [POS_MO1] = ____,
+        [POS_EMPTY] = ____,
+    },
+    {
+        [POS_A] = KC(KEY_B),
+        [POS_B] = ____,
+        [POS_MO1] = MO(1),
+        [POS_TG2] = TG(2),
+        [POS_DF0] = DF(0),
+    },
+};
+
+static struct Keymap keymap;
+static struct KeyOutput out[KEYMAP_MAX_OUTPUT];
+
+static uint8_t press(uint8_t key)
+{
+    return keymapProcess(&keymap, key, true, out);
+}
+
+static uint8_t release(uint8_t key)
+{
+    return keymapProcess(&keymap, key, false, out);
+}
+
+static void checkOutput(uint8_t index, uint8_t keycode, bool pressed)
+{
+    CHECK_EQ(out[index].keycode, keycode);
+    CHECK_EQ(out[index].pressed, pressed);
+}
+
+static void testPlainKey(void)
+{
+    keymapInit(&keymap, testKeymap, 3);
+    CHECK_EQ(press(POS_A), 1);
+    checkOutput(0, KEY_A, true);
+    CHECK_EQ(release(POS_A), 1);
+    checkOutput(0, KEY_A, false);
+
+    CHECK_EQ(press(POS_LAST), 1);
+    checkOutput(0, KEY_B, true);
+    CHECK_EQ(press(POS_EMPTY), 0);
+    CHECK_EQ(keymapProcess(&keymap, KEYMAP_KEYS, true, out), 0);
+}
+
+static void testModifierTable(void)
+{
+    for (int keycode = 0; keycode < 256; keycode++)
+    {
+        CHECK_EQ(keymapModifierBit[keycode], keycode >= KEY_LEFT_CTRL && keycode < KEY_LEFT_CTRL + 8 ? 1 << (keycode - KEY_LEFT_CTRL) : 0);
+    }
+
+    // A modifier key is only its bit, there is no separate key event for it
+    keymapInit(&keymap, testKeymap, 3);
+    CHECK_EQ(press(POS_SHIFT), 1);
+    checkOutput(0, KEY_LEFT_SHIFT, true);
+    CHECK_EQ(release(POS_SHIFT), 1);
+    checkOutput(0, KEY_LEFT_SHIFT, false);
+}
+
+static void testShiftedActionOrder(void)
+{
+    keymapInit(&keymap, testKeymap, 3);
+    CHECK_EQ(press(POS_SHIFTED), 2);
+    checkOutput(0, KEY_LEFT_SHIFT, true);
+    checkOutput(1, KEY_1, true);
+    CHECK_EQ(release(POS_SHIFTED), 2);
+    checkOutput(0, KEY_1, false);
+    checkOutput(1, KEY_LEFT_SHIFT, false);
+}
+
+static void testHeldShiftSurvivesShiftedAction(void)
+{
+    keymapInit(&keymap, testKeymap, 3);
+    press(POS_SHIFT);
+    CHECK_EQ(press(POS_SHIFTED), 1);
+    checkOutput(0, KEY_1, true);
+    CHECK_EQ(release(POS_SHIFTED), 1);
+    checkOutput(0, KEY_1, false);
+    CHECK_EQ(keymap.modifierRefs[1], 1);
+
+    CHECK_EQ(release(POS_SHIFT), 1);
+    checkOutput(0, KEY_LEFT_SHIFT, false);
+}
+
+static void testMomentaryLayerFallsThrough(void)
+{
+    keymapInit(&keymap, testKeymap, 3);
+    CHECK_EQ(press(POS_MO1), 0);
+    CHECK_EQ(keymapActiveLayers(&keymap), 0x3);
+    CHECK_EQ(keymapResolve(&keymap, POS_A), KC(KEY_1));
+    // Transparent on layer 1, layer 0 below answers
+    CHECK_EQ(keymapResolve(&keymap, POS_B), KC(KEY_B));
+    // Empty on layer 1 and not transparent, the key does nothing there
+    CHECK_EQ(keymapResolve(&keymap, POS_TG2), ACTION_NONE);
+
+    release(POS_MO1);
+    CHECK_EQ(keymapActiveLayers(&keymap), 0x1);
+    CHECK_EQ(keymapResolve(&keymap, POS_A), KC(KEY_A));
+}
+
+static void testKeysStayLatchedToTheirLayer(void)
+{
+    keymapInit(&keymap, testKeymap, 3);
+    press(POS_MO1);
+    press(POS_A);
+    checkOutput(0, KEY_1, true);
+    release(POS_MO1);
+
+    // Layer 1 is gone, the key still releases what it pressed
+    CHECK_EQ(release(POS_A), 1);
+    checkOutput(0, KEY_1, false);
+
+    // And the other way round, pressed on the base layer and released on layer 1
+    press(POS_SHIFTED);
+    press(POS_MO1);
+    CHECK_EQ(release(POS_SHIFTED), 2);
+    checkOutput(0, KEY_1, false);
+    checkOutput(1, KEY_LEFT_SHIFT, false);
+}
+
+static void testMomentaryCountsHolders(void)
+{
+    keymapInit(&keymap, testKeymap, 3);
+    press(POS_TG2);
+    // The toggled layer has its own MO(1) on this key
+    press(POS_MO1);
+    CHECK_EQ(keymap.momentary[1], 1);
+    CHECK_EQ(keymapActiveLayers(&keymap), 0x7);
+    release(POS_MO1);
+    CHECK_EQ(keymap.momentary[1], 0);
+    // An unmatched release does not wrap the count
+    release(POS_MO1);
+    CHECK_EQ(keymap.momentary[1], 0);
+}
+
+static void testToggleAndDefaultLayers(void)
+{
+    uint32_t changes = 0;
+
+    keymapInit(&keymap, testKeymap, 3);
+    press(POS_TG2);
+    release(POS_TG2);
+    CHECK_EQ(keymapActiveLayers(&keymap), 0x5);
+    CHECK_EQ(keymapResolve(&keymap, POS_A), KC(KEY_B));
+    press(POS_TG2);
+    release(POS_TG2);
+    CHECK_EQ(keymapActiveLayers(&keymap), 0x1);
+
+    // The stack only changes with a layer, lookups do not rebuild it
+    changes = keymap.stats.layerChanges;
+    press(POS_A);
+    release(POS_A);
+    CHECK_EQ(keymap.stats.layerChanges, changes);
+
+    press(POS_DF2);
+    release(POS_DF2);
+    CHECK_EQ(keymap.defaultLayer, 2);
+    CHECK_EQ(keymap.stackDepth, 1);
+    // Layers below the default one are not in the stack, transparent finds nothing
+    CHECK_EQ(keymapResolve(&keymap, POS_B), ACTION_NONE);
+    press(POS_DF0);
+    release(POS_DF0);
+    CHECK_EQ(keymap.defaultLayer, 0);
+}
+
+static void testSmallerTableDropsLayers(void)
+{
+    keymapInit(&keymap, testKeymap, 3);
+    press(POS_DF2);
+    release(POS_DF2);
+    press(POS_TG2);
+    keymapSetActions(&keymap, testKeymap, 2);
+    CHECK_EQ(keymap.defaultLayer, 0);
+    CHECK_EQ(keymap.toggled, 0);
+    CHECK_EQ(keymapActiveLayers(&keymap), 0x1);
+}
+
+int main(void)
+{
+    RUN_TEST(testPlainKey);
+    RUN_TEST(testModifierTable);
+    RUN_TEST(testShiftedActionOrder);
+    RUN_TEST(testHeldShiftSurvivesShiftedAction);
+    RUN_TEST(testMomentaryLayerFallsThrough);
+    RUN_TEST(testKeysStayLatchedToTheirLayer);
+    RUN_TEST(testMomentaryCountsHolders);
+    RUN_TEST(testToggleAndDefaultLayers);
+    RUN_TEST(testSmallerTableDropsLayers);
+    return testResult();
+}
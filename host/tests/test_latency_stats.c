@@ -0,0 +1,91 @@
+#include "latency_stats.h"
+#include "test.h"
+
+#if KVASS_LATENCY_TRACE
+
+static void testBucketLimits(void)
+{
+    const struct LatencyHistogram *h = latencyGetHistogram(LATENCY_SCAN_TO_QUEUE);
+
+    latencyReset();
+    // A limit belongs to the bucket above it
+    latencyRecord(LATENCY_SCAN_TO_QUEUE, 0, 9);
+    latencyRecord(LATENCY_SCAN_TO_QUEUE, 0, 10);
+    latencyRecord(LATENCY_SCAN_TO_QUEUE, 0, 999);
+    latencyRecord(LATENCY_SCAN_TO_QUEUE, 0, 1000);
+    latencyRecord(LATENCY_SCAN_TO_QUEUE, 0, 49999);
+    latencyRecord(LATENCY_SCAN_TO_QUEUE, 0, 50000);
+    latencyRecord(LATENCY_SCAN_TO_QUEUE, 0, 4000000);
+
+    CHECK_EQ(h->buckets[0], 1);
+    CHECK_EQ(h->buckets[1], 1);
+    CHECK_EQ(h->buckets[6], 1);
+    CHECK_EQ(h->buckets[7], 1);
+    CHECK_EQ(h->buckets[LATENCY_BUCKETS - 2], 1);
+    // Last bucket takes everything from the last limit up
+    CHECK_EQ(h->buckets[LATENCY_BUCKETS - 1], 2);
+    CHECK_EQ(h->count, 7);
+}
+
+static void testMinMeanMax(void)
+{
+    const struct LatencyHistogram *h = latencyGetHistogram(LATENCY_SCAN_TO_COMPLETE);
+
+    latencyReset();
+    latencyRecord(LATENCY_SCAN_TO_COMPLETE, 100, 600);
+    latencyRecord(LATENCY_SCAN_TO_COMPLETE, 100, 400);
+    latencyRecord(LATENCY_SCAN_TO_COMPLETE, 100, 1300);
+    CHECK_EQ(h->count, 3);
+    CHECK_EQ(h->minUs, 300);
+    CHECK_EQ(h->maxUs, 1200);
+    CHECK_EQ(h->totalUs / h->count, 666);
+
+    // A zero latency is a real minimum, not an unset one
+    latencyRecord(LATENCY_SCAN_TO_COMPLETE, 5, 5);
+    CHECK_EQ(h->minUs, 0);
+}
+
+static void testClockWrap(void)
+{
+    const struct LatencyHistogram *h = latencyGetHistogram(LATENCY_QUEUE_TO_SEND);
+
+    latencyReset();
+    // Timestamps are the low 32 bits of the clock
+    latencyRecord(LATENCY_QUEUE_TO_SEND, UINT32_MAX - 99, 150);
+    CHECK_EQ(h->maxUs, 250);
+    CHECK_EQ(h->buckets[5], 1);
+}
+
+static void testStagesAndReset(void)
+{
+    latencyReset();
+    latencyRecord(LATENCY_SEND_TO_COMPLETE, 0, 125);
+    CHECK_EQ(latencyGetHistogram(LATENCY_SEND_TO_COMPLETE)->count, 1);
+    CHECK_EQ(latencyGetHistogram(LATENCY_SCAN_TO_QUEUE)->count, 0);
+    CHECK_EQ(latencyGetHistogram(LATENCY_QUEUE_TO_SEND)->count, 0);
+
+    latencyReset();
+    CHECK_EQ(latencyGetHistogram(LATENCY_SEND_TO_COMPLETE)->count, 0);
+    CHECK_EQ(latencyGetHistogram(LATENCY_SEND_TO_COMPLETE)->maxUs, 0);
+    CHECK_EQ(latencyGetHistogram(LATENCY_SEND_TO_COMPLETE)->buckets[4], 0);
+}
+
+int main(void)
+{
+    RUN_TEST(testBucketLimits);
+    RUN_TEST(testMinMeanMax);
+    RUN_TEST(testClockWrap);
+    RUN_TEST(testStagesAndReset);
+    return testResult();
+}
+
+#else
+
+// Tracing is compiled out, there is nothing to test
+int main(void)
+{
+    CHECK(latencyGetHistogram(LATENCY_SCAN_TO_QUEUE) == 0);
+    return testResult();
+}
+
+#endif
@@ -0,0 +1,209 @@
+#include <string.h>
+
+#include "led_render.h"
+#include "lock_state.h"
+#include "test.h"
+
+#define LED_STATUS 0
+#define LED_KEY_A 1
+#define LED_KEY_B 2
+#define LED_COUNT 4
+#define KEY_A 0
+#define KEY_B 5
+#define REACTIVE_US 200000
+#define FRAME_US 16667
+
+static uint8_t keyLeds[KEYMAP_KEYS];
+static struct LedConfig config;
+static struct LedRenderer renderer;
+static struct LedCaptureStrip capture;
+static struct LedInputs inputs;
+static bool failPushes;
+
+static void setup(uint8_t brightness)
+{
+    memset(keyLeds, LED_NONE, sizeof(keyLeds));
+    keyLeds[KEY_A] = LED_KEY_A;
+    keyLeds[KEY_B] = LED_KEY_B;
+    // Past the end of the strip, never drawn
+    keyLeds[KEY_B + 1] = LED_COUNT;
+    config.count = LED_COUNT;
+    config.statusLed = LED_STATUS;
+    config.keyLeds = keyLeds;
+    config.brightness = brightness;
+    config.reactiveUs = REACTIVE_US;
+    ledRendererInit(&renderer, &config);
+    ledCaptureStripInit(&capture);
+    memset(&inputs, 0, sizeof(inputs));
+    inputs.activeLayers = 0x1;
+    failPushes = false;
+}
+
+// What the LED task does each frame, pressed keys are only reported once
+static bool frame(uint32_t nowUs)
+{
+    bool pushed = false;
+
+    if (ledRendererFrame(&renderer, &inputs, nowUs))
+    {
+        pushed = ledRendererPush(&renderer, &capture.strip);
+    }
+    memset(inputs.pressed, 0, sizeof(inputs.pressed));
+    return pushed;
+}
+
+static void checkPixel(uint8_t led, uint8_t r, uint8_t g, uint8_t b)
+{
+    CHECK_EQ(capture.pixels[led].r, r);
+    CHECK_EQ(capture.pixels[led].g, g);
+    CHECK_EQ(capture.pixels[led].b, b);
+}
+
+static void testUnchangedFramesNotPushed(void)
+{
+    setup(255);
+    CHECK(frame(0));
+    CHECK_EQ(capture.pushes, 1);
+    CHECK_EQ(capture.count, LED_COUNT);
+    for (int i = 1; i <= 60; i++)
+    {
+        CHECK(!frame(i * FRAME_US));
+    }
+    CHECK_EQ(capture.pushes, 1);
+    CHECK_EQ(renderer.stats.frames, 61);
+    CHECK_EQ(renderer.stats.clean, 60);
+
+    inputs.locks = LOCK_CAPS;
+    CHECK(frame(61 * FRAME_US));
+    CHECK_EQ(capture.pushes, 2);
+}
+
+static void testStatusColours(void)
+{
+    setup(255);
+    frame(0);
+    checkPixel(LED_STATUS, 0, 0, 0);
+
+    inputs.locks = LOCK_NUM;
+    frame(FRAME_US);
+    checkPixel(LED_STATUS, 0, 0, 48);
+
+    // The highest layer wins over Num Lock
+    inputs.activeLayers = 0x5;
+    frame(2 * FRAME_US);
+    checkPixel(LED_STATUS, 0, 255, 64);
+
+    // Caps Lock wins over everything
+    inputs.locks |= LOCK_CAPS;
+    frame(3 * FRAME_US);
+    checkPixel(LED_STATUS, 255, 255, 255);
+}
+
+static void testKeysGlowInLayerColour(void)
+{
+    setup(255);
+    inputs.activeLayers = 0x3;
+    frame(0);
+    checkPixel(LED_STATUS, 0, 96, 255);
+    // A quarter of the layer colour
+    checkPixel(LED_KEY_A, 0, 24, 64);
+    checkPixel(LED_KEY_B, 0, 24, 64);
+    checkPixel(3, 0, 0, 0);
+}
+
+static void testPressFadesOut(void)
+{
+    uint32_t pushes = 0;
+
+    setup(255);
+    frame(0);
+    inputs.pressed[KEY_A / 32] |= 1u << (KEY_A % 32);
+    frame(FRAME_US);
+    checkPixel(LED_KEY_A, 255, 255, 255);
+    checkPixel(LED_KEY_B, 0, 0, 0);
+
+    frame(FRAME_US + REACTIVE_US / 2);
+    checkPixel(LED_KEY_A, 128, 128, 128);
+
+    // Pushed while fading, quiet again once it is dark
+    pushes = capture.pushes;
+    frame(FRAME_US + REACTIVE_US);
+    checkPixel(LED_KEY_A, 0, 0, 0);
+    CHECK_EQ(capture.pushes, pushes + 1);
+    CHECK(!frame(FRAME_US + REACTIVE_US + FRAME_US));
+}
+
+static void testBrightnessScalesEverything(void)
+{
+    setup(128);
+    inputs.locks = LOCK_CAPS;
+    inputs.pressed[KEY_B / 32] |= 1u << (KEY_B % 32);
+    frame(0);
+    checkPixel(LED_STATUS, 128, 128, 128);
+    checkPixel(LED_KEY_B, 128, 128, 128);
+    // Glow is a quarter of white, then half of that
+    checkPixel(LED_KEY_A, 32, 32, 32);
+}
+
+static bool failingPush(void *ctx, const struct LedRgb *pixels, uint16_t count)
+{
+    return !failPushes && capture.strip.push(ctx, pixels, count);
+}
+
+static void testFailedPushRetried(void)
+{
+    struct LedStrip strip = {
+        .ctx = &capture,
+        .push = failingPush,
+    };
+
+    setup(255);
+    failPushes = true;
+    CHECK(ledRendererFrame(&renderer, &inputs, 0));
+    CHECK(!ledRendererPush(&renderer, &strip));
+    CHECK_EQ(renderer.stats.failed, 1);
+    CHECK_EQ(capture.pushes, 0);
+
+    // Nothing changed, the strip still needs the frame
+    failPushes = false;
+    CHECK(ledRendererFrame(&renderer, &inputs, FRAME_US));
+    CHECK(ledRendererPush(&renderer, &strip));
+    CHECK_EQ(capture.pushes, 1);
+    CHECK(!ledRendererFrame(&renderer, &inputs, 2 * FRAME_US));
+}
+
+static void testFrameAccounting(void)
+{
+    setup(255);
+    ledRendererAccount(&renderer, 100, 2000, FRAME_US);
+    ledRendererAccount(&renderer, 300, FRAME_US + 1, FRAME_US);
+    ledRendererAccount(&renderer, 200, 500, FRAME_US);
+    CHECK_EQ(renderer.stats.totalRenderUs, 600);
+    CHECK_EQ(renderer.stats.maxRenderUs, 300);
+    CHECK_EQ(renderer.stats.maxFrameUs, FRAME_US + 1);
+    CHECK_EQ(renderer.stats.overBudget, 1);
+}
+
+static void testLongStripClamped(void)
+{
+    setup(255);
+    config.count = LED_MAX + 20;
+    config.statusLed = LED_NONE;
+    ledRendererInit(&renderer, &config);
+    CHECK_EQ(renderer.config.count, LED_MAX);
+    frame(0);
+    CHECK_EQ(capture.count, LED_MAX);
+}
+
+int main(void)
+{
+    RUN_TEST(testUnchangedFramesNotPushed);
+    RUN_TEST(testStatusColours);
+    RUN_TEST(testKeysGlowInLayerColour);
+    RUN_TEST(testPressFadesOut);
+    RUN_TEST(testBrightnessScalesEverything);
+    RUN_TEST(testFailedPushRetried);
+    RUN_TEST(testFrameAccounting);
+    RUN_TEST(testLongStripClamped);
+    return testResult();
+}
@@ -0,0 +1,298 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "common_kvass.h"
+#include "gpio_manager.h"
+#include "comms_manager.h"
+#include "matrix_scanner.h"
+#include "host_sim.h"
+#include "test.h"
+
+#define SCAN_PERIOD_US (1000000 / KB_MATRIX_SCAN_RATE_HZ)
+
+static void testScanReportsChangedKeys(void)
+{
+    struct MatrixFakeRegister reg;
+    struct MatrixIo io;
+    struct MatrixScanner scanner;
+    matrix_row_t changes[KB_ROWS];
+
+    matrixFakeIoInit(&io, &reg);
+    matrixScannerInit(&scanner, &io);
+
+    CHECK(!matrixScan(&scanner, changes));
+
+    reg.keys[0] = 0x01;
+    reg.keys[2] = 0x44;
+    reg.keys[4] = 0x40;
+    CHECK(matrixScan(&scanner, changes));
+    CHECK_EQ(changes[0], 0x01);
+    CHECK_EQ(changes[1], 0);
+    CHECK_EQ(changes[2], 0x44);
+    CHECK_EQ(changes[4], 0x40);
+    CHECK_EQ(scanner.state[2], 0x44);
+
+    // Nothing moved, nothing to report
+    CHECK(!matrixScan(&scanner, changes));
+
+    reg.keys[2] = 0x04;
+    CHECK(matrixScan(&scanner, changes));
+    CHECK_EQ(changes[2], 0x40);
+    CHECK_EQ(scanner.state[2], 0x04);
+    CHECK_EQ(scanner.state[0], 0x01);
+}
+
+static void testScanReadsEachColumnOnce(void)
+{
+    struct MatrixFakeRegister reg;
+    struct MatrixIo io;
+    struct MatrixScanner scanner;
+    matrix_row_t changes[KB_ROWS];
+
+    matrixFakeIoInit(&io, &reg);
+    matrixScannerInit(&scanner, &io);
+    reg.keys[1] = MATRIX_COL_MASK;
+
+    matrixScan(&scanner, changes);
+    CHECK_EQ(reg.reads, KB_COLS);
+    // Columns are released once the scan is done
+    CHECK_EQ(reg.selected, -1);
+    CHECK_EQ(changes[1], MATRIX_COL_MASK);
+}
+
+static void testPopLowestWalksColumnsInOrder(void)
+{
+    matrix_row_t bits = 0x52;
+
+    CHECK_EQ(matrixPopLowest(&bits), 1);
+    CHECK_EQ(matrixPopLowest(&bits), 4);
+    CHECK_EQ(matrixPopLowest(&bits), 6);
+    CHECK_EQ(bits, 0);
+}
+
+#define IDLE_AFTER 4
+
+static void testQuietScansArmWake(void)
+{
+    struct MatrixFakeRegister reg;
+    struct MatrixIo io;
+    struct MatrixIdle idle;
+
+    matrixFakeIoInit(&io, &reg);
+    matrixIdleInit(&idle, IDLE_AFTER, SCAN_PERIOD_US);
+
+    for (int i = 0; i < IDLE_AFTER - 1; i++)
+    {
+        CHECK(!matrixIdleUpdate(&idle, true));
+    }
+    // A busy scan starts the count again
+    CHECK(!matrixIdleUpdate(&idle, false));
+    for (int i = 0; i < IDLE_AFTER - 1; i++)
+    {
+        CHECK(!matrixIdleUpdate(&idle, true));
+    }
+    CHECK(matrixIdleUpdate(&idle, true));
+
+    CHECK(matrixIdleEnter(&idle, &io, 1000));
+    CHECK_EQ(idle.state, MATRIX_SCAN_IDLE);
+    CHECK(reg.armed);
+    CHECK(!matrixFakeEdge(&reg));
+}
+
+static void testKeyDuringArmingStaysActive(void)
+{
+    struct MatrixFakeRegister reg;
+    struct MatrixIo io;
+    struct MatrixIdle idle;
+
+    matrixFakeIoInit(&io, &reg);
+    matrixIdleInit(&idle, IDLE_AFTER, SCAN_PERIOD_US);
+    for (int i = 0; i < IDLE_AFTER; i++)
+    {
+        matrixIdleUpdate(&idle, true);
+    }
+
+    // Pressed before the interrupt was enabled, no edge will come for it
+    reg.keys[3] = 0x10;
+    CHECK(!matrixIdleEnter(&idle, &io, 1000));
+    CHECK_EQ(idle.state, MATRIX_SCAN_ACTIVE);
+    CHECK(!reg.armed);
+    CHECK_EQ(idle.quietScans, 0);
+}
+
+static void testEdgeWakesAndCountsSleep(void)
+{
+    struct MatrixFakeRegister reg;
+    struct MatrixIo io;
+    struct MatrixIdle idle;
+    matrix_row_t raw[KB_ROWS];
+
+    matrixFakeIoInit(&io, &reg);
+    matrixIdleInit(&idle, IDLE_AFTER, SCAN_PERIOD_US);
+    for (int i = 0; i < IDLE_AFTER; i++)
+    {
+        matrixIdleUpdate(&idle, true);
+    }
+    CHECK(matrixIdleEnter(&idle, &io, 10000));
+
+    // Any row of any column raises the edge while every column is driven
+    reg.keys[4] = 0x40;
+    CHECK(matrixFakeEdge(&reg));
+    matrixIdleWake(&idle, &io, 60000, 60250);
+
+    CHECK_EQ(idle.state, MATRIX_SCAN_ACTIVE);
+    CHECK(!reg.armed);
+    CHECK(!matrixFakeEdge(&reg));
+    CHECK_EQ(idle.wakeups, 1);
+    CHECK_EQ(idle.lastWakeLatencyUs, 250);
+    CHECK_EQ(idle.idleUs, 50250);
+    CHECK_EQ(idle.scansSaved, 50);
+
+    // The woken scanner reads the key with normal column scans
+    matrixScanRaw(&io, raw);
+    CHECK_EQ(raw[4], 0x40);
+
+    matrixIdleEnter(&idle, &io, 70000);
+    matrixIdleWake(&idle, &io, 0, 71000);
+    CHECK_EQ(idle.wakeups, 2);
+    CHECK_EQ(idle.lastWakeLatencyUs, 0);
+    CHECK_EQ(idle.maxWakeLatencyUs, 250);
+}
+
+static struct EventRing ring;
+static TaskHandle_t commsTask = NULL;
+static struct CommsParameters comms;
+static struct GodParameters god;
+static uint32_t drains = 0;
+
+static void runComms(void *ctx)
+{
+    (void)ctx;
+    drains++;
+    captureTransportAdvance(hostUsbCapture(), (uint32_t)hostClockNow());
+    sendPendingEvents(&comms);
+}
+
+// Everything but the comms task, which only runs when the producer waits for it
+static void scanTick(void)
+{
+    hostClockAdvance(SCAN_PERIOD_US);
+    scanKeys(&god);
+    releaseKeyEvents(&comms);
+    eventRingFlush(&ring);
+}
+
+// Plain keycodes on the default base layer
+static void setTypingKeys(bool pressed)
+{
+    for (uint8_t row = 0; row < 4; row++)
+    {
+        for (uint8_t col = 1; col <= 5; col++)
+        {
+            hostMatrixKey(row, col, pressed);
+        }
+    }
+}
+
+static void setupPipeline(void (*yield)(void *ctx))
+{
+    hostReset();
+    eventRingInit(&ring);
+    memset(&comms, 0, sizeof(comms));
+    comms.commsTask = &commsTask;
+    comms.protocol = USB;
+    comms.commsData.eventRing = &ring;
+    god.commsParameters = &comms;
+    ESP_ERROR_CHECK(initMatrixIo());
+    initKeyProcessing(&comms);
+    initComms(&comms);
+    hostSetYield(yield, NULL);
+    drains = 0;
+}
+
+static void testFullRingWaitsForComms(void)
+{
+    const uint32_t toggles = 5;
+    const uint32_t holdTicks = KB_DEBOUNCE_SAMPLES + 2;
+    uint64_t startUs = 0;
+
+    setupPipeline(runComms);
+
+    // 100 key events with nothing draining, more than ring and backlog hold together
+    startUs = hostClockNow();
+    for (uint32_t t = 0; t < toggles; t++)
+    {
+        setTypingKeys(t % 2 == 0);
+        for (uint32_t i = 0; i < holdTicks; i++)
+        {
+            scanTick();
+        }
+    }
+
+    CHECK(drains > 0);
+    CHECK(ring.deferred > 0);
+    // Woken by the drain, not by the timeout, so no simulated time went by waiting
+    CHECK_EQ(hostClockNow() - startUs, (uint64_t)toggles * holdTicks * SCAN_PERIOD_US);
+    CHECK(comms.commsData.spaceWaiter == NULL);
+
+    sendPendingEvents(&comms);
+    CHECK_EQ(atomic_load(&ring.head), toggles * 20);
+    CHECK_EQ(atomic_load(&ring.tail), toggles * 20);
+}
+
+static uint32_t yields = 0;
+
+// The scan timer fires while the producer waits, the comms task only gets to run after that
+static void tickThenComms(void *ctx)
+{
+    yields++;
+    if (yields == 1)
+    {
+        xTaskNotify(xTaskGetCurrentTaskHandle(), NOTIF_SCAN_MATRIX, eSetBits);
+        return;
+    }
+    runComms(ctx);
+}
+
+static void testScanTickDoesNotEndRingWait(void)
+{
+    const uint32_t holdTicks = KB_DEBOUNCE_SAMPLES + 2;
+    uint32_t notifyValue = 0;
+
+    setupPipeline(tickThenComms);
+    yields = 0;
+
+    // 100 key events, the producer blocks once when ring and backlog are full
+    for (uint32_t t = 0; t < 5; t++)
+    {
+        setTypingKeys(t % 2 == 0);
+        for (uint32_t i = 0; i < holdTicks; i++)
+        {
+            scanTick();
+        }
+    }
+
+    // The tick did not end the wait, a producer spinning on it would never yield again
+    CHECK_EQ(yields, 2);
+    CHECK_EQ(drains, 1);
+    CHECK(ring.deferred > 0);
+
+    // The tick is still there for the task loop, raised once
+    CHECK_EQ(xTaskNotifyWait(0, UINT32_MAX, &notifyValue, 0), pdTRUE);
+    CHECK_EQ(notifyValue, NOTIF_SCAN_MATRIX);
+    CHECK_EQ(xTaskNotifyWait(0, UINT32_MAX, &notifyValue, 0), pdFALSE);
+}
+
+int main(void)
+{
+    RUN_TEST(testScanReportsChangedKeys);
+    RUN_TEST(testScanReadsEachColumnOnce);
+    RUN_TEST(testPopLowestWalksColumnsInOrder);
+    RUN_TEST(testQuietScansArmWake);
+    RUN_TEST(testKeyDuringArmingStaysActive);
+    RUN_TEST(testEdgeWakesAndCountsSleep);
+    RUN_TEST(testFullRingWaitsForComms);
+    RUN_TEST(testScanTickDoesNotEndRingWait);
+    return testResult();
+}
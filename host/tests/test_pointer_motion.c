@@ -0,0 +1,199 @@
+#include "pointer_motion.h"
+#include "test.h"
+
+#define CENTRE 2000
+#define DEADZONE 100
+#define FULL_SCALE 1100
+#define HALF (DEADZONE + (FULL_SCALE - DEADZONE) / 2)
+
+static struct PointerMotion motion;
+
+// One pixel per tick at full deflection
+static void setup(enum PointerCurve curve)
+{
+    struct PointerConfig config = {
+        .curve = curve,
+        .deadzone = DEADZONE,
+        .fullScale = FULL_SCALE,
+        .maxSpeedPps = 1000,
+        .tickHz = 1000,
+    };
+    int32_t rest[POINTER_AXES] = {CENTRE, CENTRE};
+    int16_t out[POINTER_AXES];
+
+    pointerMotionInit(&motion, &config);
+    for (int i = 0; i < POINTER_CALIBRATION_TICKS; i++)
+    {
+        pointerMotionUpdate(&motion, rest, out);
+    }
+}
+
+// Sums what goes out over a number of ticks at one stick position
+static void move(int32_t dx, int32_t dy, int ticks, int32_t total[POINTER_AXES])
+{
+    int32_t input[POINTER_AXES] = {CENTRE + dx, CENTRE + dy};
+    int16_t out[POINTER_AXES];
+
+    total[0] = total[1] = 0;
+    for (int i = 0; i < ticks; i++)
+    {
+        pointerMotionUpdate(&motion, input, out);
+        total[0] += out[0];
+        total[1] += out[1];
+    }
+}
+
+static void testCalibratesBeforeMoving(void)
+{
+    struct PointerConfig config = {
+        .deadzone = DEADZONE,
+        .fullScale = FULL_SCALE,
+        .maxSpeedPps = 1000,
+        .tickHz = 1000,
+    };
+    int32_t input[POINTER_AXES] = {CENTRE + 40, CENTRE - 40};
+    int16_t out[POINTER_AXES];
+
+    pointerMotionInit(&motion, &config);
+    for (int i = 0; i < POINTER_CALIBRATION_TICKS; i++)
+    {
+        CHECK(!motion.calibrated);
+        CHECK(!pointerMotionUpdate(&motion, input, out));
+    }
+    CHECK(motion.calibrated);
+    // Wherever the stick rested is the centre
+    CHECK_EQ(motion.centre[0] >> 4, CENTRE + 40);
+    CHECK_EQ(motion.centre[1] >> 4, CENTRE - 40);
+
+    pointerMotionRecalibrate(&motion);
+    CHECK(!motion.calibrated);
+    CHECK_EQ(motion.calibrationTicks, 0);
+}
+
+static void testSilentAtRest(void)
+{
+    int32_t total[POINTER_AXES];
+    int32_t input[POINTER_AXES] = {CENTRE + DEADZONE, CENTRE};
+    int16_t out[POINTER_AXES] = {1, 1};
+
+    setup(POINTER_CURVE_LINEAR);
+    // Right on the deadzone edge is still rest
+    CHECK(!pointerMotionUpdate(&motion, input, out));
+    CHECK_EQ(out[0], 0);
+    CHECK_EQ(out[1], 0);
+    CHECK(!motion.deflected);
+    move(-60, 60, 1000, total);
+    CHECK_EQ(total[0], 0);
+    CHECK_EQ(total[1], 0);
+}
+
+static void testDeadzoneIsRadial(void)
+{
+    int32_t total[POINTER_AXES];
+
+    setup(POINTER_CURVE_LINEAR);
+    // Inside the deadzone on each axis, outside it diagonally
+    move(80, 80, 1, total);
+    CHECK(motion.deflected);
+    move(DEADZONE - 1, 0, 1, total);
+    CHECK(!motion.deflected);
+}
+
+static void testFullDeflectionSpeed(void)
+{
+    int32_t total[POINTER_AXES];
+
+    setup(POINTER_CURVE_LINEAR);
+    move(FULL_SCALE, 0, 100, total);
+    CHECK_EQ(total[0], 100);
+    CHECK_EQ(total[1], 0);
+
+    // Past full scale is no faster, a diagonal splits the speed between the axes
+    move(-3 * FULL_SCALE, 0, 100, total);
+    CHECK_EQ(total[0], -100);
+    move(FULL_SCALE, FULL_SCALE, 1000, total);
+    CHECK(total[0] >= 706 && total[0] <= 708);
+    CHECK_EQ(total[0], total[1]);
+}
+
+static void testSubPixelCarry(void)
+{
+    int32_t total[POINTER_AXES];
+    int16_t out[POINTER_AXES];
+    int32_t input[POINTER_AXES] = {CENTRE + HALF, CENTRE};
+    int32_t rest[POINTER_AXES] = {CENTRE, CENTRE};
+
+    setup(POINTER_CURVE_LINEAR);
+    // Half a pixel a tick, every other tick sends one
+    CHECK(!pointerMotionUpdate(&motion, input, out));
+    CHECK(pointerMotionUpdate(&motion, input, out));
+    CHECK_EQ(out[0], 1);
+    move(HALF, 0, 98, total);
+    CHECK_EQ(total[0], 49);
+
+    // Back at rest the leftover half pixel is dropped
+    pointerMotionUpdate(&motion, input, out);
+    CHECK_EQ(motion.carry[0], POINTER_ONE / 2);
+    pointerMotionUpdate(&motion, rest, out);
+    CHECK_EQ(motion.carry[0], 0);
+}
+
+static void testCurvesInterpolate(void)
+{
+    int32_t linear[POINTER_AXES];
+    int32_t quadratic[POINTER_AXES];
+    int32_t precision[POINTER_AXES];
+
+    setup(POINTER_CURVE_LINEAR);
+    move(HALF, 0, 1000, linear);
+    setup(POINTER_CURVE_QUADRATIC);
+    move(HALF, 0, 1000, quadratic);
+    setup(POINTER_CURVE_PRECISION);
+    move(HALF, 0, 1000, precision);
+    CHECK_EQ(linear[0], 500);
+    CHECK_EQ(quadratic[0], 250);
+    CHECK_EQ(precision[0], 125);
+
+    // 3/4 of the way from the point at 36/256 to the one at 49/256, without interpolation this is 144
+    setup(POINTER_CURVE_QUADRATIC);
+    move(DEADZONE + 422, 0, 1024, quadratic);
+    CHECK_EQ(quadratic[0], 180);
+
+    // Every curve is full speed at full deflection
+    move(FULL_SCALE, 0, 100, quadratic);
+    CHECK_EQ(quadratic[0], 100);
+}
+
+static void testInvertAndDrift(void)
+{
+    struct PointerConfig config = {
+        .deadzone = DEADZONE,
+        .fullScale = FULL_SCALE,
+        .maxSpeedPps = 1000,
+        .tickHz = 1000,
+        .invert = {false, true},
+    };
+    int32_t total[POINTER_AXES];
+
+    pointerMotionInit(&motion, &config);
+    move(0, 0, POINTER_CALIBRATION_TICKS, total);
+    move(0, FULL_SCALE, 10, total);
+    CHECK_EQ(total[1], -10);
+
+    // The resting centre follows slow drift inside the deadzone, to within the shift's rounding
+    move(50, 0, 2000, total);
+    CHECK((motion.centre[0] >> 4) >= CENTRE + 46);
+    CHECK_EQ(total[0], 0);
+}
+
+int main(void)
+{
+    RUN_TEST(testCalibratesBeforeMoving);
+    RUN_TEST(testSilentAtRest);
+    RUN_TEST(testDeadzoneIsRadial);
+    RUN_TEST(testFullDeflectionSpeed);
+    RUN_TEST(testSubPixelCarry);
+    RUN_TEST(testCurvesInterpolate);
+    RUN_TEST(testInvertAndDrift);
+    return testResult();
+}
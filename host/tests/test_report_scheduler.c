@@ -0,0 +1,202 @@
+#include <string.h>
+
+#include "report_pipeline.h"
+#include "transport_capture.h"
+#include "test.h"
+
+#define KEY_A 0x04
+#define FRAME_US 1000
+
+static struct EventRing ring;
+static struct CaptureTransport capture;
+static struct ReportPipeline pipeline;
+
+static void completed(void *owner, enum ReportType type)
+{
+    (void)owner;
+    reportPipelineComplete(&pipeline, type);
+}
+
+static void setup(void)
+{
+    eventRingInit(&ring);
+    captureTransportInit(&capture, FRAME_US);
+    reportPipelineInit(&pipeline);
+    CHECK(reportPipelineAttach(&pipeline, &capture.transport, completed, NULL));
+    // Attaching resyncs, the empty state it leaves pending is deduplicated here
+    reportPipelineProcess(&pipeline, &ring);
+    memset(&pipeline.scheduler.stats, 0, sizeof(pipeline.scheduler.stats));
+}
+
+static void pushKey(uint8_t keycode, bool pressed)
+{
+    struct InputEvent event = {
+        .type = INPUT_EVENT_KEY,
+        .keycode = keycode,
+        .pressed = pressed,
+    };
+    CHECK(eventRingPushKey(&ring, &event));
+}
+
+static void pushButtons(uint8_t buttons)
+{
+    struct InputEvent event = {
+        .type = INPUT_EVENT_MOUSE,
+        .buttons = buttons,
+    };
+    CHECK(eventRingPushMouse(&ring, &event));
+    eventRingFlush(&ring);
+}
+
+// Host polls once per frame, the comms task drains whenever it is woken
+static void runFrames(uint32_t frames)
+{
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        reportPipelineProcess(&pipeline, &ring);
+        captureTransportAdvance(&capture, capture.nowUs + FRAME_US);
+    }
+}
+
+static void testTapsSurviveFullQueue(void)
+{
+    const uint32_t taps = KEYBOARD_QUEUE_SIZE * 2;
+    const struct CaptureRecord *record = NULL;
+    uint32_t presses = 0;
+    uint32_t releases = 0;
+
+    setup();
+    for (uint32_t i = 0; i < taps; i++)
+    {
+        pushKey(KEY_A, true);
+        pushKey(KEY_A, false);
+    }
+
+    reportPipelineProcess(&pipeline, &ring);
+    CHECK(pipeline.scheduler.drainBlocked);
+    CHECK(eventRingCount(&ring) > 0);
+    CHECK_EQ(pipeline.scheduler.keyboardCount, KEYBOARD_QUEUE_SIZE - 1);
+
+    runFrames(taps * 2 + 2);
+    CHECK(!pipeline.scheduler.drainBlocked);
+    CHECK_EQ(eventRingCount(&ring), 0);
+
+    for (uint32_t i = 0; i < capture.count; i++)
+    {
+        record = captureTransportRecord(&capture, i);
+        presses += record->keyboard.keycode[0] == KEY_A;
+        releases += record->keyboard.keycode[0] == 0;
+    }
+    CHECK_EQ(presses, taps);
+    CHECK_EQ(releases, taps);
+    CHECK(pipeline.scheduler.stats.queueFull > 0);
+}
+
+static void testClicksSurviveFullQueue(void)
+{
+    const uint32_t clicks = MOUSE_QUEUE_SIZE * 3;
+    const struct CaptureRecord *record = NULL;
+    uint32_t downs = 0;
+    uint8_t buttons = 0;
+
+    setup();
+    for (uint32_t i = 0; i < clicks; i++)
+    {
+        pushButtons(1);
+        pushButtons(0);
+    }
+
+    runFrames(clicks * 2 + 2);
+    CHECK_EQ(eventRingCount(&ring), 0);
+    for (uint32_t i = 0; i < capture.count; i++)
+    {
+        record = captureTransportRecord(&capture, i);
+        if (record->type == REPORT_MOUSE && record->mouse.button != buttons)
+        {
+            buttons = record->mouse.button;
+            downs += buttons == 1;
+        }
+    }
+    CHECK_EQ(downs, clicks);
+}
+
+static void testClickStartsItsOwnReport(void)
+{
+    struct ReportScheduler *sched = &pipeline.scheduler;
+    struct InputEvent motion = {
+        .type = INPUT_EVENT_MOUSE,
+        .delta_x = 3,
+        .scan_us = 10,
+        .queue_us = 15,
+    };
+    struct InputEvent click = {
+        .type = INPUT_EVENT_MOUSE,
+        .buttons = 1,
+        .scan_us = 20,
+        .queue_us = 25,
+    };
+
+    setup();
+    CHECK(reportSchedulerApply(sched, &motion));
+    CHECK(reportSchedulerApply(sched, &click));
+    // The motion went out on its own, the click is the first event of the next report
+    CHECK_EQ(sched->stats.merged, 0);
+    CHECK_EQ(sched->mouseCount, 1);
+    CHECK(sched->mouseDirty);
+    CHECK_EQ(sched->mouseScanUs, 20);
+    CHECK_EQ(sched->mouseQueueUs, 25);
+
+    // Motion with the button held joins the click's report
+    motion.buttons = 1;
+    motion.scan_us = 30;
+    CHECK(reportSchedulerApply(sched, &motion));
+    CHECK_EQ(sched->stats.merged, 1);
+    CHECK_EQ(sched->mouseScanUs, 20);
+}
+
+static void testDifferentKeysStillMerge(void)
+{
+    setup();
+    for (uint8_t k = 0; k < 10; k++)
+    {
+        pushKey(KEY_A + k, true);
+    }
+    runFrames(2);
+    CHECK_EQ(capture.count, 1);
+    CHECK_EQ(pipeline.scheduler.stats.merged, 9);
+    CHECK_EQ(pipeline.scheduler.stats.queueFull, 0);
+}
+
+static void testSuspendHoldsReportsUntilResume(void)
+{
+    const struct CaptureRecord *record = NULL;
+
+    setup();
+    reportPipelineSuspend(&pipeline, true);
+    CHECK_EQ(capture.stats.suspends, 1);
+    pushKey(KEY_A, true);
+    pushKey(KEY_A, false);
+    runFrames(5);
+    CHECK_EQ(capture.count, 0);
+    CHECK(pipeline.scheduler.stats.stalled > 0);
+
+    // Resuming pumps on its own, no completion from the transport needed
+    reportPipelineSuspend(&pipeline, false);
+    CHECK_EQ(capture.count, 1);
+    runFrames(3);
+    CHECK_EQ(capture.count, 2);
+    record = captureTransportRecord(&capture, 0);
+    CHECK_EQ(record->keyboard.keycode[0], KEY_A);
+    record = captureTransportRecord(&capture, 1);
+    CHECK_EQ(record->keyboard.keycode[0], 0);
+}
+
+int main(void)
+{
+    RUN_TEST(testTapsSurviveFullQueue);
+    RUN_TEST(testClicksSurviveFullQueue);
+    RUN_TEST(testClickStartsItsOwnReport);
+    RUN_TEST(testDifferentKeysStillMerge);
+    RUN_TEST(testSuspendHoldsReportsUntilResume);
+    return testResult();
+}
@@ -0,0 +1,93 @@
+#include "scan_timing.h"
+#include "test.h"
+
+static void testRateClamped(void)
+{
+    struct ScanTiming timing;
+
+    CHECK_EQ(scanTimingClampRate(10), SCAN_RATE_MIN_HZ);
+    CHECK_EQ(scanTimingClampRate(100000), SCAN_RATE_MAX_HZ);
+    CHECK_EQ(scanTimingClampRate(1000), 1000);
+
+    scanTimingInit(&timing, 0);
+    CHECK_EQ(timing.rateHz, SCAN_RATE_MIN_HZ);
+    CHECK_EQ(timing.targetPeriodUs, 1000000 / SCAN_RATE_MIN_HZ);
+    CHECK_EQ(scanTimingAvgPeriodUs(&timing), 0);
+}
+
+static void testPeriodsMeasured(void)
+{
+    struct ScanTiming timing;
+    const uint32_t periods[] = {1000, 990, 1010, 1000, 1500};
+    uint64_t nowUs = 5000;
+
+    scanTimingInit(&timing, 1000);
+    // The first tick only starts the first period
+    scanTimingTick(&timing, nowUs);
+    CHECK_EQ(timing.periods, 0);
+    for (uint32_t i = 0; i < sizeof(periods) / sizeof(periods[0]); i++)
+    {
+        nowUs += periods[i];
+        scanTimingTick(&timing, nowUs);
+    }
+
+    CHECK_EQ(timing.periods, 5);
+    CHECK_EQ(timing.minPeriodUs, 990);
+    CHECK_EQ(timing.maxPeriodUs, 1500);
+    CHECK_EQ(scanTimingAvgPeriodUs(&timing), 1100);
+    CHECK_EQ(timing.maxJitterUs, 500);
+}
+
+static void testJitterBuckets(void)
+{
+    struct ScanTiming timing;
+    // Early and late both count, bucket N holds misses below 2^N us
+    const uint32_t periods[] = {1000, 1001, 999, 1002, 1003, 996, 1100, 1000 + 5000};
+    const uint32_t expected[SCAN_JITTER_BUCKETS] = {
+        [0] = 1,
+        [1] = 2,
+        [2] = 2,
+        [3] = 1,
+        [7] = 1,
+        [SCAN_JITTER_BUCKETS - 1] = 1,
+    };
+    uint64_t nowUs = 1;
+
+    scanTimingInit(&timing, 1000);
+    scanTimingTick(&timing, nowUs);
+    for (uint32_t i = 0; i < sizeof(periods) / sizeof(periods[0]); i++)
+    {
+        nowUs += periods[i];
+        scanTimingTick(&timing, nowUs);
+    }
+    for (int b = 0; b < SCAN_JITTER_BUCKETS; b++)
+    {
+        CHECK_EQ(timing.jitterHistogram[b], expected[b]);
+    }
+}
+
+static void testRestartSkipsPause(void)
+{
+    struct ScanTiming timing;
+
+    scanTimingInit(&timing, 1000);
+    scanTimingTick(&timing, 1000);
+    scanTimingTick(&timing, 2000);
+
+    // Asleep for a second, that gap is not a scan period
+    scanTimingRestart(&timing);
+    scanTimingTick(&timing, 1002000);
+    scanTimingTick(&timing, 1003000);
+    CHECK_EQ(timing.periods, 2);
+    CHECK_EQ(timing.maxPeriodUs, 1000);
+    CHECK_EQ(timing.maxJitterUs, 0);
+}
+
+int main(void)
+{
+    RUN_TEST(testRateClamped);
+    RUN_TEST(testPeriodsMeasured);
+    RUN_TEST(testJitterBuckets);
+    RUN_TEST(testRestartSkipsPause);
+    return testResult();
+}
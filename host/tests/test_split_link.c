@@ -0,0 +1,225 @@
+#include <string.h>
+
+#include "split_link.h"
+#include "test.h"
+
+#define TICK_US 1000
+
+struct Recorder
+{
+    matrix_row_t last[KB_ROWS];
+    uint32_t states;
+    uint32_t presses;
+    uint32_t releases;
+};
+
+static struct SplitLoopback loop;
+static struct SplitTransport secondaryTransport;
+static struct SplitTransport primaryTransport;
+static struct SplitLink secondary;
+static struct SplitLink primary;
+static struct Recorder recorder;
+static matrix_row_t rows[KB_ROWS];
+static uint32_t nowUs;
+
+// Counts edges of the first key, the primary sees every state the secondary scanned
+static void remoteState(void *ctx, const matrix_row_t remote[KB_ROWS], uint32_t timeUs)
+{
+    struct Recorder *rec = (struct Recorder *)ctx;
+
+    (void)timeUs;
+    rec->presses += (remote[0] & 1) && !(rec->last[0] & 1);
+    rec->releases += !(remote[0] & 1) && (rec->last[0] & 1);
+    memcpy(rec->last, remote, sizeof(rec->last));
+    rec->states++;
+}
+
+static void setup(void)
+{
+    splitLoopbackInit(&loop, &secondaryTransport, &primaryTransport);
+    splitLinkInit(&secondary, SPLIT_ROLE_SECONDARY, &secondaryTransport, 1);
+    splitLinkInit(&primary, SPLIT_ROLE_PRIMARY, &primaryTransport, 2);
+    memset(&recorder, 0, sizeof(recorder));
+    splitLinkSetRemoteHandler(&primary, remoteState, &recorder);
+    memset(rows, 0, sizeof(rows));
+    nowUs = 0;
+}
+
+static void runTicks(uint32_t ticks)
+{
+    for (uint32_t i = 0; i < ticks; i++)
+    {
+        nowUs += TICK_US;
+        loop.nowUs = nowUs;
+        splitLinkPoll(&secondary, nowUs);
+        splitLinkPoll(&primary, nowUs);
+    }
+}
+
+static void setKey(bool pressed)
+{
+    rows[0] = pressed ? 1 : 0;
+    splitLinkSendState(&secondary, rows, nowUs);
+}
+
+static void testTapsArriveOverLossyLink(void)
+{
+    const uint32_t taps = 300;
+
+    setup();
+    loop.lossPercent = 5;
+    loop.reorderPercent = 5;
+    loop.corruptPercent = 5;
+    loop.delayUs = 200;
+    loop.jitterUs = 300;
+    runTicks(20);
+
+    for (uint32_t i = 0; i < taps; i++)
+    {
+        setKey(true);
+        runTicks(3);
+        setKey(false);
+        runTicks(5);
+    }
+    runTicks(500);
+
+    CHECK(loop.lost > 0 && loop.corrupted > 0 && loop.reordered > 0);
+    CHECK_EQ(recorder.presses, taps);
+    CHECK_EQ(recorder.releases, taps);
+    CHECK_EQ(secondary.stats.statesFolded, 0);
+}
+
+// A press and its release in the same stall used to cancel out in the pending frame
+static void testTapsQueueWhileWindowFull(void)
+{
+    const uint32_t taps = 10;
+
+    setup();
+    runTicks(20);
+    CHECK(primary.synced);
+
+    loop.lossPercent = 100;
+    for (uint32_t i = 0; i < taps; i++)
+    {
+        setKey(true);
+        runTicks(1);
+        setKey(false);
+        runTicks(1);
+    }
+    CHECK(secondary.stats.statesQueued > 0);
+    CHECK_EQ(recorder.presses, 0);
+
+    loop.lossPercent = 0;
+    runTicks(600);
+    CHECK_EQ(recorder.presses, taps);
+    CHECK_EQ(recorder.releases, taps);
+    CHECK_EQ(secondary.stateCount, 0);
+}
+
+static void testQueueFoldsIntoNewestWhenFull(void)
+{
+    setup();
+    runTicks(20);
+
+    loop.lossPercent = 100;
+    for (uint32_t i = 0; i < SPLIT_WINDOW + SPLIT_STATE_QUEUE + 4; i++)
+    {
+        setKey(i % 2 == 0);
+    }
+    CHECK_EQ(secondary.stateCount, SPLIT_STATE_QUEUE);
+    CHECK(secondary.stats.statesFolded > 0);
+
+    // Whatever was folded, the last state is the one that sticks
+    setKey(false);
+    loop.lossPercent = 0;
+    runTicks(600);
+    CHECK_EQ(primary.remote[0], 0);
+    CHECK_EQ(recorder.last[0], 0);
+}
+
+static void injectFrame(const uint8_t *payload, size_t length)
+{
+    uint8_t frame[SPLIT_FRAME_MAX];
+    size_t frameLength = splitEncodeFrame(payload, length, frame);
+
+    CHECK(secondaryTransport.send(secondaryTransport.ctx, frame, frameLength));
+}
+
+static void testMalformedDeltaNotApplied(void)
+{
+    uint8_t payload[SPLIT_PAYLOAD_MAX] = {0};
+    uint8_t expected = 0;
+    uint32_t states = 0;
+
+    setup();
+    runTicks(20);
+    expected = primary.expectedSeq;
+    states = recorder.states;
+
+    // Mask says two rows, only one row byte follows
+    payload[0] = SPLIT_FRAME_DELTA;
+    payload[1] = expected;
+    payload[2] = 0x03;
+    payload[7] = 0xFF;
+    injectFrame(payload, 8);
+
+    // Mask bit past the last row
+    payload[2] = 1 << KB_ROWS;
+    injectFrame(payload, 8);
+
+    nowUs += TICK_US;
+    loop.nowUs = nowUs;
+    splitLinkPoll(&primary, nowUs);
+    CHECK_EQ(primary.remote[0], 0);
+    CHECK_EQ(primary.expectedSeq, expected);
+    CHECK_EQ(recorder.states, states);
+}
+
+static void testRetransmitsBackOffWhilePrimaryAbsent(void)
+{
+    uint32_t retransmits = 0;
+
+    setup();
+    runTicks(20);
+    loop.lossPercent = 100;
+    setKey(true);
+    runTicks(SPLIT_LINK_TIMEOUT_MS);
+
+    // One frame in flight, a fixed interval would have sent it every SPLIT_RETRANSMIT_MS
+    retransmits = secondary.stats.retransmits;
+    CHECK(retransmits > 0);
+    CHECK(retransmits < 16);
+    CHECK_EQ(secondary.retransmitUs, SPLIT_RETRANSMIT_MAX_MS * 1000);
+
+    loop.lossPercent = 0;
+    runTicks(SPLIT_RETRANSMIT_MAX_MS + 20);
+    CHECK_EQ(recorder.presses, 1);
+    CHECK_EQ(secondary.retransmitUs, SPLIT_RETRANSMIT_MS * 1000);
+}
+
+static void testLinkDropReleasesRemoteKeys(void)
+{
+    setup();
+    runTicks(20);
+    setKey(true);
+    runTicks(5);
+    CHECK_EQ(primary.remote[0], 1);
+
+    loop.lossPercent = 100;
+    runTicks(SPLIT_LINK_TIMEOUT_MS + 10);
+    CHECK(!primary.synced);
+    CHECK_EQ(primary.remote[0], 0);
+    CHECK_EQ(recorder.releases, 1);
+    CHECK_EQ(primary.stats.linkDrops, 1);
+}
+
+int main(void)
+{
+    RUN_TEST(testTapsArriveOverLossyLink);
+    RUN_TEST(testTapsQueueWhileWindowFull);
+    RUN_TEST(testQueueFoldsIntoNewestWhenFull);
+    RUN_TEST(testMalformedDeltaNotApplied);
+    RUN_TEST(testRetransmitsBackOffWhilePrimaryAbsent);
+    RUN_TEST(testLinkDropReleasesRemoteKeys);
+    return testResult();
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetry.h"
+#include "split_link.h"
+#include "test.h"
+
+#define PAYLOAD (TELEMETRY_SYNC_LENGTH + 2)
+#define SAMPLE_BYTES(tasks) (4 + 4 * TELEMETRY_COUNTERS + 4 * TELEMETRY_GAUGES + 2 * (tasks))
+
+static struct Telemetry t;
+static uint8_t frame[TELEMETRY_FRAME_MAX];
+
+static uint16_t get16(const uint8_t *in)
+{
+    return (uint16_t)(in[0] | in[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *in)
+{
+    return get16(in) | (uint32_t)get16(in + 2) << 16;
+}
+
+static void pushSamples(uint32_t count)
+{
+    struct TelemetrySample sample;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        memset(&sample, 0, sizeof(sample));
+        sample.timeMs = (t.written + 1) * t.periodMs;
+        sample.counters[TELEMETRY_MATRIX_SCANS] = t.written * 1000;
+        sample.gauges[TELEMETRY_HEAP_FREE] = 200000 - t.written;
+        sample.taskPermille[1] = (uint16_t)t.written;
+        telemetryPush(&t, &sample);
+    }
+}
+
+static void testTaskTable(void)
+{
+    char name[TELEMETRY_TASK_NAME];
+
+    telemetryInit(&t, 100);
+    CHECK_EQ(telemetryAddTask(&t, "gpio"), 0);
+    CHECK_EQ(telemetryAddTask(&t, "comms"), 1);
+    CHECK_EQ(telemetryAddTask(&t, "gpio"), 0);
+    // Names are cut to fit, the cut name finds the same slot again
+    CHECK_EQ(telemetryAddTask(&t, "a_very_long_task_name"), 2);
+    CHECK_EQ(strlen(t.taskNames[2]), TELEMETRY_TASK_NAME - 1);
+    CHECK_EQ(telemetryAddTask(&t, "a_very_long_task_name_too"), 2);
+
+    for (int i = t.taskCount; i < TELEMETRY_TASKS; i++)
+    {
+        snprintf(name, sizeof(name), "task%d", i);
+        CHECK_EQ(telemetryAddTask(&t, name), i);
+    }
+    CHECK_EQ(telemetryAddTask(&t, "one more"), -1);
+}
+
+static void testCountersSumCores(void)
+{
+    telemetryInit(&t, 100);
+    telemetryCount(&t, TELEMETRY_KEYBOARD_SENT, 3);
+    telemetryCount(&t, TELEMETRY_KEYBOARD_SENT, 4);
+    t.counters[1][TELEMETRY_KEYBOARD_SENT] = 10;
+    CHECK_EQ(telemetryTotal(&t, TELEMETRY_KEYBOARD_SENT), 17);
+    CHECK_EQ(telemetryTotal(&t, TELEMETRY_MOUSE_SENT), 0);
+}
+
+static void testFrameLayout(void)
+{
+    const uint8_t taskCount = 2;
+    const uint8_t *payload = &frame[PAYLOAD];
+    const uint8_t *sample = NULL;
+    size_t length = 0;
+    uint16_t payloadLength = 0;
+
+    telemetryInit(&t, 250);
+    telemetryAddTask(&t, "gpio");
+    telemetryAddTask(&t, "comms");
+    t.taskStackFree[1] = 1234;
+    pushSamples(3);
+
+    CHECK_EQ(telemetryEncode(&t, frame, sizeof(frame) - 1), 0);
+    length = telemetryEncode(&t, frame, sizeof(frame));
+    payloadLength = get16(&frame[TELEMETRY_SYNC_LENGTH]);
+    CHECK(memcmp(frame, TELEMETRY_SYNC, TELEMETRY_SYNC_LENGTH) == 0);
+    CHECK_EQ(payloadLength, TELEMETRY_HEADER_BYTES + taskCount * (TELEMETRY_TASK_NAME + 4) + 3 * SAMPLE_BYTES(taskCount));
+    CHECK_EQ(length, PAYLOAD + payloadLength + 2);
+    CHECK_EQ(get16(&payload[payloadLength]), splitCrc16(payload, payloadLength));
+
+    // Header
+    CHECK_EQ(payload[0], TELEMETRY_VERSION);
+    CHECK_EQ(payload[1], TELEMETRY_COUNTERS);
+    CHECK_EQ(payload[2], TELEMETRY_GAUGES);
+    CHECK_EQ(payload[3], taskCount);
+    CHECK_EQ(get16(&payload[4]), 250);
+    CHECK_EQ(get16(&payload[6]), 3);
+    CHECK_EQ(get32(&payload[8]), 3);
+    CHECK_EQ(payload[12], TELEMETRY_TASK_NAME);
+
+    // Tasks, names padded to a fixed width
+    CHECK(strcmp((const char *)&payload[TELEMETRY_HEADER_BYTES + TELEMETRY_TASK_NAME + 4], "comms") == 0);
+    CHECK_EQ(get32(&payload[TELEMETRY_HEADER_BYTES + 2 * TELEMETRY_TASK_NAME + 4]), 1234);
+
+    // Samples oldest first, only as many task slots as there are tasks
+    sample = &payload[TELEMETRY_HEADER_BYTES + taskCount * (TELEMETRY_TASK_NAME + 4)];
+    CHECK_EQ(get32(sample), 250);
+    CHECK_EQ(get32(&sample[4 + 4 * TELEMETRY_MATRIX_SCANS]), 0);
+    sample += SAMPLE_BYTES(taskCount);
+    CHECK_EQ(get32(sample), 500);
+    CHECK_EQ(get32(&sample[4 + 4 * TELEMETRY_MATRIX_SCANS]), 1000);
+    CHECK_EQ(get32(&sample[4 + 4 * TELEMETRY_COUNTERS + 4 * TELEMETRY_HEAP_FREE]), 199999);
+    CHECK_EQ(get16(&sample[4 + 4 * TELEMETRY_COUNTERS + 4 * TELEMETRY_GAUGES + 2]), 1);
+}
+
+static void testRingKeepsNewest(void)
+{
+    const uint8_t *payload = &frame[PAYLOAD];
+    const uint8_t *sample = &payload[TELEMETRY_HEADER_BYTES];
+
+    telemetryInit(&t, 100);
+    pushSamples(TELEMETRY_SAMPLES * 2 + 5);
+    CHECK(telemetryEncode(&t, frame, sizeof(frame)) > 0);
+
+    // The slot after the newest sample is left out, it could be mid write
+    CHECK_EQ(get16(&payload[6]), TELEMETRY_SAMPLES - 1);
+    CHECK_EQ(get32(&payload[8]), TELEMETRY_SAMPLES * 2 + 5);
+    CHECK_EQ(get32(sample), (TELEMETRY_SAMPLES + 7) * 100);
+    sample += (TELEMETRY_SAMPLES - 2) * SAMPLE_BYTES(0);
+    CHECK_EQ(get32(sample), (TELEMETRY_SAMPLES * 2 + 5) * 100);
+}
+
+static void testEmptyFrame(void)
+{
+    size_t length = 0;
+
+    telemetryInit(&t, 100);
+    length = telemetryEncode(&t, frame, sizeof(frame));
+    CHECK_EQ(length, PAYLOAD + TELEMETRY_HEADER_BYTES + 2);
+    CHECK_EQ(get16(&frame[PAYLOAD + 6]), 0);
+    CHECK_EQ(get16(&frame[PAYLOAD + TELEMETRY_HEADER_BYTES]), splitCrc16(&frame[PAYLOAD], TELEMETRY_HEADER_BYTES));
+}
+
+int main(void)
+{
+    RUN_TEST(testTaskTable);
+    RUN_TEST(testCountersSumCores);
+    RUN_TEST(testFrameLayout);
+    RUN_TEST(testRingKeepsNewest);
+    RUN_TEST(testEmptyFrame);
+    return testResult();
+}
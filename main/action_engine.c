@@ -0,0 +1,389 @@
+#include <string.h>
+
+#include "action_engine.h"
+
+#define TIMER_DECIDE 0
+#define TIMER_ONESHOT 1
+#define KEY_NONE 0xFF
+
+#define KEY_TEST(map, key) (((map)[(key) >> 3] >> ((key) & 7)) & 1)
+#define KEY_SET(map, key) ((map)[(key) >> 3] |= (uint8_t)(1u << ((key) & 7)))
+#define KEY_CLEAR(map, key) ((map)[(key) >> 3] &= (uint8_t)~(1u << ((key) & 7)))
+
+void actionEngineInit(struct ActionEngine *engine, struct Keymap *keymap, const struct ActionConfig *config, const struct Combo *combos, uint8_t comboCount, ActionEmitFn emit, void *ctx)
+{
+    memset(engine, 0, sizeof(*engine));
+    engine->keymap = keymap;
+    engine->config = *config;
+    engine->combos = combos;
+    engine->comboCount = comboCount;
+    engine->emit = emit;
+    engine->ctx = ctx;
+    engine->oneshotKey = KEY_NONE;
+    timerWheelInit(&engine->wheel, 0);
+
+    for (uint8_t c = 0; c < comboCount; c++)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            if (combos[c].keys[k] < KEYMAP_KEYS)
+            {
+                KEY_SET(engine->comboKeys, combos[c].keys[k]);
+            }
+        }
+    }
+}
+
+// Runs the action through the keymap as if key did it, returns the number of key events sent
+static uint8_t applyAction(struct ActionEngine *engine, const struct InputEvent *source, uint8_t key, keyaction_t action, bool pressed)
+{
+    struct KeyOutput out[KEYMAP_MAX_OUTPUT];
+    struct InputEvent event = *source;
+    uint8_t count = keymapApply(engine->keymap, key, action, pressed, out);
+
+    for (uint8_t k = 0; k < count; k++)
+    {
+        event.keycode = out[k].keycode;
+        event.pressed = out[k].pressed;
+        engine->emit(engine->ctx, &event);
+    }
+    return count;
+}
+
+static void releaseOneshot(struct ActionEngine *engine, const struct InputEvent *source)
+{
+    uint8_t key = engine->oneshotKey;
+
+    engine->oneshotKey = KEY_NONE;
+    engine->oneshotArmed = false;
+    timerWheelCancel(&engine->wheel, TIMER_ONESHOT);
+    applyAction(engine, source, key, ACTION_NONE, false);
+}
+
+// Another key went down, an armed one-shot goes up right after it
+static void useOneshot(struct ActionEngine *engine, const struct InputEvent *source)
+{
+    if (engine->oneshotKey == KEY_NONE)
+    {
+        return;
+    }
+    if (engine->oneshotArmed)
+    {
+        releaseOneshot(engine, source);
+        engine->stats.oneshots++;
+    }
+    else
+    {
+        engine->oneshotUsed = true;
+    }
+}
+
+static void pressAction(struct ActionEngine *engine, const struct ActionQueued *queued, keyaction_t action)
+{
+    uint8_t key = queued->event.position;
+
+    if (ACTION_KIND(action) == ACTION_KIND_ONESHOT_MOD)
+    {
+        if (engine->oneshotKey != KEY_NONE)
+        {
+            releaseOneshot(engine, &queued->event);
+        }
+        engine->oneshotKey = key;
+        engine->oneshotUsed = false;
+        applyAction(engine, &queued->event, key, action, true);
+        return;
+    }
+    if (applyAction(engine, &queued->event, key, action, true) > 0)
+    {
+        useOneshot(engine, &queued->event);
+    }
+}
+
+static void releaseKey(struct ActionEngine *engine, const struct ActionQueued *queued)
+{
+    uint8_t key = queued->event.position;
+    uint8_t peer = 0;
+
+    if (KEY_TEST(engine->consumed, key))
+    {
+        // First combo key up releases the combo, the second one is swallowed
+        KEY_CLEAR(engine->consumed, key);
+        peer = engine->comboPeer[key];
+        if (KEY_TEST(engine->consumed, peer))
+        {
+            applyAction(engine, &queued->event, key < peer ? key : peer, ACTION_NONE, false);
+        }
+        return;
+    }
+    if (key == engine->oneshotKey && !engine->oneshotArmed)
+    {
+        if (!engine->oneshotUsed)
+        {
+            engine->oneshotArmed = true;
+            timerWheelArm(&engine->wheel, TIMER_ONESHOT, queued->timeUs + engine->config.oneshotTimeoutUs);
+            return;
+        }
+        engine->oneshotKey = KEY_NONE;
+    }
+    applyAction(engine, &queued->event, key, ACTION_NONE, false);
+}
+
+static void popFront(struct ActionEngine *engine, uint8_t count)
+{
+    engine->count -= count;
+    memmove(engine->queue, &engine->queue[count], engine->count * sizeof(engine->queue[0]));
+}
+
+static void startPending(struct ActionEngine *engine, uint8_t pending, uint32_t termUs)
+{
+    engine->pending = pending;
+    engine->examined = 1;
+    engine->deadlineForced = engine->config.maxDelayUs < termUs;
+    if (engine->deadlineForced)
+    {
+        termUs = engine->config.maxDelayUs;
+    }
+    timerWheelArm(&engine->wheel, TIMER_DECIDE, engine->queue[0].timeUs + termUs);
+}
+
+// Front event with nothing undecided before it, returns true if it has to wait for a decision
+static bool handleFront(struct ActionEngine *engine)
+{
+    const struct ActionQueued *queued = &engine->queue[0];
+    uint8_t key = queued->event.position;
+    bool comboChecked = engine->comboChecked;
+    keyaction_t action = ACTION_NONE;
+
+    engine->comboChecked = false;
+    if (key >= KEYMAP_KEYS)
+    {
+        return false;
+    }
+    if (!queued->event.pressed)
+    {
+        releaseKey(engine, queued);
+        return false;
+    }
+    if (key == engine->oneshotKey)
+    {
+        releaseOneshot(engine, &queued->event);
+    }
+    if (!comboChecked && KEY_TEST(engine->comboKeys, key))
+    {
+        startPending(engine, ACTION_PENDING_COMBO, engine->config.comboTermUs);
+        return true;
+    }
+
+    action = keymapResolve(engine->keymap, key);
+    if (ACTION_KIND(action) == ACTION_KIND_MOD_TAP || ACTION_KIND(action) == ACTION_KIND_LAYER_TAP)
+    {
+        startPending(engine, ACTION_PENDING_TAP_HOLD, engine->config.tappingTermUs);
+        return true;
+    }
+    pressAction(engine, queued, action);
+    return false;
+}
+
+static void endPending(struct ActionEngine *engine, uint32_t nowUs)
+{
+    uint32_t delay = nowUs - engine->queue[0].timeUs;
+
+    if (delay > engine->stats.maxDelayUs)
+    {
+        engine->stats.maxDelayUs = delay;
+    }
+    engine->pending = ACTION_PENDING_NONE;
+    timerWheelCancel(&engine->wheel, TIMER_DECIDE);
+}
+
+static void decideTapHold(struct ActionEngine *engine, bool hold, uint32_t nowUs)
+{
+    keyaction_t action = keymapResolve(engine->keymap, engine->queue[0].event.position);
+
+    if (!hold)
+    {
+        action = KC(ACTION_KEYCODE(action));
+        engine->stats.taps++;
+    }
+    else
+    {
+        action = ACTION_KIND(action) == ACTION_KIND_MOD_TAP ? KM(ACTION_MODS(action), 0) : MO(ACTION_HOLD_LAYER(action));
+        engine->stats.holds++;
+    }
+    endPending(engine, nowUs);
+    pressAction(engine, &engine->queue[0], action);
+    popFront(engine, 1);
+}
+
+// Both presses are queue[0] and queue[1], they leave the queue together
+static void decideCombo(struct ActionEngine *engine, const struct Combo *combo, uint32_t nowUs)
+{
+    uint8_t first = combo->keys[0], second = combo->keys[1];
+
+    endPending(engine, nowUs);
+    KEY_SET(engine->consumed, first);
+    KEY_SET(engine->consumed, second);
+    engine->comboPeer[first] = second;
+    engine->comboPeer[second] = first;
+    engine->stats.combos++;
+    if (applyAction(engine, &engine->queue[1].event, first < second ? first : second, combo->action, true) > 0)
+    {
+        useOneshot(engine, &engine->queue[1].event);
+    }
+    popFront(engine, 2);
+}
+
+// The key goes through again as an ordinary key, it may still be a tap-hold key
+static void decideNoCombo(struct ActionEngine *engine, uint32_t nowUs)
+{
+    endPending(engine, nowUs);
+    engine->comboChecked = true;
+}
+
+static const struct Combo *findCombo(const struct ActionEngine *engine, uint8_t a, uint8_t b)
+{
+    for (uint8_t c = 0; c < engine->comboCount; c++)
+    {
+        const struct Combo *combo = &engine->combos[c];
+
+        if ((combo->keys[0] == a && combo->keys[1] == b) || (combo->keys[0] == b && combo->keys[1] == a))
+        {
+            return combo;
+        }
+    }
+    return NULL;
+}
+
+static bool pressedBefore(const struct ActionEngine *engine, uint8_t index, uint8_t key)
+{
+    for (uint8_t i = 1; i < index; i++)
+    {
+        if (engine->queue[i].event.position == key && engine->queue[i].event.pressed)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Checks whether queue[index] settles the pending key
+static void evaluate(struct ActionEngine *engine, uint8_t index, uint32_t nowUs)
+{
+    const struct ActionQueued *next = &engine->queue[index];
+    uint8_t key = engine->queue[0].event.position;
+    uint8_t other = next->event.position;
+    const struct Combo *combo = NULL;
+
+    if (engine->pending == ACTION_PENDING_TAP_HOLD)
+    {
+        if (other == key && !next->event.pressed)
+        {
+            decideTapHold(engine, false, nowUs);
+        }
+        else if (next->event.pressed ? engine->config.holdOnOtherPress : (engine->config.permissiveHold && pressedBefore(engine, index, other)))
+        {
+            decideTapHold(engine, true, nowUs);
+        }
+        return;
+    }
+
+    // Only the very next event can complete a combo
+    combo = next->event.pressed ? findCombo(engine, key, other) : NULL;
+    if (combo != NULL)
+    {
+        decideCombo(engine, combo, nowUs);
+    }
+    else
+    {
+        decideNoCombo(engine, nowUs);
+    }
+}
+
+// Handles queued events in order until one has to wait or the queue is empty
+static void drain(struct ActionEngine *engine, uint32_t nowUs)
+{
+    while (engine->count > 0)
+    {
+        if (engine->pending == ACTION_PENDING_NONE)
+        {
+            if (!handleFront(engine))
+            {
+                popFront(engine, 1);
+            }
+        }
+        else if (engine->examined < engine->count)
+        {
+            evaluate(engine, engine->examined++, nowUs);
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+// Timeout, latency bound or full queue, the key is still down so tap-hold becomes a hold
+static void forceDecision(struct ActionEngine *engine, uint32_t nowUs)
+{
+    if (engine->pending == ACTION_PENDING_TAP_HOLD)
+    {
+        decideTapHold(engine, true, nowUs);
+    }
+    else if (engine->pending == ACTION_PENDING_COMBO)
+    {
+        decideNoCombo(engine, nowUs);
+    }
+    drain(engine, nowUs);
+}
+
+// Takes one position event, timeUs is when it happened
+void actionEngineProcess(struct ActionEngine *engine, const struct InputEvent *event, uint32_t timeUs)
+{
+    struct ActionQueued queued = {
+        .event = *event,
+        .timeUs = timeUs,
+    };
+
+    // Anything that timed out before this event is decided first
+    actionEngineTick(engine, timeUs);
+    if (engine->count == ACTION_QUEUE_SIZE)
+    {
+        engine->stats.forced++;
+        forceDecision(engine, timeUs);
+    }
+    engine->queue[engine->count++] = queued;
+    drain(engine, timeUs);
+}
+
+void actionEngineTick(struct ActionEngine *engine, uint32_t nowUs)
+{
+    uint8_t expired[TIMER_WHEEL_TIMERS];
+    uint8_t count = timerWheelAdvance(&engine->wheel, nowUs, expired);
+    struct InputEvent source = {
+        .type = INPUT_EVENT_KEY,
+        .scan_us = nowUs,
+    };
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (expired[i] == TIMER_DECIDE && engine->pending != ACTION_PENDING_NONE)
+        {
+            if (engine->deadlineForced)
+            {
+                engine->stats.forced++;
+            }
+            forceDecision(engine, nowUs);
+        }
+        else if (expired[i] == TIMER_ONESHOT && engine->oneshotArmed)
+        {
+            source.position = engine->oneshotKey;
+            releaseOneshot(engine, &source);
+        }
+    }
+}
+
+// True while a decision or an armed one-shot still needs the tick
+bool actionEnginePending(const struct ActionEngine *engine)
+{
+    return engine->pending != ACTION_PENDING_NONE || engine->oneshotArmed;
+}
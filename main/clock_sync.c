@@ -0,0 +1,97 @@
+#include <string.h>
+
+#include "clock_sync.h"
+
+#define DRIFT_LIMIT (CLOCK_SYNC_DRIFT_MAX_PPM * 256)
+
+void clockSyncInit(struct ClockSync *clock)
+{
+    memset(clock, 0, sizeof(*clock));
+}
+
+static int64_t predictOffset(const struct ClockSync *clock, uint32_t localUs)
+{
+    int32_t elapsed = (int32_t)(localUs - clock->lastUs);
+    return clock->offset + (int64_t)clock->drift * elapsed / 1000000;
+}
+
+// Returns true if the sample was used, congested round trips are dropped
+bool clockSyncSample(struct ClockSync *clock, uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4)
+{
+    int32_t rtt = (int32_t)(t4 - t1) - (int32_t)(t3 - t2);
+    int64_t measured = 0, error = 0;
+    int32_t elapsed = 0;
+
+    if (rtt < 0)
+    {
+        rtt = 0;
+    }
+    clock->lastRttUs = (uint32_t)rtt;
+    if ((uint32_t)rtt > clock->maxRttUs)
+    {
+        clock->maxRttUs = (uint32_t)rtt;
+    }
+
+    // Queueing only ever adds delay, so the fastest round trips are the most symmetric
+    if (clock->synced && (uint32_t)rtt > clock->minRttUs * 2 + CLOCK_SYNC_RTT_SLACK_US)
+    {
+        clock->rejected++;
+        if (++clock->rejectsInRow < CLOCK_SYNC_MAX_REJECTS)
+        {
+            return false;
+        }
+        // Path got slower for good, start trusting it
+        clock->minRttUs = (uint32_t)rtt;
+    }
+    clock->rejectsInRow = 0;
+    if (!clock->synced || (uint32_t)rtt < clock->minRttUs)
+    {
+        clock->minRttUs = (uint32_t)rtt;
+    }
+
+    measured = ((int64_t)(int32_t)(t2 - t1) + (int32_t)(t3 - t4)) * 128;
+
+    if (!clock->synced)
+    {
+        clock->offset = measured;
+        clock->lastUs = t4;
+        clock->samples = 1;
+        clock->synced = true;
+        return true;
+    }
+
+    elapsed = (int32_t)(t4 - clock->lastUs);
+    error = measured - predictOffset(clock, t4);
+    clock->offset = predictOffset(clock, t4) + error / (1 << CLOCK_SYNC_OFFSET_SHIFT);
+    clock->lastUs = t4;
+
+    if (elapsed > 0 && clock->samples >= 2)
+    {
+        clock->drift += (int32_t)(error * 1000000 / elapsed / (1 << CLOCK_SYNC_DRIFT_SHIFT));
+        clock->drift = clock->drift > DRIFT_LIMIT ? DRIFT_LIMIT : (clock->drift < -DRIFT_LIMIT ? -DRIFT_LIMIT : clock->drift);
+    }
+    clock->samples++;
+
+    clock->lastSkewUs = (int32_t)(error / 256);
+    if ((uint32_t)(clock->lastSkewUs < 0 ? -clock->lastSkewUs : clock->lastSkewUs) > clock->maxSkewUs)
+    {
+        clock->maxSkewUs = (uint32_t)(clock->lastSkewUs < 0 ? -clock->lastSkewUs : clock->lastSkewUs);
+    }
+    return true;
+}
+
+// Remote minus local clock in us at the given local time
+int32_t clockSyncOffsetAt(const struct ClockSync *clock, uint32_t localUs)
+{
+    return (int32_t)(predictOffset(clock, localUs) / 256);
+}
+
+// Moves a remote timestamp to the local clock, nowUs is a local time close to it
+uint32_t clockSyncToLocal(const struct ClockSync *clock, uint32_t remoteUs, uint32_t nowUs)
+{
+    if (!clock->synced)
+    {
+        return nowUs;
+    }
+    return remoteUs - (uint32_t)clockSyncOffsetAt(clock, nowUs);
+}
@@ -1,105 +1,104 @@
+#include <string.h>
 #include "esp_log.h"
 
 #include "common_utils.h"
 
-Node *createnode(uint8_t data)
+void keySetClear(KeySet *set)
 {
-    Node *newNode = malloc(sizeof(Node));
-    if (!newNode)
-    {
-        return NULL;
-    }
-    newNode->data = data;
-    newNode->next = NULL;
-    return newNode;
+    memset(set, 0, sizeof(KeySet));
 }
 
-List *makeLinkedList()
+bool keySetContains(uint8_t key, const KeySet *set)
 {
-    List *list = malloc(sizeof(List));
-    if (!list)
-    {
-        return NULL;
-    }
-    list->head = NULL;
-    return list;
+    return (set->bits[key >> 5] >> (key & 31)) & 1;
 }
 
-void addLLElement(uint8_t data, List *list)
+bool keySetAdd(uint8_t key, KeySet *set)
 {
-    Node *current = NULL;
-    if (list->head == NULL)
+    if (keySetContains(key, set))
+    {
+        return false;
+    }
+    set->bits[key >> 5] |= 1u << (key & 31);
+
+    if (key >= KEYSET_MODIFIER_FIRST)
     {
-        list->head = createnode(data);
+        return true;
+    }
+    // Keys pressed while the order is full are only in the bitmap until a slot frees up
+    if (set->orderCount < KEYSET_ORDER_SIZE)
+    {
+        set->order[set->orderCount++] = key;
     }
     else
     {
-        current = list->head;
-        while (current->next != NULL)
-        {
-            current = current->next;
-        }
-        current->next = createnode(data);
+        set->unordered++;
     }
+    return true;
+}
+
+static bool keySetOrdered(uint8_t key, const KeySet *set)
+{
+    return memchr(set->order, key, set->orderCount) != NULL;
 }
 
-void deleteLLElement(uint8_t data, List *list)
+// Their press order is lost, the lowest keycode that is waiting gets the slot
+static void keySetBackfill(KeySet *set)
 {
-    Node *current = list->head;
-    Node *previous = current;
-    while (current != NULL)
+    uint32_t word = 0;
+    uint8_t key = 0;
+
+    for (int w = 0; w < (KEYSET_MODIFIER_FIRST >> 5); w++)
     {
-        if (current->data == data)
+        word = set->bits[w];
+        while (word)
         {
-            previous->next = current->next;
-            if (current == list->head)
-                list->head = current->next;
-            free(current);
-            return;
+            key = (uint8_t)((w << 5) + __builtin_ctz(word));
+            word &= word - 1;
+            if (!keySetOrdered(key, set))
+            {
+                set->order[set->orderCount++] = key;
+                set->unordered--;
+                return;
+            }
         }
-        previous = current;
-        current = current->next;
     }
 }
 
-bool existsInLL(uint8_t data, List *list)
+bool keySetRemove(uint8_t key, KeySet *set)
 {
-    Node *current = list->head;
-    while (current != NULL)
+    if (!keySetContains(key, set))
+    {
+        return false;
+    }
+    set->bits[key >> 5] &= ~(1u << (key & 31));
+
+    if (key >= KEYSET_MODIFIER_FIRST)
+    {
+        return true;
+    }
+    for (int i = 0; i < set->orderCount; i++)
     {
-        if (current->data == data)
+        if (set->order[i] == key)
         {
+            memmove(&set->order[i], &set->order[i + 1], set->orderCount - i - 1);
+            set->orderCount--;
+            if (set->unordered)
+            {
+                keySetBackfill(set);
+            }
             return true;
         }
-        current = current->next;
     }
-    return false;
+    set->unordered--;
+    return true;
 }
 
-void reverseLinkedList(List *list)
+uint8_t keySetOldest(uint8_t *keys, uint8_t count, const KeySet *set)
 {
-    Node *reversed = NULL;
-    Node *current = list->head;
-    Node *temp = NULL;
-    while (current != NULL)
-    {
-        temp = current;
-        current = current->next;
-        temp->next = reversed;
-        reversed = temp;
-    }
-    list->head = reversed;
-}
+    uint8_t n = set->orderCount < count ? set->orderCount : count;
 
-void destroyLinkedList(List *list)
-{
-    Node *current = list->head;
-    Node *next = current;
-    while (current != NULL)
-    {
-        next = current->next;
-        free(current);
-        current = next;
-    }
-    free(list);
+    memcpy(keys, set->order, n);
+    memset(keys + n, 0, count - n);
+    return n;
 }
\ No newline at end of file
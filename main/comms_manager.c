@@ -1,257 +1,327 @@
+#include <string.h>
+#include <inttypes.h>
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "tinyusb.h"
-#include "class/hid/hid_device.h"
-#include "tusb_cdc_acm.h"
-#include "tusb_console.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
 
 #include "common_kvass.h"
 #include "comms_manager.h"
+#include "latency_stats.h"
+#include "event_ring.h"
+#include "report_pipeline.h"
+#include "transport_usb.h"
+#include "transport_espnow.h"
+#include "espnow_radio.h"
+#include "config_manager.h"
+#include "led_manager.h"
+#include "display_manager.h"
+#include "telemetry_manager.h"
+#include "dlog_manager.h"
+#include "keymap_store.h"
 
-/* A combination of interfaces must have a unique product id, since PC will save device driver after the first plug.
- * Same VID/PID with different interface e.g MSC (first), then CDC (later) will possibly cause system error on PC.
- *
- * Auto ProductID layout's Bitmap:
- *   [MSB]         HID | MSC | CDC          [LSB]
- */
-#define _PID_MAP(itf, n) ((CFG_TUD_##itf) << (n))
-#define USB_PID (0x4000 | _PID_MAP(CDC, 0) | _PID_MAP(HID, 1) | _PID_MAP(VENDOR, 2))
-#define USB_VID 0x303a
-#define USB_BCD 0x200
+const char *TAG_COMMS = "comms";
 
-#define TUSB_DESC_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN + TUD_CDC_DESC_LEN)
+static TaskHandle_t commsTask = NULL;
+static struct CommsParameters *comms = NULL;
+static struct ReportPipeline pipeline = {0};
+static SemaphoreHandle_t pipelineLock = NULL;
+static volatile char consoleCommand = 0;
+static volatile bool hostSuspended = false;
 
-const char *TAG_COMMS = "comms";
+// Time from protocol change to the new transport taking reports
+static uint32_t lastSwitchUs = 0;
+static uint32_t maxSwitchUs = 0;
 
-const uint8_t hid_report_descriptor[] = {
-    TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(HID_ITF_PROTOCOL_KEYBOARD)),
-    TUD_HID_REPORT_DESC_MOUSE(HID_REPORT_ID(HID_ITF_PROTOCOL_MOUSE))};
+static bool idleInit(void *ctx, TransportCompleteFn complete, void *owner)
+{
+    return true;
+}
 
-tusb_desc_device_t const desc_device =
-    {
-        .bLength = sizeof(tusb_desc_device_t),
-        .bDescriptorType = TUSB_DESC_DEVICE,
-        .bcdUSB = USB_BCD,
-        .bDeviceClass = 0x00,
-        .bDeviceSubClass = 0x00,
-        .bDeviceProtocol = 0x00,
-        .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
-
-        .idVendor = USB_VID,
-        .idProduct = USB_PID,
-        .bcdDevice = 0x0100,
-
-        .iManufacturer = 0x01,
-        .iProduct = 0x02,
-        .iSerialNumber = 0x03,
-
-        .bNumConfigurations = 0x01};
-
-const char *hid_string_descriptor[6] = {
-    // array of pointer to string descriptors
-    (char[]){0x09, 0x04},        // 0: supported language is English (0x0409)
-    "RKBoard",                   // 1: Manufacturer
-    "RKBoard v1.0",              // 2: Product
-    "C0FFEE",                    // 3: Serials, should use chip ID
-    "Split keyboard with mouse", // 4: HID
-    "RKBoard debug"              // 5: CDC debug channel
-};
-
-enum
+static bool idleConnected(void *ctx)
 {
-    ITF_NUM_CDC = 0,
-    ITF_NUM_CDC_DATA,
-    ITF_HID,
-    ITF_TOTAL,
-};
+    return false;
+}
 
-static const uint8_t hid_configuration_descriptor[] = {
-    // Configuration number, interface count, string index, total length, attribute, power in mA
-    TUD_CONFIG_DESCRIPTOR(1, ITF_TOTAL, 0, TUSB_DESC_TOTAL_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 200),
+static bool idleReady(void *ctx, enum ReportType type)
+{
+    return false;
+}
 
-    // Interface number, string index, boot protocol, report descriptor len, EP In address, size & polling interval
-    TUD_HID_DESCRIPTOR(ITF_HID, 4, HID_ITF_PROTOCOL_NONE, sizeof(hid_report_descriptor), 0x81, 64, 5),
+static bool idleSendKeyboard(void *ctx, const struct KeyboardData *data)
+{
+    return false;
+}
 
-    // Interface number, string index, EP notification address and size, EP data address (out, in) and size.
-    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 5, 0x83, 8, 0x04, 0x84, 64),
-};
+static bool idleSendPointer(void *ctx, const struct MouseData *data)
+{
+    return false;
+}
 
-uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance)
+static void idleSuspend(void *ctx, bool suspended)
 {
-    // We use only one interface and one HID report descriptor, so we can ignore parameter 'instance'
-    return hid_report_descriptor;
 }
 
-uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t *buffer, uint16_t reqlen)
+static void idleDeinit(void *ctx)
 {
-    (void)instance;
-    (void)report_id;
-    (void)report_type;
-    (void)buffer;
-    (void)reqlen;
+}
+
+// Protocols without a link yet, events are drained and dropped so the ring never fills
+#define IDLE_TRANSPORT(transportName)        \
+    {                                        \
+        .name = transportName,               \
+        .ctx = NULL,                         \
+        .init = idleInit,                    \
+        .connected = idleConnected,          \
+        .ready = idleReady,                  \
+        .sendKeyboard = idleSendKeyboard,    \
+        .sendPointer = idleSendPointer,      \
+        .suspend = idleSuspend,              \
+        .deinit = idleDeinit,                \
+    }
+
+static const struct Transport bluetoothTransport = IDLE_TRANSPORT("Bluetooth");
+static const struct Transport noneTransport = IDLE_TRANSPORT("no");
 
-    return 0;
+static const struct Transport *getTransport(enum CommsProtocol protocol)
+{
+    switch (protocol)
+    {
+    case USB:
+        return getUsbTransport();
+    case BLUETOOTH:
+        return &bluetoothTransport;
+    case ESPNOW:
+        return getEspnowTransport();
+    default:
+        return &noneTransport;
+    }
 }
 
-void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const *buffer, uint16_t bufsize)
+// Runs in the transport's own task, e.g. TinyUSB, pipeline calls are serialised here
+static void transportComplete(void *owner, enum ReportType type)
 {
-    ESP_LOGI(TAG_COMMS, "Set report: instance: %d, report_id: %d, report_type: %d, buffer: %d, bufsize: %d", instance, report_id, report_type, buffer[0], bufsize);
+    bool blocked = false;
+
+    xSemaphoreTake(pipelineLock, portMAX_DELAY);
+    reportPipelineComplete(&pipeline, type);
+    blocked = pipeline.scheduler.drainBlocked;
+    xSemaphoreGive(pipelineLock);
+
+    // Events left in the ring for a full queue fit now that a report went out
+    if (blocked)
+    {
+        xTaskNotify(commsTask, NOTIF_HID_CHANGED, eSetBits);
+    }
 }
 
-void doUSBCommunication(struct GodParameters *godParameters)
+// Held keys are released on the old transport and sent again on the new one
+static void attachTransport(enum CommsProtocol protocol)
 {
-    BaseType_t xResult;
-    uint32_t notifyValue = 0;
-    struct MouseData mouseData = {0};
-    struct KeyboardData kbData = {0};
-    struct CommsParameters *commsParams = (struct CommsParameters *)godParameters->commsParameters;
-    ESP_LOGI(TAG_COMMS, "USB communication selected");
-
-    // Setup HID config
-    const tinyusb_config_t tusb_cfg = {
-        .device_descriptor = &desc_device,
-        .string_descriptor = hid_string_descriptor,
-        .string_descriptor_count = sizeof(hid_string_descriptor) / sizeof(hid_string_descriptor[0]),
-        .external_phy = false,
-        .configuration_descriptor = hid_configuration_descriptor,
-    };
-    ESP_ERROR_CHECK(tinyusb_driver_install(&tusb_cfg));
-
-    // Setup CDC config
-    tinyusb_config_cdcacm_t acm_cfg = {0};
-    ESP_ERROR_CHECK(tusb_cdc_acm_init(&acm_cfg));
-
-    // Init CDC console
-    esp_tusb_init_console(TINYUSB_CDC_ACM_0);
-
-    vTaskDelay(pdMS_TO_TICKS(10));
-    ESP_LOGI(TAG_COMMS, "USB initialization DONE");
-
-    // Send data to host device
-    while (1)
+    const struct Transport *transport = getTransport(protocol);
+    uint32_t startUs = (uint32_t)esp_timer_get_time();
+    bool attached = false;
+
+    if (pipeline.transport == transport)
     {
-        xResult = xTaskNotifyWait(pdFALSE,      /* Don't clear bits on entry. */
-                                  UINT32_MAX,   /* Clear bits on exit. */
-                                  &notifyValue, /* Stores the notified value. */
-                                  portMAX_DELAY);
-        // If protocol changed, break out
-        if (xResult == pdTRUE && (notifyValue & NOTIF_PROTOCOL_CHANGED) != 0)
-        {
-            break;
-        }
+        return;
+    }
 
-        // Check if we can communicate
-        if (tud_mounted())
-        {
-            // block unitl HID has data
-            if (xResult == pdTRUE && (notifyValue & NOTIF_KEYB_CHANGED) != 0)
-            {
-                xResult = xQueueReceive(commsParams->commsData.keyboardQueue, &kbData, 10);
-                if (xResult == pdTRUE)
-                {
-                    tud_hid_keyboard_report(
-                        HID_ITF_PROTOCOL_KEYBOARD,
-                        kbData.modifier,
-                        kbData.keycode);
-
-                    // ESP_LOGI(TAG_COMMS, "Sent keyboard report!");
-                    // ESP_LOGI(TAG_COMMS, "Keyboard mod: %d, buffer: ", kbData.modifier);
-                    // for (int i = 0; i < KB_BUFFER_SIZE; i++)
-                    // {
-                    //     printf("%u", kbData.keycode[i]);
-                    // }
-                    // printf("\n");
-                }
-            }
-            else if (xResult == pdTRUE && (notifyValue & NOTIF_MOUSE_CHANGED) != 0)
-            {
-                xResult = xQueueReceive(commsParams->commsData.mouseQueue, &mouseData, 10);
-                if (xResult == pdTRUE)
-                {
-                    tud_hid_mouse_report(
-                        HID_ITF_PROTOCOL_MOUSE,
-                        mouseData.button,
-                        mouseData.delta_x,
-                        mouseData.delta_y,
-                        mouseData.scroll_vertical,
-                        mouseData.scroll_horizontal);
-
-                    // ESP_LOGI(TAG_COMMS, "Sent mouse report!");
-                    // ESP_LOGI(TAG_COMMS, "Mouse button: %d, x: %d, y:, %d",
-                    //          mouseData.button,
-                    //          mouseData.delta_x,
-                    //          mouseData.delta_y);
-                }
-            }
-        }
+    xSemaphoreTake(pipelineLock, portMAX_DELAY);
+    attached = reportPipelineAttach(&pipeline, transport, transportComplete, NULL);
+    if (attached)
+    {
+        reportSchedulerPump(&pipeline.scheduler);
     }
+    xSemaphoreGive(pipelineLock);
 
-    // Close USB
-    ESP_ERROR_CHECK(tinyusb_driver_uninstall());
+    lastSwitchUs = (uint32_t)esp_timer_get_time() - startUs;
+    if (lastSwitchUs > maxSwitchUs)
+    {
+        maxSwitchUs = lastSwitchUs;
+    }
+    if (!attached)
+    {
+        ESP_LOGE(TAG_COMMS, "%s transport failed to start", transport->name);
+        return;
+    }
+    ESP_LOGI(TAG_COMMS, "%s communication selected in %" PRIu32 " us", transport->name, lastSwitchUs);
+    if (lastSwitchUs > COMMS_SWITCH_BUDGET_US)
+    {
+        ESP_LOGW(TAG_COMMS, "Protocol switch took longer than %d us", COMMS_SWITCH_BUDGET_US);
+    }
 }
 
-void doBluetoothCommunication(struct GodParameters *godParameters)
+// Switches for this boot only, the comms task does the switch
+static void switchProtocol(enum CommsProtocol protocol)
 {
-    BaseType_t xResult;
-    uint32_t notifyValue = 0;
-    struct CommsParameters *commsParams = (struct CommsParameters *)godParameters->commsParameters;
+    comms->protocol = protocol;
+    xTaskNotify(commsTask, NOTIF_PROTOCOL_CHANGED, eSetBits);
+}
 
-    ESP_LOGI(TAG_COMMS, "Bluetooth communication selected");
-    while (1)
+// Can be called from any task. The choice survives a reset unless it has no link, booting into one would leave the keyboard dead
+void commsSetProtocol(enum CommsProtocol protocol)
+{
+    if (protocol == USB || protocol == ESPNOW)
     {
-        xResult = xTaskNotifyWait(pdFALSE,                /* Don't clear bits on entry. */
-                                  NOTIF_PROTOCOL_CHANGED, /* Clear notif bit on exit. */
-                                  &notifyValue,           /* Stores the notified value. */
-                                  portMAX_DELAY);
-        if (xResult == pdPASS && (notifyValue & NOTIF_PROTOCOL_CHANGED) != 0)
-        {
-            break;
-        }
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        setDefaultProtocol(protocol);
     }
+    switchProtocol(protocol);
 }
 
-void doESPNOWCommunication(struct GodParameters *godParameters)
+// Called from the USB stack when the bus sleeps or wakes, the comms task applies it
+void commsHostSuspend(bool suspended)
 {
-    BaseType_t xResult;
-    uint32_t notifyValue = 0;
-    struct CommsParameters *commsParams = (struct CommsParameters *)godParameters->commsParameters;
+    hostSuspended = suspended;
+    xTaskNotify(commsTask, NOTIF_HOST_SUSPEND, eSetBits);
+}
 
-    ESP_LOGI(TAG_COMMS, "ESPNOW communication selected");
-    while (1)
+// A sleeping USB bus only holds reports back while USB carries them
+static void applyHostSuspend(void)
+{
+    xSemaphoreTake(pipelineLock, portMAX_DELAY);
+    reportPipelineSuspend(&pipeline, hostSuspended && pipeline.transport == getUsbTransport());
+    xSemaphoreGive(pipelineLock);
+}
+
+// Called from the console transport once a keymap upload has ended, either way
+void commsKeymapUploaded(void)
+{
+    xTaskNotify(commsTask, NOTIF_KEYMAP_UPLOAD, eSetBits);
+}
+
+// Writing flash takes a while, reports queue up meanwhile and nothing is lost
+static void applyKeymapUpload(void)
+{
+    struct KeymapStoreStats stats;
+    esp_err_t err = keymapUploadApply();
+
+    getKeymapStoreStats(&stats);
+    if (err == ESP_OK)
     {
-        xResult = xTaskNotifyWait(pdFALSE,                /* Don't clear bits on entry. */
-                                  NOTIF_PROTOCOL_CHANGED, /* Clear notif bit on exit. */
-                                  &notifyValue,           /* Stores the notified value. */
-                                  portMAX_DELAY);
-        if (xResult == pdPASS && (notifyValue & NOTIF_PROTOCOL_CHANGED) != 0)
-        {
-            break;
-        }
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        printf("Keymap updated, generation %" PRIu32 "\n", stats.generation);
+    }
+    else if (err == ESP_ERR_INVALID_STATE || err == ESP_ERR_INVALID_ARG)
+    {
+        printf("Keymap rejected: %s\n", keymapImageErrorName(stats.lastError));
+    }
+    else
+    {
+        printf("Keymap not written (%s)\n", esp_err_to_name(err));
     }
 }
 
-void waitForProtocolChange(struct GodParameters *godParameters)
+// Called from the console transport, the command itself is handled by the comms task
+void commsConsoleInput(char command)
 {
-    BaseType_t xResult;
-    uint32_t notifyValue = 0;
-    struct CommsParameters *commsParams = (struct CommsParameters *)godParameters->commsParameters;
+    consoleCommand = command;
+    xTaskNotify(commsTask, NOTIF_CONSOLE_COMMAND, eSetBits);
+}
 
-    ESP_LOGI(TAG_COMMS, "No communication protocol selected, will wait for protocol change");
-    while (1)
+void handleConsoleCommand(char command)
+{
+    struct ReportStats *stats = &pipeline.scheduler.stats;
+    struct LedStats leds;
+    struct DisplayStats display;
+    struct DlogStats dlog;
+    uint32_t fpsMilli = 0;
+
+    switch (command)
     {
-        xResult = xTaskNotifyWait(pdFALSE,                /* Don't clear bits on entry. */
-                                  NOTIF_PROTOCOL_CHANGED, /* Clear notif bit on exit. */
-                                  &notifyValue,           /* Stores the notified value. */
-                                  portMAX_DELAY);
-        if (xResult == pdPASS && (notifyValue & NOTIF_PROTOCOL_CHANGED) != 0)
-        {
-            break;
-        }
-        vTaskDelay(pdMS_TO_TICKS(1000));
+    case 'l':
+        latencyDump();
+        break;
+    case 'r':
+        latencyReset();
+        printf("Latency stats reset\n");
+        break;
+    case 's':
+        printf("reports: keyboard=%" PRIu32 " mouse=%" PRIu32 " merged=%" PRIu32 " deduplicated=%" PRIu32 " stalled=%" PRIu32 " queueFull=%" PRIu32 "\n",
+               stats->keyboardSent, stats->mouseSent, stats->merged,
+               stats->deduplicated, stats->stalled, stats->queueFull);
+        printf("transport: %s attached=%" PRIu32 " failed=%" PRIu32 " resynced=%" PRIu32 " switch=%" PRIu32 "us maxSwitch=%" PRIu32 "us\n",
+               pipeline.transport ? pipeline.transport->name : "none", pipeline.stats.attached,
+               pipeline.stats.failed, pipeline.stats.resynced, lastSwitchUs, maxSwitchUs);
+        getLedStats(&leds, &fpsMilli);
+        printf("leds: fps=%" PRIu32 ".%03" PRIu32 " frames=%" PRIu32 " pushed=%" PRIu32 " clean=%" PRIu32 " failed=%" PRIu32 " overBudget=%" PRIu32 " render=%" PRIu32 "us/frame maxRender=%" PRIu32 "us maxFrame=%" PRIu32 "us\n",
+               fpsMilli / 1000, fpsMilli % 1000, leds.frames, leds.pushed, leds.clean, leds.failed, leds.overBudget,
+               leds.frames ? leds.totalRenderUs / leds.frames : 0, leds.maxRenderUs, leds.maxFrameUs);
+        getDisplayStats(&display, &fpsMilli);
+        printf("display: fps=%" PRIu32 ".%03" PRIu32 " frames=%" PRIu32 " flushed=%" PRIu32 " transfers=%" PRIu32 " failed=%" PRIu32 " bytes=%" PRIu64 " last=%" PRIu32 " max=%" PRIu32 " render=%" PRIu32 "us/frame maxRender=%" PRIu32 "us maxFlush=%" PRIu32 "us\n",
+               fpsMilli / 1000, fpsMilli % 1000, display.frames, display.flushed, display.transfers, display.failed,
+               display.totalBytes, display.lastBytes, display.maxBytes,
+               display.frames ? display.totalRenderUs / display.frames : 0, display.maxRenderUs, display.maxFlushUs);
+        getDlogStats(&dlog);
+        printf("dlog: rings=%u written=%" PRIu32 " printed=%" PRIu32 " dropped=%" PRIu32 " noRing=%" PRIu32 "\n",
+               dlog.rings, dlog.written, dlog.printed, dlog.dropped, dlog.noRing);
+        break;
+    case 't':
+        // Binary, tools/telemetry_decode.py reads it
+        telemetrySendSnapshot();
+        break;
+    case 'p':
+        // Console is on USB CDC and stays up, so this can be run back and forth. Not saved, a reset undoes it
+        switchProtocol(comms->protocol == NONE ? USB : (enum CommsProtocol)(comms->protocol + 1));
+        break;
+    default:
+        printf("Commands: l - dump latency, r - reset latency, s - report stats, t - telemetry snapshot, p - next protocol, k<image> - keymap upload\n");
+        break;
+    }
+}
+
+// Drains all pending events into the pipeline and sends what the transport takes
+void sendPendingEvents(struct CommsParameters *commsParams)
+{
+    TaskHandle_t waiter = NULL;
+
+    xSemaphoreTake(pipelineLock, portMAX_DELAY);
+    reportPipelineProcess(&pipeline, commsParams->commsData.eventRing);
+    xSemaphoreGive(pipelineLock);
+
+    waiter = __atomic_exchange_n(&commsParams->commsData.spaceWaiter, NULL, __ATOMIC_ACQ_REL);
+    if (waiter != NULL)
+    {
+        xTaskNotify(waiter, NOTIF_RING_SPACE, eSetBits);
+    }
+}
+
+void getReportStats(struct ReportStats *stats)
+{
+    *stats = pipeline.scheduler.stats;
+}
+
+// Transport taking reports right now, "none" before the first one is attached
+const char *getCommsTransportName(void)
+{
+    const struct Transport *transport = pipeline.transport;
+
+    return transport != NULL ? transport->name : "none";
+}
+
+// Must run in the task that sends reports, it is the one transports notify
+void initComms(struct CommsParameters *commsParams)
+{
+    commsTask = xTaskGetCurrentTaskHandle();
+    comms = commsParams;
+    reportPipelineInit(&pipeline);
+    pipelineLock = xSemaphoreCreateMutex();
+    configASSERT(pipelineLock);
+
+    if (commsParams->commsData.eventRing == NULL)
+    {
+        ESP_LOGE(TAG_COMMS, "No event ring given!");
+    }
+
+    // USB carries the console whatever the protocol, it is installed once and never torn down
+    ESP_ERROR_CHECK(usbInstall());
+    // WiFi driver is slow to bring up, do it now so a switch to ESP-NOW only starts the radio
+    if (espnowRadioPrepare() != ESP_OK)
+    {
+        ESP_LOGE(TAG_COMMS, "WiFi driver init failed, ESP-NOW will not be available");
     }
+
+    attachTransport(commsParams->protocol);
 }
 
 void vCommsTask(void *godParameters)
@@ -260,31 +330,48 @@ void vCommsTask(void *godParameters)
 
     struct GodParameters *params = (struct GodParameters *)(godParameters);
     struct CommsParameters *commsParams = (struct CommsParameters *)(params->commsParameters);
+    BaseType_t xResult;
+    uint32_t notifyValue = 0;
 
-    commsParams->commsData.mouseQueue = xQueueCreate(KB_QUEUE_SIZE, sizeof(struct MouseData));
-    commsParams->commsData.keyboardQueue = xQueueCreate(MOUSE_QUEUE_SIZE, sizeof(struct KeyboardData));
-
-    if (commsParams->commsData.mouseQueue == 0 || commsParams->commsData.keyboardQueue == 0)
-    {
-        ESP_LOGE(TAG_COMMS, "Failed to create queues!");
-    }
+    initComms(commsParams);
 
+    // One loop for every protocol, only the transport under the pipeline changes
     while (1)
     {
-        switch (commsParams->protocol)
+        xResult = xTaskNotifyWait(pdFALSE,      /* Don't clear bits on entry. */
+                                  UINT32_MAX,   /* Clear bits on exit. */
+                                  &notifyValue, /* Stores the notified value. */
+                                  portMAX_DELAY);
+        if (xResult != pdTRUE)
         {
-        case USB:
-            doUSBCommunication(params);
-            break;
-        case BLUETOOTH:
-            doBluetoothCommunication(params);
-            break;
-        case ESPNOW:
-            doESPNOWCommunication(params);
-            break;
-        case NONE:
-            waitForProtocolChange(params);
-            break;
+            continue;
+        }
+
+        if ((notifyValue & NOTIF_CONSOLE_COMMAND) != 0)
+        {
+            handleConsoleCommand(consoleCommand);
+        }
+
+        if ((notifyValue & NOTIF_KEYMAP_UPLOAD) != 0)
+        {
+            applyKeymapUpload();
+        }
+
+        // Events already queued go out on the old transport, the switch carries the rest over
+        if ((notifyValue & NOTIF_HID_CHANGED) != 0)
+        {
+            sendPendingEvents(commsParams);
+        }
+
+        if ((notifyValue & NOTIF_PROTOCOL_CHANGED) != 0)
+        {
+            attachTransport(commsParams->protocol);
+            applyHostSuspend();
+        }
+
+        if ((notifyValue & NOTIF_HOST_SUSPEND) != 0)
+        {
+            applyHostSuspend();
         }
     }
-}
\ No newline at end of file
+}
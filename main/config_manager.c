@@ -1,10 +1,112 @@
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 #include "config_manager.h"
 
+#define CFG_NAMESPACE "storage"
+#define CFG_BLOB_KEY "config"
+
 nvs_handle_t handle;
 const char *TAG_CFG = "config";
 
+static struct ConfigStore store = {0};
+static SemaphoreHandle_t configLock = NULL;
+static esp_timer_handle_t flushTimer = NULL;
+
+static bool nvsReadBlob(void *ctx, void *data, size_t *length)
+{
+    esp_err_t err = nvs_get_blob(handle, CFG_BLOB_KEY, data, length);
+
+    if (err == ESP_ERR_NVS_INVALID_LENGTH)
+    {
+        // Bigger than anything this version wrote, only the length is of use
+        return nvs_get_blob(handle, CFG_BLOB_KEY, NULL, length) == ESP_OK;
+    }
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+    {
+        ESP_LOGE(TAG_CFG, "Error (%s) reading config!", esp_err_to_name(err));
+    }
+    return err == ESP_OK;
+}
+
+static bool nvsWriteBlob(void *ctx, const void *data, size_t length)
+{
+    esp_err_t err = nvs_set_blob(handle, CFG_BLOB_KEY, data, length);
+
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(handle);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG_CFG, "Error (%s) writing config!", esp_err_to_name(err));
+    }
+    return err == ESP_OK;
+}
+
+static bool nvsReadLegacyI8(void *ctx, const char *key, int8_t *value)
+{
+    return nvs_get_i8(handle, key, value) == ESP_OK;
+}
+
+static void nvsEraseLegacy(void *ctx, const char *key)
+{
+    if (nvs_erase_key(handle, key) == ESP_OK)
+    {
+        nvs_commit(handle);
+    }
+}
+
+static const struct ConfigBackend nvsBackend = {
+    .readBlob = nvsReadBlob,
+    .writeBlob = nvsWriteBlob,
+    .readLegacyI8 = nvsReadLegacyI8,
+    .eraseLegacy = nvsEraseLegacy,
+};
+
+// Runs on the esp_timer task once settings stopped changing
+static void flushTimerCallback(void *arg)
+{
+    uint32_t waitUs = 0;
+
+    xSemaphoreTake(configLock, portMAX_DELAY);
+    if (configStoreFlushDue(&store, (uint32_t)esp_timer_get_time(), &waitUs))
+    {
+        if (!configStoreFlush(&store))
+        {
+            // Nothing else would write it before the next change, or ever if none comes before a reset
+            esp_timer_start_once(flushTimer, configStoreRetryUs(&store));
+        }
+    }
+    else if (store.dirty)
+    {
+        esp_timer_start_once(flushTimer, waitUs);
+    }
+    xSemaphoreGive(configLock);
+}
+
+// Called with the lock held after store.config changed
+static void configChanged(void)
+{
+    uint32_t nowUs = (uint32_t)esp_timer_get_time();
+    uint32_t waitUs = 0;
+
+    // Without NVS the settings only live until the next reset
+    if (store.backend == NULL)
+    {
+        return;
+    }
+    configStoreTouch(&store, nowUs);
+    esp_timer_stop(flushTimer);
+    if (store.dirty)
+    {
+        configStoreFlushDue(&store, nowUs, &waitUs);
+        esp_timer_start_once(flushTimer, waitUs);
+    }
+}
+
 esp_err_t initConfigManager()
 {
     // Initialize NVS
@@ -18,68 +120,72 @@ esp_err_t initConfigManager()
     }
     ESP_ERROR_CHECK(err);
 
-    return err;
-}
+    const esp_timer_create_args_t timerArgs = {
+        .callback = flushTimerCallback,
+        .name = "configFlush",
+    };
+    configLock = xSemaphoreCreateMutex();
+    configASSERT(configLock);
+    ESP_ERROR_CHECK(esp_timer_create(&timerArgs, &flushTimer));
 
-esp_err_t getKbSide(int8_t *side)
-{
-    ESP_LOGI(TAG_CFG, "Opening Non-Volatile Storage (NVS)... ");
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &handle);
+    // Handle stays open, settings are read from RAM after this
+    err = nvs_open(CFG_NAMESPACE, NVS_READWRITE, &handle);
     if (err != ESP_OK)
     {
-        ESP_LOGI(TAG_CFG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+        ESP_LOGE(TAG_CFG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+        store.config = configDefaults;
         return err;
     }
 
-    err = nvs_get_i8(handle, CFG_KB_SIDE, side);
-    switch (err)
+    configStoreLoad(&store, &nvsBackend, (uint32_t)esp_timer_get_time());
+    if (store.dirty)
     {
-        case ESP_OK:
-            break;
-        case ESP_ERR_NVS_NOT_FOUND:
-            ESP_LOGW(TAG_CFG, "The value is not initialized yet!");
-            err = nvs_set_i8(handle, CFG_KB_SIDE, 0);
-            if (err)
-            {
-                ESP_LOGW(TAG_CFG, "Cannot set initial value!");
-            }
-
-            err = nvs_commit(handle);
-            if (err)
-            {
-                ESP_LOGW(TAG_CFG, "Cannot commit value!");
-            }
-            break;
-        default:
-            ESP_LOGE(TAG_CFG, "Error (%s) reading kb side!", esp_err_to_name(err));
+        // Defaults or migrated settings that could not be written yet
+        esp_timer_start_once(flushTimer, configStoreRetryUs(&store));
     }
+    ESP_LOGI(TAG_CFG, "Config loaded, version %d%s", store.stats.loadedVersion, store.stats.defaulted ? " (defaults)" : "");
+    return ESP_OK;
+}
 
-    nvs_close(handle);
-    return err;
+const struct KbConfig *getConfig(void)
+{
+    return &store.config;
 }
 
-esp_err_t setKbSide(int8_t side)
+int8_t getKbSide(void)
 {
-    ESP_LOGI(TAG_CFG, "Opening Non-Volatile Storage (NVS)... ");
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &handle);
-    if (err != ESP_OK)
-    {
-        ESP_LOGI(TAG_CFG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
-        return err;
-    }
+    return store.config.side;
+}
 
-    err = nvs_set_i8(handle, CFG_KB_SIDE, side ? 1 : 0);
-    if (err)
-    {
-        ESP_LOGW(TAG_CFG, "Cannot set kb side value!");
-    }
+void setKbSide(int8_t side)
+{
+    xSemaphoreTake(configLock, portMAX_DELAY);
+    store.config.side = side ? CFG_KB_SIDE_RIGHT : CFG_KB_SIDE_LEFT;
+    configChanged();
+    xSemaphoreGive(configLock);
+}
 
-    err = nvs_commit(handle);
-    if (err)
-    {
-        ESP_LOGW(TAG_CFG, "Cannot commit value!");
-    }
+void setDefaultProtocol(uint8_t protocol)
+{
+    xSemaphoreTake(configLock, portMAX_DELAY);
+    store.config.protocol = protocol;
+    configChanged();
+    xSemaphoreGive(configLock);
+}
+
+// Writes pending changes now, e.g. before a restart
+esp_err_t flushConfig(void)
+{
+    bool ok = false;
 
-    nvs_close(handle);
-    return err;
-}
\ No newline at end of file
+    xSemaphoreTake(configLock, portMAX_DELAY);
+    esp_timer_stop(flushTimer);
+    ok = store.backend != NULL && configStoreFlush(&store);
+    xSemaphoreGive(configLock);
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+void getConfigStoreStats(struct ConfigStoreStats *stats)
+{
+    *stats = store.stats;
+}
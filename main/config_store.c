@@ -0,0 +1,252 @@
+#include <string.h>
+
+#include "config_store.h"
+
+#define LEGACY_KEY_SIDE "side"
+
+const struct KbConfig configDefaults = {
+    .side = 0,
+    .protocol = 0, // USB
+};
+
+_Static_assert(sizeof(struct KbConfig) <= CONFIG_STORE_BLOB_MAX - sizeof(struct ConfigBlobHeader), "config does not fit the blob");
+
+// FNV-1a, only has to catch torn or foreign blobs
+static uint32_t checksum(const uint8_t *data, size_t length)
+{
+    uint32_t hash = 0x811C9DC5;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ data[i]) * 0x01000193;
+    }
+    return hash;
+}
+
+// Fixes up settings whose meaning changed, called with the version the blob was written by
+static void migrate(struct ConfigStore *store, uint8_t version)
+{
+    int8_t side = 0;
+
+    switch (version)
+    {
+    case 0:
+        // Before the blob every setting had a key of its own
+        if (store->backend->readLegacyI8 != NULL && store->backend->readLegacyI8(store->backend->ctx, LEGACY_KEY_SIDE, &side))
+        {
+            store->config.side = side ? 1 : 0;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static bool loadBlob(struct ConfigStore *store)
+{
+    uint8_t blob[CONFIG_STORE_BLOB_MAX];
+    struct ConfigBlobHeader header;
+    size_t length = sizeof(blob);
+    size_t known = 0;
+
+    if (!store->backend->readBlob(store->backend->ctx, blob, &length) || length < sizeof(header) || length > sizeof(blob))
+    {
+        return false;
+    }
+    memcpy(&header, blob, sizeof(header));
+    if (header.magic != CONFIG_STORE_MAGIC || header.version == 0 || sizeof(header) + header.size > length ||
+        checksum(&blob[sizeof(header)], header.size) != header.checksum)
+    {
+        return false;
+    }
+
+    known = header.size < sizeof(store->config) ? header.size : sizeof(store->config);
+    memcpy(&store->config, &blob[sizeof(header)], known);
+    store->stats.loadedVersion = header.version;
+    if (header.version < CONFIG_STORE_VERSION)
+    {
+        migrate(store, header.version);
+    }
+    return true;
+}
+
+static void markDirty(struct ConfigStore *store, uint32_t nowUs)
+{
+    if (!store->dirty)
+    {
+        store->firstDirtyUs = nowUs;
+    }
+    store->dirty = true;
+    store->lastDirtyUs = nowUs;
+    store->changes++;
+}
+
+// Anything not in flash yet (defaults, migrated values) is written back once
+void configStoreLoad(struct ConfigStore *store, const struct ConfigBackend *backend, uint32_t nowUs)
+{
+    memset(store, 0, sizeof(*store));
+    store->backend = backend;
+    store->config = configDefaults;
+
+    if (!loadBlob(store))
+    {
+        store->config = configDefaults;
+        store->stats.defaulted = true;
+        migrate(store, 0);
+    }
+    // A newer blob is left alone until a setting actually changes
+    if (store->stats.loadedVersion >= CONFIG_STORE_VERSION)
+    {
+        store->saved = store->config;
+        return;
+    }
+
+    markDirty(store, nowUs);
+    if (configStoreFlush(store) && store->stats.loadedVersion == 0 && backend->eraseLegacy != NULL)
+    {
+        backend->eraseLegacy(backend->ctx, LEGACY_KEY_SIDE);
+    }
+}
+
+// Call after changing store->config, changes that end up where flash already is cost nothing
+void configStoreTouch(struct ConfigStore *store, uint32_t nowUs)
+{
+    if (memcmp(&store->config, &store->saved, sizeof(store->config)) == 0)
+    {
+        store->dirty = false;
+        store->changes = 0;
+        return;
+    }
+    markDirty(store, nowUs);
+}
+
+// waitUs is how long until the flush is due, for re-arming a timer
+bool configStoreFlushDue(const struct ConfigStore *store, uint32_t nowUs, uint32_t *waitUs)
+{
+    uint32_t quiet = nowUs - store->lastDirtyUs;
+    uint32_t dirty = nowUs - store->firstDirtyUs;
+
+    if (!store->dirty)
+    {
+        return false;
+    }
+    if (quiet >= CONFIG_STORE_QUIET_MS * 1000 || dirty >= CONFIG_STORE_MAX_DIRTY_MS * 1000)
+    {
+        *waitUs = 0;
+        return true;
+    }
+    quiet = CONFIG_STORE_QUIET_MS * 1000 - quiet;
+    dirty = CONFIG_STORE_MAX_DIRTY_MS * 1000 - dirty;
+    *waitUs = quiet < dirty ? quiet : dirty;
+    return false;
+}
+
+// One blob write and commit for every change since the last flush
+bool configStoreFlush(struct ConfigStore *store)
+{
+    uint8_t blob[sizeof(struct ConfigBlobHeader) + sizeof(struct KbConfig)];
+    struct ConfigBlobHeader header = {
+        .magic = CONFIG_STORE_MAGIC,
+        .version = CONFIG_STORE_VERSION,
+        .size = sizeof(struct KbConfig),
+    };
+
+    if (!store->dirty)
+    {
+        store->stats.skipped++;
+        return true;
+    }
+
+    memcpy(&blob[sizeof(header)], &store->config, sizeof(store->config));
+    header.checksum = checksum(&blob[sizeof(header)], sizeof(store->config));
+    memcpy(blob, &header, sizeof(header));
+    if (!store->backend->writeBlob(store->backend->ctx, blob, sizeof(blob)))
+    {
+        // Stays dirty, the next flush tries again
+        store->stats.failed++;
+        if (store->retries < UINT8_MAX)
+        {
+            store->retries++;
+        }
+        return false;
+    }
+
+    store->saved = store->config;
+    store->retries = 0;
+    store->stats.writes++;
+    store->stats.coalesced += store->changes - 1;
+    store->dirty = false;
+    store->changes = 0;
+    return true;
+}
+
+// How long to wait before trying a failed write again, backs off while flash keeps failing
+uint32_t configStoreRetryUs(const struct ConfigStore *store)
+{
+    uint32_t retryMs = CONFIG_STORE_RETRY_MS;
+
+    for (uint8_t i = 1; i < store->retries && retryMs < CONFIG_STORE_RETRY_MAX_MS; i++)
+    {
+        retryMs *= 2;
+    }
+    return (retryMs < CONFIG_STORE_RETRY_MAX_MS ? retryMs : CONFIG_STORE_RETRY_MAX_MS) * 1000;
+}
+
+static bool ramReadBlob(void *ctx, void *data, size_t *length)
+{
+    struct ConfigRamBackend *ram = (struct ConfigRamBackend *)ctx;
+
+    if (ram->length == 0)
+    {
+        return false;
+    }
+    memcpy(data, ram->blob, ram->length < *length ? ram->length : *length);
+    *length = ram->length;
+    return true;
+}
+
+static bool ramWriteBlob(void *ctx, const void *data, size_t length)
+{
+    struct ConfigRamBackend *ram = (struct ConfigRamBackend *)ctx;
+
+    if (ram->failWrites || length > sizeof(ram->blob))
+    {
+        return false;
+    }
+    memcpy(ram->blob, data, length);
+    ram->length = length;
+    ram->writes++;
+    return true;
+}
+
+static bool ramReadLegacyI8(void *ctx, const char *key, int8_t *value)
+{
+    struct ConfigRamBackend *ram = (struct ConfigRamBackend *)ctx;
+
+    if (!ram->legacyPresent || strcmp(key, LEGACY_KEY_SIDE) != 0)
+    {
+        return false;
+    }
+    *value = ram->legacySide;
+    return true;
+}
+
+static void ramEraseLegacy(void *ctx, const char *key)
+{
+    struct ConfigRamBackend *ram = (struct ConfigRamBackend *)ctx;
+
+    if (strcmp(key, LEGACY_KEY_SIDE) == 0)
+    {
+        ram->legacyPresent = false;
+    }
+}
+
+void configRamBackendInit(struct ConfigRamBackend *ram)
+{
+    memset(ram, 0, sizeof(*ram));
+    ram->backend.ctx = ram;
+    ram->backend.readBlob = ramReadBlob;
+    ram->backend.writeBlob = ramWriteBlob;
+    ram->backend.readLegacyI8 = ramReadLegacyI8;
+    ram->backend.eraseLegacy = ramEraseLegacy;
+}
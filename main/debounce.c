@@ -0,0 +1,110 @@
+#include <string.h>
+
+#include "debounce.h"
+
+void debounceInit(struct Debouncer *db, enum DebounceMode mode, uint8_t samples, uint16_t timeoutMs)
+{
+    memset(db, 0, sizeof(*db));
+    db->mode = mode;
+    db->samples = samples;
+    db->timeoutMs = timeoutMs;
+
+    if (db->samples == 0)
+    {
+        db->samples = 1;
+    }
+    if (db->samples > DEBOUNCE_MAX_SAMPLES)
+    {
+        db->samples = DEBOUNCE_MAX_SAMPLES;
+    }
+}
+
+// Counts samples of keys in delta, resets the rest and returns keys that reached db->samples
+static matrix_row_t countSamples(struct Debouncer *db, int row, matrix_row_t delta)
+{
+    matrix_row_t carry = delta;
+    matrix_row_t reached = MATRIX_COL_MASK;
+    matrix_row_t t = 0;
+
+    for (int p = 0; p < DEBOUNCE_COUNTER_BITS; p++)
+    {
+        t = db->count[p][row] & carry;
+        db->count[p][row] = (db->count[p][row] ^ carry) & delta;
+        carry = t;
+
+        reached &= (db->samples & (1 << p)) ? db->count[p][row] : (matrix_row_t)~db->count[p][row];
+    }
+
+    return reached & delta;
+}
+
+static void clearCounters(struct Debouncer *db, int row, matrix_row_t keys)
+{
+    for (int p = 0; p < DEBOUNCE_COUNTER_BITS; p++)
+    {
+        db->count[p][row] &= (matrix_row_t)~keys;
+    }
+}
+
+static matrix_row_t updateTimeout(struct Debouncer *db, int row, matrix_row_t delta, uint16_t now)
+{
+    matrix_row_t fire = 0;
+    matrix_row_t locked = db->locked[row];
+    int col = 0;
+
+    // Release locks that expired, only keys that were changed recently are visited
+    while (locked)
+    {
+        col = matrixPopLowest(&locked);
+        if ((uint16_t)(now - db->lastChange[row][col]) >= db->timeoutMs)
+        {
+            db->locked[row] &= (matrix_row_t)~(1u << col);
+        }
+    }
+
+    fire = delta & (matrix_row_t)~db->locked[row];
+    locked = fire;
+    while (locked)
+    {
+        col = matrixPopLowest(&locked);
+        db->lastChange[row][col] = now;
+    }
+    db->locked[row] |= fire;
+
+    return fire;
+}
+
+bool debounceUpdate(struct Debouncer *db, const matrix_row_t raw[KB_ROWS], uint32_t nowMs, matrix_row_t changes[KB_ROWS])
+{
+    matrix_row_t delta = 0, fire = 0, any = 0;
+
+    for (int j = 0; j < KB_ROWS; j++)
+    {
+        delta = raw[j] ^ db->stable[j];
+
+        switch (db->mode)
+        {
+        case DEBOUNCE_EAGER:
+            // New presses go through at once, releases have to hold for N samples
+            fire = countSamples(db, j, delta) | (delta & raw[j]);
+            clearCounters(db, j, fire);
+            break;
+        case DEBOUNCE_DEFER:
+            fire = countSamples(db, j, delta);
+            clearCounters(db, j, fire);
+            break;
+        case DEBOUNCE_TIMEOUT:
+            fire = updateTimeout(db, j, delta, (uint16_t)nowMs);
+            break;
+        default:
+            fire = delta;
+            break;
+        }
+
+        db->stable[j] ^= fire;
+        changes[j] = fire;
+        any |= fire;
+    }
+
+    return any != 0;
+}
@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "display_fb.h"
+
+size_t displayFbSize(enum DisplayFormat format, uint16_t width, uint16_t height)
+{
+    return format == DISPLAY_MONO ? (size_t)width * ((height + 7) / 8) : (size_t)width * height * 2;
+}
+
+void displayFbInit(struct DisplayFb *fb, enum DisplayFormat format, uint16_t width, uint16_t height, uint8_t *pixels)
+{
+    memset(fb, 0, sizeof(*fb));
+    fb->format = format;
+    fb->width = width;
+    fb->height = height;
+    fb->pixels = pixels;
+    memset(pixels, 0, displayFbSize(format, width, height));
+    // The panel holds garbage until the first flush
+    displayFbInvalidate(fb, &(struct DisplayRect){0, 0, (int16_t)width, (int16_t)height});
+}
+
+// Returns true if the pixel changed
+static bool setPixel(struct DisplayFb *fb, int16_t x, int16_t y, uint16_t colour)
+{
+    uint8_t *byte = NULL;
+    uint8_t bit = 0;
+    uint8_t hi = (uint8_t)(colour >> 8), lo = (uint8_t)colour;
+
+    if (fb->format == DISPLAY_MONO)
+    {
+        byte = &fb->pixels[(y >> 3) * fb->width + x];
+        bit = (uint8_t)(1u << (y & 7));
+        if (((*byte & bit) != 0) == (colour != 0))
+        {
+            return false;
+        }
+        *byte ^= bit;
+        return true;
+    }
+
+    byte = &fb->pixels[(y * fb->width + x) * 2];
+    if (byte[0] == hi && byte[1] == lo)
+    {
+        return false;
+    }
+    byte[0] = hi;
+    byte[1] = lo;
+    return true;
+}
+
+static bool clip(const struct DisplayFb *fb, struct DisplayRect *rect)
+{
+    rect->x0 = rect->x0 < 0 ? 0 : rect->x0;
+    rect->y0 = rect->y0 < 0 ? 0 : rect->y0;
+    rect->x1 = rect->x1 > fb->width ? (int16_t)fb->width : rect->x1;
+    rect->y1 = rect->y1 > fb->height ? (int16_t)fb->height : rect->y1;
+    return rect->x0 < rect->x1 && rect->y0 < rect->y1;
+}
+
+// Grows the box around the pixels changed so far
+static void include(struct DisplayRect *changed, int16_t x, int16_t y)
+{
+    changed->x0 = x < changed->x0 ? x : changed->x0;
+    changed->y0 = y < changed->y0 ? y : changed->y0;
+    changed->x1 = x + 1 > changed->x1 ? x + 1 : changed->x1;
+    changed->y1 = y + 1 > changed->y1 ? y + 1 : changed->y1;
+}
+
+static const struct DisplayRect nothingChanged = {INT16_MAX, INT16_MAX, INT16_MIN, INT16_MIN};
+
+void displayFbFill(struct DisplayFb *fb, const struct DisplayRect *rect, uint16_t colour)
+{
+    struct DisplayRect area = *rect;
+    struct DisplayRect changed = nothingChanged;
+
+    if (!clip(fb, &area))
+    {
+        return;
+    }
+    for (int16_t y = area.y0; y < area.y1; y++)
+    {
+        for (int16_t x = area.x0; x < area.x1; x++)
+        {
+            if (setPixel(fb, x, y, colour))
+            {
+                include(&changed, x, y);
+            }
+        }
+    }
+    displayFbInvalidate(fb, &changed);
+}
+
+// Each glyph takes a 6x8 cell, the background fills the spacing too
+int16_t displayFbText(struct DisplayFb *fb, int16_t x, int16_t y, const char *text, uint16_t colour, uint16_t background)
+{
+    struct DisplayRect changed = nothingChanged;
+    const uint8_t *glyph = NULL;
+    uint8_t column = 0;
+    int16_t px = 0, py = 0;
+
+    for (; *text != '\0'; text++, x += DISPLAY_FONT_WIDTH + 1)
+    {
+        glyph = displayFont[(*text < DISPLAY_FONT_FIRST || *text > DISPLAY_FONT_LAST ? '?' : *text) - DISPLAY_FONT_FIRST];
+        for (int cx = 0; cx <= DISPLAY_FONT_WIDTH; cx++)
+        {
+            column = cx < DISPLAY_FONT_WIDTH ? glyph[cx] : 0;
+            for (int cy = 0; cy <= DISPLAY_FONT_HEIGHT; cy++)
+            {
+                px = (int16_t)(x + cx);
+                py = (int16_t)(y + cy);
+                if (px < 0 || py < 0 || px >= fb->width || py >= fb->height)
+                {
+                    continue;
+                }
+                if (setPixel(fb, px, py, (column >> cy) & 1 ? colour : background))
+                {
+                    include(&changed, px, py);
+                }
+            }
+        }
+    }
+    displayFbInvalidate(fb, &changed);
+    return x;
+}
+
+static int32_t area(const struct DisplayRect *rect)
+{
+    return (int32_t)(rect->x1 - rect->x0) * (rect->y1 - rect->y0);
+}
+
+static struct DisplayRect merge(const struct DisplayRect *a, const struct DisplayRect *b)
+{
+    struct DisplayRect rect = {
+        .x0 = a->x0 < b->x0 ? a->x0 : b->x0,
+        .y0 = a->y0 < b->y0 ? a->y0 : b->y0,
+        .x1 = a->x1 > b->x1 ? a->x1 : b->x1,
+        .y1 = a->y1 > b->y1 ? a->y1 : b->y1,
+    };
+    return rect;
+}
+
+static void removeDirty(struct DisplayFb *fb, uint8_t index)
+{
+    fb->dirty[index] = fb->dirty[--fb->dirtyCount];
+}
+
+/*
+Overlapping or touching regions are merged, so are the two regions that grow
+the least once the list is full. Mono regions cover whole pages since that is
+what the controller addresses.
+*/
+void displayFbInvalidate(struct DisplayFb *fb, const struct DisplayRect *rect)
+{
+    struct DisplayRect region = *rect;
+    struct DisplayRect grown;
+    int32_t growth = 0, bestGrowth = 0;
+    int best = -1;
+
+    if (!clip(fb, &region))
+    {
+        return;
+    }
+    if (fb->format == DISPLAY_MONO)
+    {
+        region.y0 &= ~7;
+        region.y1 = (int16_t)((region.y1 + 7) & ~7);
+    }
+
+    for (uint8_t i = 0; i < fb->dirtyCount;)
+    {
+        if (region.x0 <= fb->dirty[i].x1 && fb->dirty[i].x0 <= region.x1 && region.y0 <= fb->dirty[i].y1 && fb->dirty[i].y0 <= region.y1)
+        {
+            region = merge(&region, &fb->dirty[i]);
+            removeDirty(fb, i);
+            // The grown region may reach ones already passed
+            i = 0;
+            continue;
+        }
+        i++;
+    }
+
+    while (fb->dirtyCount == DISPLAY_DIRTY_RECTS)
+    {
+        best = -1;
+        for (uint8_t i = 0; i < fb->dirtyCount; i++)
+        {
+            grown = merge(&region, &fb->dirty[i]);
+            growth = area(&grown) - area(&region) - area(&fb->dirty[i]);
+            if (best < 0 || growth < bestGrowth)
+            {
+                best = i;
+                bestGrowth = growth;
+            }
+        }
+        region = merge(&region, &fb->dirty[best]);
+        removeDirty(fb, (uint8_t)best);
+    }
+    fb->dirty[fb->dirtyCount++] = region;
+}
+
+bool displayFbDirty(const struct DisplayFb *fb)
+{
+    return fb->dirtyCount > 0;
+}
+
+// Copies a region between the framebuffer and a buffer in panel format
+static size_t copyRegion(struct DisplayFb *fb, const struct DisplayRect *rect, uint8_t *buffer, bool toPanel)
+{
+    size_t width = (size_t)(rect->x1 - rect->x0);
+    size_t length = 0;
+    uint8_t *source = NULL;
+
+    if (fb->format == DISPLAY_MONO)
+    {
+        for (int16_t page = rect->y0 >> 3; page < (rect->y1 + 7) >> 3; page++, length += width)
+        {
+            source = &fb->pixels[page * fb->width + rect->x0];
+            memcpy(toPanel ? &buffer[length] : source, toPanel ? source : &buffer[length], width);
+        }
+        return length;
+    }
+
+    width *= 2;
+    for (int16_t y = rect->y0; y < rect->y1; y++, length += width)
+    {
+        source = &fb->pixels[(y * fb->width + rect->x0) * 2];
+        memcpy(toPanel ? &buffer[length] : source, toPanel ? source : &buffer[length], width);
+    }
+    return length;
+}
+
+/*
+Sends every dirty region, split into bands that fit the scratch buffer. A failed
+transfer leaves its region and the ones after it dirty for the next frame.
+Returns the bytes sent.
+*/
+uint32_t displayFbFlush(struct DisplayFb *fb, const struct DisplayPanel *panel, uint8_t *scratch, size_t scratchSize)
+{
+    struct DisplayRect band;
+    int16_t rowHeight = fb->format == DISPLAY_MONO ? 8 : 1;
+    size_t rowBytes = 0, length = 0;
+    int16_t rows = 0;
+    uint32_t sent = 0;
+    uint8_t done = 0;
+
+    fb->stats.frames++;
+    for (; done < fb->dirtyCount; done++)
+    {
+        band = fb->dirty[done];
+        rowBytes = (size_t)(band.x1 - band.x0) * (fb->format == DISPLAY_MONO ? 1 : 2);
+        rows = (int16_t)(scratchSize / rowBytes) * rowHeight;
+        if (rows == 0)
+        {
+            fb->stats.failed++;
+            break;
+        }
+        for (; band.y0 < fb->dirty[done].y1; band.y0 = band.y1)
+        {
+            band.y1 = band.y0 + rows < fb->dirty[done].y1 ? band.y0 + rows : fb->dirty[done].y1;
+            length = copyRegion(fb, &band, scratch, true);
+            if (!panel->draw(panel->ctx, &band, scratch, length))
+            {
+                fb->stats.failed++;
+                break;
+            }
+            fb->stats.transfers++;
+            sent += length;
+        }
+        if (band.y0 < fb->dirty[done].y1)
+        {
+            break;
+        }
+    }
+    memmove(fb->dirty, &fb->dirty[done], (fb->dirtyCount - done) * sizeof(fb->dirty[0]));
+    fb->dirtyCount -= done;
+
+    if (sent > 0)
+    {
+        fb->stats.flushed++;
+        if (panel->present != NULL)
+        {
+            panel->present(panel->ctx);
+        }
+    }
+    fb->stats.totalBytes += sent;
+    fb->stats.lastBytes = sent;
+    if (sent > fb->stats.maxBytes)
+    {
+        fb->stats.maxBytes = sent;
+    }
+    return sent;
+}
+
+void displayFbAccount(struct DisplayFb *fb, uint32_t renderUs, uint32_t flushUs)
+{
+    fb->stats.totalRenderUs += renderUs;
+    if (renderUs > fb->stats.maxRenderUs)
+    {
+        fb->stats.maxRenderUs = renderUs;
+    }
+    if (flushUs > fb->stats.maxFlushUs)
+    {
+        fb->stats.maxFlushUs = flushUs;
+    }
+}
+
+static bool pgmDraw(void *ctx, const struct DisplayRect *rect, const void *data, size_t length)
+{
+    struct DisplayPgmPanel *pgm = (struct DisplayPgmPanel *)ctx;
+
+    (void)length;
+    copyRegion(&pgm->mirror, rect, (uint8_t *)data, false);
+    pgm->draws++;
+    return true;
+}
+
+static void pgmPresent(void *ctx)
+{
+    struct DisplayPgmPanel *pgm = (struct DisplayPgmPanel *)ctx;
+    char path[256];
+
+    if (pgm->prefix != NULL)
+    {
+        snprintf(path, sizeof(path), "%s%04" PRIu32 ".pgm", pgm->prefix, pgm->frames);
+        displayPgmWrite(pgm, path);
+    }
+    pgm->frames++;
+}
+
+void displayPgmPanelInit(struct DisplayPgmPanel *pgm, enum DisplayFormat format, uint16_t width, uint16_t height, uint8_t *pixels, const char *prefix)
+{
+    memset(pgm, 0, sizeof(*pgm));
+    displayFbInit(&pgm->mirror, format, width, height, pixels);
+    pgm->prefix = prefix;
+    pgm->panel.ctx = pgm;
+    pgm->panel.draw = pgmDraw;
+    pgm->panel.present = pgmPresent;
+}
+
+// What the panel shows as 8 bit grey
+bool displayPgmWrite(const struct DisplayPgmPanel *pgm, const char *path)
+{
+    const struct DisplayFb *fb = &pgm->mirror;
+    const uint8_t *pixel = NULL;
+    uint16_t colour = 0;
+    FILE *file = fopen(path, "wb");
+
+    if (file == NULL)
+    {
+        return false;
+    }
+    fprintf(file, "P5\n%u %u\n255\n", fb->width, fb->height);
+    for (int y = 0; y < fb->height; y++)
+    {
+        for (int x = 0; x < fb->width; x++)
+        {
+            if (fb->format == DISPLAY_MONO)
+            {
+                fputc((fb->pixels[(y >> 3) * fb->width + x] >> (y & 7)) & 1 ? 255 : 0, file);
+                continue;
+            }
+            pixel = &fb->pixels[(y * fb->width + x) * 2];
+            colour = (uint16_t)(pixel[0] << 8 | pixel[1]);
+            fputc((((colour >> 11) << 3) * 77 + (((colour >> 5) & 0x3F) << 2) * 150 + ((colour & 0x1F) << 3) * 29) >> 8, file);
+        }
+    }
+    return fclose(file) == 0;
+}
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_lcd_panel_io.h"
+#include "esp_lcd_panel_ops.h"
+#include "esp_lcd_panel_ssd1306.h"
+
+#include "display_manager.h"
+#include "display_ui.h"
+#include "gpio_manager.h"
+#include "comms_manager.h"
+
+const char *TAG_DISPLAY = "display";
+
+static esp_lcd_panel_handle_t panelHandle = NULL;
+static SemaphoreHandle_t transferDone = NULL;
+static uint8_t pixels[KB_DISPLAY_WIDTH * KB_DISPLAY_HEIGHT / 8];
+// Regions are copied here so the framebuffer can be drawn on while DMA reads this
+DMA_ATTR static uint8_t transfer[KB_DISPLAY_TRANSFER_BYTES];
+static struct DisplayFb fb = {0};
+static uint64_t startUs = 0;
+
+static bool IRAM_ATTR onTransferDone(esp_lcd_panel_io_handle_t io, esp_lcd_panel_io_event_data_t *data, void *ctx)
+{
+    BaseType_t woken = pdFALSE;
+
+    xSemaphoreGiveFromISR(transferDone, &woken);
+    return woken == pdTRUE;
+}
+
+// The SPI transaction is queued and runs by DMA, this task sleeps until it is done
+static bool lcdDraw(void *ctx, const struct DisplayRect *rect, const void *data, size_t length)
+{
+    if (esp_lcd_panel_draw_bitmap(panelHandle, rect->x0, rect->y0, rect->x1, rect->y1, data) != ESP_OK)
+    {
+        return false;
+    }
+    return xSemaphoreTake(transferDone, pdMS_TO_TICKS(KB_DISPLAY_TRANSFER_TIMEOUT_MS)) == pdTRUE;
+}
+
+static const struct DisplayPanel lcdPanel = {
+    .draw = lcdDraw,
+};
+
+// Frame rate in thousandths of a frame per second since the task started
+void getDisplayStats(struct DisplayStats *stats, uint32_t *fpsMilli)
+{
+    uint64_t elapsedUs = esp_timer_get_time() - startUs;
+
+    *stats = fb.stats;
+    *fpsMilli = startUs != 0 && elapsedUs > 0 ? (uint32_t)((uint64_t)stats->frames * 1000000000ULL / elapsedUs) : 0;
+}
+
+static esp_err_t initDisplay(void)
+{
+    esp_err_t err = ESP_OK;
+    esp_lcd_panel_io_handle_t io = NULL;
+    spi_bus_config_t busConfig = {
+        .sclk_io_num = KB_DISPLAY_SCLK_GPIO,
+        .mosi_io_num = KB_DISPLAY_MOSI_GPIO,
+        .miso_io_num = GPIO_NUM_NC,
+        .quadwp_io_num = GPIO_NUM_NC,
+        .quadhd_io_num = GPIO_NUM_NC,
+        .max_transfer_sz = KB_DISPLAY_TRANSFER_BYTES,
+    };
+    esp_lcd_panel_io_spi_config_t ioConfig = {
+        .dc_gpio_num = KB_DISPLAY_DC_GPIO,
+        .cs_gpio_num = KB_DISPLAY_CS_GPIO,
+        .pclk_hz = KB_DISPLAY_PCLK_HZ,
+        .lcd_cmd_bits = 8,
+        .lcd_param_bits = 8,
+        .spi_mode = 0,
+        .trans_queue_depth = 4,
+        .on_color_trans_done = onTransferDone,
+        // SSD1306 takes command parameters as commands, with D/C low
+        .flags.dc_low_on_param = 1,
+    };
+    esp_lcd_panel_ssd1306_config_t ssd1306Config = {
+        .height = KB_DISPLAY_HEIGHT,
+    };
+    esp_lcd_panel_dev_config_t panelConfig = {
+        .reset_gpio_num = KB_DISPLAY_RST_GPIO,
+        .bits_per_pixel = 1,
+        .vendor_config = &ssd1306Config,
+    };
+
+    err = spi_bus_initialize(KB_DISPLAY_SPI_HOST, &busConfig, SPI_DMA_CH_AUTO);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = esp_lcd_new_panel_io_spi((esp_lcd_spi_bus_handle_t)KB_DISPLAY_SPI_HOST, &ioConfig, &io);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = esp_lcd_new_panel_ssd1306(io, &panelConfig, &panelHandle);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = esp_lcd_panel_reset(panelHandle);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = esp_lcd_panel_init(panelHandle);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    return esp_lcd_panel_disp_on_off(panelHandle, true);
+}
+
+static const char *layerName(uint16_t activeLayers, char *buffer, size_t size)
+{
+    int top = activeLayers ? 31 - __builtin_clz(activeLayers) : 0;
+
+    if (top < defaultKeymapLayers)
+    {
+        return defaultLayerNames[top];
+    }
+    snprintf(buffer, size, "L%d", top);
+    return buffer;
+}
+
+void vDisplayTask(void *godParameters)
+{
+    struct DisplayUi ui;
+    struct WpmMeter wpm;
+    struct DisplayStatus status = {
+        .batteryPercent = DISPLAY_BATTERY_NONE, // no battery gauge on the board yet
+    };
+    struct KeymapStats keymapStats;
+    uint16_t activeLayers = 0;
+    char layerBuffer[8];
+    TickType_t wake = 0;
+    uint64_t frameStartUs = 0, renderedUs = 0;
+
+    ESP_LOGI(TAG_DISPLAY, "Initializing display task...");
+
+    transferDone = xSemaphoreCreateBinary();
+    if (transferDone == NULL || initDisplay() != ESP_OK)
+    {
+        ESP_LOGE(TAG_DISPLAY, "Cannot set up the display!");
+        // Telemetry holds the handle, so the task has to stay around
+        vTaskSuspend(NULL);
+    }
+    displayFbInit(&fb, DISPLAY_MONO, KB_DISPLAY_WIDTH, KB_DISPLAY_HEIGHT, pixels);
+    displayUiInit(&ui, &fb);
+    wpmMeterInit(&wpm);
+    startUs = esp_timer_get_time();
+    wake = xTaskGetTickCount();
+
+    while (1)
+    {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(KB_DISPLAY_FRAME_MS));
+
+        frameStartUs = esp_timer_get_time();
+        getKeymapStats(&keymapStats, &activeLayers);
+        status.layer = layerName(activeLayers, layerBuffer, sizeof(layerBuffer));
+        status.protocol = getCommsTransportName();
+        status.wpm = wpmMeterUpdate(&wpm, keymapStats.resolved, (uint32_t)frameStartUs);
+
+        displayUiRender(&ui, &status);
+        renderedUs = esp_timer_get_time();
+        // Only the regions that changed go out
+        displayFbFlush(&fb, &lcdPanel, transfer, sizeof(transfer));
+        displayFbAccount(&fb, (uint32_t)(renderedUs - frameStartUs), (uint32_t)(esp_timer_get_time() - renderedUs));
+    }
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "display_ui.h"
+
+#define LINE_HEIGHT (DISPLAY_FONT_HEIGHT + 1)
+#define CHAR_WIDTH (DISPLAY_FONT_WIDTH + 1)
+
+// Lines sit on page boundaries, a mono panel then only gets the pages of the lines that changed
+void displayUiInit(struct DisplayUi *ui, struct DisplayFb *fb)
+{
+    int16_t width = (int16_t)fb->width;
+
+    memset(ui, 0, sizeof(*ui));
+    ui->fb = fb;
+    ui->widgets[DISPLAY_WIDGET_LAYER].box = (struct DisplayRect){0, 0, width, LINE_HEIGHT};
+    ui->widgets[DISPLAY_WIDGET_PROTOCOL].box = (struct DisplayRect){0, 2 * LINE_HEIGHT, width / 2, 3 * LINE_HEIGHT};
+    ui->widgets[DISPLAY_WIDGET_BATTERY].box = (struct DisplayRect){width / 2, 2 * LINE_HEIGHT, width, 3 * LINE_HEIGHT};
+    ui->widgets[DISPLAY_WIDGET_BATTERY].alignRight = true;
+    ui->widgets[DISPLAY_WIDGET_WPM].box = (struct DisplayRect){0, 4 * LINE_HEIGHT, width, 5 * LINE_HEIGHT};
+}
+
+static void drawWidget(struct DisplayUi *ui, struct DisplayWidget *widget, const char *text)
+{
+    struct DisplayRect box = widget->box;
+    int16_t maxChars = (int16_t)((box.x1 - box.x0) / CHAR_WIDTH);
+    char shown[DISPLAY_TEXT_MAX];
+    int16_t x = box.x0;
+
+    if (widget->drawn && strcmp(widget->text, text) == 0)
+    {
+        return;
+    }
+    snprintf(widget->text, sizeof(widget->text), "%s", text);
+    snprintf(shown, sizeof(shown), "%.*s", maxChars, text);
+    if (widget->alignRight)
+    {
+        x = (int16_t)(box.x1 - (int16_t)strlen(shown) * CHAR_WIDTH);
+    }
+
+    // Clearing around the text instead of under it keeps unchanged pixels out of the dirty regions
+    displayFbFill(ui->fb, &(struct DisplayRect){box.x0, box.y0, x, box.y1}, DISPLAY_BLACK);
+    x = displayFbText(ui->fb, x, box.y0, shown, DISPLAY_WHITE, DISPLAY_BLACK);
+    displayFbFill(ui->fb, &(struct DisplayRect){x, box.y0, box.x1, box.y1}, DISPLAY_BLACK);
+    widget->drawn = true;
+    ui->redraws++;
+}
+
+void displayUiRender(struct DisplayUi *ui, const struct DisplayStatus *status)
+{
+    char text[DISPLAY_TEXT_MAX];
+
+    snprintf(text, sizeof(text), "Layer: %s", status->layer);
+    drawWidget(ui, &ui->widgets[DISPLAY_WIDGET_LAYER], text);
+    drawWidget(ui, &ui->widgets[DISPLAY_WIDGET_PROTOCOL], status->protocol);
+    if (status->batteryPercent == DISPLAY_BATTERY_NONE)
+    {
+        snprintf(text, sizeof(text), "BAT --");
+    }
+    else
+    {
+        snprintf(text, sizeof(text), "BAT %u%%", status->batteryPercent);
+    }
+    drawWidget(ui, &ui->widgets[DISPLAY_WIDGET_BATTERY], text);
+    snprintf(text, sizeof(text), "WPM %u", status->wpm);
+    drawWidget(ui, &ui->widgets[DISPLAY_WIDGET_WPM], text);
+}
+
+void wpmMeterInit(struct WpmMeter *meter)
+{
+    memset(meter, 0, sizeof(*meter));
+}
+
+// presses is any running count of key presses, only its change matters
+uint16_t wpmMeterUpdate(struct WpmMeter *meter, uint32_t presses, uint32_t nowUs)
+{
+    uint32_t total = 0;
+
+    if (!meter->started)
+    {
+        meter->lastPresses = presses;
+        meter->bucketUs = nowUs;
+        meter->started = true;
+    }
+    for (int i = 0; nowUs - meter->bucketUs >= WPM_BUCKET_US; i++)
+    {
+        // Idle for a whole window, start over from now
+        if (i == WPM_BUCKETS)
+        {
+            meter->bucketUs = nowUs;
+            break;
+        }
+        meter->current = (uint8_t)((meter->current + 1) % WPM_BUCKETS);
+        meter->buckets[meter->current] = 0;
+        meter->bucketUs += WPM_BUCKET_US;
+    }
+    meter->buckets[meter->current] += (uint16_t)(presses - meter->lastPresses);
+    meter->lastPresses = presses;
+
+    for (int i = 0; i < WPM_BUCKETS; i++)
+    {
+        total += meter->buckets[i];
+    }
+    return (uint16_t)(total * 60 * 1000000ULL / ((uint64_t)WPM_CHARS_PER_WORD * WPM_BUCKETS * WPM_BUCKET_US));
+}
@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "dlog.h"
+
+#define DLOG_ENTRY(id, level, tag, format) [id] = {level, tag, format},
+const struct DlogFormat dlogFormats[DLOG_COUNT] = {
+    DLOG_FORMATS(DLOG_ENTRY)
+};
+#undef DLOG_ENTRY
+
+void dlogRingInit(struct DlogRing *ring)
+{
+    memset(ring, 0, sizeof(*ring));
+}
+
+bool dlogRead(struct DlogRing *ring, struct DlogRecord *record)
+{
+    uint32_t tail = ring->tail;
+
+    if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+    *record = ring->records[tail & (DLOG_RING_SIZE - 1)];
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Message text only, the caller adds level, time and tag. Formats ignore arguments they do not use
+int dlogFormat(const struct DlogRecord *record, char *text, size_t size)
+{
+    if (record->id >= DLOG_COUNT)
+    {
+        return snprintf(text, size, "Unknown log id %u", record->id);
+    }
+    return snprintf(text, size, dlogFormats[record->id].format, record->args[0], record->args[1], record->args[2], record->args[3]);
+}
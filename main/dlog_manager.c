@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "dlog_manager.h"
+
+const char *TAG_DLOG = "dlog";
+
+static struct DlogRing rings[KB_DLOG_RINGS];
+// Task writing each ring, claimed once and never given back
+static TaskHandle_t owners[KB_DLOG_RINGS] = {0};
+static uint32_t noRing = 0;
+static uint32_t printed = 0;
+
+static struct DlogRing *ringOfTask(TaskHandle_t task)
+{
+    TaskHandle_t owner = NULL;
+
+    for (int i = 0; i < KB_DLOG_RINGS; i++)
+    {
+        owner = __atomic_load_n(&owners[i], __ATOMIC_ACQUIRE);
+        if (owner == task)
+        {
+            return &rings[i];
+        }
+        // Two tasks claiming at once cannot end up with the same ring
+        if (owner == NULL && __atomic_compare_exchange_n(&owners[i], &owner, task, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            return &rings[i];
+        }
+        if (owner == task)
+        {
+            return &rings[i];
+        }
+    }
+    return NULL;
+}
+
+// Safe from any task, never blocks. Records from interrupts are only counted
+void dlogRecord(enum DlogId id, const uint32_t args[DLOG_MAX_ARGS])
+{
+    struct DlogRing *ring = xPortInIsrContext() ? NULL : ringOfTask(xTaskGetCurrentTaskHandle());
+
+    if (ring == NULL)
+    {
+        __atomic_fetch_add(&noRing, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    dlogWrite(ring, (uint16_t)id, (uint32_t)esp_timer_get_time(), args);
+}
+
+void getDlogStats(struct DlogStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < KB_DLOG_RINGS; i++)
+    {
+        if (__atomic_load_n(&owners[i], __ATOMIC_ACQUIRE) == NULL)
+        {
+            continue;
+        }
+        stats->written += rings[i].written;
+        stats->dropped += rings[i].dropped;
+        stats->rings++;
+    }
+    stats->noRing = __atomic_load_n(&noRing, __ATOMIC_RELAXED);
+    stats->printed = printed;
+}
+
+// Formatting and the console write happen here, a slow console only holds up this task
+void vDlogTask(void *godParameters)
+{
+    struct DlogRecord record;
+    uint32_t reported[KB_DLOG_RINGS] = {0};
+    uint32_t dropped = 0;
+    char text[128];
+    TaskHandle_t owner = NULL;
+    TickType_t wake = 0;
+
+    // Rings are zeroed statics and may already hold records from tasks that started first
+    ESP_LOGI(TAG_DLOG, "Initializing deferred log task...");
+    wake = xTaskGetTickCount();
+
+    while (1)
+    {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(KB_DLOG_DRAIN_MS));
+
+        for (int i = 0; i < KB_DLOG_RINGS; i++)
+        {
+            owner = __atomic_load_n(&owners[i], __ATOMIC_ACQUIRE);
+            if (owner == NULL)
+            {
+                continue;
+            }
+            while (dlogRead(&rings[i], &record))
+            {
+                dlogFormat(&record, text, sizeof(text));
+                printf("%c (%" PRIu32 ") %s: %s\n", record.id < DLOG_COUNT ? dlogFormats[record.id].level : 'E', record.timeUs / 1000,
+                       record.id < DLOG_COUNT ? dlogFormats[record.id].tag : TAG_DLOG, text);
+                printed++;
+            }
+            dropped = rings[i].dropped;
+            if (dropped != reported[i])
+            {
+                ESP_LOGW(TAG_DLOG, "%" PRIu32 " messages from %s dropped", dropped - reported[i], pcTaskGetName(owner));
+                reported[i] = dropped;
+            }
+        }
+    }
+}
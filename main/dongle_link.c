@@ -0,0 +1,381 @@
+#include <string.h>
+
+#include "dongle_link.h"
+
+#define KEEPALIVE_US (DONGLE_KEEPALIVE_MS * 1000u)
+#define TIMEOUT_US (DONGLE_TIMEOUT_MS * 1000u)
+
+static size_t encodeHeader(struct DongleSender *sender, uint8_t type, uint8_t *frame)
+{
+    frame[0] = DONGLE_FRAME_MAGIC;
+    frame[1] = sender->session;
+    frame[2] = (uint8_t)sender->seq;
+    frame[3] = (uint8_t)(sender->seq >> 8);
+    frame[4] = type;
+    sender->seq++;
+    return DONGLE_HEADER_SIZE;
+}
+
+void dongleSenderInit(struct DongleSender *sender, const struct DongleRadio *radio, uint8_t session)
+{
+    memset(sender, 0, sizeof(*sender));
+    sender->radio = radio;
+    sender->session = session;
+}
+
+static void sendCopy(struct DongleSender *sender, struct DongleCopy *copy, uint32_t nowUs)
+{
+    if (!sender->radio->send(sender->radio->ctx, copy->frame, copy->length))
+    {
+        sender->stats.radioErrors++;
+    }
+    sender->stats.copies++;
+    sender->lastFrameUs = nowUs;
+    copy->dueUs = nowUs + DONGLE_COPY_SPACING_US;
+    copy->copiesLeft--;
+}
+
+static struct DongleCopy *freeSlot(struct DongleSender *sender)
+{
+    for (int i = 0; i < DONGLE_SENDER_SLOTS; i++)
+    {
+        if (sender->slots[i].copiesLeft == 0)
+        {
+            return &sender->slots[i];
+        }
+    }
+    return NULL;
+}
+
+bool dongleSenderHasRoom(const struct DongleSender *sender)
+{
+    for (int i = 0; i < DONGLE_SENDER_SLOTS; i++)
+    {
+        if (sender->slots[i].copiesLeft == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// First copy goes out right away, the rest are sent by dongleSenderPoll
+static bool queueFrame(struct DongleSender *sender, struct DongleCopy *copy, uint32_t nowUs)
+{
+    copy->copiesLeft = DONGLE_COPIES;
+    sender->stats.frames++;
+    sendCopy(sender, copy, nowUs);
+    return true;
+}
+
+static size_t encodeState(struct DongleSender *sender, uint8_t type, uint8_t *frame)
+{
+    size_t length = encodeHeader(sender, type, frame);
+
+    frame[length++] = sender->modifier;
+    memcpy(&frame[length], sender->bitmap, KB_NKRO_BYTES);
+    length += KB_NKRO_BYTES;
+    if (type == DONGLE_FRAME_FULL)
+    {
+        frame[length++] = sender->buttons;
+    }
+    return length;
+}
+
+// Keyboard frames carry the whole state, a newer one makes older copies pointless
+bool dongleSenderKeyboard(struct DongleSender *sender, const struct KeyboardData *data, uint32_t nowUs)
+{
+    struct DongleCopy *copy = NULL;
+
+    for (int i = 0; i < DONGLE_SENDER_SLOTS; i++)
+    {
+        if (sender->slots[i].copiesLeft > 0 && sender->slots[i].type != DONGLE_FRAME_POINTER)
+        {
+            sender->stats.superseded += sender->slots[i].copiesLeft;
+            sender->slots[i].copiesLeft = 0;
+        }
+    }
+    copy = freeSlot(sender);
+    if (copy == NULL)
+    {
+        return false;
+    }
+
+    sender->modifier = data->modifier;
+    memcpy(sender->bitmap, data->bitmap, KB_NKRO_BYTES);
+    copy->type = DONGLE_FRAME_KEYBOARD;
+    copy->length = (uint8_t)encodeState(sender, DONGLE_FRAME_KEYBOARD, copy->frame);
+    return queueFrame(sender, copy, nowUs);
+}
+
+bool dongleSenderPointer(struct DongleSender *sender, const struct MouseData *data, uint32_t nowUs)
+{
+    struct DongleCopy *copy = freeSlot(sender);
+    size_t length = 0;
+
+    if (copy == NULL)
+    {
+        return false;
+    }
+
+    sender->buttons = data->button;
+    length = encodeHeader(sender, DONGLE_FRAME_POINTER, copy->frame);
+    copy->frame[length++] = data->button;
+    copy->frame[length++] = (uint8_t)data->delta_x;
+    copy->frame[length++] = (uint8_t)((uint16_t)data->delta_x >> 8);
+    copy->frame[length++] = (uint8_t)data->delta_y;
+    copy->frame[length++] = (uint8_t)((uint16_t)data->delta_y >> 8);
+    copy->frame[length++] = (uint8_t)data->scroll_vertical;
+    copy->frame[length++] = (uint8_t)data->scroll_horizontal;
+    copy->type = DONGLE_FRAME_POINTER;
+    copy->length = (uint8_t)length;
+    return queueFrame(sender, copy, nowUs);
+}
+
+// Sends due copies and keepalives, returns true if a slot became free
+bool dongleSenderPoll(struct DongleSender *sender, uint32_t nowUs)
+{
+    struct DongleCopy *copy = NULL;
+    bool freed = false;
+
+    for (int i = 0; i < DONGLE_SENDER_SLOTS; i++)
+    {
+        copy = &sender->slots[i];
+        if (copy->copiesLeft > 0 && (int32_t)(nowUs - copy->dueUs) >= 0)
+        {
+            sendCopy(sender, copy, nowUs);
+            freed = freed || copy->copiesLeft == 0;
+        }
+    }
+
+    if (nowUs - sender->lastFrameUs >= KEEPALIVE_US && (copy = freeSlot(sender)) != NULL)
+    {
+        // Single copy, the next keepalive covers its loss
+        copy->type = DONGLE_FRAME_FULL;
+        copy->length = (uint8_t)encodeState(sender, DONGLE_FRAME_FULL, copy->frame);
+        copy->copiesLeft = 1;
+        sender->stats.keepalives++;
+        sendCopy(sender, copy, nowUs);
+    }
+    return freed;
+}
+
+// Earliest time dongleSenderPoll has work, keepalives included
+bool dongleSenderNextDue(const struct DongleSender *sender, uint32_t *dueUs)
+{
+    bool found = false;
+
+    *dueUs = sender->lastFrameUs + KEEPALIVE_US;
+    for (int i = 0; i < DONGLE_SENDER_SLOTS; i++)
+    {
+        if (sender->slots[i].copiesLeft > 0 && (!found || (int32_t)(sender->slots[i].dueUs - *dueUs) < 0))
+        {
+            *dueUs = sender->slots[i].dueUs;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void dongleReceiverInit(struct DongleReceiver *receiver)
+{
+    memset(receiver, 0, sizeof(*receiver));
+}
+
+static void buildKeyboard(const struct DongleReceiver *receiver, struct KeyboardData *data)
+{
+    uint8_t count = 0;
+
+    memset(data, 0, sizeof(*data));
+    data->modifier = receiver->modifier;
+    memcpy(data->bitmap, receiver->bitmap, KB_NKRO_BYTES);
+    // Press order is not on the wire, 6KRO hosts get the lowest keycodes
+    for (int i = 0; i < KB_NKRO_BYTES * 8 && count < KB_BUFFER_SIZE; i++)
+    {
+        if (receiver->bitmap[i >> 3] & (1u << (i & 7)))
+        {
+            data->keycode[count++] = (uint8_t)i;
+        }
+    }
+}
+
+static uint8_t applyState(struct DongleReceiver *receiver, const uint8_t *payload, bool full, struct DongleReport *report)
+{
+    uint8_t result = 0;
+
+    if (payload[0] != receiver->modifier || memcmp(&payload[1], receiver->bitmap, KB_NKRO_BYTES) != 0)
+    {
+        receiver->modifier = payload[0];
+        memcpy(receiver->bitmap, &payload[1], KB_NKRO_BYTES);
+        buildKeyboard(receiver, &report->keyboard);
+        result |= DONGLE_REPORT_KEYBOARD;
+    }
+    if (full && payload[1 + KB_NKRO_BYTES] != receiver->buttons)
+    {
+        receiver->buttons = payload[1 + KB_NKRO_BYTES];
+        memset(&report->mouse, 0, sizeof(report->mouse));
+        report->mouse.button = receiver->buttons;
+        result |= DONGLE_REPORT_POINTER;
+    }
+    if (full && result)
+    {
+        receiver->stats.recovered++;
+    }
+    return result;
+}
+
+// Returns which reports in report changed, 0 for duplicates
+uint8_t dongleReceiverPush(struct DongleReceiver *receiver, const uint8_t *frame, size_t length, uint32_t nowUs, struct DongleReport *report)
+{
+    const uint8_t *payload = &frame[DONGLE_HEADER_SIZE];
+    uint16_t seq = 0;
+    int16_t ahead = 0;
+
+    if (length < DONGLE_HEADER_SIZE || frame[0] != DONGLE_FRAME_MAGIC)
+    {
+        receiver->stats.badFrames++;
+        return 0;
+    }
+    seq = (uint16_t)(frame[2] | (frame[3] << 8));
+
+    // New session means the keyboard restarted, its sequence starts over
+    if (receiver->synced && frame[1] == receiver->session)
+    {
+        ahead = (int16_t)(seq - receiver->lastSeq);
+        if (ahead <= 0)
+        {
+            receiver->stats.duplicates++;
+            return 0;
+        }
+        receiver->stats.missed += (uint32_t)(ahead - 1);
+    }
+    receiver->synced = true;
+    receiver->session = frame[1];
+    receiver->lastSeq = seq;
+    receiver->lastFrameUs = nowUs;
+    receiver->stats.frames++;
+
+    switch (frame[4])
+    {
+    case DONGLE_FRAME_KEYBOARD:
+        if (length < DONGLE_HEADER_SIZE + 1 + KB_NKRO_BYTES)
+        {
+            break;
+        }
+        return applyState(receiver, payload, false, report);
+    case DONGLE_FRAME_FULL:
+        if (length < DONGLE_HEADER_SIZE + 2 + KB_NKRO_BYTES)
+        {
+            break;
+        }
+        receiver->stats.keepalives++;
+        return applyState(receiver, payload, true, report);
+    case DONGLE_FRAME_POINTER:
+        if (length < DONGLE_HEADER_SIZE + 7)
+        {
+            break;
+        }
+        receiver->buttons = payload[0];
+        report->mouse.button = payload[0];
+        report->mouse.delta_x = (int16_t)(payload[1] | (payload[2] << 8));
+        report->mouse.delta_y = (int16_t)(payload[3] | (payload[4] << 8));
+        report->mouse.scroll_vertical = (int8_t)payload[5];
+        report->mouse.scroll_horizontal = (int8_t)payload[6];
+        return DONGLE_REPORT_POINTER;
+    default:
+        break;
+    }
+    receiver->stats.badFrames++;
+    return 0;
+}
+
+// Releases everything once the keyboard went quiet, keepalives stop only if it is gone
+uint8_t dongleReceiverPoll(struct DongleReceiver *receiver, uint32_t nowUs, struct DongleReport *report)
+{
+    uint8_t result = 0;
+
+    if (!receiver->synced || nowUs - receiver->lastFrameUs < TIMEOUT_US)
+    {
+        return 0;
+    }
+    receiver->synced = false;
+    receiver->stats.timeouts++;
+
+    if (receiver->modifier || memcmp(receiver->bitmap, (uint8_t[KB_NKRO_BYTES]){0}, KB_NKRO_BYTES) != 0)
+    {
+        receiver->modifier = 0;
+        memset(receiver->bitmap, 0, KB_NKRO_BYTES);
+        buildKeyboard(receiver, &report->keyboard);
+        result |= DONGLE_REPORT_KEYBOARD;
+    }
+    if (receiver->buttons)
+    {
+        receiver->buttons = 0;
+        memset(&report->mouse, 0, sizeof(report->mouse));
+        result |= DONGLE_REPORT_POINTER;
+    }
+    return result;
+}
+
+bool dongleReceiverConnected(const struct DongleReceiver *receiver)
+{
+    return receiver->synced;
+}
+
+static uint32_t channelRandom(struct DongleChannel *channel)
+{
+    channel->seed = channel->seed * 1664525u + 1013904223u;
+    return channel->seed >> 16;
+}
+
+static bool channelSend(void *ctx, const uint8_t *frame, size_t length)
+{
+    struct DongleChannel *channel = (struct DongleChannel *)ctx;
+    struct DongleChannelFrame *slot = NULL;
+    uint32_t chance = channel->lastLost ? channel->burstPercent * 10u : channel->lossPermille;
+
+    channel->sent++;
+    channel->lastLost = channelRandom(channel) % 1000 < chance;
+    if (channel->lastLost)
+    {
+        channel->lost++;
+        return true;
+    }
+    if (channel->count == DONGLE_CHANNEL_DEPTH || length > DONGLE_FRAME_MAX)
+    {
+        channel->overflowed++;
+        return false;
+    }
+
+    // Airtime is the same for every frame, so jitter never reorders them
+    slot = &channel->frames[(channel->head + channel->count++) % DONGLE_CHANNEL_DEPTH];
+    memcpy(slot->frame, frame, length);
+    slot->length = (uint8_t)length;
+    slot->dueUs = channel->nowUs + channel->delayUs + (channel->jitterUs ? channelRandom(channel) % (channel->jitterUs + 1) : 0);
+    return true;
+}
+
+void dongleChannelInit(struct DongleChannel *channel, struct DongleRadio *radio)
+{
+    memset(channel, 0, sizeof(*channel));
+    channel->seed = 1;
+    radio->ctx = channel;
+    radio->send = channelSend;
+}
+
+// Next frame that arrived by nowUs, 0 if none
+size_t dongleChannelReceive(struct DongleChannel *channel, uint8_t *frame, size_t max)
+{
+    struct DongleChannelFrame *slot = &channel->frames[channel->head];
+    size_t length = 0;
+
+    if (channel->count == 0 || (int32_t)(channel->nowUs - slot->dueUs) < 0)
+    {
+        return 0;
+    }
+    length = slot->length < max ? slot->length : max;
+    memcpy(frame, slot->frame, length);
+    channel->head = (channel->head + 1) % DONGLE_CHANNEL_DEPTH;
+    channel->count--;
+    return length;
+}
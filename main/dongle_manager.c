@@ -0,0 +1,171 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "dongle_link.h"
+#include "dongle_manager.h"
+#include "espnow_radio.h"
+#include "transport_usb.h"
+#include "dlog_manager.h"
+
+const char *TAG_DONGLE = "dongle";
+
+// Length 0 only wakes the task, e.g. after a USB endpoint completed
+struct DongleFrame
+{
+    uint8_t length;
+    uint8_t data[DONGLE_FRAME_MAX];
+};
+
+static QueueHandle_t frameQueue = NULL;
+static struct DongleReceiver receiver = {0};
+// Keyboard the dongle follows, the first one heard after boot
+static uint8_t pairedMac[6] = {0};
+static bool paired = false;
+
+// Newest state for each endpoint, pointer motion adds up while the endpoint is busy
+static struct KeyboardData pendingKeyboard = {0};
+static bool keyboardPending = false;
+static struct MouseData pendingMouse = {0};
+static int32_t pendingX = 0, pendingY = 0;
+static bool mousePending = false;
+
+// Runs in the WiFi task
+static void dongleReceive(const uint8_t *mac, const uint8_t *data, int length)
+{
+    struct DongleFrame frame;
+
+    if (length <= 0 || length > DONGLE_FRAME_MAX || data[0] != DONGLE_FRAME_MAGIC)
+    {
+        return;
+    }
+    if (!paired)
+    {
+        memcpy(pairedMac, mac, sizeof(pairedMac));
+        paired = true;
+    }
+    else if (memcmp(pairedMac, mac, sizeof(pairedMac)) != 0)
+    {
+        return;
+    }
+
+    frame.length = (uint8_t)length;
+    memcpy(frame.data, data, length);
+    xQueueSend(frameQueue, &frame, 0);
+}
+
+// Runs in the TinyUSB task
+static void dongleUsbComplete(void *owner, enum ReportType type)
+{
+    struct DongleFrame wake = {0};
+
+    xQueueSend(frameQueue, &wake, 0);
+}
+
+static int16_t takeAxis(int32_t *accumulated)
+{
+    int32_t delta = *accumulated;
+
+    delta = delta > INT16_MAX ? INT16_MAX : (delta < -INT16_MAX ? -INT16_MAX : delta);
+    *accumulated -= delta;
+    return (int16_t)delta;
+}
+
+static void flushReports(const struct Transport *usb)
+{
+    struct MouseData mouse;
+
+    if (!usb->connected(usb->ctx))
+    {
+        return;
+    }
+    if (keyboardPending && usb->ready(usb->ctx, REPORT_KEYBOARD) && usb->sendKeyboard(usb->ctx, &pendingKeyboard))
+    {
+        keyboardPending = false;
+    }
+    if (mousePending && usb->ready(usb->ctx, REPORT_MOUSE))
+    {
+        mouse = pendingMouse;
+        mouse.delta_x = takeAxis(&pendingX);
+        mouse.delta_y = takeAxis(&pendingY);
+        if (usb->sendPointer(usb->ctx, &mouse))
+        {
+            pendingMouse.scroll_vertical = pendingMouse.scroll_horizontal = 0;
+            mousePending = pendingX || pendingY;
+        }
+        else
+        {
+            pendingX += mouse.delta_x;
+            pendingY += mouse.delta_y;
+        }
+    }
+}
+
+static void collectReport(const struct Transport *usb, uint8_t changed, const struct DongleReport *report)
+{
+    if (changed & DONGLE_REPORT_KEYBOARD)
+    {
+        pendingKeyboard = report->keyboard;
+        keyboardPending = true;
+    }
+    if (changed & DONGLE_REPORT_POINTER)
+    {
+        // Motion so far belongs to the old buttons, get it out before they change
+        if (mousePending && pendingMouse.button != report->mouse.button)
+        {
+            flushReports(usb);
+        }
+        pendingMouse.button = report->mouse.button;
+        pendingX += report->mouse.delta_x;
+        pendingY += report->mouse.delta_y;
+        pendingMouse.scroll_vertical += report->mouse.scroll_vertical;
+        pendingMouse.scroll_horizontal += report->mouse.scroll_horizontal;
+        mousePending = true;
+    }
+}
+
+void getDongleReceiverStats(struct DongleReceiverStats *stats)
+{
+    *stats = receiver.stats;
+}
+
+void vDongleTask(void *godParameters)
+{
+    const struct Transport *usb = getUsbTransport();
+    struct DongleFrame frame;
+    struct DongleReport report;
+    uint8_t changed = 0;
+
+    ESP_LOGI(TAG_DONGLE, "Initializing dongle task...");
+    frameQueue = xQueueCreate(DONGLE_FRAME_QUEUE_LEN, sizeof(struct DongleFrame));
+    configASSERT(frameQueue);
+    dongleReceiverInit(&receiver);
+
+    if (!usb->init(usb->ctx, dongleUsbComplete, NULL))
+    {
+        ESP_LOGE(TAG_DONGLE, "USB failed to start");
+    }
+    ESP_ERROR_CHECK(espnowRadioInit(dongleReceive));
+
+    while (1)
+    {
+        // Wakes on every frame copy and USB completion, otherwise checks for a silent keyboard
+        if (xQueueReceive(frameQueue, &frame, pdMS_TO_TICKS(DONGLE_KEEPALIVE_MS)) == pdTRUE && frame.length > 0)
+        {
+            changed = dongleReceiverPush(&receiver, frame.data, frame.length, (uint32_t)esp_timer_get_time(), &report);
+            collectReport(usb, changed, &report);
+        }
+
+        changed = dongleReceiverPoll(&receiver, (uint32_t)esp_timer_get_time(), &report);
+        if (changed)
+        {
+            DLOG(DLOG_KEYBOARD_SILENT, 0);
+            collectReport(usb, changed, &report);
+        }
+
+        flushReports(usb);
+    }
+}
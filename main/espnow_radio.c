@@ -0,0 +1,128 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_wifi.h"
+#include "esp_now.h"
+
+#include "espnow_radio.h"
+
+const char *TAG_ESPNOW = "espnow";
+
+static const uint8_t broadcastMac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static EspnowReceiveFn receiveCallback = NULL;
+static bool wifiReady = false;
+static bool wifiStarted = false;
+
+static void espnowReceive(const esp_now_recv_info_t *info, const uint8_t *data, int length)
+{
+    if (receiveCallback != NULL)
+    {
+        receiveCallback(info->src_addr, data, length);
+    }
+}
+
+// Broadcasts are never retried by the MAC, redundancy is up to the dongle link
+static bool espnowSend(void *ctx, const uint8_t *frame, size_t length)
+{
+    return esp_now_send(broadcastMac, frame, length) == ESP_OK;
+}
+
+static const struct DongleRadio espnowRadio = {
+    .ctx = NULL,
+    .send = espnowSend,
+};
+
+// Driver and buffers only, the RF part stays off until ESP-NOW is first used
+esp_err_t espnowRadioPrepare()
+{
+    esp_err_t err = ESP_OK;
+    wifi_init_config_t config = WIFI_INIT_CONFIG_DEFAULT();
+
+    if (wifiReady)
+    {
+        return ESP_OK;
+    }
+    err = esp_event_loop_create_default();
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+    {
+        return err;
+    }
+    err = esp_wifi_init(&config);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    wifiReady = true;
+    return ESP_OK;
+}
+
+static esp_err_t startWifi()
+{
+    esp_err_t err = espnowRadioPrepare();
+
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = esp_wifi_start();
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    // Modem sleep would hold frames until the next beacon interval
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));
+    return esp_wifi_set_channel(ESPNOW_CHANNEL, WIFI_SECOND_CHAN_NONE);
+}
+
+esp_err_t espnowRadioInit(EspnowReceiveFn receive)
+{
+    esp_err_t err = ESP_OK;
+    esp_now_peer_info_t peer = {
+        .channel = ESPNOW_CHANNEL,
+        .ifidx = WIFI_IF_STA,
+        .encrypt = false,
+    };
+
+    if (!wifiStarted)
+    {
+        err = startWifi();
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG_ESPNOW, "WiFi start failed: %s", esp_err_to_name(err));
+            return err;
+        }
+        wifiStarted = true;
+    }
+
+    err = esp_now_init();
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    receiveCallback = receive;
+    ESP_ERROR_CHECK(esp_now_register_recv_cb(espnowReceive));
+
+    memcpy(peer.peer_addr, broadcastMac, ESP_NOW_ETH_ALEN);
+    err = esp_now_add_peer(&peer);
+    if (err != ESP_OK)
+    {
+        esp_now_deinit();
+        return err;
+    }
+    ESP_LOGI(TAG_ESPNOW, "ESP-NOW up on channel %d", ESPNOW_CHANNEL);
+    return ESP_OK;
+}
+
+// WiFi stays up, restarting it costs far more than keeping the radio idle
+void espnowRadioDeinit()
+{
+    receiveCallback = NULL;
+    esp_now_deinit();
+}
+
+const struct DongleRadio *getEspnowRadio()
+{
+    return &espnowRadio;
+}
@@ -0,0 +1,67 @@
+#include <string.h>
+
+#include "event_merge.h"
+
+void eventMergeInit(struct EventMerge *merge, uint32_t windowUs)
+{
+    memset(merge, 0, sizeof(*merge));
+    merge->windowUs = windowUs;
+}
+
+// Keeps entries sorted by time, equal times stay in arrival order, false if full
+bool eventMergeAdd(struct EventMerge *merge, const struct InputEvent *event, uint32_t timeUs)
+{
+    int i = merge->count;
+    int32_t lateUs = 0;
+
+    if (merge->count >= EVENT_MERGE_SIZE)
+    {
+        return false;
+    }
+
+    while (i > 0 && (int32_t)(merge->entries[i - 1].timeUs - timeUs) > 0)
+    {
+        merge->entries[i] = merge->entries[i - 1];
+        i--;
+    }
+    merge->entries[i].event = *event;
+    merge->entries[i].timeUs = timeUs;
+    merge->count++;
+    merge->merged++;
+    if (i < merge->count - 1)
+    {
+        merge->reordered++;
+    }
+
+    // Something newer already left, this one can only go out behind it
+    lateUs = (int32_t)(merge->releasedUs - timeUs);
+    if (merge->released && lateUs > 0)
+    {
+        merge->late++;
+        if ((uint32_t)lateUs > merge->maxLateUs)
+        {
+            merge->maxLateUs = (uint32_t)lateUs;
+        }
+    }
+    return true;
+}
+
+// Returns the oldest event once it has waited out the window
+bool eventMergePop(struct EventMerge *merge, uint32_t nowUs, struct InputEvent *event)
+{
+    if (merge->count == 0 || (int32_t)(nowUs - merge->entries[0].timeUs) < (int32_t)merge->windowUs)
+    {
+        return false;
+    }
+
+    *event = merge->entries[0].event;
+    if (!merge->released || (int32_t)(merge->entries[0].timeUs - merge->releasedUs) > 0)
+    {
+        merge->releasedUs = merge->entries[0].timeUs;
+    }
+    merge->released = true;
+
+    merge->count--;
+    memmove(&merge->entries[0], &merge->entries[1], merge->count * sizeof(merge->entries[0]));
+    return true;
+}
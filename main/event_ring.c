@@ -0,0 +1,184 @@
+#include <string.h>
+
+#include "event_ring.h"
+
+#define EVENT_RING_MASK (EVENT_RING_SIZE - 1)
+
+void eventRingInit(struct EventRing *ring)
+{
+    memset(ring, 0, sizeof(*ring));
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+}
+
+uint32_t eventRingCount(struct EventRing *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return head - tail;
+}
+
+static bool ringPush(struct EventRing *ring, const struct InputEvent *event, uint32_t reserve)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t used = head - tail;
+
+    if (used + reserve >= EVENT_RING_SIZE)
+    {
+        return false;
+    }
+
+    ring->events[head & EVENT_RING_MASK] = *event;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    if (used + 1 > ring->highWater)
+    {
+        ring->highWater = used + 1;
+    }
+    return true;
+}
+
+// Moves held events into the ring in order, returns true once nothing is held back
+bool eventRingFlush(struct EventRing *ring)
+{
+    uint8_t moved = 0;
+
+    while (moved < ring->backlogCount && ringPush(ring, &ring->backlog[moved], 0))
+    {
+        moved++;
+    }
+    if (moved)
+    {
+        memmove(ring->backlog, &ring->backlog[moved], (ring->backlogCount - moved) * sizeof(struct InputEvent));
+        ring->backlogCount -= moved;
+    }
+
+    if (ring->backlogCount == 0 && ring->mousePending && ringPush(ring, &ring->pendingMouse, EVENT_RING_MOUSE_RESERVE))
+    {
+        ring->mousePending = false;
+    }
+
+    return ring->backlogCount == 0 && !ring->mousePending;
+}
+
+static bool holdEvent(struct EventRing *ring, const struct InputEvent *event)
+{
+    if (ring->backlogCount >= EVENT_BACKLOG_SIZE)
+    {
+        return false;
+    }
+    ring->backlog[ring->backlogCount++] = *event;
+    ring->deferred++;
+    return true;
+}
+
+// Returns false only when both ring and backlog are full, caller has to retry
+bool eventRingPushKey(struct EventRing *ring, const struct InputEvent *event)
+{
+    // Motion accumulated so far happened before this key, keep that order
+    if (ring->mousePending)
+    {
+        // Backlog may only be full because nothing moved it since the consumer made room
+        eventRingFlush(ring);
+    }
+    if (ring->mousePending)
+    {
+        if (!holdEvent(ring, &ring->pendingMouse))
+        {
+            return false;
+        }
+        ring->mousePending = false;
+    }
+
+    eventRingFlush(ring);
+    if (ring->backlogCount == 0 && ringPush(ring, event, 0))
+    {
+        return true;
+    }
+
+    return holdEvent(ring, event);
+}
+
+static int16_t addSaturate16(int16_t a, int16_t b)
+{
+    int32_t sum = (int32_t)a + b;
+
+    return sum > INT16_MAX ? INT16_MAX : sum < INT16_MIN ? INT16_MIN : (int16_t)sum;
+}
+
+static int8_t addSaturate8(int8_t a, int8_t b)
+{
+    int16_t sum = (int16_t)a + b;
+
+    return sum > INT8_MAX ? INT8_MAX : sum < INT8_MIN ? INT8_MIN : (int8_t)sum;
+}
+
+/*
+Motion is merged into one pending event while the ring is busy, button
+changes are never merged. Returns false when a button change found the
+backlog full, nothing was queued then and the caller has to retry.
+*/
+bool eventRingPushMouse(struct EventRing *ring, const struct InputEvent *event)
+{
+    struct InputEvent *pending = &ring->pendingMouse;
+
+    eventRingFlush(ring);
+    if (!ring->mousePending && ring->backlogCount == 0 && ringPush(ring, event, EVENT_RING_MOUSE_RESERVE))
+    {
+        return true;
+    }
+
+    if (ring->mousePending && pending->buttons == event->buttons)
+    {
+        pending->delta_x = addSaturate16(pending->delta_x, event->delta_x);
+        pending->delta_y = addSaturate16(pending->delta_y, event->delta_y);
+        pending->scroll_vertical = addSaturate8(pending->scroll_vertical, event->scroll_vertical);
+        pending->scroll_horizontal = addSaturate8(pending->scroll_horizontal, event->scroll_horizontal);
+        ring->mouseCoalesced++;
+        return true;
+    }
+
+    if (ring->mousePending)
+    {
+        // Button changed, older motion has to go out as its own event
+        if (!holdEvent(ring, pending))
+        {
+            return false;
+        }
+    }
+
+    *pending = *event;
+    ring->mousePending = true;
+    return true;
+}
+
+// Copies the oldest event out without consuming it
+bool eventRingPeek(struct EventRing *ring, struct InputEvent *event)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (head == tail)
+    {
+        return false;
+    }
+
+    *event = ring->events[tail & EVENT_RING_MASK];
+    return true;
+}
+
+bool eventRingPop(struct EventRing *ring, struct InputEvent *event)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (head == tail)
+    {
+        return false;
+    }
+
+    *event = ring->events[tail & EVENT_RING_MASK];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
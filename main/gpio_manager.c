@@ -1,46 +1,39 @@
+#include <inttypes.h>
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "driver/adc.h"
-#include "class/hid/hid.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_oneshot.h"
+#include "driver/dedic_gpio.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "driver/gptimer.h"
 
 #include "common_kvass.h"
 #include "gpio_manager.h"
-#include "common_utils.h"
+#include "matrix_scanner.h"
+#include "debounce.h"
+#include "scan_timing.h"
+#include "latency_stats.h"
+#include "event_ring.h"
+#include "joystick_filter.h"
+#include "pointer_motion.h"
+#include "event_merge.h"
+#include "keymap.h"
 #include "config_manager.h"
+#include "kb_interconnect_manager.h"
+#include "telemetry.h"
+#include "dlog_manager.h"
 
-#define JOYSTICK_SAMPLE_COUNT 16
+// Conversions are 4 bytes (type 2 output), one frame is what a single DMA interrupt hands over
+#define JOYSTICK_ADC_FRAME_SIZE (64 * SOC_ADC_DIGI_RESULT_BYTES)
+#define JOYSTICK_ADC_POOL_SIZE (4 * JOYSTICK_ADC_FRAME_SIZE)
+#define JOYSTICK_BTN_THRESHOLD_RAW 500
+#define SCAN_TIMER_RESOLUTION_HZ 1000000
 
 const char *TAG_GPIO = "GPIO";
 
-const uint8_t keyboard_layouts[][KB_ROWS][KB_COLS] = {
-    // Layout 1 (left side)
-    {
-        {HID_KEY_ESCAPE, HID_KEY_1, HID_KEY_2, HID_KEY_3, HID_KEY_4, HID_KEY_5, HID_KEY_BACKSPACE},
-        {HID_KEY_TAB, HID_KEY_Q, HID_KEY_W, HID_KEY_E, HID_KEY_R, HID_KEY_T, HID_KEY_ENTER},
-        {HID_KEY_CAPS_LOCK, HID_KEY_A, HID_KEY_S, HID_KEY_D, HID_KEY_F, HID_KEY_G, HID_KEY_PAGE_UP},
-        {HID_KEY_SHIFT_LEFT, HID_KEY_Z, HID_KEY_X, HID_KEY_C, HID_KEY_V, HID_KEY_B, HID_KEY_PAGE_DOWN},
-        {HID_KEY_CONTROL_LEFT, HID_KEY_NONE, HID_KEY_NONE, HID_KEY_ARROW_UP, HID_KEY_ARROW_DOWN, HID_KEY_GUI_LEFT, HID_KEY_NONE},
-    },
-
-    // Layout 2 (right side)
-    {
-        {HID_KEY_MINUS, HID_KEY_0, HID_KEY_9, HID_KEY_8, HID_KEY_7, HID_KEY_6, HID_KEY_SPACE},
-        {HID_KEY_EQUAL, HID_KEY_P, HID_KEY_O, HID_KEY_I, HID_KEY_U, HID_KEY_Y, HID_KEY_BACKSPACE},
-        {HID_KEY_APOSTROPHE, HID_KEY_SEMICOLON, HID_KEY_L, HID_KEY_K, HID_KEY_J, HID_KEY_H, HID_KEY_DELETE},
-        {HID_KEY_BACKSLASH, HID_KEY_SLASH, HID_KEY_PERIOD, HID_KEY_COMMA, HID_KEY_M, HID_KEY_N, HID_KEY_PRINT_SCREEN},
-        {HID_KEY_ALT_RIGHT, HID_KEY_BRACKET_RIGHT, HID_KEY_BRACKET_LEFT, HID_KEY_ARROW_RIGHT, HID_KEY_ARROW_LEFT, HID_KEY_CONTROL_RIGHT, HID_KEY_NONE},
-    }
-};
-
-enum
-{
-    LAYOUT_LEFT_1 = 0,
-    LAYOUT_RIGHT_1,
-    LAYOUT_COUNT,
-};
-
-const uint8_t cols[KB_COLS] = {
+const int cols[KB_COLS] = {
     KB_COL_0_GPIO,
     KB_COL_1_GPIO,
     KB_COL_2_GPIO,
@@ -50,7 +43,7 @@ const uint8_t cols[KB_COLS] = {
     KB_COL_6_GPIO,
 };
 
-const uint8_t rows[KB_ROWS] = {
+const int rows[KB_ROWS] = {
     KB_ROW_0_GPIO,
     KB_ROW_1_GPIO,
     KB_ROW_2_GPIO,
@@ -58,195 +51,708 @@ const uint8_t rows[KB_ROWS] = {
     KB_ROW_4_GPIO,
 };
 
+static const struct PointerConfig pointerConfig = {
+    .curve = KB_POINTER_CURVE,
+    .deadzone = KB_POINTER_DEADZONE_RAW * JOYSTICK_FILTER_SCALE,
+    .fullScale = KB_POINTER_FULL_SCALE_RAW * JOYSTICK_FILTER_SCALE,
+    .maxSpeedPps = KB_POINTER_MAX_SPEED_PPS,
+    .tickHz = KB_JOYSTICK_SCAN_RATE_HZ,
+    .invert = {false, KB_POINTER_INVERT_Y},
+};
+
+static const struct ActionConfig actionConfig = {
+    .tappingTermUs = KB_TAPPING_TERM_MS * 1000,
+    .comboTermUs = KB_COMBO_TERM_MS * 1000,
+    .oneshotTimeoutUs = KB_ONESHOT_TIMEOUT_MS * 1000,
+    .maxDelayUs = KB_ACTION_MAX_DELAY_MS * 1000,
+    .holdOnOtherPress = KB_HOLD_ON_OTHER_PRESS,
+    .permissiveHold = KB_PERMISSIVE_HOLD,
+};
+
+static dedic_gpio_bundle_handle_t colBundle = NULL;
+static dedic_gpio_bundle_handle_t rowBundle = NULL;
+static struct MatrixIo matrixIo = {0};
+static struct MatrixScanner scanner = {0};
+static struct Debouncer debouncer = {0};
+static struct MatrixIdle matrixIdle = {0};
+static TaskHandle_t wakeTask = NULL;
+static volatile uint64_t wakeEdgeUs = 0;
+static gptimer_handle_t matrixTimer = NULL;
+static gptimer_handle_t joystickTimer = NULL;
+static struct ScanTiming matrixTiming = {0};
+static struct ScanTiming joystickTiming = {0};
+static adc_continuous_handle_t joystickAdc = NULL;
+static adc_oneshot_unit_handle_t joystickAdc2 = NULL;
+static struct JoystickFilter joystickFilter = {0};
+static volatile uint32_t joystickPoolOverflows = 0;
+static struct PointerMotion pointer = {0};
+static struct EventMerge eventMerge = {0};
+static struct Keymap keymap = {0};
+static struct ActionEngine actionEngine = {0};
+static bool actionEmitted = false;
+static uint8_t joystickButtons = 0;
+
+static void hwSelectCol(void *ctx, uint8_t col)
+{
+    dedic_gpio_bundle_write(colBundle, MATRIX_COL_MASK, 1u << col);
+    esp_rom_delay_us(KB_MATRIX_SETTLE_US);
+}
+
+static void hwUnselectCols(void *ctx)
+{
+    dedic_gpio_bundle_write(colBundle, MATRIX_COL_MASK, 0);
+}
+
+static uint32_t hwReadRows(void *ctx)
+{
+    // Bundle bits follow rows[] order, so this is already a row mask
+    return dedic_gpio_bundle_read_in(rowBundle);
+}
+
+static void IRAM_ATTR rowWakeIsr(void *arg)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    if (wakeEdgeUs == 0)
+    {
+        wakeEdgeUs = esp_timer_get_time();
+    }
+    xTaskNotifyFromISR(wakeTask, NOTIF_GPIO_WAKE, eSetBits, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+static void hwArmWake(void *ctx)
+{
+    wakeEdgeUs = 0;
+    dedic_gpio_bundle_write(colBundle, MATRIX_COL_MASK, MATRIX_COL_MASK);
+    for (int j = 0; j < KB_ROWS; j++)
+    {
+        gpio_intr_enable(rows[j]);
+    }
+}
+
+static void hwDisarmWake(void *ctx)
+{
+    for (int j = 0; j < KB_ROWS; j++)
+    {
+        gpio_intr_disable(rows[j]);
+    }
+    dedic_gpio_bundle_write(colBundle, MATRIX_COL_MASK, 0);
+}
+
+esp_err_t initMatrixIo()
+{
+    esp_err_t err = ESP_OK;
+    gpio_config_t colConfig = {
+        .mode = GPIO_MODE_OUTPUT,
+    };
+    gpio_config_t rowConfig = {
+        .mode = GPIO_MODE_INPUT,
+        .pull_down_en = GPIO_PULLDOWN_ENABLE,
+        .intr_type = GPIO_INTR_POSEDGE,
+    };
+
+    for (int i = 0; i < KB_COLS; i++)
+    {
+        colConfig.pin_bit_mask |= 1ULL << cols[i];
+    }
+    for (int j = 0; j < KB_ROWS; j++)
+    {
+        rowConfig.pin_bit_mask |= 1ULL << rows[j];
+    }
+    ESP_ERROR_CHECK(gpio_config(&colConfig));
+    ESP_ERROR_CHECK(gpio_config(&rowConfig));
+
+    dedic_gpio_bundle_config_t colBundleConfig = {
+        .gpio_array = cols,
+        .array_size = KB_COLS,
+        .flags = {
+            .out_en = 1,
+        },
+    };
+    dedic_gpio_bundle_config_t rowBundleConfig = {
+        .gpio_array = rows,
+        .array_size = KB_ROWS,
+        .flags = {
+            .in_en = 1,
+        },
+    };
+
+    err = dedic_gpio_new_bundle(&colBundleConfig, &colBundle);
+    if (err)
+    {
+        ESP_LOGE(TAG_GPIO, "Cannot create column bundle (%s)!", esp_err_to_name(err));
+        return err;
+    }
+    err = dedic_gpio_new_bundle(&rowBundleConfig, &rowBundle);
+    if (err)
+    {
+        ESP_LOGE(TAG_GPIO, "Cannot create row bundle (%s)!", esp_err_to_name(err));
+        return err;
+    }
+
+    // Row interrupts stay disabled until the matrix goes idle
+    wakeTask = xTaskGetCurrentTaskHandle();
+    err = gpio_install_isr_service(0);
+    if (err && err != ESP_ERR_INVALID_STATE)
+    {
+        ESP_LOGE(TAG_GPIO, "Cannot install GPIO ISR service (%s)!", esp_err_to_name(err));
+        return err;
+    }
+    for (int j = 0; j < KB_ROWS; j++)
+    {
+        gpio_intr_disable(rows[j]);
+        ESP_ERROR_CHECK(gpio_isr_handler_add(rows[j], rowWakeIsr, NULL));
+    }
+
+    matrixIo.ctx = NULL;
+    matrixIo.selectCol = hwSelectCol;
+    matrixIo.unselectCols = hwUnselectCols;
+    matrixIo.readRows = hwReadRows;
+    matrixIo.armWake = hwArmWake;
+    matrixIo.disarmWake = hwDisarmWake;
+    matrixScannerInit(&scanner, &matrixIo);
+    debounceInit(&debouncer, KB_DEBOUNCE_MODE, KB_DEBOUNCE_SAMPLES, KB_DEBOUNCE_TIMEOUT_MS);
+
+    return err;
+}
+
 int getCurrentLayout()
 {
-    static bool initialized = false;
-    static int8_t side = 0;
+    return getKbSide();
+}
+
+/*
+Sleeps until the comms task has drained the ring or the wait runs out. Only
+NOTIF_RING_SPACE ends it early, scan ticks that come in meanwhile are taken
+off the task so they cannot end every later wait at once. They collect in
+missed, the caller raises them again once it stops retrying.
+*/
+static void waitForRingSpace(struct CommsParameters *commsParams, uint32_t changed, uint32_t *missed)
+{
+    const TickType_t waitTicks = pdMS_TO_TICKS(KB_RING_SPACE_WAIT_MS);
+    TickType_t startTicks = 0;
+    TickType_t elapsedTicks = 0;
+    uint32_t notifyValue = 0;
+
+    // Registered before the comms task is kicked, a drain that happens first still wakes us
+    __atomic_store_n(&commsParams->commsData.spaceWaiter, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
+    xTaskNotify(*commsParams->commsTask, changed | NOTIF_HID_CHANGED, eSetBits);
 
-    if (!initialized)
+    startTicks = xTaskGetTickCount();
+    while (elapsedTicks < waitTicks)
     {
-        esp_err_t err = getKbSide(&side);
-        initialized = true;
+        if (xTaskNotifyWait(0, UINT32_MAX, &notifyValue, waitTicks - elapsedTicks) == pdTRUE)
+        {
+            *missed |= notifyValue & ~NOTIF_RING_SPACE;
+            if ((notifyValue & NOTIF_RING_SPACE) != 0)
+            {
+                return;
+            }
+        }
+        elapsedTicks = xTaskGetTickCount() - startTicks;
     }
+}
 
-    return side;
+// Scan ticks seen while waiting for ring space, raised once for the task loop
+static void raiseMissedNotifications(uint32_t missed)
+{
+    if (missed != 0)
+    {
+        xTaskNotify(xTaskGetCurrentTaskHandle(), missed, eSetBits);
+    }
 }
 
-void populateKeyboard(struct KeyboardData *data, bool press_matrix[KB_ROWS][KB_COLS], int layout)
+// Key transitions are never dropped, producer sleeps until the comms task has made room
+static void pushKeyEvent(struct CommsParameters *commsParams, struct InputEvent *event)
 {
-    uint8_t modifier = 0;
-    static List *list = NULL;
+    uint32_t missed = 0;
+
+    event->queue_us = LATENCY_TIMESTAMP();
+    latencyRecord(LATENCY_SCAN_TO_QUEUE, event->scan_us, event->queue_us);
 
-    if (list == NULL)
+    while (!eventRingPushKey(commsParams->commsData.eventRing, event))
     {
-        list = makeLinkedList();
+        waitForRingSpace(commsParams, NOTIF_KEYB_CHANGED, &missed);
     }
+    raiseMissedNotifications(missed);
+}
 
-    for (int i = 0; i < KB_COLS; i++)
+static void emitKeyEvent(void *ctx, const struct InputEvent *event)
+{
+    struct InputEvent out = *event;
+
+    pushKeyEvent((struct CommsParameters *)ctx, &out);
+    actionEmitted = true;
+}
+
+// Layers only change in scan order, so positions are resolved after the merge
+static void resolveKeyEvent(const struct InputEvent *position)
+{
+    if (position->pressed)
     {
-        for (int j = 0; j < KB_ROWS; j++)
+        ledKeyPressed(position->position);
+    }
+    actionEngineProcess(&actionEngine, position, position->scan_us);
+}
+
+// Events wait in the merge buffer so both halves come out in scan order
+void pushKeyEvents(struct CommsParameters *commsParams, const matrix_row_t matrix[KB_ROWS], const matrix_row_t changes[KB_ROWS], int side, uint32_t scanUs)
+{
+    matrix_row_t changed = 0;
+    struct InputEvent event = {
+        .type = INPUT_EVENT_KEY,
+        .scan_us = scanUs,
+    };
+    int i = 0;
+
+    for (int j = 0; j < KB_ROWS; j++)
+    {
+        changed = changes[j];
+        while (changed)
         {
-            if (press_matrix[j][i])
+            i = matrixPopLowest(&changed);
+            event.position = KEYMAP_KEY_INDEX(side, j, i);
+            event.pressed = (matrix[j] >> i) & 1;
+            if (event.pressed)
             {
-                // Key pressed
-                switch (keyboard_layouts[layout][j][i])
-                {
-                case HID_KEY_CONTROL_LEFT:
-                    modifier = modifier | 1;
-                    break;
-                case HID_KEY_SHIFT_LEFT:
-                    modifier = modifier | (1 << 1);
-                    break;
-                case HID_KEY_ALT_LEFT:
-                    modifier = modifier | (1 << 2);
-                    break;
-                case HID_KEY_GUI_LEFT:
-                    modifier = modifier | (1 << 3);
-                    break;
-                case HID_KEY_CONTROL_RIGHT:
-                    modifier = modifier | (1 << 4);
-                    break;
-                case HID_KEY_SHIFT_RIGHT:
-                    modifier = modifier | (1 << 5);
-                    break;
-                case HID_KEY_ALT_RIGHT:
-                    modifier = modifier | (1 << 6);
-                    break;
-                case HID_KEY_GUI_RIGHT:
-                    modifier = modifier | (1 << 7);
-                    break;
-                default:
-                    if (!existsInLL(keyboard_layouts[layout][j][i], list))
-                    {
-                        addLLElement(keyboard_layouts[layout][j][i], list);
-                    }
-                    break;
-                }
-                ESP_LOGW(TAG_GPIO, "Key [%d,%d] is pressed", j, i);
+                DLOG(DLOG_KEY_PRESSED, j, i, side);
             }
-            else
+            if (!eventMergeAdd(&eventMerge, &event, scanUs))
             {
-                // Key released
-                deleteLLElement(keyboard_layouts[layout][j][i], list);
+                // Buffer only fills if the comms task stalls, order no longer matters then
+                resolveKeyEvent(&event);
             }
         }
     }
+}
+
+// Moves events that waited out the reorder window into the ring, tap-hold and combo timeouts fire here too
+void releaseKeyEvents(struct CommsParameters *commsParams)
+{
+    struct InputEvent event;
+    uint32_t nowUs = (uint32_t)esp_timer_get_time();
+
+    eventMerge.windowUs = interconnectIsConnected() ? INTERCONNECT_MERGE_WINDOW_US : 0;
+    while (eventMergePop(&eventMerge, nowUs, &event))
+    {
+        resolveKeyEvent(&event);
+    }
+    actionEngineTick(&actionEngine, nowUs);
+    if (actionEmitted)
+    {
+        actionEmitted = false;
+        xTaskNotify(*commsParams->commsTask, NOTIF_KEYB_CHANGED | NOTIF_HID_CHANGED, eSetBits);
+    }
+}
 
-    // Set keyboard data
-    Node *element = list->head;
-    memset(data->keycode, 0, KB_BUFFER_SIZE);
-    for (int i = 0; i < KB_BUFFER_SIZE; i++)
+// Turns rows received from the other half into key events with that half's layout
+void mergeRemoteMatrix(struct GodParameters *params)
+{
+    static matrix_row_t remote[KB_ROWS] = {0};
+    struct CommsParameters *commsParams = (struct CommsParameters *)params->commsParameters;
+    matrix_row_t rows[KB_ROWS], changes[KB_ROWS];
+    uint32_t timeUs = 0;
+
+    while (interconnectTakeRemoteMatrix(rows, &timeUs))
     {
-        if (element == NULL)
+        for (int j = 0; j < KB_ROWS; j++)
         {
-            break;
+            changes[j] = rows[j] ^ remote[j];
+            remote[j] = rows[j];
         }
-        data->keycode[i] = element->data;
-        element = element->next;
+        pushKeyEvents(commsParams, remote, changes, getCurrentLayout() ^ 1, timeUs);
     }
-    data->modifier = modifier;
 }
 
-void scanKeys(struct GodParameters *params)
+// Returns true while any key is down or still bouncing
+bool scanKeys(struct GodParameters *params)
 {
-    struct KeyboardData kbData = {0};
     struct CommsParameters *commsParams = (struct CommsParameters *)params->commsParameters;
-    BaseType_t xResult;
-    int level = false;
-    bool changed = false;
-    static bool press_matrix[KB_ROWS][KB_COLS] = {0};
+    matrix_row_t changes[KB_ROWS];
+    uint32_t scanUs = 0;
 
-    for (int i = 0; i < KB_COLS; i++)
+    // Raw changes are ignored, debouncer compares every sample against its stable state
+    matrixScan(&scanner, changes);
+
+    if (debounceUpdate(&debouncer, scanner.state, (uint32_t)(esp_timer_get_time() / 1000), changes))
     {
-        gpio_set_level(cols[i], 1);
-        for (int j = 0; j < KB_ROWS; j++)
+        scanUs = (uint32_t)esp_timer_get_time();
+        pushKeyEvents(commsParams, debouncer.stable, changes, getCurrentLayout(), scanUs);
+        if (!interconnectIsPrimary())
         {
-            level = gpio_get_level(rows[j]);
+            // Everything debounced this tick goes to the other half as one frame
+            interconnectSendMatrix(debouncer.stable, scanUs);
+        }
+    }
 
-            if (press_matrix[j][i] != level)
-            {
-                changed = true;
-                press_matrix[j][i] = level;
-            }
+    for (int j = 0; j < KB_ROWS; j++)
+    {
+        if (scanner.state[j] | debouncer.stable[j])
+        {
+            return true;
         }
-        gpio_set_level(cols[i], 0);
     }
+    return false;
+}
+
+// Drains converted frames from the DMA pool without waiting
+static size_t hwJoystickRead(void *ctx, struct JoystickSample *samples, size_t max)
+{
+    uint8_t frame[JOYSTICK_ADC_FRAME_SIZE];
+    uint32_t length = 0;
+    size_t n = 0;
 
-    if (changed)
+    max = max < JOYSTICK_ADC_FRAME_SIZE / SOC_ADC_DIGI_RESULT_BYTES ? max : JOYSTICK_ADC_FRAME_SIZE / SOC_ADC_DIGI_RESULT_BYTES;
+    if (adc_continuous_read(joystickAdc, frame, max * SOC_ADC_DIGI_RESULT_BYTES, &length, 0) != ESP_OK)
     {
-        populateKeyboard(&kbData, press_matrix, getCurrentLayout());
-        xResult = xQueueSend(commsParams->commsData.keyboardQueue, &kbData, 0);
-        xResult = xTaskNotify(*commsParams->commsTask, NOTIF_KEYB_CHANGED | NOTIF_HID_CHANGED, eSetBits);
+        return 0;
     }
+
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES)
+    {
+        adc_digi_output_data_t *out = (adc_digi_output_data_t *)&frame[i];
+        samples[n].channel = out->type2.channel == JOYSTICK_LR_ADC ? JOYSTICK_CH_LR : JOYSTICK_CH_BTN;
+        samples[n].value = out->type2.data;
+        n++;
+    }
+    return n;
+}
+
+static const struct JoystickSampleSource joystickSource = {
+    .ctx = NULL,
+    .read = hwJoystickRead,
+};
+
+static bool IRAM_ATTR joystickPoolOverflow(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *userData)
+{
+    joystickPoolOverflows++;
+    return false;
+}
+
+// LR and button are sampled by ADC1 over DMA, UD sits on ADC2 which is shared with the radio
+esp_err_t initJoystickAdc()
+{
+    esp_err_t err = ESP_OK;
+    adc_continuous_handle_cfg_t handleConfig = {
+        .max_store_buf_size = JOYSTICK_ADC_POOL_SIZE,
+        .conv_frame_size = JOYSTICK_ADC_FRAME_SIZE,
+    };
+    adc_digi_pattern_config_t pattern[] = {
+        {.atten = ADC_ATTEN_DB_12, .channel = JOYSTICK_LR_ADC, .unit = ADC_UNIT_1, .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH},
+        {.atten = ADC_ATTEN_DB_12, .channel = JOYSTICK_BTN_ADC, .unit = ADC_UNIT_1, .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH},
+    };
+    adc_continuous_config_t config = {
+        .pattern_num = sizeof(pattern) / sizeof(pattern[0]),
+        .adc_pattern = pattern,
+        .sample_freq_hz = KB_JOYSTICK_SAMPLE_RATE_HZ,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,
+    };
+    adc_continuous_evt_cbs_t callbacks = {
+        .on_pool_ovf = joystickPoolOverflow,
+    };
+    adc_oneshot_unit_init_cfg_t oneshotConfig = {
+        .unit_id = ADC_UNIT_2,
+    };
+    adc_oneshot_chan_cfg_t channelConfig = {
+        .atten = ADC_ATTEN_DB_12,
+        .bitwidth = ADC_BITWIDTH_DEFAULT,
+    };
+
+    joystickFilterInit(&joystickFilter);
+    // One UD sample per tick, a full window would lag by hundreds of ms
+    joystickFilterSetDepth(&joystickFilter, JOYSTICK_CH_UD, KB_JOYSTICK_UD_DEPTH);
+
+    err = adc_continuous_new_handle(&handleConfig, &joystickAdc);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = adc_continuous_config(joystickAdc, &config);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = adc_continuous_register_event_callbacks(joystickAdc, &callbacks, NULL);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    err = adc_oneshot_new_unit(&oneshotConfig, &joystickAdc2);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = adc_oneshot_config_channel(joystickAdc2, JOYSTICK_UD_ADC, &channelConfig);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    return adc_continuous_start(joystickAdc);
 }
 
-void scanJoystick(struct GodParameters *params)
+void getJoystickFilterStats(struct JoystickFilter *stats, uint32_t *poolOverflows)
 {
-    static struct MouseData mouseData = {0};
+    *stats = joystickFilter;
+    *poolOverflows = joystickPoolOverflows;
+}
+
+// Returns true while the stick is deflected or its button is held
+bool scanJoystick(struct GodParameters *params)
+{
+    struct InputEvent mouseEvent = {
+        .type = INPUT_EVENT_MOUSE,
+    };
     struct CommsParameters *commsParams = (struct CommsParameters *)params->commsParameters;
-    BaseType_t xResult;
-    int btn_pressed = false;
-    int raw_value_adc1 = 0, raw_value_adc2 = 0, temp_raw = 0;
+    int rawUd = 0;
+    int32_t axes[POINTER_AXES];
+    int16_t delta[POINTER_AXES];
+    uint32_t missed = 0;
+    bool moved = false;
+
+    // Sampling ran in the background since the last tick, only pick up the results
+    joystickFilterDrain(&joystickFilter, &joystickSource);
+    // ADC2 fails while the radio holds it, the filter keeps the older samples then
+    if (adc_oneshot_read(joystickAdc2, JOYSTICK_UD_ADC, &rawUd) == ESP_OK)
+    {
+        joystickFilterPush(&joystickFilter, JOYSTICK_CH_UD, (uint16_t)rawUd);
+    }
 
-    for (int i = 0; i < JOYSTICK_SAMPLE_COUNT; i++)
+    if (!joystickFilterReady(&joystickFilter, JOYSTICK_CH_LR) || !joystickFilterReady(&joystickFilter, JOYSTICK_CH_UD))
     {
-        raw_value_adc1 = raw_value_adc1 + (adc1_get_raw(JOYSTICK_LR_ADC) / JOYSTICK_SAMPLE_COUNT);
-        adc2_get_raw(JOYSTICK_UD_ADC, ADC_WIDTH_BIT_DEFAULT, &temp_raw);
-        raw_value_adc2 = raw_value_adc2 + (temp_raw / JOYSTICK_SAMPLE_COUNT);
+        return false;
     }
-    btn_pressed = adc1_get_raw(JOYSTICK_BTN_GPIO);
 
-    mouseData.button = (btn_pressed > 500) ? 1 : 0;
-    mouseData.delta_x = ((raw_value_adc1 - 2000) / 120) * 2;
+    axes[0] = (int32_t)joystickFilterValue(&joystickFilter, JOYSTICK_CH_LR);
+    axes[1] = (int32_t)joystickFilterValue(&joystickFilter, JOYSTICK_CH_UD);
+    moved = pointerMotionUpdate(&pointer, axes, delta);
+    mouseEvent.buttons = (joystickFilterValue(&joystickFilter, JOYSTICK_CH_BTN) > JOYSTICK_BTN_THRESHOLD_RAW * JOYSTICK_FILTER_SCALE) ? 1 : 0;
 
-    xResult = xQueueSend(commsParams->commsData.mouseQueue, &mouseData, 0);
-    xResult = xTaskNotify(*commsParams->commsTask, NOTIF_MOUSE_CHANGED | NOTIF_HID_CHANGED, eSetBits);
+    // Nothing to tell the host at rest
+    if (moved || mouseEvent.buttons != joystickButtons)
+    {
+        joystickButtons = mouseEvent.buttons;
+        mouseEvent.delta_x = delta[0];
+        mouseEvent.delta_y = delta[1];
+        mouseEvent.scan_us = LATENCY_TIMESTAMP();
+        mouseEvent.queue_us = mouseEvent.scan_us;
+        // Motion always fits, only a button change can find the backlog full
+        while (!eventRingPushMouse(commsParams->commsData.eventRing, &mouseEvent))
+        {
+            waitForRingSpace(commsParams, NOTIF_MOUSE_CHANGED, &missed);
+        }
+        raiseMissedNotifications(missed);
+        xTaskNotify(*commsParams->commsTask, NOTIF_MOUSE_CHANGED | NOTIF_HID_CHANGED, eSetBits);
+    }
+
+    return mouseEvent.buttons != 0 || pointer.deflected;
+}
+
+// Sleeps until a row edge or joystick activity, matrix must be quiet when called
+void idleUntilWake(struct GodParameters *params)
+{
+    uint32_t notifyValue = 0;
+
+    if (!matrixIdleEnter(&matrixIdle, &matrixIo, esp_timer_get_time()))
+    {
+        return;
+    }
+    gptimer_stop(matrixTimer);
+
+    while (1)
+    {
+        xTaskNotifyWait(0, NOTIF_GPIO_WAKE | NOTIF_SCAN_JOYSTICK | NOTIF_REMOTE_MATRIX | NOTIF_KEYMAP_UPDATE, &notifyValue, portMAX_DELAY);
+        // A new keymap is taken by the scan loop, an updater may be waiting for it
+        if ((notifyValue & (NOTIF_GPIO_WAKE | NOTIF_KEYMAP_UPDATE)) != 0)
+        {
+            break;
+        }
+
+        // Remote keys sit in the merge buffer for a moment, scan ticks are what releases them
+        if ((notifyValue & NOTIF_REMOTE_MATRIX) != 0)
+        {
+            mergeRemoteMatrix(params);
+            break;
+        }
+
+        // The stick cannot raise an interrupt, its own timer keeps running
+        if ((notifyValue & NOTIF_SCAN_JOYSTICK) != 0)
+        {
+            scanTimingTick(&joystickTiming, esp_timer_get_time());
+            if (scanJoystick(params))
+            {
+                break;
+            }
+        }
+    }
 
-    // ESP_LOGI(TAG_GPIO, "LR: %d, UD: %d, pressed: %d", raw_value_adc1, raw_value_adc2, btn_pressed);
+    matrixIdleWake(&matrixIdle, &matrixIo, wakeEdgeUs, esp_timer_get_time());
+    scanTimingRestart(&matrixTiming);
+    gptimer_start(matrixTimer);
+}
+
+void getMatrixIdleStats(struct MatrixIdle *stats)
+{
+    *stats = matrixIdle;
+}
+
+void getEventMergeStats(struct EventMerge *stats)
+{
+    *stats = eventMerge;
+}
+
+void getKeymapStats(struct KeymapStats *stats, uint16_t *activeLayers)
+{
+    *stats = keymap.stats;
+    *activeLayers = keymapActiveLayers(&keymap);
+}
+
+void getActionEngineStats(struct ActionEngineStats *stats)
+{
+    *stats = actionEngine.stats;
+}
+
+void getScanTimingStats(struct ScanTiming *matrix, struct ScanTiming *joystick)
+{
+    *matrix = matrixTiming;
+    *joystick = joystickTiming;
+}
+
+static bool IRAM_ATTR scanTimerAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *userCtx)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    xTaskNotifyFromISR(wakeTask, (uint32_t)(uintptr_t)userCtx, eSetBits, &xHigherPriorityTaskWoken);
+    return xHigherPriorityTaskWoken == pdTRUE;
+}
+
+// Everything between a debounced matrix and the event ring, no hardware involved
+void initKeyProcessing(struct CommsParameters *commsParams)
+{
+    eventMergeInit(&eventMerge, 0);
+    // Flash keymap replaces the built in one before the first scan if there is one
+    keymapInit(&keymap, defaultKeymap, defaultKeymapLayers);
+    keymapStoreInit();
+    actionEngineInit(&actionEngine, &keymap, &actionConfig, defaultCombos, defaultComboCount, emitKeyEvent, commsParams);
+}
+
+static esp_err_t setScanTimerRate(gptimer_handle_t timer, uint32_t rateHz)
+{
+    gptimer_alarm_config_t alarmConfig = {
+        .alarm_count = SCAN_TIMER_RESOLUTION_HZ / scanTimingClampRate(rateHz),
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    return gptimer_set_alarm_action(timer, &alarmConfig);
+}
+
+static esp_err_t initScanTimer(gptimer_handle_t *timer, uint32_t notifyBit, uint32_t rateHz)
+{
+    gptimer_config_t timerConfig = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = SCAN_TIMER_RESOLUTION_HZ,
+    };
+    gptimer_event_callbacks_t callbacks = {
+        .on_alarm = scanTimerAlarm,
+    };
+
+    ESP_ERROR_CHECK(gptimer_new_timer(&timerConfig, timer));
+    ESP_ERROR_CHECK(gptimer_register_event_callbacks(*timer, &callbacks, (void *)(uintptr_t)notifyBit));
+    ESP_ERROR_CHECK(gptimer_enable(*timer));
+    ESP_ERROR_CHECK(setScanTimerRate(*timer, rateHz));
+    return gptimer_start(*timer);
+}
+
+// Rates are clamped to SCAN_RATE_MIN_HZ..SCAN_RATE_MAX_HZ, safe to call while scanning
+esp_err_t setScanRates(uint32_t matrixHz, uint32_t joystickHz)
+{
+    esp_err_t err = setScanTimerRate(matrixTimer, matrixHz);
+    if (err)
+    {
+        return err;
+    }
+    err = setScanTimerRate(joystickTimer, joystickHz);
+    if (err)
+    {
+        return err;
+    }
+
+    scanTimingInit(&matrixTiming, matrixHz);
+    scanTimingInit(&joystickTiming, joystickHz);
+    matrixIdle.scanPeriodUs = matrixTiming.targetPeriodUs;
+    pointer.config.tickHz = joystickTiming.rateHz;
+    ESP_LOGI(TAG_GPIO, "Scan rates set to %" PRIu32 " Hz (matrix), %" PRIu32 " Hz (joystick)", matrixTiming.rateHz, joystickTiming.rateHz);
+    return ESP_OK;
 }
 
 void vGpioTask(void *godParameters)
 {
     struct GodParameters *params = (struct GodParameters *)(godParameters);
+    struct CommsParameters *commsParams = (struct CommsParameters *)params->commsParameters;
 
     ESP_LOGI(TAG_GPIO, "Initializing GPIO task...");
-    gpio_set_direction(KB_COL_0_GPIO, GPIO_MODE_OUTPUT);
-    gpio_set_direction(KB_COL_1_GPIO, GPIO_MODE_OUTPUT);
-    gpio_set_direction(KB_COL_2_GPIO, GPIO_MODE_OUTPUT);
-    gpio_set_direction(KB_COL_3_GPIO, GPIO_MODE_OUTPUT);
-    gpio_set_direction(KB_COL_4_GPIO, GPIO_MODE_OUTPUT);
-    gpio_set_direction(KB_COL_5_GPIO, GPIO_MODE_OUTPUT);
-    gpio_set_direction(KB_COL_6_GPIO, GPIO_MODE_OUTPUT);
-
-    gpio_set_direction(KB_ROW_0_GPIO, GPIO_MODE_INPUT);
-    gpio_set_direction(KB_ROW_1_GPIO, GPIO_MODE_INPUT);
-    gpio_set_direction(KB_ROW_2_GPIO, GPIO_MODE_INPUT);
-    gpio_set_direction(KB_ROW_3_GPIO, GPIO_MODE_INPUT);
-    gpio_set_direction(KB_ROW_4_GPIO, GPIO_MODE_INPUT);
-
-    gpio_set_pull_mode(KB_ROW_0_GPIO, GPIO_PULLDOWN_ONLY);
-    gpio_set_pull_mode(KB_ROW_1_GPIO, GPIO_PULLDOWN_ONLY);
-    gpio_set_pull_mode(KB_ROW_2_GPIO, GPIO_PULLDOWN_ONLY);
-    gpio_set_pull_mode(KB_ROW_3_GPIO, GPIO_PULLDOWN_ONLY);
-    gpio_set_pull_mode(KB_ROW_4_GPIO, GPIO_PULLDOWN_ONLY);
+    ESP_ERROR_CHECK(initMatrixIo());
 
     // gpio_set_direction(JOYSTICK_BTN_GPIO, GPIO_MODE_INPUT);
     // gpio_set_pull_mode(JOYSTICK_BTN_GPIO, GPIO_PULLUP_ONLY);
 
     ESP_LOGI(TAG_GPIO, "GPIOs digital pins configured!");
 
-    adc1_config_channel_atten(JOYSTICK_LR_ADC, ADC_ATTEN_DB_12);
-    adc1_config_channel_atten(JOYSTICK_BTN_GPIO, ADC_ATTEN_DB_12);
-    // adc2_config_channel_atten(JOYSTICK_UD_ADC, ADC_ATTEN_DB_12);
-
-    adc1_config_width(ADC_WIDTH_BIT_DEFAULT);
+    ESP_ERROR_CHECK(initJoystickAdc());
+    pointerMotionInit(&pointer, &pointerConfig);
 
     ESP_LOGI(TAG_GPIO, "GPIOs analog pins configured!");
 
+    initKeyProcessing(commsParams);
+    scanTimingInit(&matrixTiming, KB_MATRIX_SCAN_RATE_HZ);
+    scanTimingInit(&joystickTiming, KB_JOYSTICK_SCAN_RATE_HZ);
+    matrixIdleInit(&matrixIdle, KB_IDLE_AFTER_MS * matrixTiming.rateHz / 1000, matrixTiming.targetPeriodUs);
+    ESP_ERROR_CHECK(initScanTimer(&matrixTimer, NOTIF_SCAN_MATRIX, KB_MATRIX_SCAN_RATE_HZ));
+    ESP_ERROR_CHECK(initScanTimer(&joystickTimer, NOTIF_SCAN_JOYSTICK, KB_JOYSTICK_SCAN_RATE_HZ));
+
+    ESP_LOGI(TAG_GPIO, "Scan timers started!");
+
+    uint32_t notifyValue = 0;
+    bool matrixActive = false, joystickActive = false;
+    const keyaction_t (*actions)[KEYMAP_KEYS] = NULL;
+    uint8_t layers = 0;
     while (1)
     {
-        scanKeys(params);
-        scanJoystick(params);
-        vTaskDelay(pdMS_TO_TICKS(10));
+        xTaskNotifyWait(0, UINT32_MAX, &notifyValue, portMAX_DELAY);
+
+        // Keymap updates switch here, never in the middle of a scan
+        if (keymapStoreTake(&actions, &layers))
+        {
+            keymapSetActions(&keymap, actions, layers);
+        }
+
+        if ((notifyValue & NOTIF_SCAN_MATRIX) != 0)
+        {
+            scanTimingTick(&matrixTiming, esp_timer_get_time());
+            telemetryCount(&telemetry, TELEMETRY_MATRIX_SCANS, 1);
+            matrixActive = scanKeys(params);
+        }
+        if ((notifyValue & NOTIF_SCAN_JOYSTICK) != 0)
+        {
+            scanTimingTick(&joystickTiming, esp_timer_get_time());
+            joystickActive = scanJoystick(params);
+        }
+        if ((notifyValue & NOTIF_REMOTE_MATRIX) != 0)
+        {
+            mergeRemoteMatrix(params);
+        }
+        releaseKeyEvents(commsParams);
+
+        // Anything held back by a full ring goes out in order on the next tick
+        eventRingFlush(commsParams->commsData.eventRing);
+
+        if ((notifyValue & NOTIF_SCAN_MATRIX) != 0 && matrixIdleUpdate(&matrixIdle, !(matrixActive || joystickActive || eventMerge.count || actionEnginePending(&actionEngine))))
+        {
+            idleUntilWake(params);
+        }
     }
 }
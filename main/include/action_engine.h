@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "event_ring.h"
+#include "keymap.h"
+#include "timer_wheel.h"
+
+// Events held back behind one undecided key, a full queue forces the decision
+#define ACTION_QUEUE_SIZE 16
+#define ACTION_KEY_BYTES ((KEYMAP_KEYS + 7) / 8)
+
+struct ActionConfig
+{
+    uint32_t tappingTermUs;
+    uint32_t comboTermUs;
+    uint32_t oneshotTimeoutUs;
+    // Upper bound on how long any key event waits for a decision, caps both terms
+    uint32_t maxDelayUs;
+    // Tap-hold key turns into its hold action as soon as another key goes down
+    bool holdOnOtherPress;
+    // ... or once another key is pressed and released while it is held
+    bool permissiveHold;
+};
+
+// Two keys pressed within the combo term act as one key with its own action
+struct Combo
+{
+    uint8_t keys[2];
+    keyaction_t action;
+};
+
+typedef void (*ActionEmitFn)(void *ctx, const struct InputEvent *event);
+
+struct ActionQueued
+{
+    struct InputEvent event;
+    uint32_t timeUs;
+};
+
+enum ActionPending
+{
+    ACTION_PENDING_NONE,
+    ACTION_PENDING_TAP_HOLD,
+    ACTION_PENDING_COMBO,
+};
+
+struct ActionEngineStats
+{
+    uint32_t taps;
+    uint32_t holds;
+    uint32_t combos;
+    uint32_t oneshots;
+    uint32_t forced; // decisions made by the latency bound or a full queue
+    uint32_t maxDelayUs;
+};
+
+/*
+Sits between the matrix and the keymap. Keys whose meaning depends on what
+happens next (tap-hold, combo members) are queued together with every event
+behind them until a decision can be made. Decisions happen on the event that
+settles them, timeouts come from a timer wheel advanced every scan tick.
+*/
+struct ActionEngine
+{
+    struct Keymap *keymap;
+    struct ActionConfig config;
+    const struct Combo *combos;
+    uint8_t comboCount;
+    ActionEmitFn emit;
+    void *ctx;
+
+    struct TimerWheel wheel;
+    // Events not handled yet, queue[0] is the undecided key press while pending is set
+    struct ActionQueued queue[ACTION_QUEUE_SIZE];
+    uint8_t count;
+    uint8_t pending;
+    uint8_t examined; // queue entries already checked against the pending key
+    bool comboChecked; // queue[0] turned out not to be a combo
+    bool deadlineForced; // decision timer is the latency bound, not a term
+
+    uint8_t comboKeys[ACTION_KEY_BYTES];
+    // Keys held as part of a fired combo and the other key of their combo
+    uint8_t consumed[ACTION_KEY_BYTES];
+    uint8_t comboPeer[KEYMAP_KEYS];
+
+    // One-shot modifier, one at a time
+    uint8_t oneshotKey;
+    bool oneshotUsed;  // another key went down while it was held
+    bool oneshotArmed; // released unused, waiting for the next key
+
+    struct ActionEngineStats stats;
+};
+
+extern const struct Combo defaultCombos[];
+extern const uint8_t defaultComboCount;
+
+void actionEngineInit(struct ActionEngine *engine, struct Keymap *keymap, const struct ActionConfig *config, const struct Combo *combos, uint8_t comboCount, ActionEmitFn emit, void *ctx);
+void actionEngineProcess(struct ActionEngine *engine, const struct InputEvent *event, uint32_t timeUs);
+void actionEngineTick(struct ActionEngine *engine, uint32_t nowUs);
+bool actionEnginePending(const struct ActionEngine *engine);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Offset follows 1/2^N of each measured error, drift 1/2^N of the implied rate error
+#define CLOCK_SYNC_OFFSET_SHIFT 2
+#define CLOCK_SYNC_DRIFT_SHIFT 4
+#define CLOCK_SYNC_DRIFT_MAX_PPM 500
+// Samples with a round trip this much above twice the best one were queued somewhere
+#define CLOCK_SYNC_RTT_SLACK_US 200
+#define CLOCK_SYNC_MAX_REJECTS 4
+
+/*
+Estimates the remote clock from ping round trips, NTP style. t1 and t4 are
+local send/receive times of the ping, t2 and t3 remote receive/send times.
+*/
+struct ClockSync
+{
+    // Remote minus local clock at lastUs, in 1/256 us
+    int64_t offset;
+    // Rate of offset change in 1/256 us per second, i.e. ppm * 256
+    int32_t drift;
+    uint32_t lastUs;
+    uint32_t samples;
+    uint8_t rejectsInRow;
+    bool synced;
+
+    // Counters
+    uint32_t minRttUs;
+    uint32_t lastRttUs;
+    uint32_t maxRttUs;
+    int32_t lastSkewUs;
+    uint32_t maxSkewUs;
+    uint32_t rejected;
+};
+
+void clockSyncInit(struct ClockSync *clock);
+bool clockSyncSample(struct ClockSync *clock, uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4);
+int32_t clockSyncOffsetAt(const struct ClockSync *clock, uint32_t localUs);
+uint32_t clockSyncToLocal(const struct ClockSync *clock, uint32_t remoteUs, uint32_t nowUs);
@@ -5,6 +5,17 @@
 #define NOTIF_KEYB_CHANGED 0x2
 #define NOTIF_MOUSE_CHANGED 0x4
 #define NOTIF_PROTOCOL_CHANGED 0x8
+#define NOTIF_CONSOLE_COMMAND 0x10
+#define NOTIF_HOST_SUSPEND 0x20
+#define NOTIF_KEYMAP_UPLOAD 0x40
+
+// GPIO task notifications
+#define NOTIF_GPIO_WAKE 0x1
+#define NOTIF_SCAN_MATRIX 0x2
+#define NOTIF_SCAN_JOYSTICK 0x4
+#define NOTIF_REMOTE_MATRIX 0x8
+#define NOTIF_RING_SPACE 0x10
+#define NOTIF_KEYMAP_UPDATE 0x20
 
 
 struct GodParameters
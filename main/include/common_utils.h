@@ -1,22 +1,26 @@
 #pragma once
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdbool.h>
 
-typedef struct node
-{
-    uint8_t data;
-    struct node *next;
-} Node;
+#define KEYSET_WORDS 8      // 256 keycodes
+#define KEYSET_ORDER_SIZE 16 // tracked press order for 6KRO reports
+#define KEYSET_MODIFIER_FIRST 0xE0 // modifiers are only kept in the bitmap
+
+// Modifier byte of a HID keyboard report, bits 224-231 of the set
+#define KEYSET_MODIFIERS(set) ((uint8_t)((set)->bits[KEYSET_MODIFIER_FIRST >> 5] & 0xFF))
 
-typedef struct list
+typedef struct keySet
 {
-    Node *head;
-} List;
+    uint32_t bits[KEYSET_WORDS];
+    uint8_t order[KEYSET_ORDER_SIZE]; // oldest press first
+    uint8_t orderCount;
+    uint8_t unordered; // keys in the bitmap that did not fit the order
+} KeySet;
 
-List *makeLinkedList();
-void addLLElement(uint8_t data, List *list);
-void deleteLLElement(uint8_t data, List *list);
-void reverseLinkedList(List *list);
-void destroyLinkedList(List *list);
-bool existsInLL(uint8_t data, List *list);
\ No newline at end of file
+void keySetClear(KeySet *set);
+bool keySetAdd(uint8_t key, KeySet *set);
+bool keySetRemove(uint8_t key, KeySet *set);
+bool keySetContains(uint8_t key, const KeySet *set);
+uint8_t keySetOldest(uint8_t *keys, uint8_t count, const KeySet *set);
\ No newline at end of file
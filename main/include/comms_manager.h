@@ -1,10 +1,14 @@
 #pragma once
 
 #include <stdlib.h>
+#include <stdbool.h>
 
-#define KB_BUFFER_SIZE 6
-#define KB_QUEUE_SIZE 10
-#define MOUSE_QUEUE_SIZE 10
+#include "event_ring.h"
+#include "hid_reports.h"
+#include "report_scheduler.h"
+
+// Protocol switches slower than this are logged
+#define COMMS_SWITCH_BUDGET_US 20000
 
 enum CommsProtocol
 {
@@ -14,25 +18,12 @@ enum CommsProtocol
     NONE,
 };
 
-struct KeyboardData
-{
-    uint8_t modifier;
-    uint8_t keycode[KB_BUFFER_SIZE];
-};
-
-struct MouseData
-{
-    uint8_t button;
-    uint8_t delta_x;
-    uint8_t delta_y;
-    uint8_t scroll_vertical;
-    uint8_t scroll_horizontal;
-};
-
 struct CommsData
 {
-    QueueHandle_t mouseQueue;
-    QueueHandle_t keyboardQueue;
+    // Key and mouse events from the GPIO task, single producer and single consumer
+    struct EventRing *eventRing;
+    // Producer blocked on a full ring, woken by the comms task once it has drained it
+    TaskHandle_t spaceWaiter;
 };
 
 struct CommsParameters
@@ -43,4 +34,12 @@ struct CommsParameters
     struct CommsData commsData;
 };
 
+void initComms(struct CommsParameters *commsParams);
+void sendPendingEvents(struct CommsParameters *commsParams);
+void commsSetProtocol(enum CommsProtocol protocol);
+void commsConsoleInput(char command);
+void commsKeymapUploaded(void);
+void commsHostSuspend(bool suspended);
+void getReportStats(struct ReportStats *stats);
+const char *getCommsTransportName(void);
 void vCommsTask(void *godParameters);
\ No newline at end of file
@@ -4,7 +4,7 @@
 #include "nvs_flash.h"
 #include "nvs.h"
 
-#define CFG_KB_SIDE "side"
+#include "config_store.h"
 
 enum {
     CFG_KB_SIDE_LEFT,
@@ -12,6 +12,9 @@ enum {
 };
 
 esp_err_t initConfigManager();
-esp_err_t getKbSide(int8_t *side);
-esp_err_t setKbSide(int8_t side);
-
+const struct KbConfig *getConfig(void);
+int8_t getKbSide(void);
+void setKbSide(int8_t side);
+void setDefaultProtocol(uint8_t protocol);
+esp_err_t flushConfig(void);
+void getConfigStoreStats(struct ConfigStoreStats *stats);
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CONFIG_STORE_MAGIC 0x4B56
+#define CONFIG_STORE_VERSION 1
+// Largest blob read back, room for settings added by later versions
+#define CONFIG_STORE_BLOB_MAX 128
+
+// Writes wait for this much quiet, but never longer than the max dirty time
+#define CONFIG_STORE_QUIET_MS 2000
+#define CONFIG_STORE_MAX_DIRTY_MS 30000
+// A failed write is tried again after this, doubling up to the max while flash keeps refusing
+#define CONFIG_STORE_RETRY_MS 1000
+#define CONFIG_STORE_RETRY_MAX_MS 60000
+
+/*
+Every persisted setting. Fields are only ever appended, a blob from an older
+version leaves the newer fields at their defaults and a blob from a newer
+version is read up to what this version knows.
+*/
+struct KbConfig
+{
+    int8_t side;
+    uint8_t protocol;
+};
+
+struct ConfigBlobHeader
+{
+    uint16_t magic;
+    uint8_t version;
+    uint8_t size; // payload bytes after the header
+    uint32_t checksum;
+};
+
+struct ConfigBackend
+{
+    void *ctx;
+    // Reads at most *length bytes and sets *length to the stored size, false if there is none
+    bool (*readBlob)(void *ctx, void *data, size_t *length);
+    // Stores and commits the whole blob in one go
+    bool (*writeBlob)(void *ctx, const void *data, size_t length);
+    // Settings kept as separate keys before the blob existed
+    bool (*readLegacyI8)(void *ctx, const char *key, int8_t *value);
+    void (*eraseLegacy)(void *ctx, const char *key);
+};
+
+struct ConfigStoreStats
+{
+    uint32_t writes;
+    uint32_t skipped;   // flushes that found nothing changed since the last write
+    uint32_t coalesced; // changes folded into another write
+    uint32_t failed;
+    uint8_t loadedVersion; // 0 for legacy keys or nothing stored
+    bool defaulted;
+};
+
+// Settings live in RAM, flash only sees one write per burst of changes
+struct ConfigStore
+{
+    const struct ConfigBackend *backend;
+    struct KbConfig config; // what everyone reads
+    struct KbConfig saved;  // what flash holds
+
+    bool dirty;
+    uint32_t firstDirtyUs;
+    uint32_t lastDirtyUs;
+    uint32_t changes;
+    uint8_t retries; // failed writes since the last one that went through
+
+    struct ConfigStoreStats stats;
+};
+
+// RAM stand-in for NVS, for host builds
+struct ConfigRamBackend
+{
+    struct ConfigBackend backend;
+    uint8_t blob[CONFIG_STORE_BLOB_MAX];
+    size_t length;
+    bool legacyPresent;
+    int8_t legacySide;
+    bool failWrites;
+    uint32_t writes;
+};
+
+extern const struct KbConfig configDefaults;
+
+void configStoreLoad(struct ConfigStore *store, const struct ConfigBackend *backend, uint32_t nowUs);
+void configStoreTouch(struct ConfigStore *store, uint32_t nowUs);
+bool configStoreFlushDue(const struct ConfigStore *store, uint32_t nowUs, uint32_t *waitUs);
+bool configStoreFlush(struct ConfigStore *store);
+uint32_t configStoreRetryUs(const struct ConfigStore *store);
+
+void configRamBackendInit(struct ConfigRamBackend *ram);
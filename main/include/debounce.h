@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "matrix_scanner.h"
+
+// Bit planes of the per-key sample counters, max samples is (1 << planes) - 1
+#define DEBOUNCE_COUNTER_BITS 3
+#define DEBOUNCE_MAX_SAMPLES ((1 << DEBOUNCE_COUNTER_BITS) - 1)
+
+enum DebounceMode
+{
+    DEBOUNCE_EAGER,   // press reported at once, release after N stable samples
+    DEBOUNCE_DEFER,   // both edges reported after N stable samples
+    DEBOUNCE_TIMEOUT, // both edges reported at once, then key ignored for timeout
+};
+
+struct Debouncer
+{
+    enum DebounceMode mode;
+    uint8_t samples;
+    uint16_t timeoutMs;
+
+    matrix_row_t stable[KB_ROWS];
+    // Vertical counters, plane N holds bit N of every key's counter
+    matrix_row_t count[DEBOUNCE_COUNTER_BITS][KB_ROWS];
+    // Only used by DEBOUNCE_TIMEOUT
+    matrix_row_t locked[KB_ROWS];
+    uint16_t lastChange[KB_ROWS][KB_COLS];
+};
+
+void debounceInit(struct Debouncer *db, enum DebounceMode mode, uint8_t samples, uint16_t timeoutMs);
+bool debounceUpdate(struct Debouncer *db, const matrix_row_t raw[KB_ROWS], uint32_t nowMs, matrix_row_t changes[KB_ROWS]);
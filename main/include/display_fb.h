@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// More dirty regions than this are merged, the panel sees at most this many transfers a frame
+#define DISPLAY_DIRTY_RECTS 6
+
+#define DISPLAY_FONT_WIDTH 5
+#define DISPLAY_FONT_HEIGHT 7
+#define DISPLAY_FONT_FIRST ' '
+#define DISPLAY_FONT_LAST '~'
+
+enum DisplayFormat
+{
+    // 1 bpp in controller page order (SSD1306), a byte is 8 pixels down a column
+    DISPLAY_MONO,
+    // 16 bpp row by row, big endian as SPI panels expect it
+    DISPLAY_RGB565,
+};
+
+#define DISPLAY_WHITE 0xFFFF
+#define DISPLAY_BLACK 0x0000
+
+// x1 and y1 are exclusive
+struct DisplayRect
+{
+    int16_t x0;
+    int16_t y0;
+    int16_t x1;
+    int16_t y1;
+};
+
+struct DisplayPanel
+{
+    void *ctx;
+    // Sends one region in panel format, may block the calling task until the data is out
+    bool (*draw)(void *ctx, const struct DisplayRect *rect, const void *data, size_t length);
+    // Optional, called after a frame that sent anything
+    void (*present)(void *ctx);
+};
+
+struct DisplayStats
+{
+    uint32_t frames;
+    uint32_t flushed; // frames that sent anything
+    uint32_t transfers;
+    uint32_t failed;
+    uint64_t totalBytes;
+    uint32_t lastBytes;
+    uint32_t maxBytes;
+    // Render time is CPU, flush time mostly waits on DMA
+    uint32_t totalRenderUs;
+    uint32_t maxRenderUs;
+    uint32_t maxFlushUs;
+};
+
+/*
+Drawing only marks regions whose pixels actually changed, a flush sends just
+those regions. The caller times each frame and reports it with
+displayFbAccount, so the counters work the same on the host.
+*/
+struct DisplayFb
+{
+    enum DisplayFormat format;
+    uint16_t width;
+    uint16_t height;
+    uint8_t *pixels;
+
+    struct DisplayRect dirty[DISPLAY_DIRTY_RECTS];
+    uint8_t dirtyCount;
+
+    struct DisplayStats stats;
+};
+
+// Mirrors whatever it is sent and writes every frame as a PGM file, for host builds
+struct DisplayPgmPanel
+{
+    struct DisplayPanel panel;
+    struct DisplayFb mirror;
+    const char *prefix; // files are <prefix>NNNN.pgm, NULL writes nothing
+    uint32_t frames;
+    uint32_t draws;
+};
+
+extern const uint8_t displayFont[][DISPLAY_FONT_WIDTH];
+
+size_t displayFbSize(enum DisplayFormat format, uint16_t width, uint16_t height);
+void displayFbInit(struct DisplayFb *fb, enum DisplayFormat format, uint16_t width, uint16_t height, uint8_t *pixels);
+void displayFbFill(struct DisplayFb *fb, const struct DisplayRect *rect, uint16_t colour);
+// Returns the x after the text, drawing is clipped to the framebuffer
+int16_t displayFbText(struct DisplayFb *fb, int16_t x, int16_t y, const char *text, uint16_t colour, uint16_t background);
+void displayFbInvalidate(struct DisplayFb *fb, const struct DisplayRect *rect);
+bool displayFbDirty(const struct DisplayFb *fb);
+uint32_t displayFbFlush(struct DisplayFb *fb, const struct DisplayPanel *panel, uint8_t *scratch, size_t scratchSize);
+void displayFbAccount(struct DisplayFb *fb, uint32_t renderUs, uint32_t flushUs);
+
+void displayPgmPanelInit(struct DisplayPgmPanel *pgm, enum DisplayFormat format, uint16_t width, uint16_t height, uint8_t *pixels, const char *prefix);
+bool displayPgmWrite(const struct DisplayPgmPanel *pgm, const char *path);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+
+#include "display_fb.h"
+
+// SSD1306 128x64 OLED on SPI2, pins are the SPI2 IO MUX ones
+#define KB_DISPLAY_SPI_HOST SPI2_HOST
+#define KB_DISPLAY_SCLK_GPIO GPIO_NUM_12
+#define KB_DISPLAY_MOSI_GPIO GPIO_NUM_11
+#define KB_DISPLAY_CS_GPIO GPIO_NUM_10
+#define KB_DISPLAY_DC_GPIO GPIO_NUM_13
+#define KB_DISPLAY_RST_GPIO GPIO_NUM_NC
+#define KB_DISPLAY_PCLK_HZ 8000000
+#define KB_DISPLAY_WIDTH 128
+#define KB_DISPLAY_HEIGHT 64
+
+// Upper bound on the refresh rate, frames that change nothing send nothing
+#define KB_DISPLAY_FRAME_MS 50
+// DMA bounce buffer, larger regions go out in bands
+#define KB_DISPLAY_TRANSFER_BYTES 512
+#define KB_DISPLAY_TRANSFER_TIMEOUT_MS 100
+
+void getDisplayStats(struct DisplayStats *stats, uint32_t *fpsMilli);
+void vDisplayTask(void *godParameters);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "display_fb.h"
+
+#define DISPLAY_BATTERY_NONE 0xFF
+#define DISPLAY_TEXT_MAX 24
+
+// Words per minute over a sliding window, a word is five key presses
+#define WPM_BUCKET_US 1000000
+#define WPM_BUCKETS 10
+#define WPM_CHARS_PER_WORD 5
+
+// Everything a widget may show, sampled once per frame
+struct DisplayStatus
+{
+    const char *layer;
+    const char *protocol;
+    uint8_t batteryPercent; // DISPLAY_BATTERY_NONE without a battery gauge
+    uint16_t wpm;
+};
+
+enum DisplayWidgetId
+{
+    DISPLAY_WIDGET_LAYER,
+    DISPLAY_WIDGET_PROTOCOL,
+    DISPLAY_WIDGET_BATTERY,
+    DISPLAY_WIDGET_WPM,
+    DISPLAY_WIDGETS,
+};
+
+// One line of text in a fixed box, only redrawn when the text changes
+struct DisplayWidget
+{
+    struct DisplayRect box;
+    bool alignRight;
+    bool drawn;
+    char text[DISPLAY_TEXT_MAX];
+};
+
+struct DisplayUi
+{
+    struct DisplayFb *fb;
+    struct DisplayWidget widgets[DISPLAY_WIDGETS];
+    uint32_t redraws;
+};
+
+struct WpmMeter
+{
+    uint32_t lastPresses;
+    uint32_t bucketUs;
+    uint16_t buckets[WPM_BUCKETS];
+    uint8_t current;
+    bool started;
+};
+
+void displayUiInit(struct DisplayUi *ui, struct DisplayFb *fb);
+void displayUiRender(struct DisplayUi *ui, const struct DisplayStatus *status);
+
+void wpmMeterInit(struct WpmMeter *meter);
+uint16_t wpmMeterUpdate(struct WpmMeter *meter, uint32_t presses, uint32_t nowUs);
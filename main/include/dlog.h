@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "dlog_formats.h"
+
+#define DLOG_MAX_ARGS 4
+#define DLOG_RING_SIZE 64 // must be a power of two
+
+#define DLOG_ENUM(id, level, tag, format) id,
+enum DlogId
+{
+    DLOG_FORMATS(DLOG_ENUM)
+    DLOG_COUNT,
+};
+#undef DLOG_ENUM
+
+struct DlogFormat
+{
+    char level;
+    const char *tag;
+    const char *format;
+};
+
+// Nothing is formatted when the message is logged, only the id and raw arguments are kept
+struct DlogRecord
+{
+    uint16_t id;
+    uint32_t timeUs;
+    uint32_t args[DLOG_MAX_ARGS];
+};
+
+// Single producer, single consumer. A full ring drops the new record instead of waiting
+struct DlogRing
+{
+    uint32_t head;
+    uint32_t tail;
+    struct DlogRecord records[DLOG_RING_SIZE];
+
+    // Written by the producer only
+    uint32_t written;
+    uint32_t dropped;
+};
+
+extern const struct DlogFormat dlogFormats[DLOG_COUNT];
+
+// A bounds check, a copy of the record and a release store, cheap enough for the scan path
+static inline bool dlogWrite(struct DlogRing *ring, uint16_t id, uint32_t timeUs, const uint32_t args[DLOG_MAX_ARGS])
+{
+    uint32_t head = ring->head;
+    struct DlogRecord *record = NULL;
+
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= DLOG_RING_SIZE)
+    {
+        ring->dropped++;
+        return false;
+    }
+    record = &ring->records[head & (DLOG_RING_SIZE - 1)];
+    record->id = id;
+    record->timeUs = timeUs;
+    memcpy(record->args, args, sizeof(record->args));
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    ring->written++;
+    return true;
+}
+
+void dlogRingInit(struct DlogRing *ring);
+bool dlogRead(struct DlogRing *ring, struct DlogRecord *record);
+int dlogFormat(const struct DlogRecord *record, char *text, size_t size);
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <inttypes.h>
+
+/*
+Every deferred log message, X(id, level, tag, format). Arguments are recorded as
+uint32_t, so conversions have to take one (PRIu32, PRIx32, ...). New messages go
+at the end, ids stay the same for what a host tool already knows that way.
+*/
+#define DLOG_FORMATS(X)                                                                                \
+    X(DLOG_KEY_PRESSED, 'I', "gpio", "Key [%" PRIu32 ",%" PRIu32 "] on side %" PRIu32 " is pressed") \
+    X(DLOG_LOCK_STATE, 'I', "usb", "Host lock state: 0x%02" PRIx32)                                  \
+    X(DLOG_HID_PROTOCOL, 'I', "usb", "HID protocol set to %" PRIu32 " (0 boot, 1 report)")          \
+    X(DLOG_KEYBOARD_SILENT, 'W', "dongle", "Keyboard went silent, releasing all keys")
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dlog.h"
+
+// Tasks that log get a ring each, the first time they log
+#define KB_DLOG_RINGS 4
+#define KB_DLOG_DRAIN_MS 20
+
+// DLOG(DLOG_KEY_PRESSED, row, column, side), at most DLOG_MAX_ARGS arguments
+#define DLOG(id, ...) dlogRecord((id), (const uint32_t[DLOG_MAX_ARGS]){__VA_ARGS__})
+
+struct DlogStats
+{
+    uint32_t written;
+    uint32_t dropped;
+    uint32_t noRing; // logged from an interrupt or with every ring taken
+    uint32_t printed;
+    uint8_t rings;
+};
+
+void dlogRecord(enum DlogId id, const uint32_t args[DLOG_MAX_ARGS]);
+void getDlogStats(struct DlogStats *stats);
+void vDlogTask(void *godParameters);
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "hid_reports.h"
+
+// Frame: magic, session, seq (LE), type, payload. The radio checks integrity itself
+#define DONGLE_FRAME_MAGIC 0xD5
+#define DONGLE_HEADER_SIZE 5
+#define DONGLE_FRAME_MAX (DONGLE_HEADER_SIZE + 1 + KB_NKRO_BYTES + 1)
+
+// Every frame goes out this many times instead of waiting for an ACK
+#define DONGLE_COPIES 3
+#define DONGLE_COPY_SPACING_US 300
+#define DONGLE_SENDER_SLOTS 4
+// Full state after this much silence, receiver releases everything after the timeout
+#define DONGLE_KEEPALIVE_MS 50
+#define DONGLE_TIMEOUT_MS 200
+
+enum DongleFrameType
+{
+    DONGLE_FRAME_KEYBOARD = 1, // modifier, NKRO bitmap
+    DONGLE_FRAME_POINTER,      // buttons, x, y (LE), wheel, pan
+    DONGLE_FRAME_FULL,         // modifier, NKRO bitmap, buttons
+};
+
+// What dongleReceiverPush and dongleReceiverPoll filled in
+#define DONGLE_REPORT_KEYBOARD 0x1
+#define DONGLE_REPORT_POINTER 0x2
+
+struct DongleReport
+{
+    struct KeyboardData keyboard;
+    struct MouseData mouse;
+};
+
+struct DongleRadio
+{
+    void *ctx;
+    // Sends one frame without waiting for it to arrive, returns false if the radio refused it
+    bool (*send)(void *ctx, const uint8_t *frame, size_t length);
+};
+
+struct DongleCopy
+{
+    uint8_t frame[DONGLE_FRAME_MAX];
+    uint8_t length;
+    uint8_t type;
+    uint8_t copiesLeft; // 0 marks a free slot
+    uint32_t dueUs;
+};
+
+struct DongleSenderStats
+{
+    uint32_t frames;
+    uint32_t copies;
+    uint32_t superseded; // keyboard copies dropped for a newer state
+    uint32_t keepalives;
+    uint32_t radioErrors;
+};
+
+// Keyboard side, the caller polls it at least every DONGLE_COPY_SPACING_US while copies are due
+struct DongleSender
+{
+    const struct DongleRadio *radio;
+    uint8_t session;
+    uint16_t seq;
+    struct DongleCopy slots[DONGLE_SENDER_SLOTS];
+
+    // Last state sent, repeated by keepalives
+    uint8_t modifier;
+    uint8_t bitmap[KB_NKRO_BYTES];
+    uint8_t buttons;
+    uint32_t lastFrameUs;
+
+    struct DongleSenderStats stats;
+};
+
+struct DongleReceiverStats
+{
+    uint32_t frames;
+    uint32_t duplicates;
+    uint32_t missed; // sequence numbers none of the copies arrived for
+    uint32_t keepalives;
+    uint32_t recovered; // keepalives that changed the state, i.e. a lost update
+    uint32_t timeouts;
+    uint32_t badFrames;
+};
+
+// Dongle side, turns frames from any number of copies into HID reports exactly once
+struct DongleReceiver
+{
+    bool synced;
+    uint8_t session;
+    uint16_t lastSeq;
+    uint32_t lastFrameUs;
+
+    uint8_t modifier;
+    uint8_t bitmap[KB_NKRO_BYTES];
+    uint8_t buttons;
+
+    struct DongleReceiverStats stats;
+};
+
+#define DONGLE_CHANNEL_DEPTH 32
+
+struct DongleChannelFrame
+{
+    uint8_t frame[DONGLE_FRAME_MAX];
+    uint8_t length;
+    uint32_t dueUs;
+};
+
+// Lossy air for host builds, losses come in bursts like on a busy 2.4 GHz channel
+struct DongleChannel
+{
+    struct DongleChannelFrame frames[DONGLE_CHANNEL_DEPTH];
+    uint8_t head;
+    uint8_t count;
+
+    uint32_t nowUs;
+    uint32_t delayUs;
+    uint32_t jitterUs;
+    uint16_t lossPermille;
+    // Chance that the frame after a lost one is lost too
+    uint8_t burstPercent;
+    bool lastLost;
+    uint32_t seed;
+
+    // Counters
+    uint32_t sent;
+    uint32_t lost;
+    uint32_t overflowed;
+};
+
+void dongleSenderInit(struct DongleSender *sender, const struct DongleRadio *radio, uint8_t session);
+bool dongleSenderHasRoom(const struct DongleSender *sender);
+bool dongleSenderKeyboard(struct DongleSender *sender, const struct KeyboardData *data, uint32_t nowUs);
+bool dongleSenderPointer(struct DongleSender *sender, const struct MouseData *data, uint32_t nowUs);
+bool dongleSenderPoll(struct DongleSender *sender, uint32_t nowUs);
+bool dongleSenderNextDue(const struct DongleSender *sender, uint32_t *dueUs);
+
+void dongleReceiverInit(struct DongleReceiver *receiver);
+uint8_t dongleReceiverPush(struct DongleReceiver *receiver, const uint8_t *frame, size_t length, uint32_t nowUs, struct DongleReport *report);
+uint8_t dongleReceiverPoll(struct DongleReceiver *receiver, uint32_t nowUs, struct DongleReport *report);
+bool dongleReceiverConnected(const struct DongleReceiver *receiver);
+
+void dongleChannelInit(struct DongleChannel *channel, struct DongleRadio *radio);
+size_t dongleChannelReceive(struct DongleChannel *channel, uint8_t *frame, size_t max);
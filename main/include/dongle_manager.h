@@ -0,0 +1,13 @@
+#pragma once
+
+#include "dongle_link.h"
+
+// Set to 1 to build the USB receiver dongle instead of a keyboard half
+#ifndef KVASS_DONGLE_BUILD
+#define KVASS_DONGLE_BUILD 0
+#endif
+
+#define DONGLE_FRAME_QUEUE_LEN 16
+
+void getDongleReceiverStats(struct DongleReceiverStats *stats);
+void vDongleTask(void *godParameters);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "dongle_link.h"
+
+// Keyboard and dongle meet on a fixed channel, no access point involved
+#define ESPNOW_CHANNEL 1
+
+// Runs in the WiFi task, must only copy the frame out
+typedef void (*EspnowReceiveFn)(const uint8_t *mac, const uint8_t *data, int length);
+
+esp_err_t espnowRadioPrepare();
+esp_err_t espnowRadioInit(EspnowReceiveFn receive);
+void espnowRadioDeinit();
+const struct DongleRadio *getEspnowRadio();
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "event_ring.h"
+
+#define EVENT_MERGE_SIZE 32
+
+struct MergeEntry
+{
+    struct InputEvent event;
+    uint32_t timeUs;
+};
+
+/*
+Puts key events from both halves back into scan order. Events wait until
+they are windowUs old, so a remote event that was scanned earlier but
+arrived later still gets in front of them. A window of 0 passes events
+straight through.
+*/
+struct EventMerge
+{
+    struct MergeEntry entries[EVENT_MERGE_SIZE];
+    uint8_t count;
+    uint32_t windowUs;
+    uint32_t releasedUs;
+    bool released;
+
+    // Counters
+    uint32_t merged;
+    uint32_t reordered;
+    uint32_t late;
+    uint32_t maxLateUs;
+};
+
+void eventMergeInit(struct EventMerge *merge, uint32_t windowUs);
+bool eventMergeAdd(struct EventMerge *merge, const struct InputEvent *event, uint32_t timeUs);
+bool eventMergePop(struct EventMerge *merge, uint32_t nowUs, struct InputEvent *event);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define EVENT_RING_SIZE 64 // must be a power of two
+#define EVENT_BACKLOG_SIZE 32
+// Mouse motion only goes into the ring while this many slots stay free for keys
+#define EVENT_RING_MOUSE_RESERVE 16
+
+enum InputEventType
+{
+    INPUT_EVENT_KEY,
+    INPUT_EVENT_MOUSE,
+};
+
+struct InputEvent
+{
+    uint8_t type;
+    uint8_t keycode;
+    uint8_t pressed;
+    uint8_t buttons;
+    int16_t delta_x;
+    int16_t delta_y;
+    int8_t scroll_vertical;
+    int8_t scroll_horizontal;
+    // Matrix key index before the keymap turned it into keycodes
+    uint8_t position;
+
+    // Latency tracing, us when the change was scanned and when it was queued
+    uint32_t scan_us;
+    uint32_t queue_us;
+};
+
+/*
+Single producer, single consumer ring between GPIO and comms tasks.
+Only the producer touches the backlog and pending mouse motion, key
+events that do not fit are held there instead of being dropped.
+*/
+struct EventRing
+{
+    atomic_uint_fast32_t head;
+    atomic_uint_fast32_t tail;
+    struct InputEvent events[EVENT_RING_SIZE];
+
+    struct InputEvent backlog[EVENT_BACKLOG_SIZE];
+    uint8_t backlogCount;
+    bool mousePending;
+    struct InputEvent pendingMouse;
+
+    // Counters, written by the producer only. Deferred events went through the backlog, each counted once
+    uint32_t deferred;
+    uint32_t mouseCoalesced;
+    uint32_t highWater;
+};
+
+void eventRingInit(struct EventRing *ring);
+uint32_t eventRingCount(struct EventRing *ring);
+
+// Producer side
+bool eventRingPushKey(struct EventRing *ring, const struct InputEvent *event);
+bool eventRingPushMouse(struct EventRing *ring, const struct InputEvent *event);
+bool eventRingFlush(struct EventRing *ring);
+
+// Consumer side
+bool eventRingPeek(struct EventRing *ring, struct InputEvent *event);
+bool eventRingPop(struct EventRing *ring, struct InputEvent *event);
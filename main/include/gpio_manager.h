@@ -3,11 +3,22 @@
 #include <stdlib.h>
 #include "driver/gpio.h"
 
+#include "common_kvass.h"
 #include "comms_manager.h"
+#include "matrix_scanner.h"
+#include "debounce.h"
+#include "scan_timing.h"
+#include "joystick_filter.h"
+#include "pointer_motion.h"
+#include "event_merge.h"
+#include "keymap.h"
+#include "keymap_store.h"
+#include "led_manager.h"
+#include "action_engine.h"
 
-#define JOYSTICK_LR_ADC ADC1_CHANNEL_7
-#define JOYSTICK_UD_ADC ADC2_CHANNEL_3
-#define JOYSTICK_BTN_ADC ADC1_CHANNEL_8  // due to PCB error
+#define JOYSTICK_LR_ADC ADC_CHANNEL_7  // ADC1
+#define JOYSTICK_UD_ADC ADC_CHANNEL_3  // ADC2
+#define JOYSTICK_BTN_ADC ADC_CHANNEL_8 // ADC1, due to PCB error
 #define JOYSTICK_BTN_GPIO GPIO_NUM_9
 
 #define KB_ROW_0_GPIO GPIO_NUM_33
@@ -24,12 +35,59 @@
 #define KB_COL_5_GPIO GPIO_NUM_1
 #define KB_COL_6_GPIO GPIO_NUM_16
 
-#define KB_COLS 7
-#define KB_ROWS 5
+// Time for rows to follow a newly driven column
+#define KB_MATRIX_SETTLE_US 1
+
+// Hardware timer paced scan rates, SCAN_RATE_MIN_HZ..SCAN_RATE_MAX_HZ
+#define KB_MATRIX_SCAN_RATE_HZ 1000
+#define KB_JOYSTICK_SCAN_RATE_HZ 100
+
+// Background ADC1 conversion rate, shared by the DMA sampled joystick channels
+#define KB_JOYSTICK_SAMPLE_RATE_HZ 20000
+// UD is read once per joystick tick, so it gets a short averaging window
+#define KB_JOYSTICK_UD_DEPTH 4
+
+// Pointer motion, distances are raw ADC steps from the calibrated centre
+#define KB_POINTER_CURVE POINTER_CURVE_QUADRATIC
+#define KB_POINTER_DEADZONE_RAW 150
+#define KB_POINTER_FULL_SCALE_RAW 1800
+#define KB_POINTER_MAX_SPEED_PPS 1500
+#define KB_POINTER_INVERT_Y false
+
+// Longest sleep on a full event ring before trying again without a wakeup
+#define KB_RING_SPACE_WAIT_MS 10
+
+// Quiet time before the matrix is armed for wake interrupts
+#define KB_IDLE_AFTER_MS 100
+
+// Debounce algorithm, samples are counted in scans, timeout only applies to DEBOUNCE_TIMEOUT
+#define KB_DEBOUNCE_MODE DEBOUNCE_EAGER
+#define KB_DEBOUNCE_SAMPLES 5
+#define KB_DEBOUNCE_TIMEOUT_MS 5
+
+// Tap-hold, combo and one-shot timing, max delay bounds how long any key waits for a decision
+#define KB_TAPPING_TERM_MS 200
+#define KB_COMBO_TERM_MS 30
+#define KB_ONESHOT_TIMEOUT_MS 1000
+#define KB_ACTION_MAX_DELAY_MS 200
+#define KB_HOLD_ON_OTHER_PRESS false
+#define KB_PERMISSIVE_HOLD true
 
 struct GpioParameters
 {
     TaskHandle_t *gpioTask;
 };
 
+esp_err_t initMatrixIo();
+void initKeyProcessing(struct CommsParameters *commsParams);
+bool scanKeys(struct GodParameters *params);
+void releaseKeyEvents(struct CommsParameters *commsParams);
+
+void getMatrixIdleStats(struct MatrixIdle *stats);
+void getEventMergeStats(struct EventMerge *stats);
+void getKeymapStats(struct KeymapStats *stats, uint16_t *activeLayers);
+void getActionEngineStats(struct ActionEngineStats *stats);
+void getJoystickFilterStats(struct JoystickFilter *stats, uint32_t *poolOverflows);
+void getScanTimingStats(struct ScanTiming *matrix, struct ScanTiming *joystick);
+esp_err_t setScanRates(uint32_t matrixHz, uint32_t joystickHz);
 void vGpioTask(void *godParameters);
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#define KB_BUFFER_SIZE 6
+#define KB_NKRO_BYTES 28 // NKRO bitmap covers keycodes 0x00-0xDF, modifiers are sent separately
+
+struct KeyboardData
+{
+    uint8_t modifier;
+    uint8_t keycode[KB_BUFFER_SIZE];
+    uint8_t bitmap[KB_NKRO_BYTES];
+
+    // Latency tracing, oldest change folded into this report
+    uint32_t scan_us;
+    uint32_t queue_us;
+};
+
+struct MouseData
+{
+    uint8_t button;
+    int16_t delta_x;
+    int16_t delta_y;
+    int8_t scroll_vertical;
+    int8_t scroll_horizontal;
+
+    uint32_t scan_us;
+    uint32_t queue_us;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Max samples averaged per channel, power of two, 4^N samples give N extra bits
+#define JOYSTICK_FILTER_DEPTH 64
+#define JOYSTICK_FILTER_EXTRA_BITS 3
+#define JOYSTICK_FILTER_SCALE (1 << JOYSTICK_FILTER_EXTRA_BITS)
+
+// Raw ADC samples are 12 bit
+#define JOYSTICK_SAMPLE_MAX 4095
+
+enum JoystickChannel
+{
+    JOYSTICK_CH_LR,
+    JOYSTICK_CH_UD,
+    JOYSTICK_CH_BTN,
+    JOYSTICK_CH_COUNT,
+};
+
+struct JoystickSample
+{
+    uint8_t channel;
+    uint16_t value;
+};
+
+/*
+Where samples come from. Hardware backend drains the ADC DMA pool,
+host builds use the fake source below.
+*/
+struct JoystickSampleSource
+{
+    void *ctx;
+    // Copies up to max buffered samples, returns 0 once nothing is left
+    size_t (*read)(void *ctx, struct JoystickSample *samples, size_t max);
+};
+
+// Moving average over the last depth samples of each channel
+struct JoystickFilter
+{
+    uint16_t ring[JOYSTICK_CH_COUNT][JOYSTICK_FILTER_DEPTH];
+    uint8_t depth[JOYSTICK_CH_COUNT];
+    uint8_t head[JOYSTICK_CH_COUNT];
+    uint8_t count[JOYSTICK_CH_COUNT];
+    uint32_t sum[JOYSTICK_CH_COUNT];
+
+    // Counters
+    uint32_t samples[JOYSTICK_CH_COUNT];
+    uint32_t dropped;
+};
+
+// Fake ADC for host builds, produces level +- noise round robin over all channels
+struct JoystickFakeSource
+{
+    uint16_t level[JOYSTICK_CH_COUNT];
+    uint16_t noise;
+    uint32_t seed;
+    uint32_t pending;
+    uint8_t next;
+};
+
+void joystickFilterInit(struct JoystickFilter *filter);
+void joystickFilterSetDepth(struct JoystickFilter *filter, enum JoystickChannel channel, uint8_t depth);
+void joystickFilterPush(struct JoystickFilter *filter, uint8_t channel, uint16_t value);
+size_t joystickFilterDrain(struct JoystickFilter *filter, const struct JoystickSampleSource *source);
+bool joystickFilterReady(const struct JoystickFilter *filter, enum JoystickChannel channel);
+uint32_t joystickFilterValue(const struct JoystickFilter *filter, enum JoystickChannel channel);
+
+void joystickFakeSourceInit(struct JoystickSampleSource *source, struct JoystickFakeSource *fake);
+void joystickFakeFeed(struct JoystickFakeSource *fake, uint32_t count);
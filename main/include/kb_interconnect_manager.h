@@ -1,10 +1,38 @@
 #pragma once
 
 #include <stdlib.h>
+#include "driver/gpio.h"
+
+#include "matrix_scanner.h"
+#include "split_link.h"
+
+// Full duplex UART over the TRRS cable between the halves
+#define INTERCONNECT_UART UART_NUM_1
+#define INTERCONNECT_TX_GPIO GPIO_NUM_39
+#define INTERCONNECT_RX_GPIO GPIO_NUM_40
+#define INTERCONNECT_BAUD_RATE 1000000
+#define INTERCONNECT_BUFFER_SIZE 256
+
+// Half that talks to the host, the other one forwards its matrix
+#define INTERCONNECT_PRIMARY_SIDE CFG_KB_SIDE_LEFT
+
+// How long key events wait for an earlier one from the other half, covers link delay and jitter
+#define INTERCONNECT_MERGE_WINDOW_US 2000
+// Remote states buffered between the interconnect and scan tasks
+#define INTERCONNECT_REMOTE_QUEUE_LEN 16
+// Local states on the secondary waiting for the interconnect task, each one is sent
+#define INTERCONNECT_LOCAL_QUEUE_LEN 16
+// How long either task waits for room before giving up or waking the other side again, one 5 ms tick at 200 Hz
+#define INTERCONNECT_QUEUE_WAIT_MS 5
 
 struct InterconnectParameters
 {
     TaskHandle_t *interconnectTask;
 };
 
-void vInterconnectTask(void *godParameters);
\ No newline at end of file
+bool interconnectIsPrimary();
+bool interconnectIsConnected();
+void interconnectSendMatrix(const matrix_row_t rows[KB_ROWS], uint32_t scanUs);
+bool interconnectTakeRemoteMatrix(matrix_row_t rows[KB_ROWS], uint32_t *timeUs);
+void getSplitLinkStats(struct SplitStats *stats, struct ClockSync *clock, bool *connected);
+void vInterconnectTask(void *godParameters);
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "matrix_scanner.h"
+
+#define KEYMAP_LAYERS 8
+#define KEYMAP_SIDES 2
+// Both halves in one flat table, index = (side * KB_ROWS + row) * KB_COLS + col
+#define KEYMAP_KEYS (KEYMAP_SIDES * KB_ROWS * KB_COLS)
+#define KEYMAP_KEY_INDEX(side, row, col) (((side) * KB_ROWS + (row)) * KB_COLS + (col))
+// Most key events one action can produce, four modifiers and the key itself
+#define KEYMAP_MAX_OUTPUT 5
+
+/*
+Action word: kind in the top 4 bits, argument below.
+  KEY      mods (CSAG, left hand) in bits 8-11, keycode in bits 0-7
+  MO/TG/DF layer in bits 0-3
+  MT       hold mods in bits 8-11, tap keycode in bits 0-7
+  LT       hold layer in bits 8-11, tap keycode in bits 0-7
+  OSM      mods in bits 8-11, held for the next key only
+0x0000 is no action, 0xF000 falls through to the next lower active layer.
+Tap-hold and one-shot need the action engine, on their own they act as the
+tap keycode and a plain modifier.
+*/
+typedef uint16_t keyaction_t;
+
+enum KeyActionKind
+{
+    ACTION_KIND_KEY = 0x0,
+    ACTION_KIND_LAYER_MOMENTARY = 0x1,
+    ACTION_KIND_LAYER_TOGGLE = 0x2,
+    ACTION_KIND_LAYER_DEFAULT = 0x3,
+    ACTION_KIND_MOD_TAP = 0x4,
+    ACTION_KIND_LAYER_TAP = 0x5,
+    ACTION_KIND_ONESHOT_MOD = 0x6,
+    ACTION_KIND_TRANSPARENT = 0xF,
+};
+
+#define ACTION_KIND(action) ((action) >> 12)
+#define ACTION_KEYCODE(action) ((uint8_t)((action) & 0xFF))
+#define ACTION_MODS(action) ((uint8_t)(((action) >> 8) & 0xF))
+#define ACTION_LAYER(action) ((uint8_t)((action) & 0xF))
+#define ACTION_HOLD_LAYER(action) ((uint8_t)(((action) >> 8) & 0xF))
+
+#define MOD_CTRL 0x1
+#define MOD_SHIFT 0x2
+#define MOD_ALT 0x4
+#define MOD_GUI 0x8
+
+#define ACTION_NONE ((keyaction_t)0x0000)
+#define ACTION_TRANSPARENT ((keyaction_t)(ACTION_KIND_TRANSPARENT << 12))
+#define KC(keycode) ((keyaction_t)(keycode))
+#define KM(mods, keycode) ((keyaction_t)(((mods) << 8) | (keycode)))
+#define MO(layer) ((keyaction_t)((ACTION_KIND_LAYER_MOMENTARY << 12) | (layer)))
+#define TG(layer) ((keyaction_t)((ACTION_KIND_LAYER_TOGGLE << 12) | (layer)))
+#define DF(layer) ((keyaction_t)((ACTION_KIND_LAYER_DEFAULT << 12) | (layer)))
+#define MT(mods, keycode) ((keyaction_t)((ACTION_KIND_MOD_TAP << 12) | ((mods) << 8) | (keycode)))
+#define LT(layer, keycode) ((keyaction_t)((ACTION_KIND_LAYER_TAP << 12) | ((layer) << 8) | (keycode)))
+#define OSM(mods) ((keyaction_t)((ACTION_KIND_ONESHOT_MOD << 12) | ((mods) << 8)))
+#define ____ ACTION_TRANSPARENT
+#define XXXX ACTION_NONE
+
+// One key press or release the keymap produced, in report order
+struct KeyOutput
+{
+    uint8_t keycode;
+    bool pressed;
+};
+
+struct KeymapStats
+{
+    uint32_t resolved;
+    uint32_t layerChanges;
+};
+
+/*
+Resolves matrix positions through a stack of active layers. The stack is
+rebuilt only when a layer changes, so a lookup is one table read per layer
+above the first non-transparent action. The action a key resolved to on press
+is latched and used again on release, whatever the layers did meanwhile.
+*/
+struct Keymap
+{
+    const keyaction_t (*actions)[KEYMAP_KEYS];
+    uint8_t layerCount;
+
+    uint8_t defaultLayer;
+    uint16_t toggled;
+    uint8_t momentary[KEYMAP_LAYERS]; // keys holding each layer
+    // Active layers, highest first, always ends with the default layer
+    uint8_t stack[KEYMAP_LAYERS];
+    uint8_t stackDepth;
+
+    keyaction_t latched[KEYMAP_KEYS];
+    // Keys and actions holding each modifier bit down
+    uint8_t modifierRefs[8];
+
+    struct KeymapStats stats;
+};
+
+extern const uint8_t keymapModifierBit[256];
+// Built in keymap, used until one is loaded from elsewhere
+extern const keyaction_t defaultKeymap[][KEYMAP_KEYS];
+extern const uint8_t defaultKeymapLayers;
+extern const char *const defaultLayerNames[];
+
+void keymapInit(struct Keymap *keymap, const keyaction_t (*actions)[KEYMAP_KEYS], uint8_t layerCount);
+void keymapSetActions(struct Keymap *keymap, const keyaction_t (*actions)[KEYMAP_KEYS], uint8_t layerCount);
+keyaction_t keymapResolve(const struct Keymap *keymap, uint8_t key);
+uint8_t keymapApply(struct Keymap *keymap, uint8_t key, keyaction_t action, bool pressed, struct KeyOutput out[KEYMAP_MAX_OUTPUT]);
+uint8_t keymapProcess(struct Keymap *keymap, uint8_t key, bool pressed, struct KeyOutput out[KEYMAP_MAX_OUTPUT]);
+uint16_t keymapActiveLayers(const struct Keymap *keymap);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "keymap.h"
+
+#define KEYMAP_IMAGE_MAGIC 0x4D4B564B // "KVKM" little endian
+#define KEYMAP_IMAGE_VERSION 1
+// One erase sector per slot, the partition holds slot A then slot B
+#define KEYMAP_IMAGE_SLOT_SIZE 0x1000
+#define KEYMAP_IMAGE_SLOTS 2
+
+/*
+Slot layout, all little endian:
+  header      struct KeymapImageHeader
+  actions     layers * keys keyaction_t words, layer after layer
+The CRC32 (zlib polynomial) covers the header with crc set to 0 and the actions.
+Actions are read straight from flash, so the header keeps them 4 byte aligned.
+tools/keymap_compiler.py writes and checks the same format.
+*/
+struct KeymapImageHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t keys; // KEYMAP_KEYS of the build the image is for
+    uint8_t layers;
+    uint8_t reserved[3];
+    uint32_t generation; // bumped on every update, the higher valid slot wins
+    uint32_t crc;
+};
+
+_Static_assert(sizeof(struct KeymapImageHeader) == 20, "header layout is shared with the compiler");
+
+enum KeymapImageError
+{
+    KEYMAP_IMAGE_OK,
+    KEYMAP_IMAGE_TRUNCATED,
+    KEYMAP_IMAGE_BAD_MAGIC,
+    KEYMAP_IMAGE_BAD_VERSION,
+    KEYMAP_IMAGE_BAD_SHAPE, // key count or layer count does not fit this build
+    KEYMAP_IMAGE_BAD_CRC,
+};
+
+uint32_t keymapImageCrc(const struct KeymapImageHeader *header, const keyaction_t *actions);
+size_t keymapImageSize(uint8_t layers);
+enum KeymapImageError keymapImageCheck(const void *image, size_t size);
+const keyaction_t (*keymapImageActions(const void *image))[KEYMAP_KEYS];
+const char *keymapImageErrorName(enum KeymapImageError error);
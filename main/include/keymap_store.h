@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#include "keymap_image.h"
+
+#define KEYMAP_PARTITION_LABEL "keymap"
+#define KEYMAP_PARTITION_SUBTYPE 0x40
+// How long an update waits for the GPIO task to let go of the image it has not taken yet
+#define KEYMAP_TAKE_WAIT_MS 100
+// Console command byte, the image follows it
+#define CONSOLE_KEYMAP_UPLOAD 'k'
+// A console upload that stops this long is dropped
+#define KEYMAP_UPLOAD_TIMEOUT_MS 1000
+
+enum KeymapUploadState
+{
+    KEYMAP_UPLOAD_IDLE,
+    KEYMAP_UPLOAD_RECEIVING,
+    KEYMAP_UPLOAD_READY, // complete, waiting for keymapUploadApply
+};
+
+struct KeymapStoreStats
+{
+    int8_t activeSlot; // -1 while the built in keymap is used
+    uint32_t generation;
+    uint32_t updates;
+    uint32_t rejected;
+    enum KeymapImageError lastError;
+};
+
+esp_err_t keymapStoreInit(void);
+bool keymapStoreTake(const keyaction_t (**actions)[KEYMAP_KEYS], uint8_t *layers);
+esp_err_t keymapStoreUpdate(const void *image, size_t size);
+bool keymapUploadBegin(uint32_t nowUs);
+bool keymapUploadReceiving(uint32_t nowUs);
+size_t keymapUploadFeed(const uint8_t *data, size_t length, uint32_t nowUs, enum KeymapUploadState *state);
+esp_err_t keymapUploadApply(void);
+void getKeymapStoreStats(struct KeymapStoreStats *stats);
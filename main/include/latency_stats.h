@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+// Set from CONFIG_KVASS_LATENCY_TRACE by main/CMakeLists.txt, 0 compiles out all latency tracing
+#ifndef KVASS_LATENCY_TRACE
+#define KVASS_LATENCY_TRACE 1
+#endif
+
+#define LATENCY_BUCKETS 13
+
+enum LatencyStage
+{
+    LATENCY_SCAN_TO_QUEUE,
+    LATENCY_QUEUE_TO_SEND,
+    LATENCY_SEND_TO_COMPLETE,
+    LATENCY_SCAN_TO_COMPLETE,
+    LATENCY_STAGE_COUNT,
+};
+
+struct LatencyHistogram
+{
+    uint32_t count;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint64_t totalUs;
+    uint32_t buckets[LATENCY_BUCKETS];
+};
+
+#if KVASS_LATENCY_TRACE
+
+// Low 32 bits of the microsecond clock, differences stay valid across wrap
+#define LATENCY_TIMESTAMP() ((uint32_t)esp_timer_get_time())
+
+void latencyRecord(enum LatencyStage stage, uint32_t startUs, uint32_t endUs);
+void latencyReset(void);
+void latencyDump(void);
+const struct LatencyHistogram *latencyGetHistogram(enum LatencyStage stage);
+
+#else
+
+#define LATENCY_TIMESTAMP() 0u
+
+static inline void latencyRecord(enum LatencyStage stage, uint32_t startUs, uint32_t endUs)
+{
+    (void)stage;
+    (void)startUs;
+    (void)endUs;
+}
+static inline void latencyReset(void) {}
+static inline void latencyDump(void) {}
+static inline const struct LatencyHistogram *latencyGetHistogram(enum LatencyStage stage)
+{
+    (void)stage;
+    return 0;
+}
+
+#endif
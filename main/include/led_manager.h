@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include "driver/gpio.h"
+
+#include "led_render.h"
+
+// WS2812 data pin, the on-board LED of ESP32-S3 DevKitC boards
+#define KB_LED_GPIO GPIO_NUM_48
+// 1 adds one LED per key after the status LED, in keymap order
+#define KB_LED_PER_KEY 0
+#define KB_LED_COUNT (1 + (KB_LED_PER_KEY ? KEYMAP_KEYS : 0))
+#define KB_LED_BRIGHTNESS 64
+#define KB_LED_REACTIVE_MS 300
+
+// Frames are rendered at this rate, a frame taking longer than the budget is counted
+#define KB_LED_FRAME_MS 20
+#define KB_LED_FRAME_BUDGET_US 4000
+// RMT symbols per DMA block, the strip is streamed through it
+#define KB_LED_RMT_SYMBOLS 256
+#define KB_LED_RMT_RESOLUTION_HZ 10000000
+
+void ledKeyPressed(uint8_t key);
+void getLedStats(struct LedStats *stats, uint32_t *fpsMilli);
+void vLedTask(void *godParameters);
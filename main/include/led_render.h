@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "keymap.h"
+
+// Enough for one LED per key plus a few status LEDs
+#define LED_MAX 80
+#define LED_NONE 0xFF
+
+struct LedRgb
+{
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+
+struct LedStrip
+{
+    void *ctx;
+    // Sends the whole frame, may block the calling task until the data is out
+    bool (*push)(void *ctx, const struct LedRgb *pixels, uint16_t count);
+};
+
+struct LedConfig
+{
+    uint16_t count;
+    uint8_t statusLed; // LED_NONE if there is none
+    // LED under each key, NULL or LED_NONE where there is none
+    const uint8_t *keyLeds;
+    uint8_t brightness;
+    uint32_t reactiveUs; // fade time of a key press
+};
+
+// Everything an effect may look at, sampled once per frame
+struct LedInputs
+{
+    uint8_t locks;
+    uint16_t activeLayers;
+    uint32_t pressed[(KEYMAP_KEYS + 31) / 32]; // keys pressed since the last frame
+};
+
+struct LedStats
+{
+    uint32_t frames;
+    uint32_t pushed;
+    uint32_t clean; // frames identical to what the strip shows
+    uint32_t failed;
+    uint32_t overBudget;
+    // Render time is CPU, frame time adds the push which mostly waits on DMA
+    uint32_t totalRenderUs;
+    uint32_t maxRenderUs;
+    uint32_t maxFrameUs;
+};
+
+/*
+Renders into a frame buffer and only hands frames that differ from what the
+strip already shows to the strip. The caller times each frame and reports it
+with ledRendererAccount, so the counters work the same on the host.
+*/
+struct LedRenderer
+{
+    struct LedConfig config;
+    struct LedRgb frame[LED_MAX];
+    struct LedRgb shown[LED_MAX];
+    bool shownValid;
+    uint32_t pressedUs[LED_MAX];
+    bool fading[LED_MAX];
+
+    struct LedStats stats;
+};
+
+// Records every frame, for host builds
+struct LedCaptureStrip
+{
+    struct LedStrip strip;
+    struct LedRgb pixels[LED_MAX];
+    uint16_t count;
+    uint32_t pushes;
+};
+
+void ledRendererInit(struct LedRenderer *renderer, const struct LedConfig *config);
+bool ledRendererFrame(struct LedRenderer *renderer, const struct LedInputs *inputs, uint32_t nowUs);
+bool ledRendererPush(struct LedRenderer *renderer, const struct LedStrip *strip);
+void ledRendererAccount(struct LedRenderer *renderer, uint32_t renderUs, uint32_t frameUs, uint32_t budgetUs);
+
+void ledCaptureStripInit(struct LedCaptureStrip *capture);
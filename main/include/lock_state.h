@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Keyboard LED output report bits, HID usage page 0x08
+#define LOCK_NUM 0x01
+#define LOCK_CAPS 0x02
+#define LOCK_SCROLL 0x04
+#define LOCK_COMPOSE 0x08
+#define LOCK_KANA 0x10
+#define LOCK_MASK 0x1F
+
+// Lock state as the host last reported it, written by one task and read by any
+struct LockState
+{
+    volatile uint8_t leds;
+    uint32_t reports;
+    uint32_t changes;
+    uint32_t malformed; // wrong report ID or empty
+};
+
+bool lockStateUpdate(struct LockState *state, uint8_t reportId, uint8_t expectedId, const uint8_t *buffer, uint16_t length);
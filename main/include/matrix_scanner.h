@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define KB_COLS 7
+#define KB_ROWS 5
+
+// One bit per column, bit N = column N (KB_COLS must fit)
+typedef uint8_t matrix_row_t;
+
+#define MATRIX_COL_MASK ((matrix_row_t)((1u << KB_COLS) - 1))
+
+/*
+Pin map abstraction used by the scanner. Hardware backend drives columns
+through a dedicated GPIO bundle, host builds use the fake register below.
+*/
+struct MatrixIo
+{
+    void *ctx;
+    // Drive only the given column high, returns once rows have settled
+    void (*selectCol)(void *ctx, uint8_t col);
+    // Drive all columns low
+    void (*unselectCols)(void *ctx);
+    // Read all row pins in one access, bit N = row N
+    uint32_t (*readRows)(void *ctx);
+    // Drive all columns high and enable row edge interrupts
+    void (*armWake)(void *ctx);
+    // Disable row interrupts, columns are left low
+    void (*disarmWake)(void *ctx);
+};
+
+enum MatrixScanState
+{
+    MATRIX_SCAN_ACTIVE,
+    MATRIX_SCAN_IDLE,
+};
+
+/*
+Idle scanning state machine. After idleAfter quiet scans the matrix is armed
+for wake interrupts and the scan task sleeps until a row edge arrives.
+*/
+struct MatrixIdle
+{
+    enum MatrixScanState state;
+    uint16_t idleAfter;
+    uint16_t quietScans;
+    uint32_t scanPeriodUs;
+    uint64_t idleSinceUs;
+
+    // Counters
+    uint32_t wakeups;
+    uint32_t lastWakeLatencyUs;
+    uint32_t maxWakeLatencyUs;
+    uint64_t idleUs;
+    uint64_t scansSaved;
+};
+
+struct MatrixScanner
+{
+    const struct MatrixIo *io;
+    matrix_row_t state[KB_ROWS];
+};
+
+// Fake input register for host builds, keys[row] holds pressed columns
+struct MatrixFakeRegister
+{
+    matrix_row_t keys[KB_ROWS];
+    int8_t selected;
+    bool armed;
+    uint32_t reads;
+};
+
+void matrixScannerInit(struct MatrixScanner *scanner, const struct MatrixIo *io);
+void matrixScanRaw(const struct MatrixIo *io, matrix_row_t raw[KB_ROWS]);
+bool matrixScan(struct MatrixScanner *scanner, matrix_row_t changes[KB_ROWS]);
+
+void matrixIdleInit(struct MatrixIdle *idle, uint16_t idleAfter, uint32_t scanPeriodUs);
+bool matrixIdleUpdate(struct MatrixIdle *idle, bool quiet);
+bool matrixIdleEnter(struct MatrixIdle *idle, const struct MatrixIo *io, uint64_t nowUs);
+void matrixIdleWake(struct MatrixIdle *idle, const struct MatrixIo *io, uint64_t edgeUs, uint64_t nowUs);
+
+void matrixFakeIoInit(struct MatrixIo *io, struct MatrixFakeRegister *reg);
+bool matrixFakeEdge(struct MatrixFakeRegister *reg);
+
+// Returns index of lowest set bit and clears it, bits must not be 0
+static inline int matrixPopLowest(matrix_row_t *bits)
+{
+    int col = __builtin_ctz(*bits);
+    *bits &= (matrix_row_t)(*bits - 1);
+    return col;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define POINTER_AXES 2
+
+// Sub-pixel resolution of speeds and carried motion
+#define POINTER_FRAC_BITS 8
+#define POINTER_ONE (1 << POINTER_FRAC_BITS)
+
+// Acceleration curves are sampled at 17 points from deadzone edge to full deflection
+#define POINTER_CURVE_POINTS 17
+
+// Ticks averaged for the initial centre, the stick must be left alone meanwhile
+#define POINTER_CALIBRATION_TICKS 16
+// Centre follows the resting stick by 1/2^N of the error per tick
+#define POINTER_DRIFT_SHIFT 6
+
+enum PointerCurve
+{
+    POINTER_CURVE_LINEAR,
+    POINTER_CURVE_QUADRATIC, // fine control around the centre, fast at the edge
+    POINTER_CURVE_PRECISION, // cubic, mostly for small corrections
+    POINTER_CURVE_COUNT,
+};
+
+struct PointerConfig
+{
+    enum PointerCurve curve;
+    // Input counts from centre, deadzone is radial
+    uint32_t deadzone;
+    uint32_t fullScale;
+    // Speed at full deflection
+    uint32_t maxSpeedPps;
+    uint32_t tickHz;
+    bool invert[POINTER_AXES];
+};
+
+struct PointerMotion
+{
+    struct PointerConfig config;
+
+    // Centre in input counts << 4 so slow drift tracking does not round away
+    int32_t centre[POINTER_AXES];
+    uint16_t calibrationTicks;
+    bool calibrated;
+    bool deflected;
+
+    // Motion not sent yet, in 1/POINTER_ONE pixels
+    int32_t carry[POINTER_AXES];
+};
+
+void pointerMotionInit(struct PointerMotion *motion, const struct PointerConfig *config);
+void pointerMotionRecalibrate(struct PointerMotion *motion);
+bool pointerMotionUpdate(struct PointerMotion *motion, const int32_t input[POINTER_AXES], int16_t out[POINTER_AXES]);
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "event_ring.h"
+#include "report_scheduler.h"
+#include "transport.h"
+
+struct PipelineStats
+{
+    uint32_t attached;
+    uint32_t failed;   // transports that did not come up
+    uint32_t resynced; // drains with no host listening
+};
+
+/*
+Everything between the event ring and a transport: drained events are merged
+by the scheduler and paced by the transport's completion callback. Not
+thread safe, the owner serialises calls coming from the transport.
+*/
+struct ReportPipeline
+{
+    const struct Transport *transport;
+    struct ReportOutput output;
+    struct ReportScheduler scheduler;
+    bool suspended;
+
+    struct PipelineStats stats;
+};
+
+void reportPipelineInit(struct ReportPipeline *pipe);
+bool reportPipelineAttach(struct ReportPipeline *pipe, const struct Transport *transport, TransportCompleteFn complete, void *owner);
+void reportPipelineDetach(struct ReportPipeline *pipe);
+uint32_t reportPipelineProcess(struct ReportPipeline *pipe, struct EventRing *ring);
+void reportPipelineComplete(struct ReportPipeline *pipe, enum ReportType type);
+void reportPipelineSuspend(struct ReportPipeline *pipe, bool suspended);
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common_utils.h"
+#include "event_ring.h"
+#include "hid_reports.h"
+
+#define KEYBOARD_QUEUE_SIZE 16
+#define MOUSE_QUEUE_SIZE 4
+
+enum ReportType
+{
+    REPORT_KEYBOARD,
+    REPORT_MOUSE,
+};
+
+// Where finished reports go, send functions return false if the report was not taken
+struct ReportOutput
+{
+    void *ctx;
+    bool (*ready)(void *ctx, enum ReportType type);
+    bool (*sendKeyboard)(void *ctx, const struct KeyboardData *data);
+    bool (*sendMouse)(void *ctx, const struct MouseData *data);
+};
+
+struct ReportStats
+{
+    uint32_t keyboardSent;
+    uint32_t mouseSent;
+    uint32_t merged;       // events folded into a report that was already pending
+    uint32_t deduplicated; // reports skipped because they matched the last one sent
+    uint32_t stalled;      // pumps that found work but a busy endpoint
+    uint32_t queueFull;    // drains stopped because a split found the queue full
+    uint8_t keyboardHighWater;
+    uint8_t mouseHighWater;
+};
+
+/*
+Merges drained input events into the next HID reports. Reports only have to
+be split when the same key changes twice, or mouse buttons change, before
+the previous state was sent, everything else is merged. Keyboard and mouse
+are queued separately so a busy pointer endpoint never holds back keys.
+*/
+struct ReportScheduler
+{
+    const struct ReportOutput *output;
+
+    KeySet keys;
+    KeySet touched; // keys that changed since the last keyboard snapshot
+    bool keyboardDirty;
+    uint32_t keyboardScanUs;
+    uint32_t keyboardQueueUs;
+
+    int32_t mouseX;
+    int32_t mouseY;
+    int32_t mouseWheel;
+    int32_t mousePan;
+    uint8_t mouseButtons;
+    bool mouseDirty;
+    uint32_t mouseScanUs;
+    uint32_t mouseQueueUs;
+
+    struct KeyboardData keyboardQueue[KEYBOARD_QUEUE_SIZE];
+    uint8_t keyboardHead;
+    uint8_t keyboardCount;
+    struct MouseData mouseQueue[MOUSE_QUEUE_SIZE];
+    uint8_t mouseHead;
+    uint8_t mouseCount;
+
+    struct KeyboardData lastKeyboard;
+    uint8_t lastMouseButtons;
+    bool drainBlocked; // events were left in the ring for lack of queue room
+
+    struct ReportStats stats;
+};
+
+void populateKeyboard(struct KeyboardData *data, const KeySet *keys);
+
+void reportSchedulerInit(struct ReportScheduler *sched, const struct ReportOutput *output);
+bool reportSchedulerApply(struct ReportScheduler *sched, const struct InputEvent *event);
+uint32_t reportSchedulerDrain(struct ReportScheduler *sched, struct EventRing *ring);
+void reportSchedulerResync(struct ReportScheduler *sched);
+bool reportSchedulerPending(const struct ReportScheduler *sched);
+void reportSchedulerPump(struct ReportScheduler *sched);
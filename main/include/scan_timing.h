@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#define SCAN_RATE_MIN_HZ 100
+#define SCAN_RATE_MAX_HZ 8000
+
+// Bucket N counts periods that missed the target by less than 2^N us, last bucket takes the rest
+#define SCAN_JITTER_BUCKETS 12
+
+struct ScanTiming
+{
+    uint32_t rateHz;
+    uint32_t targetPeriodUs;
+    uint64_t lastUs;
+
+    uint32_t periods;
+    uint32_t minPeriodUs;
+    uint32_t maxPeriodUs;
+    uint64_t totalPeriodUs;
+    uint32_t maxJitterUs;
+    uint32_t jitterHistogram[SCAN_JITTER_BUCKETS];
+};
+
+uint32_t scanTimingClampRate(uint32_t rateHz);
+void scanTimingInit(struct ScanTiming *timing, uint32_t rateHz);
+void scanTimingRestart(struct ScanTiming *timing);
+void scanTimingTick(struct ScanTiming *timing, uint64_t nowUs);
+uint32_t scanTimingAvgPeriodUs(const struct ScanTiming *timing);
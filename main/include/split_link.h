@@ -0,0 +1,189 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "matrix_scanner.h"
+#include "clock_sync.h"
+
+// Frame on the wire: SOF, payload length, payload, CRC16 over length and payload
+#define SPLIT_FRAME_SOF 0xA5
+#define SPLIT_PAYLOAD_MAX 16
+#define SPLIT_FRAME_MAX (SPLIT_PAYLOAD_MAX + 4)
+
+// Frames in flight before the sender waits for an ACK, power of two
+#define SPLIT_WINDOW 8
+#define SPLIT_RETRANSMIT_MS 4
+// Retransmits back off by doubling while nothing is acknowledged, the other half may be unplugged
+#define SPLIT_RETRANSMIT_MAX_MS 256
+// States that wait for the window instead of being folded into the pending one
+#define SPLIT_STATE_QUEUE 16
+#define SPLIT_FULL_SYNC_MS 250
+// No ACK or frame for this long and the other half counts as gone
+#define SPLIT_LINK_TIMEOUT_MS 1000
+// Clock sync round trips from the primary
+#define SPLIT_PING_MS 100
+
+enum SplitFrameType
+{
+    SPLIT_FRAME_DELTA = 1, // seq, row mask, change time, new value of every row in the mask
+    SPLIT_FRAME_FULL,      // seq, session, change time, all rows
+    SPLIT_FRAME_ACK,       // next seq the receiver expects
+    SPLIT_FRAME_RESYNC,    // receiver lost track, asks for a full frame
+    SPLIT_FRAME_PING,      // primary send time
+    SPLIT_FRAME_PONG,      // ping send time, secondary receive and send time
+};
+
+enum SplitRole
+{
+    SPLIT_ROLE_PRIMARY,   // talks to the host, receives the other half
+    SPLIT_ROLE_SECONDARY, // sends its matrix
+};
+
+/*
+Moves whole encoded frames between the halves. UART backend lives in the
+interconnect task, host builds use the loopback below.
+*/
+struct SplitTransport
+{
+    void *ctx;
+    // Sends one encoded frame, returns false if it was not taken
+    bool (*send)(void *ctx, const uint8_t *frame, size_t length);
+    // Copies the next received frame, returns 0 if none is waiting
+    size_t (*receive)(void *ctx, uint8_t *frame, size_t max);
+};
+
+struct SplitStats
+{
+    uint32_t framesSent;
+    uint32_t retransmits;
+    uint32_t fullSyncs;
+    uint32_t framesReceived;
+    uint32_t crcErrors;
+    uint32_t outOfOrder;
+    uint32_t duplicates;
+    uint32_t linkDrops;
+    uint32_t pings;
+    uint32_t pongs;
+    uint32_t statesQueued; // states that would have cancelled an unsent change
+    uint32_t statesFolded; // queued states merged because the queue was full
+    uint32_t localDropped; // states the scan task could not hand over, set by the owner
+};
+
+// Remote rows as of timeUs, already moved to the local clock
+typedef void (*SplitRemoteHandler)(void *ctx, const matrix_row_t rows[KB_ROWS], uint32_t timeUs);
+
+struct SplitPending
+{
+    uint8_t length;
+    uint8_t frame[SPLIT_FRAME_MAX];
+};
+
+struct SplitState
+{
+    matrix_row_t rows[KB_ROWS];
+    uint32_t timeUs;
+};
+
+struct SplitLink
+{
+    enum SplitRole role;
+    const struct SplitTransport *transport;
+    // Changes on every boot so a restarted sender is told apart from late duplicates
+    uint8_t session;
+
+    // Sender, local is the newest state, sent is what the queued frames add up to
+    matrix_row_t local[KB_ROWS];
+    matrix_row_t sent[KB_ROWS];
+    // Scan time of the oldest change not in a frame yet
+    uint32_t changeUs;
+    bool changePending;
+    uint8_t nextSeq;
+    uint8_t ackedSeq;
+    struct SplitPending window[SPLIT_WINDOW];
+    // Newer states behind local, each goes out as its own frame
+    struct SplitState states[SPLIT_STATE_QUEUE];
+    uint8_t stateHead;
+    uint8_t stateCount;
+    uint32_t retransmitUs;
+    uint32_t lastSendUs;
+    uint32_t lastFullUs;
+    uint32_t lastAckUs;
+    bool fullDue;
+
+    // Receiver
+    matrix_row_t remote[KB_ROWS];
+    uint8_t remoteSession;
+    uint8_t expectedSeq;
+    bool synced;
+    bool ackDue;
+    uint32_t lastRxUs;
+    uint32_t lastPingUs;
+    struct ClockSync clock;
+    SplitRemoteHandler onRemote;
+    void *onRemoteCtx;
+
+    bool connected;
+    struct SplitStats stats;
+};
+
+// Splits a byte stream into frames, resyncs on the next SOF after garbage
+struct SplitDeframer
+{
+    uint8_t frame[SPLIT_FRAME_MAX];
+    uint8_t length;
+};
+
+#define SPLIT_LOOPBACK_DEPTH 32
+
+struct SplitLoopbackFrame
+{
+    struct SplitPending pending;
+    uint32_t dueUs;
+};
+
+struct SplitLoopbackQueue
+{
+    struct SplitLoopbackFrame frames[SPLIT_LOOPBACK_DEPTH];
+    uint8_t head;
+    uint8_t count;
+};
+
+struct SplitLoopbackEnd
+{
+    struct SplitLoopback *loop;
+    uint8_t side;
+};
+
+// In-memory link for host builds, delays, drops, reorders and corrupts frames on request
+struct SplitLoopback
+{
+    struct SplitLoopbackQueue queue[2];
+    struct SplitLoopbackEnd end[2];
+    // Frames show up delayUs + 0..jitterUs after being sent, nowUs is driven by the simulation
+    uint32_t nowUs;
+    uint32_t delayUs;
+    uint32_t jitterUs;
+    uint8_t lossPercent;
+    uint8_t reorderPercent;
+    uint8_t corruptPercent;
+    uint32_t seed;
+
+    // Counters
+    uint32_t lost;
+    uint32_t reordered;
+    uint32_t corrupted;
+};
+
+uint16_t splitCrc16(const uint8_t *data, size_t length);
+size_t splitEncodeFrame(const uint8_t *payload, size_t length, uint8_t frame[SPLIT_FRAME_MAX]);
+int splitDecodeFrame(const uint8_t *frame, size_t length, uint8_t payload[SPLIT_PAYLOAD_MAX]);
+size_t splitDeframerPush(struct SplitDeframer *deframer, uint8_t byte, uint8_t frame[SPLIT_FRAME_MAX]);
+
+void splitLinkInit(struct SplitLink *link, enum SplitRole role, const struct SplitTransport *transport, uint8_t session);
+void splitLinkSetRemoteHandler(struct SplitLink *link, SplitRemoteHandler handler, void *ctx);
+void splitLinkSendState(struct SplitLink *link, const matrix_row_t rows[KB_ROWS], uint32_t nowUs);
+bool splitLinkPoll(struct SplitLink *link, uint32_t nowUs);
+
+void splitLoopbackInit(struct SplitLoopback *loop, struct SplitTransport *a, struct SplitTransport *b);
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_cpu.h"
+#define TELEMETRY_CORE() esp_cpu_get_core_id()
+#else
+#define TELEMETRY_CORE() 0
+#endif
+
+#define TELEMETRY_CORES 2
+#define TELEMETRY_SAMPLES 32
+#define TELEMETRY_TASKS 10
+#define TELEMETRY_TASK_NAME 16
+
+#define TELEMETRY_VERSION 1
+// Snapshot frames start with this so a decoder can find them between console text
+#define TELEMETRY_SYNC "KVTM"
+#define TELEMETRY_SYNC_LENGTH 4
+#define TELEMETRY_HEADER_BYTES 16
+#define TELEMETRY_SAMPLE_BYTES (4 + 4 * TELEMETRY_COUNTERS + 4 * TELEMETRY_GAUGES + 2 * TELEMETRY_TASKS)
+#define TELEMETRY_FRAME_MAX (TELEMETRY_SYNC_LENGTH + 2 + TELEMETRY_HEADER_BYTES + TELEMETRY_TASKS * (TELEMETRY_TASK_NAME + 4) + \
+                             TELEMETRY_SAMPLES * TELEMETRY_SAMPLE_BYTES + 2)
+
+// Running totals, the decoder turns them into rates. Order is part of the snapshot format
+enum TelemetryCounter
+{
+    TELEMETRY_MATRIX_SCANS,
+    TELEMETRY_REPORTS_COMPLETED, // host took a report, counted in the USB task
+    TELEMETRY_KEYBOARD_SENT,
+    TELEMETRY_MOUSE_SENT,
+    TELEMETRY_REPORTS_MERGED,
+    TELEMETRY_REPORT_QUEUE_FULL, // drains paused until the report queue had room
+    TELEMETRY_RING_DEFERRED, // events held in the backlog, none are lost
+    TELEMETRY_COUNTERS,
+};
+
+enum TelemetryGauge
+{
+    TELEMETRY_SCAN_PERIOD_US,
+    TELEMETRY_RING_HIGH_WATER,
+    TELEMETRY_KEYBOARD_QUEUE_HIGH_WATER,
+    TELEMETRY_MOUSE_QUEUE_HIGH_WATER,
+    TELEMETRY_HEAP_FREE,
+    TELEMETRY_HEAP_MIN,
+    TELEMETRY_GAUGES,
+};
+
+struct TelemetrySample
+{
+    uint32_t timeMs;
+    uint32_t counters[TELEMETRY_COUNTERS];
+    uint32_t gauges[TELEMETRY_GAUGES];
+    // Share of one core since the previous sample, in thousandths
+    uint16_t taskPermille[TELEMETRY_TASKS];
+};
+
+/*
+Counters that several tasks bump in hot paths get a slot per core, an
+increment is one relaxed atomic add on memory no other core writes. Everything
+else already has a single writer and is only read when a sample is taken.
+Samples are written by one task into a ring that readers copy without a lock,
+a sample overwritten while it was copied is left out.
+*/
+struct Telemetry
+{
+    uint32_t counters[TELEMETRY_CORES][TELEMETRY_COUNTERS];
+
+    char taskNames[TELEMETRY_TASKS][TELEMETRY_TASK_NAME];
+    uint32_t taskStackFree[TELEMETRY_TASKS]; // bytes, refreshed on request only
+    uint8_t taskCount;
+
+    uint16_t periodMs;
+    struct TelemetrySample samples[TELEMETRY_SAMPLES];
+    uint32_t written; // samples ever pushed
+};
+
+extern struct Telemetry telemetry;
+
+static inline void telemetryCount(struct Telemetry *t, enum TelemetryCounter counter, uint32_t n)
+{
+    // Atomic still, a task can be preempted or moved to the other core mid increment
+    __atomic_fetch_add(&t->counters[TELEMETRY_CORE()][counter], n, __ATOMIC_RELAXED);
+}
+
+void telemetryInit(struct Telemetry *t, uint16_t periodMs);
+int telemetryAddTask(struct Telemetry *t, const char *name);
+uint32_t telemetryTotal(const struct Telemetry *t, enum TelemetryCounter counter);
+void telemetryPush(struct Telemetry *t, const struct TelemetrySample *sample);
+size_t telemetryEncode(const struct Telemetry *t, uint8_t *frame, size_t size);
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "event_ring.h"
+#include "telemetry.h"
+
+#define KB_TELEMETRY_PERIOD_MS 1000
+
+void telemetryStart(struct EventRing *ring);
+void telemetryWatchTask(TaskHandle_t task);
+void telemetrySampleNow(void);
+void telemetrySendSnapshot(void);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TIMER_WHEEL_SLOTS 32 // must be a power of two
+#define TIMER_WHEEL_TICK_US 1000
+#define TIMER_WHEEL_TIMERS 8
+#define TIMER_WHEEL_NONE 0xFF
+
+struct WheelTimer
+{
+    uint32_t dueUs;
+    uint8_t next; // next timer in the same slot
+    bool armed;
+};
+
+/*
+Hashed timer wheel, a timer sits in the slot of its due tick and is checked
+once per lap, so arming, cancelling and advancing are O(timers in a slot).
+Timers further out than one lap just stay in their slot for more laps.
+*/
+struct TimerWheel
+{
+    uint8_t slots[TIMER_WHEEL_SLOTS];
+    struct WheelTimer timers[TIMER_WHEEL_TIMERS];
+    uint32_t tick; // last tick advanced to
+    uint32_t lastUs;
+};
+
+void timerWheelInit(struct TimerWheel *wheel, uint32_t nowUs);
+void timerWheelArm(struct TimerWheel *wheel, uint8_t id, uint32_t dueUs);
+void timerWheelCancel(struct TimerWheel *wheel, uint8_t id);
+bool timerWheelArmed(const struct TimerWheel *wheel, uint8_t id);
+uint8_t timerWheelAdvance(struct TimerWheel *wheel, uint32_t nowUs, uint8_t expired[TIMER_WHEEL_TIMERS]);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hid_reports.h"
+#include "report_scheduler.h"
+
+// Called by a transport when it can take the next report of that type, may run in another task
+typedef void (*TransportCompleteFn)(void *owner, enum ReportType type);
+
+/*
+Link to the host. Only the report pipeline calls these, one at a time. Send
+functions return false if the report was not taken, the pipeline keeps it
+and tries again after the completion callback.
+*/
+struct Transport
+{
+    const char *name;
+    void *ctx;
+
+    bool (*init)(void *ctx, TransportCompleteFn complete, void *owner);
+    // False while no host listens, held keys are then resent once it is back
+    bool (*connected)(void *ctx);
+    bool (*ready)(void *ctx, enum ReportType type);
+    bool (*sendKeyboard)(void *ctx, const struct KeyboardData *data);
+    bool (*sendPointer)(void *ctx, const struct MouseData *data);
+    // Stops taking reports while suspended, the pipeline pumps again itself on resume
+    void (*suspend)(void *ctx, bool suspended);
+    void (*deinit)(void *ctx);
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "transport.h"
+
+#define CAPTURE_RECORDS 256 // must be a power of two
+
+struct CaptureRecord
+{
+    enum ReportType type;
+    uint32_t sentUs;
+    // 0 until the emulated host polled the report
+    uint32_t completeUs;
+    union
+    {
+        struct KeyboardData keyboard;
+        struct MouseData mouse;
+    };
+};
+
+struct CaptureStats
+{
+    uint32_t keyboardReports;
+    uint32_t mouseReports;
+    uint32_t refused; // sends while the endpoint was still busy
+    uint32_t suspends;
+    // Scan to host poll of every report
+    uint32_t minLatencyUs;
+    uint32_t maxLatencyUs;
+    uint64_t totalLatencyUs;
+};
+
+/*
+Transport that records every report instead of sending it, for measuring the
+whole pipeline without a host. Each report type has its own endpoint that
+stays busy until the next multiple of intervalUs, like a USB interrupt
+endpoint polled once per frame. Time only moves in captureTransportAdvance.
+*/
+struct CaptureTransport
+{
+    struct Transport transport;
+
+    uint32_t nowUs;
+    uint32_t intervalUs; // 0 completes every report on the next advance
+    bool connected;
+    bool suspended;
+
+    TransportCompleteFn complete;
+    void *owner;
+    bool busy[2];
+    uint32_t busyUntilUs[2];
+    uint32_t inflight[2];
+
+    struct CaptureRecord records[CAPTURE_RECORDS];
+    uint32_t count; // reports ever captured, only the last CAPTURE_RECORDS are kept
+
+    struct CaptureStats stats;
+};
+
+void captureTransportInit(struct CaptureTransport *cap, uint32_t intervalUs);
+void captureTransportAdvance(struct CaptureTransport *cap, uint32_t nowUs);
+const struct CaptureRecord *captureTransportRecord(const struct CaptureTransport *cap, uint32_t index);
+void captureTransportClear(struct CaptureTransport *cap);
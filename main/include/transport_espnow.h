@@ -0,0 +1,7 @@
+#pragma once
+
+#include "transport.h"
+#include "dongle_link.h"
+
+const struct Transport *getEspnowTransport();
+void getDongleSenderStats(struct DongleSenderStats *stats);
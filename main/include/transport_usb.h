@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#include "transport.h"
+
+// Keyboard and pointer get their own HID interface and IN endpoint, 0 puts both on one interface
+#define USB_HID_SPLIT_INTERFACES 1
+// Endpoint polling interval, full speed devices can ask for 1 ms
+#define USB_HID_POLL_INTERVAL_MS 1
+#define USB_CONSOLE_WRITE_TIMEOUT_MS 100
+
+esp_err_t usbInstall();
+void setKeyboardNkro(bool enabled);
+// LOCK_* bits from the last keyboard output report
+uint8_t getLockState();
+bool usbConsoleWrite(const uint8_t *data, size_t length);
+const struct Transport *getUsbTransport();
@@ -0,0 +1,139 @@
+#include <string.h>
+
+#include "joystick_filter.h"
+
+#define JOYSTICK_DRAIN_BATCH 32
+
+_Static_assert((JOYSTICK_FILTER_DEPTH & (JOYSTICK_FILTER_DEPTH - 1)) == 0, "JOYSTICK_FILTER_DEPTH must be a power of two");
+_Static_assert(JOYSTICK_FILTER_DEPTH <= 255, "Ring indexes are 8 bit");
+
+void joystickFilterInit(struct JoystickFilter *filter)
+{
+    memset(filter, 0, sizeof(*filter));
+    for (int i = 0; i < JOYSTICK_CH_COUNT; i++)
+    {
+        filter->depth[i] = JOYSTICK_FILTER_DEPTH;
+    }
+}
+
+// Shorter window for slowly sampled channels, depth is rounded down to a power of two
+void joystickFilterSetDepth(struct JoystickFilter *filter, enum JoystickChannel channel, uint8_t depth)
+{
+    if (depth == 0 || depth > JOYSTICK_FILTER_DEPTH)
+    {
+        depth = JOYSTICK_FILTER_DEPTH;
+    }
+    while (depth & (depth - 1))
+    {
+        depth &= depth - 1;
+    }
+
+    filter->depth[channel] = depth;
+    filter->head[channel] = 0;
+    filter->count[channel] = 0;
+    filter->sum[channel] = 0;
+}
+
+void joystickFilterPush(struct JoystickFilter *filter, uint8_t channel, uint16_t value)
+{
+    uint8_t head = 0;
+
+    if (channel >= JOYSTICK_CH_COUNT || value > JOYSTICK_SAMPLE_MAX)
+    {
+        filter->dropped++;
+        return;
+    }
+
+    // Running sum, the oldest sample leaves as the new one comes in
+    head = filter->head[channel];
+    if (filter->count[channel] == filter->depth[channel])
+    {
+        filter->sum[channel] -= filter->ring[channel][head];
+    }
+    else
+    {
+        filter->count[channel]++;
+    }
+    filter->ring[channel][head] = value;
+    filter->sum[channel] += value;
+    filter->head[channel] = (head + 1) & (filter->depth[channel] - 1);
+    filter->samples[channel]++;
+}
+
+// Moves everything the source has buffered into the filter, returns the sample count
+size_t joystickFilterDrain(struct JoystickFilter *filter, const struct JoystickSampleSource *source)
+{
+    struct JoystickSample batch[JOYSTICK_DRAIN_BATCH];
+    size_t total = 0, got = 0;
+
+    while ((got = source->read(source->ctx, batch, JOYSTICK_DRAIN_BATCH)) > 0)
+    {
+        for (size_t i = 0; i < got; i++)
+        {
+            joystickFilterPush(filter, batch[i].channel, batch[i].value);
+        }
+        total += got;
+    }
+    return total;
+}
+
+bool joystickFilterReady(const struct JoystickFilter *filter, enum JoystickChannel channel)
+{
+    return filter->count[channel] == filter->depth[channel];
+}
+
+// Average in 1/JOYSTICK_FILTER_SCALE of a raw step, samples are summed before dividing
+uint32_t joystickFilterValue(const struct JoystickFilter *filter, enum JoystickChannel channel)
+{
+    if (filter->count[channel] == 0)
+    {
+        return 0;
+    }
+    return (filter->sum[channel] * JOYSTICK_FILTER_SCALE + filter->count[channel] / 2) / filter->count[channel];
+}
+
+static uint32_t fakeRandom(struct JoystickFakeSource *fake)
+{
+    fake->seed = fake->seed * 1664525u + 1013904223u;
+    return fake->seed >> 16;
+}
+
+static size_t fakeRead(void *ctx, struct JoystickSample *samples, size_t max)
+{
+    struct JoystickFakeSource *fake = (struct JoystickFakeSource *)ctx;
+    size_t n = 0;
+    int32_t value = 0;
+
+    while (n < max && fake->pending > 0)
+    {
+        value = fake->level[fake->next];
+        if (fake->noise)
+        {
+            value += (int32_t)(fakeRandom(fake) % (2u * fake->noise + 1)) - fake->noise;
+        }
+        value = value < 0 ? 0 : (value > JOYSTICK_SAMPLE_MAX ? JOYSTICK_SAMPLE_MAX : value);
+
+        samples[n].channel = fake->next;
+        samples[n].value = (uint16_t)value;
+        n++;
+
+        fake->next = (fake->next + 1) % JOYSTICK_CH_COUNT;
+        fake->pending--;
+    }
+    return n;
+}
+
+void joystickFakeSourceInit(struct JoystickSampleSource *source, struct JoystickFakeSource *fake)
+{
+    memset(fake, 0, sizeof(*fake));
+    fake->seed = 1;
+
+    source->ctx = fake;
+    source->read = fakeRead;
+}
+
+// Makes count more samples available to the next drain
+void joystickFakeFeed(struct JoystickFakeSource *fake, uint32_t count)
+{
+    fake->pending += count;
+}
@@ -1,17 +1,225 @@
+#include <string.h>
 #include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/uart.h"
 
+#include "common_kvass.h"
+#include "config_manager.h"
+#include "gpio_manager.h"
 #include "include/kb_interconnect_manager.h"
 
+#define INTERCONNECT_EVENT_QUEUE_LEN 8
+// A wait shorter than a tick rounds to no wait at all, the queue waits would turn into polling
+#define INTERCONNECT_QUEUE_WAIT_TICKS (pdMS_TO_TICKS(INTERCONNECT_QUEUE_WAIT_MS) ? pdMS_TO_TICKS(INTERCONNECT_QUEUE_WAIT_MS) : 1)
+
 const char *TAG_INTERCONN = "Interconnect";
 
+struct MatrixSnapshot
+{
+    matrix_row_t rows[KB_ROWS];
+    // Scan time, on the primary already moved to the local clock
+    uint32_t timeUs;
+};
+
+static QueueHandle_t uartQueue = NULL;
+// Every local state in order on the secondary, every remote state in order on the primary
+static QueueHandle_t localQueue = NULL;
+static QueueHandle_t remoteQueue = NULL;
+static TaskHandle_t *gpioTask = NULL;
+static volatile bool primary = true;
+static volatile uint32_t localDropped = 0;
+
+static struct SplitLink link = {0};
+static struct SplitDeframer deframer = {0};
+static uint8_t rxBuffer[INTERCONNECT_BUFFER_SIZE];
+static size_t rxLength = 0;
+static size_t rxPos = 0;
+
+static bool uartSend(void *ctx, const uint8_t *frame, size_t length)
+{
+    return uart_write_bytes(INTERCONNECT_UART, frame, length) == (int)length;
+}
+
+// Feeds buffered bytes to the deframer until a frame is complete
+static size_t uartReceive(void *ctx, uint8_t *frame, size_t max)
+{
+    size_t length = 0;
+    int got = 0;
+
+    while (1)
+    {
+        if (rxPos == rxLength)
+        {
+            got = uart_read_bytes(INTERCONNECT_UART, rxBuffer, sizeof(rxBuffer), 0);
+            if (got <= 0)
+            {
+                return 0;
+            }
+            rxLength = (size_t)got;
+            rxPos = 0;
+        }
+
+        length = splitDeframerPush(&deframer, rxBuffer[rxPos++], frame);
+        if (length > 0 && length <= max)
+        {
+            return length;
+        }
+    }
+}
+
+static const struct SplitTransport uartTransport = {
+    .ctx = NULL,
+    .send = uartSend,
+    .receive = uartReceive,
+};
+
+esp_err_t initInterconnectUart()
+{
+    esp_err_t err = ESP_OK;
+    uart_config_t config = {
+        .baud_rate = INTERCONNECT_BAUD_RATE,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+
+    err = uart_driver_install(INTERCONNECT_UART, INTERCONNECT_BUFFER_SIZE, INTERCONNECT_BUFFER_SIZE, INTERCONNECT_EVENT_QUEUE_LEN, &uartQueue, 0);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = uart_param_config(INTERCONNECT_UART, &config);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = uart_set_pin(INTERCONNECT_UART, INTERCONNECT_TX_GPIO, INTERCONNECT_RX_GPIO, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    // Frames are a few bytes, report them after a short gap instead of waiting for the FIFO threshold
+    return uart_set_rx_timeout(INTERCONNECT_UART, 2);
+}
+
+bool interconnectIsPrimary()
+{
+    return primary;
+}
+
+bool interconnectIsConnected()
+{
+    return link.connected;
+}
+
+// Called by the scan task on the secondary, once per tick with changes
+void interconnectSendMatrix(const matrix_row_t rows[KB_ROWS], uint32_t scanUs)
+{
+    struct MatrixSnapshot snapshot;
+
+    if (localQueue == NULL)
+    {
+        return;
+    }
+    memcpy(snapshot.rows, rows, sizeof(snapshot.rows));
+    snapshot.timeUs = scanUs;
+    // The interconnect task runs below the scan task, blocking here lets it catch up
+    if (xQueueSend(localQueue, &snapshot, INTERCONNECT_QUEUE_WAIT_TICKS) != pdTRUE)
+    {
+        localDropped++;
+    }
+}
+
+// Called by the scan task on the primary after NOTIF_REMOTE_MATRIX, oldest state first
+bool interconnectTakeRemoteMatrix(matrix_row_t rows[KB_ROWS], uint32_t *timeUs)
+{
+    struct MatrixSnapshot snapshot;
+
+    if (remoteQueue == NULL || xQueueReceive(remoteQueue, &snapshot, 0) != pdTRUE)
+    {
+        return false;
+    }
+    memcpy(rows, snapshot.rows, sizeof(snapshot.rows));
+    *timeUs = snapshot.timeUs;
+    return true;
+}
+
+void getSplitLinkStats(struct SplitStats *stats, struct ClockSync *clock, bool *connected)
+{
+    *stats = link.stats;
+    stats->localDropped = localDropped;
+    *clock = link.clock;
+    *connected = link.connected;
+}
+
+// Runs in the interconnect task for every remote state the link applied
+static void remoteStateChanged(void *ctx, const matrix_row_t rows[KB_ROWS], uint32_t timeUs)
+{
+    struct MatrixSnapshot snapshot;
+
+    memcpy(snapshot.rows, rows, sizeof(snapshot.rows));
+    snapshot.timeUs = timeUs;
+    // The scan task drains this at a higher priority, keep waking it until the state fits
+    while (xQueueSend(remoteQueue, &snapshot, INTERCONNECT_QUEUE_WAIT_TICKS) != pdTRUE)
+    {
+        xTaskNotify(*gpioTask, NOTIF_REMOTE_MATRIX, eSetBits);
+    }
+    xTaskNotify(*gpioTask, NOTIF_REMOTE_MATRIX, eSetBits);
+}
+
 void vInterconnectTask(void *godParameters)
 {
-    struct GodParameters *params = (struct GodParameters*) godParameters;
+    struct GodParameters *params = (struct GodParameters *)godParameters;
+    QueueSetHandle_t queueSet = NULL;
+    QueueSetMemberHandle_t member = NULL;
+    struct MatrixSnapshot snapshot;
+    uart_event_t event;
+    uint32_t nowUs = 0;
 
-    while(1)
+    primary = getKbSide() == INTERCONNECT_PRIMARY_SIDE;
+    gpioTask = ((struct GpioParameters *)params->gpioParameters)->gpioTask;
+
+    localQueue = xQueueCreate(INTERCONNECT_LOCAL_QUEUE_LEN, sizeof(struct MatrixSnapshot));
+    remoteQueue = xQueueCreate(INTERCONNECT_REMOTE_QUEUE_LEN, sizeof(struct MatrixSnapshot));
+    configASSERT(localQueue && remoteQueue);
+    ESP_ERROR_CHECK(initInterconnectUart());
+
+    queueSet = xQueueCreateSet(INTERCONNECT_EVENT_QUEUE_LEN + INTERCONNECT_LOCAL_QUEUE_LEN);
+    configASSERT(queueSet);
+    xQueueAddToSet(uartQueue, queueSet);
+    xQueueAddToSet(localQueue, queueSet);
+
+    splitLinkInit(&link, primary ? SPLIT_ROLE_PRIMARY : SPLIT_ROLE_SECONDARY, &uartTransport, (uint8_t)esp_random());
+    splitLinkSetRemoteHandler(&link, remoteStateChanged, NULL);
+    ESP_LOGI(TAG_INTERCONN, "Interconnect up as %s", primary ? "primary" : "secondary");
+
+    while (1)
     {
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        // Wakes on UART data or a new local matrix, otherwise every tick for retransmits and timeouts.
+        // The set hands out one item per wake, the link queues every state it is given
+        member = xQueueSelectFromSet(queueSet, 1);
+        nowUs = (uint32_t)esp_timer_get_time();
+
+        if (member == uartQueue)
+        {
+            xQueueReceive(uartQueue, &event, 0);
+            if (event.type == UART_FIFO_OVF || event.type == UART_BUFFER_FULL)
+            {
+                // Lost bytes, CRC and sequence checks recover from here
+                uart_flush_input(INTERCONNECT_UART);
+            }
+        }
+        else if (member == localQueue && xQueueReceive(localQueue, &snapshot, 0) == pdTRUE)
+        {
+            splitLinkSendState(&link, snapshot.rows, snapshot.timeUs);
+        }
+
+        splitLinkPoll(&link, nowUs);
     }
-}
\ No newline at end of file
+}
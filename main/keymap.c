@@ -0,0 +1,191 @@
+#include <string.h>
+
+#include "keymap.h"
+
+#define KEYCODE_MODIFIER_FIRST 0xE0
+
+// HID modifier byte bit of every keycode, 0 for all but the eight modifier keys
+const uint8_t keymapModifierBit[256] = {
+    [0xE0] = 0x01, [0xE1] = 0x02, [0xE2] = 0x04, [0xE3] = 0x08,
+    [0xE4] = 0x10, [0xE5] = 0x20, [0xE6] = 0x40, [0xE7] = 0x80,
+};
+
+static void rebuildStack(struct Keymap *keymap)
+{
+    uint16_t active = keymap->toggled;
+
+    for (int layer = 0; layer < keymap->layerCount; layer++)
+    {
+        active |= (keymap->momentary[layer] ? 1u : 0u) << layer;
+    }
+
+    keymap->stackDepth = 0;
+    for (int layer = keymap->layerCount - 1; layer > keymap->defaultLayer; layer--)
+    {
+        if (active & (1u << layer))
+        {
+            keymap->stack[keymap->stackDepth++] = (uint8_t)layer;
+        }
+    }
+    keymap->stack[keymap->stackDepth++] = keymap->defaultLayer;
+    keymap->stats.layerChanges++;
+}
+
+void keymapInit(struct Keymap *keymap, const keyaction_t (*actions)[KEYMAP_KEYS], uint8_t layerCount)
+{
+    memset(keymap, 0, sizeof(*keymap));
+    keymap->actions = actions;
+    keymap->layerCount = layerCount > KEYMAP_LAYERS ? KEYMAP_LAYERS : layerCount;
+    rebuildStack(keymap);
+}
+
+// Swaps the action table under held keys, they still release what they latched on press
+void keymapSetActions(struct Keymap *keymap, const keyaction_t (*actions)[KEYMAP_KEYS], uint8_t layerCount)
+{
+    keymap->actions = actions;
+    keymap->layerCount = layerCount > KEYMAP_LAYERS ? KEYMAP_LAYERS : layerCount;
+    if (keymap->defaultLayer >= keymap->layerCount)
+    {
+        keymap->defaultLayer = 0;
+    }
+    keymap->toggled &= (uint16_t)((1u << keymap->layerCount) - 1);
+    memset(&keymap->momentary[keymap->layerCount], 0, KEYMAP_LAYERS - keymap->layerCount);
+    rebuildStack(keymap);
+}
+
+// Top active layer with a non transparent action for the key
+keyaction_t keymapResolve(const struct Keymap *keymap, uint8_t key)
+{
+    keyaction_t action = ACTION_NONE;
+
+    for (int i = 0; i < keymap->stackDepth; i++)
+    {
+        action = keymap->actions[keymap->stack[i]][key];
+        if (action != ACTION_TRANSPARENT)
+        {
+            return action;
+        }
+    }
+    return ACTION_NONE;
+}
+
+// Modifiers are reference counted, a shifted action must not release a Shift that is held on its own
+static uint8_t modifierEvents(struct Keymap *keymap, uint8_t mods, bool pressed, struct KeyOutput *out)
+{
+    uint8_t count = 0;
+    uint8_t bit = 0;
+
+    while (mods)
+    {
+        bit = (uint8_t)__builtin_ctz(mods);
+        mods &= mods - 1;
+        if (pressed ? keymap->modifierRefs[bit]++ == 0 : (keymap->modifierRefs[bit] > 0 && --keymap->modifierRefs[bit] == 0))
+        {
+            out[count].keycode = (uint8_t)(KEYCODE_MODIFIER_FIRST + bit);
+            out[count++].pressed = pressed;
+        }
+    }
+    return count;
+}
+
+static uint8_t keyEvents(struct Keymap *keymap, keyaction_t action, bool pressed, struct KeyOutput *out)
+{
+    uint8_t keycode = ACTION_KEYCODE(action);
+    uint8_t mods = ACTION_MODS(action) | keymapModifierBit[keycode];
+    uint8_t count = 0;
+
+    if (pressed)
+    {
+        count = modifierEvents(keymap, mods, true, out);
+    }
+    // Modifier keycodes are fully handled by their bit
+    if (keycode != 0 && keymapModifierBit[keycode] == 0)
+    {
+        out[count].keycode = keycode;
+        out[count++].pressed = pressed;
+    }
+    if (!pressed)
+    {
+        count += modifierEvents(keymap, mods, false, &out[count]);
+    }
+    return count;
+}
+
+// Presses the given action on the key, releases use whatever the press latched
+uint8_t keymapApply(struct Keymap *keymap, uint8_t key, keyaction_t action, bool pressed, struct KeyOutput out[KEYMAP_MAX_OUTPUT])
+{
+    uint8_t layer = 0;
+
+    if (key >= KEYMAP_KEYS)
+    {
+        return 0;
+    }
+    if (pressed)
+    {
+        keymap->latched[key] = action;
+        keymap->stats.resolved++;
+    }
+    else
+    {
+        action = keymap->latched[key];
+        keymap->latched[key] = ACTION_NONE;
+    }
+
+    layer = ACTION_LAYER(action);
+    switch (ACTION_KIND(action))
+    {
+    case ACTION_KIND_KEY:
+        return keyEvents(keymap, action, pressed, out);
+    case ACTION_KIND_MOD_TAP:
+    case ACTION_KIND_LAYER_TAP:
+        return keyEvents(keymap, KC(ACTION_KEYCODE(action)), pressed, out);
+    case ACTION_KIND_ONESHOT_MOD:
+        return keyEvents(keymap, KM(ACTION_MODS(action), 0), pressed, out);
+    case ACTION_KIND_LAYER_MOMENTARY:
+        if (layer < keymap->layerCount && (pressed || keymap->momentary[layer] > 0))
+        {
+            keymap->momentary[layer] += pressed ? 1 : -1;
+            rebuildStack(keymap);
+        }
+        break;
+    case ACTION_KIND_LAYER_TOGGLE:
+        if (pressed && layer < keymap->layerCount)
+        {
+            keymap->toggled ^= 1u << layer;
+            rebuildStack(keymap);
+        }
+        break;
+    case ACTION_KIND_LAYER_DEFAULT:
+        if (pressed && layer < keymap->layerCount)
+        {
+            keymap->defaultLayer = layer;
+            rebuildStack(keymap);
+        }
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+// Returns the number of key events written to out
+uint8_t keymapProcess(struct Keymap *keymap, uint8_t key, bool pressed, struct KeyOutput out[KEYMAP_MAX_OUTPUT])
+{
+    if (key >= KEYMAP_KEYS)
+    {
+        return 0;
+    }
+    return keymapApply(keymap, key, pressed ? keymapResolve(keymap, key) : ACTION_NONE, pressed, out);
+}
+
+// Bit per layer in the stack, default layer included
+uint16_t keymapActiveLayers(const struct Keymap *keymap)
+{
+    uint16_t active = 0;
+
+    for (int i = 0; i < keymap->stackDepth; i++)
+    {
+        active |= 1u << keymap->stack[i];
+    }
+    return active;
+}
@@ -0,0 +1,54 @@
+#include "class/hid/hid.h"
+
+#include "keymap.h"
+#include "action_engine.h"
+
+enum
+{
+    LAYER_BASE,
+    LAYER_FN,
+    LAYER_COUNT,
+};
+
+// One line per matrix row, left half first, then the right half as wired (columns mirrored)
+const keyaction_t defaultKeymap[][KEYMAP_KEYS] = {
+    [LAYER_BASE] = {
+        KC(HID_KEY_ESCAPE), KC(HID_KEY_1), KC(HID_KEY_2), KC(HID_KEY_3), KC(HID_KEY_4), KC(HID_KEY_5), KC(HID_KEY_BACKSPACE),
+        KC(HID_KEY_TAB), KC(HID_KEY_Q), KC(HID_KEY_W), KC(HID_KEY_E), KC(HID_KEY_R), KC(HID_KEY_T), KC(HID_KEY_ENTER),
+        KC(HID_KEY_CAPS_LOCK), KC(HID_KEY_A), KC(HID_KEY_S), KC(HID_KEY_D), KC(HID_KEY_F), KC(HID_KEY_G), KC(HID_KEY_PAGE_UP),
+        KC(HID_KEY_SHIFT_LEFT), KC(HID_KEY_Z), KC(HID_KEY_X), KC(HID_KEY_C), KC(HID_KEY_V), KC(HID_KEY_B), KC(HID_KEY_PAGE_DOWN),
+        KC(HID_KEY_CONTROL_LEFT), MO(LAYER_FN), XXXX, KC(HID_KEY_ARROW_UP), KC(HID_KEY_ARROW_DOWN), KC(HID_KEY_GUI_LEFT), XXXX,
+
+        KC(HID_KEY_MINUS), KC(HID_KEY_0), KC(HID_KEY_9), KC(HID_KEY_8), KC(HID_KEY_7), KC(HID_KEY_6), KC(HID_KEY_SPACE),
+        KC(HID_KEY_EQUAL), KC(HID_KEY_P), KC(HID_KEY_O), KC(HID_KEY_I), KC(HID_KEY_U), KC(HID_KEY_Y), KC(HID_KEY_BACKSPACE),
+        KC(HID_KEY_APOSTROPHE), KC(HID_KEY_SEMICOLON), KC(HID_KEY_L), KC(HID_KEY_K), KC(HID_KEY_J), KC(HID_KEY_H), KC(HID_KEY_DELETE),
+        KC(HID_KEY_BACKSLASH), KC(HID_KEY_SLASH), KC(HID_KEY_PERIOD), KC(HID_KEY_COMMA), KC(HID_KEY_M), KC(HID_KEY_N), KC(HID_KEY_PRINT_SCREEN),
+        KC(HID_KEY_ALT_RIGHT), KC(HID_KEY_BRACKET_RIGHT), KC(HID_KEY_BRACKET_LEFT), KC(HID_KEY_ARROW_RIGHT), KC(HID_KEY_ARROW_LEFT), KC(HID_KEY_CONTROL_RIGHT), MO(LAYER_FN),
+    },
+    // Function keys on the number row, arrows on HJKL, editing shortcuts on the left
+    [LAYER_FN] = {
+        KC(HID_KEY_GRAVE), KC(HID_KEY_F1), KC(HID_KEY_F2), KC(HID_KEY_F3), KC(HID_KEY_F4), KC(HID_KEY_F5), KC(HID_KEY_DELETE),
+        ____, ____, ____, ____, ____, ____, ____,
+        TG(LAYER_FN), ____, ____, ____, ____, ____, KC(HID_KEY_HOME),
+        ____, KM(MOD_CTRL, HID_KEY_Z), KM(MOD_CTRL, HID_KEY_X), KM(MOD_CTRL, HID_KEY_C), KM(MOD_CTRL, HID_KEY_V), ____, KC(HID_KEY_END),
+        ____, ____, ____, ____, ____, ____, ____,
+
+        KC(HID_KEY_F11), KC(HID_KEY_F10), KC(HID_KEY_F9), KC(HID_KEY_F8), KC(HID_KEY_F7), KC(HID_KEY_F6), ____,
+        KC(HID_KEY_F12), ____, ____, ____, ____, ____, ____,
+        ____, ____, KC(HID_KEY_ARROW_RIGHT), KC(HID_KEY_ARROW_UP), KC(HID_KEY_ARROW_DOWN), KC(HID_KEY_ARROW_LEFT), ____,
+        ____, ____, ____, ____, ____, ____, ____,
+        ____, ____, ____, ____, ____, ____, ____,
+    },
+};
+
+const uint8_t defaultKeymapLayers = LAYER_COUNT;
+
+// Shown on the display, layers of a loaded keymap past these go by number
+const char *const defaultLayerNames[] = {
+    [LAYER_BASE] = "Base",
+    [LAYER_FN] = "Fn",
+};
+
+// None by default, the array only needs to exist
+const struct Combo defaultCombos[1];
+const uint8_t defaultComboCount = 0;
@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include "keymap_image.h"
+
+_Static_assert(sizeof(struct KeymapImageHeader) + KEYMAP_LAYERS * KEYMAP_KEYS * sizeof(keyaction_t) <= KEYMAP_IMAGE_SLOT_SIZE, "keymap does not fit a slot");
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return crc;
+}
+
+uint32_t keymapImageCrc(const struct KeymapImageHeader *header, const keyaction_t *actions)
+{
+    struct KeymapImageHeader zeroed = *header;
+    uint32_t crc = 0xFFFFFFFF;
+
+    zeroed.crc = 0;
+    crc = crc32Update(crc, (const uint8_t *)&zeroed, sizeof(zeroed));
+    crc = crc32Update(crc, (const uint8_t *)actions, (size_t)header->layers * header->keys * sizeof(keyaction_t));
+    return ~crc;
+}
+
+size_t keymapImageSize(uint8_t layers)
+{
+    return sizeof(struct KeymapImageHeader) + (size_t)layers * KEYMAP_KEYS * sizeof(keyaction_t);
+}
+
+// Works on the mapped flash as is, nothing is copied
+enum KeymapImageError keymapImageCheck(const void *image, size_t size)
+{
+    const struct KeymapImageHeader *header = (const struct KeymapImageHeader *)image;
+
+    if (size < sizeof(*header))
+    {
+        return KEYMAP_IMAGE_TRUNCATED;
+    }
+    if (header->magic != KEYMAP_IMAGE_MAGIC)
+    {
+        return KEYMAP_IMAGE_BAD_MAGIC;
+    }
+    if (header->version != KEYMAP_IMAGE_VERSION)
+    {
+        return KEYMAP_IMAGE_BAD_VERSION;
+    }
+    if (header->keys != KEYMAP_KEYS || header->layers == 0 || header->layers > KEYMAP_LAYERS)
+    {
+        return KEYMAP_IMAGE_BAD_SHAPE;
+    }
+    if (size < keymapImageSize(header->layers))
+    {
+        return KEYMAP_IMAGE_TRUNCATED;
+    }
+    if (keymapImageCrc(header, (const keyaction_t *)(header + 1)) != header->crc)
+    {
+        return KEYMAP_IMAGE_BAD_CRC;
+    }
+    return KEYMAP_IMAGE_OK;
+}
+
+const keyaction_t (*keymapImageActions(const void *image))[KEYMAP_KEYS]
+{
+    return (const keyaction_t (*)[KEYMAP_KEYS])((const struct KeymapImageHeader *)image + 1);
+}
+
+const char *keymapImageErrorName(enum KeymapImageError error)
+{
+    switch (error)
+    {
+    case KEYMAP_IMAGE_OK:
+        return "ok";
+    case KEYMAP_IMAGE_TRUNCATED:
+        return "truncated";
+    case KEYMAP_IMAGE_BAD_MAGIC:
+        return "bad magic";
+    case KEYMAP_IMAGE_BAD_VERSION:
+        return "unsupported version";
+    case KEYMAP_IMAGE_BAD_SHAPE:
+        return "wrong key or layer count";
+    case KEYMAP_IMAGE_BAD_CRC:
+        return "bad crc";
+    default:
+        return "unknown";
+    }
+}
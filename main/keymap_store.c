@@ -0,0 +1,271 @@
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "common_kvass.h"
+#include "keymap_store.h"
+
+const char *TAG_KEYMAP = "keymap";
+
+static const esp_partition_t *partition = NULL;
+static esp_partition_mmap_handle_t mapHandle = 0;
+// Both slots stay mapped for good, the keymap reads its actions straight from here
+static const uint8_t *mapped = NULL;
+static SemaphoreHandle_t updateLock = NULL;
+// Given by the GPIO task each time it takes an image, an update waits on it instead of polling
+static SemaphoreHandle_t takenSignal = NULL;
+static TaskHandle_t gpioTask = NULL;
+// Slot image the GPIO task switches to before its next scan
+static const void *volatile pendingImage = NULL;
+// Last slot handed out, owned by whoever holds updateLock
+static int postedSlot = -1;
+static struct KeymapStoreStats storeStats = {.activeSlot = -1};
+
+// Image coming in over the console, words keep it aligned for keymapStoreUpdate
+static uint32_t uploadWords[KEYMAP_IMAGE_SLOT_SIZE / sizeof(uint32_t)];
+static size_t uploadLength = 0;
+static size_t uploadExpected = 0;
+static uint32_t uploadLastUs = 0;
+static volatile enum KeymapUploadState uploadState = KEYMAP_UPLOAD_IDLE;
+
+static const struct KeymapImageHeader *slotImage(int slot)
+{
+    return (const struct KeymapImageHeader *)(mapped + slot * KEYMAP_IMAGE_SLOT_SIZE);
+}
+
+static bool slotValid(int slot)
+{
+    return keymapImageCheck(slotImage(slot), KEYMAP_IMAGE_SLOT_SIZE) == KEYMAP_IMAGE_OK;
+}
+
+// Runs in the GPIO task, that is the task told about new images
+esp_err_t keymapStoreInit(void)
+{
+    const void *base = NULL;
+    int best = -1;
+    esp_err_t err = ESP_OK;
+
+    gpioTask = xTaskGetCurrentTaskHandle();
+    updateLock = xSemaphoreCreateMutex();
+    configASSERT(updateLock);
+    takenSignal = xSemaphoreCreateBinary();
+    configASSERT(takenSignal);
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, KEYMAP_PARTITION_SUBTYPE, KEYMAP_PARTITION_LABEL);
+    if (partition == NULL || partition->size < KEYMAP_IMAGE_SLOTS * KEYMAP_IMAGE_SLOT_SIZE)
+    {
+        ESP_LOGW(TAG_KEYMAP, "No keymap partition, using the built in keymap");
+        partition = NULL;
+        return ESP_ERR_NOT_FOUND;
+    }
+    err = esp_partition_mmap(partition, 0, KEYMAP_IMAGE_SLOTS * KEYMAP_IMAGE_SLOT_SIZE, ESP_PARTITION_MMAP_DATA, &base, &mapHandle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG_KEYMAP, "Error (%s) mapping the keymap partition!", esp_err_to_name(err));
+        partition = NULL;
+        return err;
+    }
+    mapped = (const uint8_t *)base;
+
+    // Newest valid slot wins, an update torn by a reset leaves the older one in charge
+    for (int slot = 0; slot < KEYMAP_IMAGE_SLOTS; slot++)
+    {
+        if (slotValid(slot) && (best < 0 || (int32_t)(slotImage(slot)->generation - slotImage(best)->generation) > 0))
+        {
+            best = slot;
+        }
+    }
+    if (best < 0)
+    {
+        ESP_LOGI(TAG_KEYMAP, "Keymap partition is empty, using the built in keymap");
+        return ESP_OK;
+    }
+
+    storeStats.generation = slotImage(best)->generation;
+    postedSlot = best;
+    pendingImage = slotImage(best);
+    ESP_LOGI(TAG_KEYMAP, "Keymap slot %d, generation %" PRIu32 ", %d layers", best, storeStats.generation, slotImage(best)->layers);
+    return ESP_OK;
+}
+
+// Called by the GPIO task between scans, true if it should switch to the returned actions
+bool keymapStoreTake(const keyaction_t (**actions)[KEYMAP_KEYS], uint8_t *layers)
+{
+    const struct KeymapImageHeader *image = NULL;
+
+    if (pendingImage == NULL)
+    {
+        return false;
+    }
+    image = (const struct KeymapImageHeader *)__atomic_exchange_n(&pendingImage, NULL, __ATOMIC_ACQ_REL);
+    if (image == NULL)
+    {
+        return false;
+    }
+    storeStats.activeSlot = (int8_t)(((const uint8_t *)image - mapped) / KEYMAP_IMAGE_SLOT_SIZE);
+    *actions = keymapImageActions(image);
+    *layers = image->layers;
+    xSemaphoreGive(takenSignal);
+    return true;
+}
+
+/*
+Writes the image into the slot not in use and hands it to the GPIO task. Actions
+go to flash before the header, so a reset halfway leaves a slot that fails its
+check and the old keymap stays. The image has to be 4 byte aligned.
+*/
+esp_err_t keymapStoreUpdate(const void *image, size_t size)
+{
+    struct KeymapImageHeader header;
+    enum KeymapImageError check = keymapImageCheck(image, size);
+    size_t length = 0;
+    int slot = 0;
+    esp_err_t err = ESP_OK;
+
+    if (partition == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (check != KEYMAP_IMAGE_OK)
+    {
+        storeStats.rejected++;
+        storeStats.lastError = check;
+        ESP_LOGW(TAG_KEYMAP, "Keymap rejected: %s", keymapImageErrorName(check));
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(updateLock, portMAX_DELAY);
+    // The slot the GPIO task has not taken yet may be the one written next, a left over signal is from an earlier take
+    while (pendingImage != NULL)
+    {
+        xTaskNotify(gpioTask, NOTIF_KEYMAP_UPDATE, eSetBits);
+        if (xSemaphoreTake(takenSignal, pdMS_TO_TICKS(KEYMAP_TAKE_WAIT_MS)) != pdTRUE)
+        {
+            xSemaphoreGive(updateLock);
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    slot = postedSlot < 0 ? 0 : postedSlot ^ 1;
+
+    memcpy(&header, image, sizeof(header));
+    header.generation = storeStats.generation + 1;
+    header.crc = keymapImageCrc(&header, (const keyaction_t *)((const uint8_t *)image + sizeof(header)));
+    length = keymapImageSize(header.layers);
+
+    // Erase and writes flush the cache lines of the mapped slot
+    err = esp_partition_erase_range(partition, slot * KEYMAP_IMAGE_SLOT_SIZE, KEYMAP_IMAGE_SLOT_SIZE);
+    if (err == ESP_OK)
+    {
+        err = esp_partition_write(partition, slot * KEYMAP_IMAGE_SLOT_SIZE + sizeof(header), (const uint8_t *)image + sizeof(header), length - sizeof(header));
+    }
+    if (err == ESP_OK)
+    {
+        err = esp_partition_write(partition, slot * KEYMAP_IMAGE_SLOT_SIZE, &header, sizeof(header));
+    }
+    if (err == ESP_OK && !slotValid(slot))
+    {
+        err = ESP_ERR_INVALID_CRC;
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG_KEYMAP, "Error (%s) writing keymap slot %d!", esp_err_to_name(err), slot);
+        xSemaphoreGive(updateLock);
+        return err;
+    }
+
+    storeStats.generation = header.generation;
+    storeStats.updates++;
+    postedSlot = slot;
+    pendingImage = slotImage(slot);
+    xSemaphoreGive(updateLock);
+    // Switches before the next scan, an idle matrix wakes for it
+    xTaskNotify(gpioTask, NOTIF_KEYMAP_UPDATE, eSetBits);
+    ESP_LOGI(TAG_KEYMAP, "Keymap written to slot %d, generation %" PRIu32, slot, storeStats.generation);
+    return ESP_OK;
+}
+
+static void uploadFail(enum KeymapImageError error)
+{
+    storeStats.rejected++;
+    storeStats.lastError = error;
+    uploadState = KEYMAP_UPLOAD_IDLE;
+}
+
+// Runs in the TinyUSB task, false while the last upload is still being written
+bool keymapUploadBegin(uint32_t nowUs)
+{
+    if (uploadState == KEYMAP_UPLOAD_READY)
+    {
+        return false;
+    }
+    uploadLength = 0;
+    uploadExpected = sizeof(struct KeymapImageHeader);
+    uploadLastUs = nowUs;
+    uploadState = KEYMAP_UPLOAD_RECEIVING;
+    return true;
+}
+
+// True while console bytes belong to an image, a sender gone quiet for KEYMAP_UPLOAD_TIMEOUT_MS gives it up
+bool keymapUploadReceiving(uint32_t nowUs)
+{
+    if (uploadState == KEYMAP_UPLOAD_RECEIVING && nowUs - uploadLastUs >= KEYMAP_UPLOAD_TIMEOUT_MS * 1000)
+    {
+        uploadFail(KEYMAP_IMAGE_TRUNCATED);
+    }
+    return uploadState == KEYMAP_UPLOAD_RECEIVING;
+}
+
+// Returns the bytes used, the header says how many follow it
+size_t keymapUploadFeed(const uint8_t *data, size_t length, uint32_t nowUs, enum KeymapUploadState *state)
+{
+    const struct KeymapImageHeader *header = (const struct KeymapImageHeader *)uploadWords;
+    size_t used = 0;
+    size_t chunk = 0;
+
+    uploadLastUs = nowUs;
+    while (used < length && uploadState == KEYMAP_UPLOAD_RECEIVING)
+    {
+        chunk = uploadExpected - uploadLength < length - used ? uploadExpected - uploadLength : length - used;
+        memcpy((uint8_t *)uploadWords + uploadLength, &data[used], chunk);
+        uploadLength += chunk;
+        used += chunk;
+        if (uploadLength < uploadExpected)
+        {
+            break;
+        }
+        if (uploadExpected == sizeof(*header))
+        {
+            uploadExpected = keymapImageSize(header->layers);
+            if (header->layers == 0 || uploadExpected > sizeof(uploadWords))
+            {
+                uploadFail(KEYMAP_IMAGE_BAD_SHAPE);
+            }
+            continue;
+        }
+        uploadState = KEYMAP_UPLOAD_READY;
+    }
+    *state = uploadState;
+    return used;
+}
+
+// Runs in the comms task once an upload is complete, the flash write is too slow for the USB task
+esp_err_t keymapUploadApply(void)
+{
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+
+    if (uploadState == KEYMAP_UPLOAD_READY)
+    {
+        err = keymapStoreUpdate(uploadWords, uploadLength);
+        uploadState = KEYMAP_UPLOAD_IDLE;
+    }
+    return err;
+}
+
+void getKeymapStoreStats(struct KeymapStoreStats *stats)
+{
+    *stats = storeStats;
+}
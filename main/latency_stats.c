@@ -0,0 +1,89 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "latency_stats.h"
+
+#if KVASS_LATENCY_TRACE
+
+// Upper bound of each bucket in us, last bucket takes everything above
+static const uint32_t bucketLimitsUs[LATENCY_BUCKETS - 1] = {
+    10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000,
+};
+
+static const char *stageNames[LATENCY_STAGE_COUNT] = {
+    "scan->queue",
+    "queue->send",
+    "send->complete",
+    "scan->complete",
+};
+
+// Every stage is written by a single task, readers may see a partial update
+static struct LatencyHistogram histograms[LATENCY_STAGE_COUNT];
+
+void latencyRecord(enum LatencyStage stage, uint32_t startUs, uint32_t endUs)
+{
+    struct LatencyHistogram *h = &histograms[stage];
+    uint32_t latency = endUs - startUs;
+    int bucket = 0;
+
+    while (bucket < LATENCY_BUCKETS - 1 && latency >= bucketLimitsUs[bucket])
+    {
+        bucket++;
+    }
+
+    if (h->count == 0 || latency < h->minUs)
+    {
+        h->minUs = latency;
+    }
+    if (latency > h->maxUs)
+    {
+        h->maxUs = latency;
+    }
+    h->totalUs += latency;
+    h->buckets[bucket]++;
+    h->count++;
+}
+
+void latencyReset(void)
+{
+    memset(histograms, 0, sizeof(histograms));
+}
+
+const struct LatencyHistogram *latencyGetHistogram(enum LatencyStage stage)
+{
+    return &histograms[stage];
+}
+
+void latencyDump(void)
+{
+    for (int i = 0; i < LATENCY_STAGE_COUNT; i++)
+    {
+        struct LatencyHistogram *h = &histograms[i];
+
+        printf("%s: n=%" PRIu32 " min=%" PRIu32 " avg=%" PRIu64 " max=%" PRIu32 " us\n",
+               stageNames[i],
+               h->count,
+               h->minUs,
+               h->count ? h->totalUs / h->count : 0,
+               h->maxUs);
+
+        for (int b = 0; b < LATENCY_BUCKETS; b++)
+        {
+            if (h->buckets[b] == 0)
+            {
+                continue;
+            }
+            if (b < LATENCY_BUCKETS - 1)
+            {
+                printf("  <%" PRIu32 " us: %" PRIu32 "\n", bucketLimitsUs[b], h->buckets[b]);
+            }
+            else
+            {
+                printf("  >=%" PRIu32 " us: %" PRIu32 "\n", bucketLimitsUs[b - 1], h->buckets[b]);
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,130 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "led_strip.h"
+
+#include "led_manager.h"
+#include "gpio_manager.h"
+#include "transport_usb.h"
+
+const char *TAG_LED = "led";
+
+static led_strip_handle_t ledStrip = NULL;
+static struct LedRenderer renderer = {0};
+// Set by the GPIO task, taken by the LED task once per frame
+static uint32_t pressedKeys[(KEYMAP_KEYS + 31) / 32] = {0};
+static uint64_t startUs = 0;
+
+#if KB_LED_PER_KEY
+static uint8_t keyLeds[KEYMAP_KEYS];
+#endif
+
+// Fills the driver buffer, the refresh streams it out by DMA while this task waits
+static bool rmtPush(void *ctx, const struct LedRgb *pixels, uint16_t count)
+{
+    for (uint16_t i = 0; i < count; i++)
+    {
+        led_strip_set_pixel(ledStrip, i, pixels[i].r, pixels[i].g, pixels[i].b);
+    }
+    return led_strip_refresh(ledStrip) == ESP_OK;
+}
+
+static const struct LedStrip rmtStrip = {
+    .push = rmtPush,
+};
+
+// Called from the GPIO task, never blocks
+void ledKeyPressed(uint8_t key)
+{
+    if (key < KEYMAP_KEYS)
+    {
+        __atomic_fetch_or(&pressedKeys[key / 32], 1u << (key % 32), __ATOMIC_RELAXED);
+    }
+}
+
+// Frame rate in thousandths of a frame per second since the task started
+void getLedStats(struct LedStats *stats, uint32_t *fpsMilli)
+{
+    uint64_t elapsedUs = esp_timer_get_time() - startUs;
+
+    *stats = renderer.stats;
+    *fpsMilli = startUs != 0 && elapsedUs > 0 ? (uint32_t)((uint64_t)stats->frames * 1000000000ULL / elapsedUs) : 0;
+}
+
+static esp_err_t initLedStrip(void)
+{
+    led_strip_config_t stripConfig = {
+        .strip_gpio_num = KB_LED_GPIO,
+        .max_leds = KB_LED_COUNT,
+        .led_pixel_format = LED_PIXEL_FORMAT_GRB,
+        .led_model = LED_MODEL_WS2812,
+    };
+    led_strip_rmt_config_t rmtConfig = {
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .resolution_hz = KB_LED_RMT_RESOLUTION_HZ,
+        .mem_block_symbols = KB_LED_RMT_SYMBOLS,
+        .flags.with_dma = true,
+    };
+
+    return led_strip_new_rmt_device(&stripConfig, &rmtConfig, &ledStrip);
+}
+
+void vLedTask(void *godParameters)
+{
+    struct LedConfig config = {
+        .count = KB_LED_COUNT,
+        .statusLed = 0,
+        .keyLeds = NULL,
+        .brightness = KB_LED_BRIGHTNESS,
+        .reactiveUs = KB_LED_REACTIVE_MS * 1000,
+    };
+    struct LedInputs inputs = {0};
+    struct KeymapStats keymapStats;
+    TickType_t wake = 0;
+    uint64_t frameStartUs = 0, renderedUs = 0;
+    bool dirty = false;
+
+    ESP_LOGI(TAG_LED, "Initializing LED task...");
+
+#if KB_LED_PER_KEY
+    for (int key = 0; key < KEYMAP_KEYS; key++)
+    {
+        keyLeds[key] = (uint8_t)(1 + key);
+    }
+    config.keyLeds = keyLeds;
+#endif
+
+    if (initLedStrip() != ESP_OK)
+    {
+        ESP_LOGE(TAG_LED, "Cannot set up the LED strip!");
+        // Suspended rather than deleted, telemetry keeps reading its handle
+        vTaskSuspend(NULL);
+    }
+    ledRendererInit(&renderer, &config);
+    startUs = esp_timer_get_time();
+    wake = xTaskGetTickCount();
+
+    while (1)
+    {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(KB_LED_FRAME_MS));
+
+        frameStartUs = esp_timer_get_time();
+        inputs.locks = getLockState();
+        getKeymapStats(&keymapStats, &inputs.activeLayers);
+        for (int i = 0; i < sizeof(pressedKeys) / sizeof(pressedKeys[0]); i++)
+        {
+            inputs.pressed[i] = __atomic_exchange_n(&pressedKeys[i], 0, __ATOMIC_RELAXED);
+        }
+
+        dirty = ledRendererFrame(&renderer, &inputs, (uint32_t)frameStartUs);
+        renderedUs = esp_timer_get_time();
+        // Nothing reaches the strip unless the picture changed
+        if (dirty)
+        {
+            ledRendererPush(&renderer, &rmtStrip);
+        }
+        ledRendererAccount(&renderer, (uint32_t)(renderedUs - frameStartUs), (uint32_t)(esp_timer_get_time() - frameStartUs), KB_LED_FRAME_BUDGET_US);
+    }
+}
@@ -0,0 +1,168 @@
+#include <string.h>
+
+#include "led_render.h"
+#include "lock_state.h"
+
+// Colour of the highest active layer, the base layer leaves keys dark
+static const struct LedRgb layerColours[KEYMAP_LAYERS] = {
+    {0, 0, 0},
+    {0, 96, 255},
+    {0, 255, 64},
+    {255, 128, 0},
+    {160, 0, 255},
+    {255, 0, 96},
+    {0, 224, 224},
+    {224, 224, 0},
+};
+
+static const struct LedRgb capsColour = {255, 255, 255};
+static const struct LedRgb numColour = {0, 0, 48};
+
+void ledRendererInit(struct LedRenderer *renderer, const struct LedConfig *config)
+{
+    memset(renderer, 0, sizeof(*renderer));
+    renderer->config = *config;
+    if (renderer->config.count > LED_MAX)
+    {
+        renderer->config.count = LED_MAX;
+    }
+}
+
+static struct LedRgb scale(struct LedRgb colour, uint8_t level)
+{
+    colour.r = (uint8_t)((colour.r * level + 255) >> 8);
+    colour.g = (uint8_t)((colour.g * level + 255) >> 8);
+    colour.b = (uint8_t)((colour.b * level + 255) >> 8);
+    return colour;
+}
+
+static struct LedRgb brighter(struct LedRgb a, struct LedRgb b)
+{
+    a.r = a.r > b.r ? a.r : b.r;
+    a.g = a.g > b.g ? a.g : b.g;
+    a.b = a.b > b.b ? a.b : b.b;
+    return a;
+}
+
+static struct LedRgb statusColour(const struct LedInputs *inputs)
+{
+    uint16_t layers = inputs->activeLayers;
+    int top = layers ? 31 - __builtin_clz(layers) : 0;
+
+    if (inputs->locks & LOCK_CAPS)
+    {
+        return capsColour;
+    }
+    if (top > 0 && top < KEYMAP_LAYERS)
+    {
+        return layerColours[top];
+    }
+    return (inputs->locks & LOCK_NUM) ? numColour : layerColours[0];
+}
+
+// Returns true if the frame differs from what the strip shows
+bool ledRendererFrame(struct LedRenderer *renderer, const struct LedInputs *inputs, uint32_t nowUs)
+{
+    const struct LedConfig *config = &renderer->config;
+    struct LedRgb base = statusColour(inputs);
+    uint32_t age = 0;
+    uint8_t led = 0;
+
+    memset(renderer->frame, 0, config->count * sizeof(renderer->frame[0]));
+
+    if (config->keyLeds != NULL)
+    {
+        for (int key = 0; key < KEYMAP_KEYS; key++)
+        {
+            led = config->keyLeds[key];
+            if (led >= config->count)
+            {
+                continue;
+            }
+            if ((inputs->pressed[key / 32] >> (key % 32)) & 1)
+            {
+                renderer->pressedUs[led] = nowUs;
+                renderer->fading[led] = true;
+            }
+            // Keys glow in the layer colour at a quarter, presses flash white and fade
+            renderer->frame[led] = scale(base, 64);
+            if (renderer->fading[led])
+            {
+                age = nowUs - renderer->pressedUs[led];
+                if (age >= config->reactiveUs)
+                {
+                    renderer->fading[led] = false;
+                    continue;
+                }
+                renderer->frame[led] = brighter(renderer->frame[led], scale(capsColour, (uint8_t)(255 - age * 255 / config->reactiveUs)));
+            }
+        }
+    }
+    if (config->statusLed < config->count)
+    {
+        renderer->frame[config->statusLed] = base;
+    }
+
+    for (uint16_t i = 0; i < config->count; i++)
+    {
+        renderer->frame[i] = scale(renderer->frame[i], config->brightness);
+    }
+
+    renderer->stats.frames++;
+    if (renderer->shownValid && memcmp(renderer->frame, renderer->shown, config->count * sizeof(renderer->frame[0])) == 0)
+    {
+        renderer->stats.clean++;
+        return false;
+    }
+    return true;
+}
+
+// Call for dirty frames only, a failed push leaves the frame dirty for the next one
+bool ledRendererPush(struct LedRenderer *renderer, const struct LedStrip *strip)
+{
+    uint16_t count = renderer->config.count;
+
+    if (!strip->push(strip->ctx, renderer->frame, count))
+    {
+        renderer->stats.failed++;
+        return false;
+    }
+    memcpy(renderer->shown, renderer->frame, count * sizeof(renderer->frame[0]));
+    renderer->shownValid = true;
+    renderer->stats.pushed++;
+    return true;
+}
+
+void ledRendererAccount(struct LedRenderer *renderer, uint32_t renderUs, uint32_t frameUs, uint32_t budgetUs)
+{
+    renderer->stats.totalRenderUs += renderUs;
+    if (renderUs > renderer->stats.maxRenderUs)
+    {
+        renderer->stats.maxRenderUs = renderUs;
+    }
+    if (frameUs > renderer->stats.maxFrameUs)
+    {
+        renderer->stats.maxFrameUs = frameUs;
+    }
+    if (frameUs > budgetUs)
+    {
+        renderer->stats.overBudget++;
+    }
+}
+
+static bool capturePush(void *ctx, const struct LedRgb *pixels, uint16_t count)
+{
+    struct LedCaptureStrip *capture = (struct LedCaptureStrip *)ctx;
+
+    memcpy(capture->pixels, pixels, count * sizeof(pixels[0]));
+    capture->count = count;
+    capture->pushes++;
+    return true;
+}
+
+void ledCaptureStripInit(struct LedCaptureStrip *capture)
+{
+    memset(capture, 0, sizeof(*capture));
+    capture->strip.ctx = capture;
+    capture->strip.push = capturePush;
+}
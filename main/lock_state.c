@@ -0,0 +1,37 @@
+#include "lock_state.h"
+
+/*
+Takes the keyboard output report as the USB stack passed it on. Depending on the
+stack version a report with an ID arrives with the ID still as the first byte,
+boot protocol reports never have one (expectedId 0). Returns true if a lock changed.
+*/
+bool lockStateUpdate(struct LockState *state, uint8_t reportId, uint8_t expectedId, const uint8_t *buffer, uint16_t length)
+{
+    uint8_t leds = 0;
+
+    if (expectedId != 0 && length >= 2 && buffer[0] == expectedId && (reportId == expectedId || reportId == 0))
+    {
+        buffer++;
+        length--;
+    }
+    else if (expectedId != 0 && reportId != expectedId)
+    {
+        state->malformed++;
+        return false;
+    }
+    if (length < 1)
+    {
+        state->malformed++;
+        return false;
+    }
+
+    leds = buffer[0] & LOCK_MASK;
+    state->reports++;
+    if (leds == state->leds)
+    {
+        return false;
+    }
+    state->leds = leds;
+    state->changes++;
+    return true;
+}
@@ -13,6 +13,12 @@ KVASS - firmware for RKBoard split keyboard
 #include "include/gpio_manager.h"
 #include "include/config_manager.h"
 #include "include/kb_interconnect_manager.h"
+#include "include/event_ring.h"
+#include "include/dongle_manager.h"
+#include "include/led_manager.h"
+#include "include/display_manager.h"
+#include "include/telemetry_manager.h"
+#include "include/dlog_manager.h"
 
 const char *TAG = "main";
 
@@ -26,17 +32,20 @@ requirements
 */
 void app_main(void)
 {
-    TaskStatus_t taskStatus = {0};
-
     volatile static struct GodParameters uGodParameters = {0};
     volatile static struct GpioParameters uGpioParameters = {0};
     volatile static struct CommsParameters uCommsParameters = {0};
     volatile static struct InterconnectParameters uInterconnectParameters = {0};
+    static struct EventRing uEventRing = {0};
 
     // define task handles
     TaskHandle_t gpioHandle = NULL;
     TaskHandle_t commsHandle = NULL;
     TaskHandle_t interconnectHandle = NULL;
+    TaskHandle_t ledHandle = NULL;
+    TaskHandle_t displayHandle = NULL;
+    TaskHandle_t dlogHandle = NULL;
+    TickType_t wake = 0;
 
     ESP_LOGI(TAG, "RKBoard initializing...");
 
@@ -48,8 +57,22 @@ void app_main(void)
         ESP_LOGE(TAG, "Cannot initialize NVS!");
     }
 
+    // Prints what the other tasks log with DLOG(), both builds have something to drain
+    xTaskCreate(vDlogTask, "dlogTask", 3072, &uGodParameters, 1, &dlogHandle);
+    configASSERT(dlogHandle);
+
+#if KVASS_DONGLE_BUILD
+    // Receiver dongle only forwards ESP-NOW reports to USB, no matrix or interconnect
+    xTaskCreate(vDongleTask, "dongleTask", CONFIG_TINYUSB_TASK_STACK_SIZE, &uGodParameters, 9, &commsHandle);
+    configASSERT(commsHandle);
+    return;
+#endif
+
     // Init parameters
-    uCommsParameters.protocol = USB;
+    // Last protocol picked, a value from a newer build falls back to USB
+    uCommsParameters.protocol = getConfig()->protocol <= NONE ? (enum CommsProtocol)getConfig()->protocol : USB;
+    eventRingInit(&uEventRing);
+    uCommsParameters.commsData.eventRing = &uEventRing;
 
     uGpioParameters.gpioTask = &gpioHandle;
     uCommsParameters.commsTask = &commsHandle;
@@ -59,25 +82,35 @@ void app_main(void)
     uGodParameters.commsParameters = (void*)&uCommsParameters;
     uGodParameters.interconnectParameters = (void*)&uInterconnectParameters;
 
+    // Before any task runs, they count into it from the start
+    telemetryStart(&uEventRing);
 
     xTaskCreate(vCommsTask, "commsTask", CONFIG_TINYUSB_TASK_STACK_SIZE, &uGodParameters, 9, &commsHandle);
     configASSERT(commsHandle);
-    xTaskCreate(vGpioTask, "gpioTask", 3072, &uGodParameters, 9, &gpioHandle);
+    // Scan task runs above the others so timer ticks are served right away
+    xTaskCreate(vGpioTask, "gpioTask", 3072, &uGodParameters, 10, &gpioHandle);
     configASSERT(gpioHandle);
     xTaskCreate(vInterconnectTask, "interconnectTask", 3072, &uGodParameters, 9, &interconnectHandle);
     configASSERT(interconnectHandle);
-
+    // LEDs are cosmetic, they only get the CPU time left over
+    xTaskCreate(vLedTask, "ledTask", 3072, &uGodParameters, 2, &ledHandle);
+    configASSERT(ledHandle);
+    // Lowest of all, the display only draws when nothing else has work
+    xTaskCreate(vDisplayTask, "displayTask", 4096, &uGodParameters, 1, &displayHandle);
+    configASSERT(displayHandle);
+
+    telemetryWatchTask(commsHandle);
+    telemetryWatchTask(gpioHandle);
+    telemetryWatchTask(interconnectHandle);
+    telemetryWatchTask(ledHandle);
+    telemetryWatchTask(displayHandle);
+    telemetryWatchTask(dlogHandle);
+
+    // This task is left with taking telemetry samples, the snapshot is read over the console
+    wake = xTaskGetTickCount();
     while (1)
     {
-        vTaskGetInfo(commsHandle, &taskStatus, pdTRUE, eInvalid);
-        ESP_LOGI(TAG, "commsTask state: %d, freeStackSpace: %lu, runtime: %lu", taskStatus.eCurrentState, taskStatus.usStackHighWaterMark, taskStatus.ulRunTimeCounter);
-
-        vTaskGetInfo(gpioHandle, &taskStatus, pdTRUE, eInvalid);
-        ESP_LOGI(TAG, "gpioTask state: %d, freeStackSpace: %lu, runtime: %lu", taskStatus.eCurrentState, taskStatus.usStackHighWaterMark, taskStatus.ulRunTimeCounter);
-
-        vTaskGetInfo(interconnectHandle, &taskStatus, pdTRUE, eInvalid);
-        ESP_LOGI(TAG, "interconnectTask state: %d, freeStackSpace: %lu, runtime: %lu", taskStatus.eCurrentState, taskStatus.usStackHighWaterMark, taskStatus.ulRunTimeCounter);
-
-        vTaskDelay(pdMS_TO_TICKS(5000));
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(KB_TELEMETRY_PERIOD_MS));
+        telemetrySampleNow();
     }
 }
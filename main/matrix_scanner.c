@@ -0,0 +1,193 @@
+#include <string.h>
+
+#include "matrix_scanner.h"
+
+void matrixScannerInit(struct MatrixScanner *scanner, const struct MatrixIo *io)
+{
+    scanner->io = io;
+    memset(scanner->state, 0, sizeof(scanner->state));
+    io->unselectCols(io->ctx);
+}
+
+void matrixScanRaw(const struct MatrixIo *io, matrix_row_t raw[KB_ROWS])
+{
+    uint32_t rowBits = 0;
+    memset(raw, 0, KB_ROWS * sizeof(matrix_row_t));
+
+    for (int i = 0; i < KB_COLS; i++)
+    {
+        io->selectCol(io->ctx, i);
+        rowBits = io->readRows(io->ctx);
+
+        // Transpose column read into per-row masks, only touching rows that are set
+        while (rowBits)
+        {
+            int row = __builtin_ctz(rowBits);
+            rowBits &= rowBits - 1;
+            if (row < KB_ROWS)
+            {
+                raw[row] |= (matrix_row_t)(1u << i);
+            }
+        }
+    }
+    io->unselectCols(io->ctx);
+}
+
+bool matrixScan(struct MatrixScanner *scanner, matrix_row_t changes[KB_ROWS])
+{
+    matrix_row_t raw[KB_ROWS];
+    matrix_row_t any = 0;
+
+    matrixScanRaw(scanner->io, raw);
+
+    for (int j = 0; j < KB_ROWS; j++)
+    {
+        changes[j] = raw[j] ^ scanner->state[j];
+        scanner->state[j] = raw[j];
+        any |= changes[j];
+    }
+
+    return any != 0;
+}
+
+void matrixIdleInit(struct MatrixIdle *idle, uint16_t idleAfter, uint32_t scanPeriodUs)
+{
+    memset(idle, 0, sizeof(*idle));
+    idle->state = MATRIX_SCAN_ACTIVE;
+    idle->idleAfter = idleAfter;
+    idle->scanPeriodUs = scanPeriodUs;
+}
+
+// Returns true once enough quiet scans were seen in a row
+bool matrixIdleUpdate(struct MatrixIdle *idle, bool quiet)
+{
+    if (!quiet)
+    {
+        idle->quietScans = 0;
+        return false;
+    }
+
+    if (idle->quietScans < idle->idleAfter)
+    {
+        idle->quietScans++;
+    }
+    return idle->quietScans >= idle->idleAfter;
+}
+
+// Arms wake interrupts, returns false if a key went down before arming finished
+bool matrixIdleEnter(struct MatrixIdle *idle, const struct MatrixIo *io, uint64_t nowUs)
+{
+    io->armWake(io->ctx);
+
+    // An edge before the interrupt got enabled would be lost, so check the level once
+    if (io->readRows(io->ctx) != 0)
+    {
+        io->disarmWake(io->ctx);
+        idle->quietScans = 0;
+        return false;
+    }
+
+    idle->state = MATRIX_SCAN_IDLE;
+    idle->idleSinceUs = nowUs;
+    return true;
+}
+
+void matrixIdleWake(struct MatrixIdle *idle, const struct MatrixIo *io, uint64_t edgeUs, uint64_t nowUs)
+{
+    uint64_t slept = nowUs - idle->idleSinceUs;
+    uint32_t latency = edgeUs && nowUs > edgeUs ? (uint32_t)(nowUs - edgeUs) : 0;
+
+    io->disarmWake(io->ctx);
+
+    idle->state = MATRIX_SCAN_ACTIVE;
+    idle->quietScans = 0;
+    idle->wakeups++;
+    idle->lastWakeLatencyUs = latency;
+    if (latency > idle->maxWakeLatencyUs)
+    {
+        idle->maxWakeLatencyUs = latency;
+    }
+    idle->idleUs += slept;
+    if (idle->scanPeriodUs)
+    {
+        idle->scansSaved += slept / idle->scanPeriodUs;
+    }
+}
+
+static void fakeSelectCol(void *ctx, uint8_t col)
+{
+    struct MatrixFakeRegister *reg = (struct MatrixFakeRegister *)ctx;
+    reg->selected = col;
+}
+
+static void fakeUnselectCols(void *ctx)
+{
+    struct MatrixFakeRegister *reg = (struct MatrixFakeRegister *)ctx;
+    reg->selected = -1;
+}
+
+static uint32_t fakeReadRows(void *ctx)
+{
+    struct MatrixFakeRegister *reg = (struct MatrixFakeRegister *)ctx;
+    uint32_t value = 0;
+
+    reg->reads++;
+    if (reg->selected < 0 && !reg->armed)
+    {
+        return 0;
+    }
+
+    for (int j = 0; j < KB_ROWS; j++)
+    {
+        // While armed every column is driven
+        if (reg->armed ? reg->keys[j] != 0 : (reg->keys[j] & (1u << reg->selected)))
+        {
+            value |= 1u << j;
+        }
+    }
+    return value;
+}
+
+static void fakeArmWake(void *ctx)
+{
+    struct MatrixFakeRegister *reg = (struct MatrixFakeRegister *)ctx;
+    reg->armed = true;
+}
+
+static void fakeDisarmWake(void *ctx)
+{
+    struct MatrixFakeRegister *reg = (struct MatrixFakeRegister *)ctx;
+    reg->armed = false;
+    reg->selected = -1;
+}
+
+// Simulated interrupt source, true if an armed row would have raised an edge
+bool matrixFakeEdge(struct MatrixFakeRegister *reg)
+{
+    if (!reg->armed)
+    {
+        return false;
+    }
+
+    for (int j = 0; j < KB_ROWS; j++)
+    {
+        if (reg->keys[j])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void matrixFakeIoInit(struct MatrixIo *io, struct MatrixFakeRegister *reg)
+{
+    memset(reg, 0, sizeof(*reg));
+    reg->selected = -1;
+
+    io->ctx = reg;
+    io->selectCol = fakeSelectCol;
+    io->unselectCols = fakeUnselectCols;
+    io->readRows = fakeReadRows;
+    io->armWake = fakeArmWake;
+    io->disarmWake = fakeDisarmWake;
+}
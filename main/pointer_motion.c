@@ -0,0 +1,159 @@
+#include <string.h>
+
+#include "pointer_motion.h"
+
+#define CENTRE_SHIFT 4
+
+_Static_assert(POINTER_FRAC_BITS == 8, "Curve points are in 1/256");
+
+// Fraction of max speed in 1/256 over normalised deflection
+static const uint16_t curves[POINTER_CURVE_COUNT][POINTER_CURVE_POINTS] = {
+    [POINTER_CURVE_LINEAR] = {0, 16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208, 224, 240, 256},
+    [POINTER_CURVE_QUADRATIC] = {0, 1, 4, 9, 16, 25, 36, 49, 64, 81, 100, 121, 144, 169, 196, 225, 256},
+    [POINTER_CURVE_PRECISION] = {0, 1, 1, 2, 4, 8, 14, 21, 32, 46, 63, 83, 108, 137, 172, 211, 256},
+};
+
+void pointerMotionInit(struct PointerMotion *motion, const struct PointerConfig *config)
+{
+    memset(motion, 0, sizeof(*motion));
+    motion->config = *config;
+
+    if (motion->config.curve >= POINTER_CURVE_COUNT)
+    {
+        motion->config.curve = POINTER_CURVE_LINEAR;
+    }
+    if (motion->config.fullScale <= motion->config.deadzone)
+    {
+        motion->config.fullScale = motion->config.deadzone + 1;
+    }
+    if (motion->config.tickHz == 0)
+    {
+        motion->config.tickHz = 1;
+    }
+}
+
+void pointerMotionRecalibrate(struct PointerMotion *motion)
+{
+    memset(motion->centre, 0, sizeof(motion->centre));
+    memset(motion->carry, 0, sizeof(motion->carry));
+    motion->calibrationTicks = 0;
+    motion->calibrated = false;
+    motion->deflected = false;
+}
+
+static uint32_t isqrt(uint32_t value)
+{
+    uint32_t root = 0, bit = 1u << 30;
+
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+    while (bit)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+// Linear interpolation between curve points, position is in 1/256, result in 1/4096
+static uint32_t curveLookup(enum PointerCurve curve, uint32_t position)
+{
+    const uint16_t *points = curves[curve];
+    uint32_t index = position >> 4;
+    uint32_t frac = position & 15;
+
+    if (index >= POINTER_CURVE_POINTS - 1)
+    {
+        return points[POINTER_CURVE_POINTS - 1] << 4;
+    }
+    // Kept unshifted, slow speeds near the deadzone edge would round to 0 otherwise
+    return (points[index] << 4) + (points[index + 1] - points[index]) * frac;
+}
+
+// Returns true if out holds whole pixels to send, at rest nothing is produced
+bool pointerMotionUpdate(struct PointerMotion *motion, const int32_t input[POINTER_AXES], int16_t out[POINTER_AXES])
+{
+    const struct PointerConfig *config = &motion->config;
+    int32_t offset[POINTER_AXES];
+    int32_t step = 0;
+    uint32_t magnitude = 0, position = 0, speed = 0;
+
+    out[0] = out[1] = 0;
+
+    if (!motion->calibrated)
+    {
+        for (int i = 0; i < POINTER_AXES; i++)
+        {
+            motion->centre[i] += input[i];
+        }
+        if (++motion->calibrationTicks < POINTER_CALIBRATION_TICKS)
+        {
+            return false;
+        }
+        for (int i = 0; i < POINTER_AXES; i++)
+        {
+            motion->centre[i] = (motion->centre[i] << CENTRE_SHIFT) / POINTER_CALIBRATION_TICKS;
+        }
+        motion->calibrated = true;
+        return false;
+    }
+
+    for (int i = 0; i < POINTER_AXES; i++)
+    {
+        offset[i] = input[i] - (motion->centre[i] >> CENTRE_SHIFT);
+    }
+    magnitude = isqrt((uint32_t)(offset[0] * offset[0]) + (uint32_t)(offset[1] * offset[1]));
+
+    if (magnitude <= config->deadzone)
+    {
+        // Resting, let the centre follow slow drift and forget partial pixels
+        for (int i = 0; i < POINTER_AXES; i++)
+        {
+            motion->centre[i] += ((input[i] << CENTRE_SHIFT) - motion->centre[i]) >> POINTER_DRIFT_SHIFT;
+            motion->carry[i] = 0;
+        }
+        motion->deflected = false;
+        return false;
+    }
+    motion->deflected = true;
+
+    // Deflection past the deadzone edge, 0..256
+    position = ((magnitude - config->deadzone) << 8) / (config->fullScale - config->deadzone);
+    if (position > 256)
+    {
+        position = 256;
+    }
+    speed = curveLookup(config->curve, position) * config->maxSpeedPps / (config->tickHz << 4);
+
+    for (int i = 0; i < POINTER_AXES; i++)
+    {
+        // Speed is in 1/POINTER_ONE pixels per tick
+        step = (int32_t)(((int64_t)speed * offset[i]) / (int32_t)magnitude);
+        motion->carry[i] += config->invert[i] ? -step : step;
+
+        // Whole pixels go out, the fraction is kept for the next tick
+        step = motion->carry[i] / POINTER_ONE;
+        if (step > INT16_MAX)
+        {
+            step = INT16_MAX;
+        }
+        if (step < -INT16_MAX)
+        {
+            step = -INT16_MAX;
+        }
+        motion->carry[i] -= step * POINTER_ONE;
+        out[i] = (int16_t)step;
+    }
+
+    return out[0] != 0 || out[1] != 0;
+}
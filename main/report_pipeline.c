@@ -0,0 +1,120 @@
+#include <string.h>
+
+#include "report_pipeline.h"
+
+static bool pipelineReady(void *ctx, enum ReportType type)
+{
+    struct ReportPipeline *pipe = (struct ReportPipeline *)ctx;
+    bool ready = false;
+
+    if (pipe->transport == NULL)
+    {
+        return false;
+    }
+    // Still asked while suspended, pending reports are how a transport knows to wake its host
+    ready = pipe->transport->ready(pipe->transport->ctx, type);
+    return ready && !pipe->suspended;
+}
+
+static bool pipelineSendKeyboard(void *ctx, const struct KeyboardData *data)
+{
+    struct ReportPipeline *pipe = (struct ReportPipeline *)ctx;
+
+    return pipe->transport->sendKeyboard(pipe->transport->ctx, data);
+}
+
+static bool pipelineSendMouse(void *ctx, const struct MouseData *data)
+{
+    struct ReportPipeline *pipe = (struct ReportPipeline *)ctx;
+
+    return pipe->transport->sendPointer(pipe->transport->ctx, data);
+}
+
+void reportPipelineInit(struct ReportPipeline *pipe)
+{
+    memset(pipe, 0, sizeof(*pipe));
+    pipe->output.ctx = pipe;
+    pipe->output.ready = pipelineReady;
+    pipe->output.sendKeyboard = pipelineSendKeyboard;
+    pipe->output.sendMouse = pipelineSendMouse;
+    reportSchedulerInit(&pipe->scheduler, &pipe->output);
+}
+
+// Replaces the current transport, held keys go out again on the new one
+bool reportPipelineAttach(struct ReportPipeline *pipe, const struct Transport *transport, TransportCompleteFn complete, void *owner)
+{
+    reportPipelineDetach(pipe);
+    reportSchedulerResync(&pipe->scheduler);
+
+    if (!transport->init(transport->ctx, complete, owner))
+    {
+        pipe->stats.failed++;
+        return false;
+    }
+    pipe->transport = transport;
+    pipe->stats.attached++;
+    if (pipe->suspended)
+    {
+        transport->suspend(transport->ctx, true);
+    }
+    return true;
+}
+
+void reportPipelineDetach(struct ReportPipeline *pipe)
+{
+    const struct Transport *transport = pipe->transport;
+
+    if (transport == NULL)
+    {
+        return;
+    }
+    pipe->transport = NULL;
+    transport->deinit(transport->ctx);
+}
+
+// Drains pending events and sends what the transport takes right now
+uint32_t reportPipelineProcess(struct ReportPipeline *pipe, struct EventRing *ring)
+{
+    uint32_t count = reportSchedulerDrain(&pipe->scheduler, ring);
+    uint32_t drained = count;
+
+    if (pipe->transport != NULL && pipe->transport->connected(pipe->transport->ctx))
+    {
+        reportSchedulerPump(&pipe->scheduler);
+        return count;
+    }
+
+    // Nobody listens, keep held keys but do not pile up motion for the next host
+    while (drained > 0 || pipe->scheduler.drainBlocked)
+    {
+        reportSchedulerResync(&pipe->scheduler);
+        pipe->stats.resynced++;
+        drained = reportSchedulerDrain(&pipe->scheduler, ring);
+        count += drained;
+    }
+    return count;
+}
+
+void reportPipelineComplete(struct ReportPipeline *pipe, enum ReportType type)
+{
+    // Pump serves both types, on a shared endpoint the other one may be waiting too
+    (void)type;
+    reportSchedulerPump(&pipe->scheduler);
+}
+
+void reportPipelineSuspend(struct ReportPipeline *pipe, bool suspended)
+{
+    if (pipe->suspended == suspended)
+    {
+        return;
+    }
+    pipe->suspended = suspended;
+    if (pipe->transport != NULL)
+    {
+        pipe->transport->suspend(pipe->transport->ctx, suspended);
+    }
+    if (!suspended)
+    {
+        reportSchedulerPump(&pipe->scheduler);
+    }
+}
@@ -0,0 +1,305 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "report_scheduler.h"
+
+#define MOUSE_DELTA_MAX 32767
+#define MOUSE_SCROLL_MAX 127
+
+void populateKeyboard(struct KeyboardData *data, const KeySet *keys)
+{
+    data->modifier = KEYSET_MODIFIERS(keys);
+    keySetOldest(data->keycode, KB_BUFFER_SIZE, keys);
+    memcpy(data->bitmap, keys->bits, KB_NKRO_BYTES);
+}
+
+void reportSchedulerInit(struct ReportScheduler *sched, const struct ReportOutput *output)
+{
+    memset(sched, 0, sizeof(*sched));
+    sched->output = output;
+}
+
+static int32_t takeDelta(int32_t *accumulated, int32_t max)
+{
+    int32_t delta = *accumulated;
+
+    if (delta > max)
+    {
+        delta = max;
+    }
+    if (delta < -max)
+    {
+        delta = -max;
+    }
+    *accumulated -= delta;
+    return delta;
+}
+
+static void buildMouse(struct ReportScheduler *sched, struct MouseData *data)
+{
+    data->button = sched->mouseButtons;
+    data->delta_x = (int16_t)takeDelta(&sched->mouseX, MOUSE_DELTA_MAX);
+    data->delta_y = (int16_t)takeDelta(&sched->mouseY, MOUSE_DELTA_MAX);
+    data->scroll_vertical = (int8_t)takeDelta(&sched->mouseWheel, MOUSE_SCROLL_MAX);
+    data->scroll_horizontal = (int8_t)takeDelta(&sched->mousePan, MOUSE_SCROLL_MAX);
+    data->scan_us = sched->mouseScanUs;
+    data->queue_us = sched->mouseQueueUs;
+
+    sched->mouseDirty = sched->mouseX || sched->mouseY || sched->mouseWheel || sched->mousePan;
+}
+
+// Freezes the current keyboard state as its own report, false if the queue has no room for it
+static bool snapshotKeyboard(struct ReportScheduler *sched)
+{
+    if (!sched->keyboardDirty)
+    {
+        return true;
+    }
+    if (sched->keyboardCount >= KEYBOARD_QUEUE_SIZE)
+    {
+        return false;
+    }
+
+    struct KeyboardData *data = &sched->keyboardQueue[(sched->keyboardHead + sched->keyboardCount++) % KEYBOARD_QUEUE_SIZE];
+    if (sched->keyboardCount > sched->stats.keyboardHighWater)
+    {
+        sched->stats.keyboardHighWater = sched->keyboardCount;
+    }
+    populateKeyboard(data, &sched->keys);
+    data->scan_us = sched->keyboardScanUs;
+    data->queue_us = sched->keyboardQueueUs;
+
+    keySetClear(&sched->touched);
+    sched->keyboardDirty = false;
+    return true;
+}
+
+static bool snapshotMouse(struct ReportScheduler *sched)
+{
+    if (!sched->mouseDirty)
+    {
+        return true;
+    }
+    if (sched->mouseCount >= MOUSE_QUEUE_SIZE)
+    {
+        return false;
+    }
+
+    buildMouse(sched, &sched->mouseQueue[(sched->mouseHead + sched->mouseCount++) % MOUSE_QUEUE_SIZE]);
+    if (sched->mouseCount > sched->stats.mouseHighWater)
+    {
+        sched->stats.mouseHighWater = sched->mouseCount;
+    }
+    return true;
+}
+
+// Returns false, with nothing applied, if the event needs a report split and the queue is full
+bool reportSchedulerApply(struct ReportScheduler *sched, const struct InputEvent *event)
+{
+    if (event->type == INPUT_EVENT_KEY)
+    {
+        // Second change of the same key would cancel the first one out, so split here
+        if (keySetContains(event->keycode, &sched->touched) && !snapshotKeyboard(sched))
+        {
+            return false;
+        }
+
+        if (sched->keyboardDirty)
+        {
+            sched->stats.merged++;
+        }
+        else
+        {
+            sched->keyboardScanUs = event->scan_us;
+            sched->keyboardQueueUs = event->queue_us;
+        }
+
+        if (event->pressed)
+        {
+            keySetAdd(event->keycode, &sched->keys);
+        }
+        else
+        {
+            keySetRemove(event->keycode, &sched->keys);
+        }
+        sched->touched.bits[event->keycode >> 5] |= 1u << (event->keycode & 31);
+        sched->keyboardDirty = true;
+        return true;
+    }
+
+    // Clicks are never merged away, motion so far goes out with the old buttons
+    if (event->buttons != sched->mouseButtons && !snapshotMouse(sched))
+    {
+        return false;
+    }
+
+    if (sched->mouseDirty)
+    {
+        sched->stats.merged++;
+    }
+    else
+    {
+        sched->mouseScanUs = event->scan_us;
+        sched->mouseQueueUs = event->queue_us;
+    }
+
+    sched->mouseDirty = sched->mouseDirty || event->buttons != sched->mouseButtons || event->delta_x || event->delta_y ||
+                        event->scroll_vertical || event->scroll_horizontal;
+    sched->mouseButtons = event->buttons;
+    sched->mouseX += event->delta_x;
+    sched->mouseY += event->delta_y;
+    sched->mouseWheel += event->scroll_vertical;
+    sched->mousePan += event->scroll_horizontal;
+    return true;
+}
+
+/*
+Applies events until the ring is empty. An event that needs a split while the
+queue is full stays in the ring, folding later events in would lose a tap or
+a click. drainBlocked tells the owner to drain again once a report went out.
+*/
+uint32_t reportSchedulerDrain(struct ReportScheduler *sched, struct EventRing *ring)
+{
+    struct InputEvent event;
+    uint32_t count = 0;
+
+    sched->drainBlocked = false;
+    while (eventRingPeek(ring, &event))
+    {
+        if (!reportSchedulerApply(sched, &event))
+        {
+            sched->drainBlocked = true;
+            sched->stats.queueFull++;
+            break;
+        }
+        eventRingPop(ring, &event);
+        count++;
+    }
+    return count;
+}
+
+// Drops queued reports and motion, held keys are sent again as one fresh report
+void reportSchedulerResync(struct ReportScheduler *sched)
+{
+    sched->keyboardHead = sched->keyboardCount = 0;
+    sched->mouseHead = sched->mouseCount = 0;
+    sched->mouseX = sched->mouseY = sched->mouseWheel = sched->mousePan = 0;
+    sched->mouseDirty = false;
+
+    keySetClear(&sched->touched);
+    memset(&sched->lastKeyboard, 0, sizeof(sched->lastKeyboard));
+    sched->lastMouseButtons = 0;
+    sched->keyboardDirty = true;
+}
+
+bool reportSchedulerPending(const struct ReportScheduler *sched)
+{
+    return sched->keyboardCount || sched->mouseCount || sched->keyboardDirty || sched->mouseDirty;
+}
+
+enum SendResult
+{
+    SEND_SKIPPED,
+    SEND_DONE,
+    SEND_REFUSED,
+};
+
+static enum SendResult sendKeyboard(struct ReportScheduler *sched, const struct KeyboardData *data)
+{
+    // Timestamps are not part of the report itself
+    if (memcmp(data, &sched->lastKeyboard, offsetof(struct KeyboardData, scan_us)) == 0)
+    {
+        sched->stats.deduplicated++;
+        return SEND_SKIPPED;
+    }
+    if (!sched->output->sendKeyboard(sched->output->ctx, data))
+    {
+        return SEND_REFUSED;
+    }
+
+    sched->lastKeyboard = *data;
+    sched->stats.keyboardSent++;
+    return SEND_DONE;
+}
+
+static enum SendResult sendMouse(struct ReportScheduler *sched, const struct MouseData *data)
+{
+    if (!data->delta_x && !data->delta_y && !data->scroll_vertical && !data->scroll_horizontal &&
+        data->button == sched->lastMouseButtons)
+    {
+        sched->stats.deduplicated++;
+        return SEND_SKIPPED;
+    }
+    if (!sched->output->sendMouse(sched->output->ctx, data))
+    {
+        return SEND_REFUSED;
+    }
+
+    sched->lastMouseButtons = data->button;
+    sched->stats.mouseSent++;
+    return SEND_DONE;
+}
+
+static void pumpKeyboard(struct ReportScheduler *sched)
+{
+    enum SendResult result = SEND_SKIPPED;
+
+    while (result == SEND_SKIPPED && (sched->keyboardCount || sched->keyboardDirty))
+    {
+        if (!sched->output->ready(sched->output->ctx, REPORT_KEYBOARD))
+        {
+            sched->stats.stalled++;
+            return;
+        }
+
+        if (sched->keyboardCount == 0)
+        {
+            snapshotKeyboard(sched);
+        }
+
+        result = sendKeyboard(sched, &sched->keyboardQueue[sched->keyboardHead]);
+        if (result == SEND_REFUSED)
+        {
+            sched->stats.stalled++;
+            return;
+        }
+        sched->keyboardHead = (sched->keyboardHead + 1) % KEYBOARD_QUEUE_SIZE;
+        sched->keyboardCount--;
+    }
+}
+
+static void pumpMouse(struct ReportScheduler *sched)
+{
+    enum SendResult result = SEND_SKIPPED;
+
+    while (result == SEND_SKIPPED && (sched->mouseCount || sched->mouseDirty))
+    {
+        if (!sched->output->ready(sched->output->ctx, REPORT_MOUSE))
+        {
+            sched->stats.stalled++;
+            return;
+        }
+
+        if (sched->mouseCount == 0)
+        {
+            snapshotMouse(sched);
+        }
+
+        result = sendMouse(sched, &sched->mouseQueue[sched->mouseHead]);
+        if (result == SEND_REFUSED)
+        {
+            sched->stats.stalled++;
+            return;
+        }
+        sched->mouseHead = (sched->mouseHead + 1) % MOUSE_QUEUE_SIZE;
+        sched->mouseCount--;
+    }
+}
+
+// Sends at most one report of each type, call again when an endpoint reports completion
+void reportSchedulerPump(struct ReportScheduler *sched)
+{
+    // Keys go first, on a shared endpoint the mouse then finds it busy and waits
+    pumpKeyboard(sched);
+    pumpMouse(sched);
+}
@@ -0,0 +1,74 @@
+#include <string.h>
+
+#include "scan_timing.h"
+
+uint32_t scanTimingClampRate(uint32_t rateHz)
+{
+    if (rateHz < SCAN_RATE_MIN_HZ)
+    {
+        return SCAN_RATE_MIN_HZ;
+    }
+    if (rateHz > SCAN_RATE_MAX_HZ)
+    {
+        return SCAN_RATE_MAX_HZ;
+    }
+    return rateHz;
+}
+
+void scanTimingInit(struct ScanTiming *timing, uint32_t rateHz)
+{
+    memset(timing, 0, sizeof(*timing));
+    timing->rateHz = scanTimingClampRate(rateHz);
+    timing->targetPeriodUs = 1000000 / timing->rateHz;
+    timing->minPeriodUs = UINT32_MAX;
+}
+
+// Next tick starts a new period, used after the scan was paused
+void scanTimingRestart(struct ScanTiming *timing)
+{
+    timing->lastUs = 0;
+}
+
+void scanTimingTick(struct ScanTiming *timing, uint64_t nowUs)
+{
+    uint32_t period = 0, jitter = 0;
+    int bucket = 0;
+
+    if (timing->lastUs == 0)
+    {
+        timing->lastUs = nowUs;
+        return;
+    }
+
+    period = (uint32_t)(nowUs - timing->lastUs);
+    timing->lastUs = nowUs;
+
+    timing->periods++;
+    timing->totalPeriodUs += period;
+    if (period < timing->minPeriodUs)
+    {
+        timing->minPeriodUs = period;
+    }
+    if (period > timing->maxPeriodUs)
+    {
+        timing->maxPeriodUs = period;
+    }
+
+    jitter = period > timing->targetPeriodUs ? period - timing->targetPeriodUs : timing->targetPeriodUs - period;
+    if (jitter > timing->maxJitterUs)
+    {
+        timing->maxJitterUs = jitter;
+    }
+
+    bucket = jitter ? 32 - __builtin_clz(jitter) : 0;
+    if (bucket >= SCAN_JITTER_BUCKETS)
+    {
+        bucket = SCAN_JITTER_BUCKETS - 1;
+    }
+    timing->jitterHistogram[bucket]++;
+}
+
+uint32_t scanTimingAvgPeriodUs(const struct ScanTiming *timing)
+{
+    return timing->periods ? (uint32_t)(timing->totalPeriodUs / timing->periods) : 0;
+}
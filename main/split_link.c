@@ -0,0 +1,612 @@
+#include <string.h>
+
+#include "split_link.h"
+
+#define SPLIT_WINDOW_MASK (SPLIT_WINDOW - 1)
+
+_Static_assert((SPLIT_WINDOW & SPLIT_WINDOW_MASK) == 0, "SPLIT_WINDOW must be a power of two");
+_Static_assert(SPLIT_WINDOW < 128, "Window must fit in half of the 8 bit sequence space");
+_Static_assert(KB_ROWS <= 8, "Row mask is one byte");
+_Static_assert(3 + 4 + KB_ROWS <= SPLIT_PAYLOAD_MAX, "Full frame does not fit the payload");
+
+static void put32(uint8_t *out, uint32_t value)
+{
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t get32(const uint8_t *in)
+{
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+// CRC-16/CCITT-FALSE
+uint16_t splitCrc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int b = 0; b < 8; b++)
+        {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+size_t splitEncodeFrame(const uint8_t *payload, size_t length, uint8_t frame[SPLIT_FRAME_MAX])
+{
+    uint16_t crc = 0;
+
+    if (length > SPLIT_PAYLOAD_MAX)
+    {
+        return 0;
+    }
+
+    frame[0] = SPLIT_FRAME_SOF;
+    frame[1] = (uint8_t)length;
+    memcpy(&frame[2], payload, length);
+    crc = splitCrc16(&frame[1], length + 1);
+    frame[length + 2] = (uint8_t)crc;
+    frame[length + 3] = (uint8_t)(crc >> 8);
+    return length + 4;
+}
+
+// Returns payload length, or -1 if the frame is malformed or fails the CRC
+int splitDecodeFrame(const uint8_t *frame, size_t length, uint8_t payload[SPLIT_PAYLOAD_MAX])
+{
+    uint16_t crc = 0;
+
+    if (length < 4 || frame[0] != SPLIT_FRAME_SOF || frame[1] > SPLIT_PAYLOAD_MAX || length != (size_t)frame[1] + 4)
+    {
+        return -1;
+    }
+
+    crc = splitCrc16(&frame[1], frame[1] + 1);
+    if (frame[length - 2] != (uint8_t)crc || frame[length - 1] != (uint8_t)(crc >> 8))
+    {
+        return -1;
+    }
+
+    memcpy(payload, &frame[2], frame[1]);
+    return frame[1];
+}
+
+// Returns the frame length once a frame is complete, CRC is checked by the decoder
+size_t splitDeframerPush(struct SplitDeframer *deframer, uint8_t byte, uint8_t frame[SPLIT_FRAME_MAX])
+{
+    size_t length = 0;
+
+    if (deframer->length == 0 && byte != SPLIT_FRAME_SOF)
+    {
+        return 0;
+    }
+    if (deframer->length == 1 && byte > SPLIT_PAYLOAD_MAX)
+    {
+        deframer->length = 0;
+        return 0;
+    }
+
+    deframer->frame[deframer->length++] = byte;
+    if (deframer->length < 2 || deframer->length < (size_t)deframer->frame[1] + 4)
+    {
+        return 0;
+    }
+
+    length = deframer->length;
+    memcpy(frame, deframer->frame, length);
+    deframer->length = 0;
+    return length;
+}
+
+void splitLinkInit(struct SplitLink *link, enum SplitRole role, const struct SplitTransport *transport, uint8_t session)
+{
+    memset(link, 0, sizeof(*link));
+    link->role = role;
+    link->transport = transport;
+    link->session = session;
+    clockSyncInit(&link->clock);
+    link->retransmitUs = SPLIT_RETRANSMIT_MS * 1000;
+    // Whatever the other half remembers is stale, start from a full frame
+    link->fullDue = true;
+}
+
+// Called for every remote state the primary applies, in the order they were scanned
+void splitLinkSetRemoteHandler(struct SplitLink *link, SplitRemoteHandler handler, void *ctx)
+{
+    link->onRemote = handler;
+    link->onRemoteCtx = ctx;
+}
+
+static uint8_t inFlight(const struct SplitLink *link)
+{
+    return (uint8_t)(link->nextSeq - link->ackedSeq);
+}
+
+static bool sendPayload(struct SplitLink *link, const uint8_t *payload, size_t length)
+{
+    uint8_t frame[SPLIT_FRAME_MAX];
+    size_t frameLength = splitEncodeFrame(payload, length, frame);
+
+    return frameLength > 0 && link->transport->send(link->transport->ctx, frame, frameLength);
+}
+
+// Encodes the payload into the next window slot and sends it
+static void queueFrame(struct SplitLink *link, uint8_t *payload, size_t length, uint32_t nowUs)
+{
+    struct SplitPending *slot = &link->window[link->nextSeq & SPLIT_WINDOW_MASK];
+
+    payload[1] = link->nextSeq++;
+    slot->length = (uint8_t)splitEncodeFrame(payload, length, slot->frame);
+    link->transport->send(link->transport->ctx, slot->frame, slot->length);
+    link->lastSendUs = nowUs;
+    link->stats.framesSent++;
+}
+
+// Sends whatever local has over sent, a full frame when one is due. False if the window is full
+static bool sendLocal(struct SplitLink *link, uint32_t nowUs)
+{
+    uint8_t payload[SPLIT_PAYLOAD_MAX];
+    size_t length = 7;
+    uint8_t mask = 0;
+    uint32_t changeUs = link->changePending ? link->changeUs : nowUs;
+
+    if (inFlight(link) >= SPLIT_WINDOW)
+    {
+        // Picked up again once an ACK frees a slot
+        return false;
+    }
+
+    if (link->fullDue)
+    {
+        payload[0] = SPLIT_FRAME_FULL;
+        payload[2] = link->session;
+        put32(&payload[3], changeUs);
+        memcpy(&payload[7], link->local, KB_ROWS);
+        queueFrame(link, payload, 7 + KB_ROWS, nowUs);
+        memcpy(link->sent, link->local, sizeof(link->sent));
+        link->changePending = false;
+        link->fullDue = false;
+        link->lastFullUs = nowUs;
+        link->stats.fullSyncs++;
+        return true;
+    }
+
+    for (int j = 0; j < KB_ROWS; j++)
+    {
+        if (link->local[j] != link->sent[j])
+        {
+            mask |= (uint8_t)(1u << j);
+            payload[length++] = link->local[j];
+        }
+    }
+    if (mask == 0)
+    {
+        return true;
+    }
+
+    payload[0] = SPLIT_FRAME_DELTA;
+    payload[2] = mask;
+    put32(&payload[3], changeUs);
+    queueFrame(link, payload, length, nowUs);
+    memcpy(link->sent, link->local, sizeof(link->sent));
+    link->changePending = false;
+    return true;
+}
+
+static void foldState(struct SplitLink *link, const matrix_row_t rows[KB_ROWS], uint32_t timeUs)
+{
+    if (!link->changePending && memcmp(link->local, rows, sizeof(link->local)) != 0)
+    {
+        link->changeUs = timeUs;
+        link->changePending = true;
+    }
+    memcpy(link->local, rows, sizeof(link->local));
+}
+
+// Sends local, then queued states in order, while the window has room
+static void flushState(struct SplitLink *link, uint32_t nowUs)
+{
+    struct SplitState *state = NULL;
+
+    while (sendLocal(link, nowUs) && link->stateCount > 0)
+    {
+        state = &link->states[link->stateHead];
+        foldState(link, state->rows, state->timeUs);
+        link->stateHead = (link->stateHead + 1) % SPLIT_STATE_QUEUE;
+        link->stateCount--;
+    }
+}
+
+// True if rows turn back a change of local that has not gone out yet
+static bool cancelsPending(const struct SplitLink *link, const matrix_row_t rows[KB_ROWS])
+{
+    for (int j = 0; j < KB_ROWS; j++)
+    {
+        if ((rows[j] ^ link->local[j]) & (link->local[j] ^ link->sent[j]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+Call once per scan tick with the scan time, every change seen during the tick
+goes out in one frame. With the window full, changes to other keys are folded
+into the pending frame. A key changing back would cancel its unsent change, so
+that state waits in the queue for a frame of its own.
+*/
+void splitLinkSendState(struct SplitLink *link, const matrix_row_t rows[KB_ROWS], uint32_t nowUs)
+{
+    struct SplitState *state = NULL;
+
+    flushState(link, nowUs);
+    if (link->stateCount == 0 && !cancelsPending(link, rows))
+    {
+        foldState(link, rows, nowUs);
+        flushState(link, nowUs);
+        return;
+    }
+
+    if (link->stateCount < SPLIT_STATE_QUEUE)
+    {
+        state = &link->states[(link->stateHead + link->stateCount++) % SPLIT_STATE_QUEUE];
+        state->timeUs = nowUs;
+        link->stats.statesQueued++;
+    }
+    else
+    {
+        // Newest queued state takes the change, the last state the other half sees is still right
+        state = &link->states[(link->stateHead + link->stateCount - 1) % SPLIT_STATE_QUEUE];
+        link->stats.statesFolded++;
+    }
+    memcpy(state->rows, rows, sizeof(state->rows));
+}
+
+static void handleAck(struct SplitLink *link, uint8_t ack, uint32_t nowUs)
+{
+    // Only ACKs that land inside the window are believed
+    if ((uint8_t)(ack - link->ackedSeq) > inFlight(link))
+    {
+        return;
+    }
+
+    if (ack != link->ackedSeq)
+    {
+        link->retransmitUs = SPLIT_RETRANSMIT_MS * 1000;
+    }
+    link->ackedSeq = ack;
+    link->lastAckUs = nowUs;
+    link->connected = true;
+}
+
+static void handlePing(struct SplitLink *link, const uint8_t *payload, int length, uint32_t nowUs)
+{
+    uint8_t pong[13];
+
+    if (length != 5)
+    {
+        return;
+    }
+    pong[0] = SPLIT_FRAME_PONG;
+    memcpy(&pong[1], &payload[1], 4);
+    put32(&pong[5], nowUs);
+    put32(&pong[9], nowUs);
+    sendPayload(link, pong, sizeof(pong));
+    link->stats.pongs++;
+}
+
+static void handlePong(struct SplitLink *link, const uint8_t *payload, int length, uint32_t nowUs)
+{
+    if (length != 13)
+    {
+        return;
+    }
+    clockSyncSample(&link->clock, get32(&payload[1]), get32(&payload[5]), get32(&payload[9]), nowUs);
+}
+
+static void notifyRemote(struct SplitLink *link, uint32_t timeUs)
+{
+    if (link->onRemote)
+    {
+        link->onRemote(link->onRemoteCtx, link->remote, timeUs);
+    }
+}
+
+// Returns true if the remote rows changed
+static bool handleState(struct SplitLink *link, const uint8_t *payload, int length, uint32_t nowUs)
+{
+    matrix_row_t before[KB_ROWS];
+    int8_t distance = (int8_t)(payload[1] - link->expectedSeq);
+    int n = 7;
+    bool changed = false;
+
+    if (length < 7)
+    {
+        return false;
+    }
+    // Checked before anything is applied, a bad frame must not leave half its rows behind
+    if (payload[0] == SPLIT_FRAME_DELTA && (payload[2] >> KB_ROWS != 0 || length != 7 + __builtin_popcount(payload[2])))
+    {
+        return false;
+    }
+    memcpy(before, link->remote, sizeof(before));
+    link->ackDue = true;
+
+    if (payload[0] == SPLIT_FRAME_FULL)
+    {
+        if (length != 7 + KB_ROWS)
+        {
+            return false;
+        }
+        // In sequence like a delta while synced, skipping ahead would lose taps in the frames it jumps over
+        if (link->synced && payload[2] == link->remoteSession && distance < 0)
+        {
+            link->stats.duplicates++;
+            return false;
+        }
+        if (link->synced && payload[2] == link->remoteSession && distance > 0)
+        {
+            link->stats.outOfOrder++;
+            return false;
+        }
+        memcpy(link->remote, &payload[7], KB_ROWS);
+        link->remoteSession = payload[2];
+        link->expectedSeq = payload[1] + 1;
+        link->synced = true;
+    }
+    else
+    {
+        if (!link->synced)
+        {
+            return false;
+        }
+        if (distance < 0)
+        {
+            link->stats.duplicates++;
+            return false;
+        }
+        if (distance > 0)
+        {
+            // Something before it was lost, the sender goes back and repeats from there
+            link->stats.outOfOrder++;
+            return false;
+        }
+
+        for (int j = 0; j < KB_ROWS; j++)
+        {
+            if ((payload[2] >> j) & 1)
+            {
+                link->remote[j] = payload[n++];
+            }
+        }
+        link->expectedSeq++;
+    }
+
+    changed = memcmp(before, link->remote, sizeof(before)) != 0;
+    if (changed)
+    {
+        notifyRemote(link, clockSyncToLocal(&link->clock, get32(&payload[3]), nowUs));
+    }
+    return changed;
+}
+
+static bool receiveFrames(struct SplitLink *link, uint32_t nowUs)
+{
+    uint8_t frame[SPLIT_FRAME_MAX];
+    uint8_t payload[SPLIT_PAYLOAD_MAX];
+    size_t frameLength = 0;
+    int length = 0;
+    bool changed = false;
+
+    while ((frameLength = link->transport->receive(link->transport->ctx, frame, sizeof(frame))) > 0)
+    {
+        length = splitDecodeFrame(frame, frameLength, payload);
+        if (length < 2)
+        {
+            link->stats.crcErrors++;
+            continue;
+        }
+        link->stats.framesReceived++;
+        link->lastRxUs = nowUs;
+
+        switch (payload[0])
+        {
+        case SPLIT_FRAME_DELTA:
+        case SPLIT_FRAME_FULL:
+            changed |= handleState(link, payload, length, nowUs);
+            break;
+        case SPLIT_FRAME_ACK:
+            handleAck(link, payload[1], nowUs);
+            break;
+        case SPLIT_FRAME_RESYNC:
+            // Frames in flight are useless to a receiver without a base, the full frame replaces them
+            link->ackedSeq = link->nextSeq;
+            link->fullDue = true;
+            link->retransmitUs = SPLIT_RETRANSMIT_MS * 1000;
+            break;
+        case SPLIT_FRAME_PING:
+            handlePing(link, payload, length, nowUs);
+            break;
+        case SPLIT_FRAME_PONG:
+            handlePong(link, payload, length, nowUs);
+            break;
+        default:
+            break;
+        }
+    }
+    return changed;
+}
+
+// Services retransmits, ACKs, clock sync, full syncs and timeouts, returns true if the remote rows changed
+bool splitLinkPoll(struct SplitLink *link, uint32_t nowUs)
+{
+    uint8_t payload[5];
+    bool changed = receiveFrames(link, nowUs);
+
+    if (link->role == SPLIT_ROLE_PRIMARY)
+    {
+        if (link->ackDue)
+        {
+            payload[0] = link->synced ? SPLIT_FRAME_ACK : SPLIT_FRAME_RESYNC;
+            payload[1] = link->expectedSeq;
+            sendPayload(link, payload, 2);
+            link->ackDue = false;
+        }
+
+        if (nowUs - link->lastPingUs >= SPLIT_PING_MS * 1000)
+        {
+            payload[0] = SPLIT_FRAME_PING;
+            put32(&payload[1], nowUs);
+            sendPayload(link, payload, 5);
+            link->lastPingUs = nowUs;
+            link->stats.pings++;
+        }
+
+        // Keys of a half that went away must not stay pressed
+        if (link->synced && nowUs - link->lastRxUs >= SPLIT_LINK_TIMEOUT_MS * 1000)
+        {
+            link->synced = false;
+            link->stats.linkDrops++;
+            clockSyncInit(&link->clock);
+            for (int j = 0; j < KB_ROWS; j++)
+            {
+                changed |= link->remote[j] != 0;
+                link->remote[j] = 0;
+            }
+            if (changed)
+            {
+                notifyRemote(link, nowUs);
+            }
+        }
+        link->connected = link->synced;
+        return changed;
+    }
+
+    // Go back N, everything not acknowledged yet is sent again in order
+    if (inFlight(link) > 0 && nowUs - link->lastSendUs >= link->retransmitUs)
+    {
+        for (uint8_t seq = link->ackedSeq; seq != link->nextSeq; seq++)
+        {
+            struct SplitPending *slot = &link->window[seq & SPLIT_WINDOW_MASK];
+            link->transport->send(link->transport->ctx, slot->frame, slot->length);
+            link->stats.retransmits++;
+        }
+        link->lastSendUs = nowUs;
+        // Reset by the next ACK that moves the window
+        if (link->retransmitUs < SPLIT_RETRANSMIT_MAX_MS * 1000)
+        {
+            link->retransmitUs *= 2;
+        }
+    }
+
+    // Full frames double as keepalive and repair anything the deltas missed
+    if (nowUs - link->lastFullUs >= SPLIT_FULL_SYNC_MS * 1000)
+    {
+        link->fullDue = true;
+    }
+    flushState(link, nowUs);
+
+    if (link->connected && nowUs - link->lastAckUs >= SPLIT_LINK_TIMEOUT_MS * 1000)
+    {
+        link->connected = false;
+        link->stats.linkDrops++;
+    }
+    return changed;
+}
+
+static uint32_t loopbackRandom(struct SplitLoopback *loop)
+{
+    loop->seed = loop->seed * 1664525u + 1013904223u;
+    return loop->seed >> 16;
+}
+
+static bool loopbackSend(void *ctx, const uint8_t *frame, size_t length)
+{
+    struct SplitLoopbackEnd *end = (struct SplitLoopbackEnd *)ctx;
+    struct SplitLoopback *loop = end->loop;
+    struct SplitLoopbackQueue *queue = &loop->queue[end->side ^ 1];
+    struct SplitLoopbackFrame *slot = NULL, *previous = NULL, swap;
+
+    if (length > SPLIT_FRAME_MAX || queue->count >= SPLIT_LOOPBACK_DEPTH)
+    {
+        return false;
+    }
+    if (loopbackRandom(loop) % 100 < loop->lossPercent)
+    {
+        // Looks sent from here, like a frame that died on the wire
+        loop->lost++;
+        return true;
+    }
+
+    slot = &queue->frames[(queue->head + queue->count++) % SPLIT_LOOPBACK_DEPTH];
+    slot->pending.length = (uint8_t)length;
+    memcpy(slot->pending.frame, frame, length);
+    slot->dueUs = loop->nowUs + loop->delayUs + (loop->jitterUs ? loopbackRandom(loop) % (loop->jitterUs + 1) : 0);
+
+    if (loopbackRandom(loop) % 100 < loop->corruptPercent)
+    {
+        slot->pending.frame[loopbackRandom(loop) % length] ^= 0x10;
+        loop->corrupted++;
+    }
+    if (queue->count > 1 && loopbackRandom(loop) % 100 < loop->reorderPercent)
+    {
+        previous = &queue->frames[(queue->head + queue->count - 2) % SPLIT_LOOPBACK_DEPTH];
+        swap = *previous;
+        *previous = *slot;
+        *slot = swap;
+        loop->reordered++;
+    }
+    return true;
+}
+
+static size_t loopbackReceive(void *ctx, uint8_t *frame, size_t max)
+{
+    struct SplitLoopbackEnd *end = (struct SplitLoopbackEnd *)ctx;
+    struct SplitLoopbackQueue *queue = &end->loop->queue[end->side];
+    struct SplitLoopbackFrame *slot = NULL;
+
+    if (queue->count == 0)
+    {
+        return 0;
+    }
+
+    // Frames leave in queue order, a late one holds back the ones behind it like a wire would
+    slot = &queue->frames[queue->head];
+    if ((int32_t)(end->loop->nowUs - slot->dueUs) < 0)
+    {
+        return 0;
+    }
+    queue->head = (queue->head + 1) % SPLIT_LOOPBACK_DEPTH;
+    queue->count--;
+    if (slot->pending.length > max)
+    {
+        return 0;
+    }
+    memcpy(frame, slot->pending.frame, slot->pending.length);
+    return slot->pending.length;
+}
+
+void splitLoopbackInit(struct SplitLoopback *loop, struct SplitTransport *a, struct SplitTransport *b)
+{
+    memset(loop, 0, sizeof(*loop));
+    loop->seed = 1;
+
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        loop->end[i].loop = loop;
+        loop->end[i].side = i;
+    }
+
+    a->ctx = &loop->end[0];
+    a->send = loopbackSend;
+    a->receive = loopbackReceive;
+    b->ctx = &loop->end[1];
+    b->send = loopbackSend;
+    b->receive = loopbackReceive;
+}
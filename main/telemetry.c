@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetry.h"
+#include "split_link.h"
+
+struct Telemetry telemetry;
+
+void telemetryInit(struct Telemetry *t, uint16_t periodMs)
+{
+    memset(t, 0, sizeof(*t));
+    t->periodMs = periodMs;
+}
+
+// Returns the slot of the task, -1 once the table is full
+int telemetryAddTask(struct Telemetry *t, const char *name)
+{
+    for (int i = 0; i < t->taskCount; i++)
+    {
+        if (strncmp(t->taskNames[i], name, TELEMETRY_TASK_NAME - 1) == 0)
+        {
+            return i;
+        }
+    }
+    if (t->taskCount == TELEMETRY_TASKS)
+    {
+        return -1;
+    }
+    snprintf(t->taskNames[t->taskCount], TELEMETRY_TASK_NAME, "%s", name);
+    return t->taskCount++;
+}
+
+uint32_t telemetryTotal(const struct Telemetry *t, enum TelemetryCounter counter)
+{
+    uint32_t total = 0;
+
+    for (int core = 0; core < TELEMETRY_CORES; core++)
+    {
+        total += __atomic_load_n(&t->counters[core][counter], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+// Single writer
+void telemetryPush(struct Telemetry *t, const struct TelemetrySample *sample)
+{
+    t->samples[t->written % TELEMETRY_SAMPLES] = *sample;
+    __atomic_store_n(&t->written, t->written + 1, __ATOMIC_RELEASE);
+}
+
+static uint8_t *put16(uint8_t *out, uint16_t value)
+{
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    return out + 2;
+}
+
+static uint8_t *put32(uint8_t *out, uint32_t value)
+{
+    out = put16(out, (uint16_t)value);
+    return put16(out, (uint16_t)(value >> 16));
+}
+
+static uint8_t *putSample(uint8_t *out, const struct TelemetrySample *sample, uint8_t taskCount)
+{
+    out = put32(out, sample->timeMs);
+    for (int i = 0; i < TELEMETRY_COUNTERS; i++)
+    {
+        out = put32(out, sample->counters[i]);
+    }
+    for (int i = 0; i < TELEMETRY_GAUGES; i++)
+    {
+        out = put32(out, sample->gauges[i]);
+    }
+    for (int i = 0; i < taskCount; i++)
+    {
+        out = put16(out, sample->taskPermille[i]);
+    }
+    return out;
+}
+
+/*
+Frame is the sync bytes, a 16 bit payload length, the payload and a CRC16 of
+the payload, all little endian. Payload starts with a fixed header, then name
+and free stack of every task, then the samples oldest first.
+Returns the frame length, 0 if it does not fit.
+*/
+size_t telemetryEncode(const struct Telemetry *t, uint8_t *frame, size_t size)
+{
+    uint8_t taskCount = t->taskCount;
+    size_t sampleBytes = 4 + 4 * TELEMETRY_COUNTERS + 4 * TELEMETRY_GAUGES + 2 * (size_t)taskCount;
+    uint8_t *payload = &frame[TELEMETRY_SYNC_LENGTH + 2];
+    uint8_t *samples = &payload[TELEMETRY_HEADER_BYTES + taskCount * (TELEMETRY_TASK_NAME + 4)];
+    uint8_t *out = samples;
+    uint32_t end = __atomic_load_n(&t->written, __ATOMIC_ACQUIRE);
+    // The slot after the newest one may be getting written already
+    uint32_t first = end > TELEMETRY_SAMPLES - 1 ? end - (TELEMETRY_SAMPLES - 1) : 0;
+    uint32_t after = 0, valid = 0, skip = 0;
+    size_t length = 0;
+
+    if (size < TELEMETRY_FRAME_MAX)
+    {
+        return 0;
+    }
+
+    for (uint32_t i = first; i < end; i++)
+    {
+        out = putSample(out, &t->samples[i % TELEMETRY_SAMPLES], taskCount);
+    }
+    // Anything the writer got to while we copied replaced the oldest samples
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = __atomic_load_n(&t->written, __ATOMIC_RELAXED);
+    valid = after >= TELEMETRY_SAMPLES ? after - TELEMETRY_SAMPLES + 1 : 0;
+    if (valid > first)
+    {
+        skip = (valid < end ? valid : end) - first;
+        memmove(samples, &samples[skip * sampleBytes], (end - first - skip) * sampleBytes);
+        first += skip;
+    }
+
+    out = payload;
+    *out++ = TELEMETRY_VERSION;
+    *out++ = TELEMETRY_COUNTERS;
+    *out++ = TELEMETRY_GAUGES;
+    *out++ = taskCount;
+    out = put16(out, t->periodMs);
+    out = put16(out, (uint16_t)(end - first));
+    out = put32(out, end);
+    *out++ = TELEMETRY_TASK_NAME;
+    memset(out, 0, 3);
+    out += 3;
+    for (int i = 0; i < taskCount; i++)
+    {
+        memcpy(out, t->taskNames[i], TELEMETRY_TASK_NAME);
+        out = put32(out + TELEMETRY_TASK_NAME, t->taskStackFree[i]);
+    }
+
+    length = (size_t)(samples - payload) + (end - first) * sampleBytes;
+    memcpy(frame, TELEMETRY_SYNC, TELEMETRY_SYNC_LENGTH);
+    put16(&frame[TELEMETRY_SYNC_LENGTH], (uint16_t)length);
+    put16(&payload[length], splitCrc16(payload, length));
+    return TELEMETRY_SYNC_LENGTH + 2 + length + 2;
+}
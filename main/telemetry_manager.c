@@ -0,0 +1,107 @@
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "telemetry_manager.h"
+#include "comms_manager.h"
+#include "gpio_manager.h"
+#include "transport_usb.h"
+
+const char *TAG_TELEMETRY = "telemetry";
+
+static struct EventRing *eventRing = NULL;
+static TaskHandle_t watched[TELEMETRY_TASKS] = {0};
+static configRUN_TIME_COUNTER_TYPE lastRuntime[TELEMETRY_TASKS] = {0};
+static uint64_t lastSampleUs = 0;
+// Only the comms task builds snapshots
+static uint8_t frame[TELEMETRY_FRAME_MAX];
+
+// Watched tasks must never be deleted, the handle is read on every sample
+void telemetryWatchTask(TaskHandle_t task)
+{
+    int slot = telemetryAddTask(&telemetry, pcTaskGetName(task));
+
+    if (slot < 0)
+    {
+        ESP_LOGW(TAG_TELEMETRY, "No room to watch %s", pcTaskGetName(task));
+        return;
+    }
+    watched[slot] = task;
+    lastRuntime[slot] = ulTaskGetRunTimeCounter(task);
+}
+
+// The calling task takes the samples, idle tasks are watched for the load of each core
+void telemetryStart(struct EventRing *ring)
+{
+    telemetryInit(&telemetry, KB_TELEMETRY_PERIOD_MS);
+    eventRing = ring;
+    lastSampleUs = esp_timer_get_time();
+    telemetryWatchTask(xTaskGetCurrentTaskHandle());
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        telemetryWatchTask(xTaskGetIdleTaskHandleForCore(core));
+    }
+}
+
+/*
+Reads counters other tasks keep anyway, nothing here locks or waits. Run time
+counters tick in microseconds, the same clock as the sample period.
+*/
+void telemetrySampleNow(void)
+{
+    struct TelemetrySample sample = {0};
+    struct ReportStats reports;
+    struct ScanTiming matrix, joystick;
+    uint64_t nowUs = esp_timer_get_time();
+    uint64_t elapsedUs = nowUs - lastSampleUs;
+    configRUN_TIME_COUNTER_TYPE runtime = 0;
+    uint32_t permille = 0;
+
+    getReportStats(&reports);
+    getScanTimingStats(&matrix, &joystick);
+
+    sample.timeMs = (uint32_t)(nowUs / 1000);
+    sample.counters[TELEMETRY_MATRIX_SCANS] = telemetryTotal(&telemetry, TELEMETRY_MATRIX_SCANS);
+    sample.counters[TELEMETRY_REPORTS_COMPLETED] = telemetryTotal(&telemetry, TELEMETRY_REPORTS_COMPLETED);
+    sample.counters[TELEMETRY_KEYBOARD_SENT] = reports.keyboardSent;
+    sample.counters[TELEMETRY_MOUSE_SENT] = reports.mouseSent;
+    sample.counters[TELEMETRY_REPORTS_MERGED] = reports.merged;
+    sample.counters[TELEMETRY_REPORT_QUEUE_FULL] = reports.queueFull;
+    sample.counters[TELEMETRY_RING_DEFERRED] = eventRing->deferred;
+
+    sample.gauges[TELEMETRY_SCAN_PERIOD_US] = scanTimingAvgPeriodUs(&matrix);
+    sample.gauges[TELEMETRY_RING_HIGH_WATER] = eventRing->highWater;
+    sample.gauges[TELEMETRY_KEYBOARD_QUEUE_HIGH_WATER] = reports.keyboardHighWater;
+    sample.gauges[TELEMETRY_MOUSE_QUEUE_HIGH_WATER] = reports.mouseHighWater;
+    sample.gauges[TELEMETRY_HEAP_FREE] = esp_get_free_heap_size();
+    sample.gauges[TELEMETRY_HEAP_MIN] = esp_get_minimum_free_heap_size();
+
+    for (int i = 0; i < telemetry.taskCount; i++)
+    {
+        runtime = ulTaskGetRunTimeCounter(watched[i]);
+        permille = elapsedUs > 0 ? (uint32_t)((uint64_t)(runtime - lastRuntime[i]) * 1000 / elapsedUs) : 0;
+        sample.taskPermille[i] = (uint16_t)(permille > 1000 ? 1000 : permille);
+        lastRuntime[i] = runtime;
+    }
+    lastSampleUs = nowUs;
+
+    telemetryPush(&telemetry, &sample);
+}
+
+// Free stack needs a walk over every stack, so it is only looked at when someone asks
+void telemetrySendSnapshot(void)
+{
+    size_t length = 0;
+
+    for (int i = 0; i < telemetry.taskCount; i++)
+    {
+        telemetry.taskStackFree[i] = uxTaskGetStackHighWaterMark(watched[i]);
+    }
+    length = telemetryEncode(&telemetry, frame, sizeof(frame));
+    if (length == 0 || !usbConsoleWrite(frame, length))
+    {
+        ESP_LOGW(TAG_TELEMETRY, "Snapshot not sent");
+    }
+}
@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include "timer_wheel.h"
+
+#define SLOT_OF(us) (((us) / TIMER_WHEEL_TICK_US) & (TIMER_WHEEL_SLOTS - 1))
+
+void timerWheelInit(struct TimerWheel *wheel, uint32_t nowUs)
+{
+    memset(wheel->timers, 0, sizeof(wheel->timers));
+    memset(wheel->slots, TIMER_WHEEL_NONE, sizeof(wheel->slots));
+    wheel->tick = nowUs / TIMER_WHEEL_TICK_US;
+    wheel->lastUs = nowUs;
+}
+
+void timerWheelCancel(struct TimerWheel *wheel, uint8_t id)
+{
+    struct WheelTimer *timer = &wheel->timers[id];
+    uint8_t *link = NULL;
+
+    if (!timer->armed)
+    {
+        return;
+    }
+    link = &wheel->slots[SLOT_OF(timer->dueUs)];
+    while (*link != id)
+    {
+        link = &wheel->timers[*link].next;
+    }
+    *link = timer->next;
+    timer->armed = false;
+}
+
+// Re-arming moves the timer, a due time in the past fires on the next advance
+void timerWheelArm(struct TimerWheel *wheel, uint8_t id, uint32_t dueUs)
+{
+    struct WheelTimer *timer = &wheel->timers[id];
+    uint8_t *slot = NULL;
+
+    timerWheelCancel(wheel, id);
+    // Rounded up to a tick, never fires early
+    dueUs = ((dueUs + TIMER_WHEEL_TICK_US - 1) / TIMER_WHEEL_TICK_US) * TIMER_WHEEL_TICK_US;
+    if ((int32_t)(dueUs - wheel->lastUs) < 0)
+    {
+        dueUs = wheel->lastUs;
+    }
+    slot = &wheel->slots[SLOT_OF(dueUs)];
+    timer->dueUs = dueUs;
+    timer->next = *slot;
+    timer->armed = true;
+    *slot = id;
+}
+
+bool timerWheelArmed(const struct TimerWheel *wheel, uint8_t id)
+{
+    return wheel->timers[id].armed;
+}
+
+// Disarms and returns every timer due by nowUs
+uint8_t timerWheelAdvance(struct TimerWheel *wheel, uint32_t nowUs, uint8_t expired[TIMER_WHEEL_TIMERS])
+{
+    uint32_t nowTick = nowUs / TIMER_WHEEL_TICK_US;
+    uint32_t ticks = nowTick - wheel->tick;
+    uint8_t count = 0;
+    uint8_t id = 0, next = 0;
+
+    // Callers may pass event times slightly behind the last advance
+    if ((int32_t)(nowUs - wheel->lastUs) < 0)
+    {
+        return 0;
+    }
+    // A full lap already visits every slot once, this also covers the wrap of the µs clock
+    if (ticks >= TIMER_WHEEL_SLOTS)
+    {
+        ticks = TIMER_WHEEL_SLOTS - 1;
+        wheel->tick = nowTick - ticks;
+    }
+    for (uint32_t t = 0; t <= ticks; t++)
+    {
+        for (id = wheel->slots[(wheel->tick + t) & (TIMER_WHEEL_SLOTS - 1)]; id != TIMER_WHEEL_NONE; id = next)
+        {
+            next = wheel->timers[id].next;
+            if ((int32_t)(nowUs - wheel->timers[id].dueUs) >= 0)
+            {
+                timerWheelCancel(wheel, id);
+                expired[count++] = id;
+            }
+        }
+    }
+    wheel->tick = nowTick;
+    wheel->lastUs = nowUs;
+    return count;
+}
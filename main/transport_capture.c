@@ -0,0 +1,165 @@
+#include <string.h>
+
+#include "transport_capture.h"
+
+static bool captureInit(void *ctx, TransportCompleteFn complete, void *owner)
+{
+    struct CaptureTransport *cap = (struct CaptureTransport *)ctx;
+
+    cap->complete = complete;
+    cap->owner = owner;
+    cap->connected = true;
+    cap->busy[REPORT_KEYBOARD] = cap->busy[REPORT_MOUSE] = false;
+    return true;
+}
+
+static bool captureConnected(void *ctx)
+{
+    return ((struct CaptureTransport *)ctx)->connected;
+}
+
+static bool captureReady(void *ctx, enum ReportType type)
+{
+    struct CaptureTransport *cap = (struct CaptureTransport *)ctx;
+
+    return cap->connected && !cap->suspended && !cap->busy[type];
+}
+
+static struct CaptureRecord *captureStart(struct CaptureTransport *cap, enum ReportType type)
+{
+    struct CaptureRecord *record = NULL;
+
+    if (!captureReady(cap, type))
+    {
+        cap->stats.refused++;
+        return NULL;
+    }
+
+    record = &cap->records[cap->count & (CAPTURE_RECORDS - 1)];
+    record->type = type;
+    record->sentUs = cap->nowUs;
+    record->completeUs = 0;
+
+    cap->inflight[type] = cap->count++;
+    cap->busy[type] = true;
+    cap->busyUntilUs[type] = cap->intervalUs ? (cap->nowUs / cap->intervalUs + 1) * cap->intervalUs : cap->nowUs;
+    return record;
+}
+
+static bool captureSendKeyboard(void *ctx, const struct KeyboardData *data)
+{
+    struct CaptureTransport *cap = (struct CaptureTransport *)ctx;
+    struct CaptureRecord *record = captureStart(cap, REPORT_KEYBOARD);
+
+    if (record == NULL)
+    {
+        return false;
+    }
+    record->keyboard = *data;
+    cap->stats.keyboardReports++;
+    return true;
+}
+
+static bool captureSendPointer(void *ctx, const struct MouseData *data)
+{
+    struct CaptureTransport *cap = (struct CaptureTransport *)ctx;
+    struct CaptureRecord *record = captureStart(cap, REPORT_MOUSE);
+
+    if (record == NULL)
+    {
+        return false;
+    }
+    record->mouse = *data;
+    cap->stats.mouseReports++;
+    return true;
+}
+
+static void captureSuspend(void *ctx, bool suspended)
+{
+    struct CaptureTransport *cap = (struct CaptureTransport *)ctx;
+
+    cap->suspended = suspended;
+    if (suspended)
+    {
+        cap->stats.suspends++;
+    }
+}
+
+static void captureDeinit(void *ctx)
+{
+    struct CaptureTransport *cap = (struct CaptureTransport *)ctx;
+
+    cap->connected = false;
+    cap->complete = NULL;
+}
+
+void captureTransportInit(struct CaptureTransport *cap, uint32_t intervalUs)
+{
+    memset(cap, 0, sizeof(*cap));
+    cap->intervalUs = intervalUs;
+    cap->stats.minLatencyUs = UINT32_MAX;
+
+    cap->transport.name = "capture";
+    cap->transport.ctx = cap;
+    cap->transport.init = captureInit;
+    cap->transport.connected = captureConnected;
+    cap->transport.ready = captureReady;
+    cap->transport.sendKeyboard = captureSendKeyboard;
+    cap->transport.sendPointer = captureSendPointer;
+    cap->transport.suspend = captureSuspend;
+    cap->transport.deinit = captureDeinit;
+}
+
+static void captureFinish(struct CaptureTransport *cap, enum ReportType type)
+{
+    struct CaptureRecord *record = &cap->records[cap->inflight[type] & (CAPTURE_RECORDS - 1)];
+    uint32_t scanUs = type == REPORT_MOUSE ? record->mouse.scan_us : record->keyboard.scan_us;
+    uint32_t latency = 0;
+
+    record->completeUs = cap->busyUntilUs[type];
+    latency = record->completeUs - scanUs;
+    cap->stats.totalLatencyUs += latency;
+    if (latency < cap->stats.minLatencyUs)
+    {
+        cap->stats.minLatencyUs = latency;
+    }
+    if (latency > cap->stats.maxLatencyUs)
+    {
+        cap->stats.maxLatencyUs = latency;
+    }
+    cap->busy[type] = false;
+}
+
+// Moves the emulated host clock, every endpoint polled by then completes
+void captureTransportAdvance(struct CaptureTransport *cap, uint32_t nowUs)
+{
+    cap->nowUs = nowUs;
+    for (int type = REPORT_KEYBOARD; type <= REPORT_MOUSE; type++)
+    {
+        if (cap->busy[type] && (int32_t)(nowUs - cap->busyUntilUs[type]) >= 0)
+        {
+            captureFinish(cap, (enum ReportType)type);
+            if (cap->complete != NULL)
+            {
+                cap->complete(cap->owner, (enum ReportType)type);
+            }
+        }
+    }
+}
+
+// Index counts from the first report ever captured, older ones are overwritten
+const struct CaptureRecord *captureTransportRecord(const struct CaptureTransport *cap, uint32_t index)
+{
+    if (index >= cap->count || cap->count - index > CAPTURE_RECORDS)
+    {
+        return NULL;
+    }
+    return &cap->records[index & (CAPTURE_RECORDS - 1)];
+}
+
+void captureTransportClear(struct CaptureTransport *cap)
+{
+    cap->count = 0;
+    memset(&cap->stats, 0, sizeof(cap->stats));
+    cap->stats.minLatencyUs = UINT32_MAX;
+}
@@ -0,0 +1,164 @@
+#include <string.h>
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "dongle_link.h"
+#include "espnow_radio.h"
+#include "transport_espnow.h"
+
+static struct DongleSender sender = {0};
+static SemaphoreHandle_t senderLock = NULL;
+static esp_timer_handle_t copyTimer = NULL;
+static TransportCompleteFn completeCallback = NULL;
+static void *completeOwner = NULL;
+static volatile bool paused = false;
+static bool running = false;
+
+// Arms the timer for the next copy or keepalive, call with senderLock held
+static void scheduleSender(uint32_t nowUs)
+{
+    uint32_t dueUs = 0;
+    int32_t waitUs = 0;
+
+    dongleSenderNextDue(&sender, &dueUs);
+    waitUs = (int32_t)(dueUs - nowUs);
+    esp_timer_stop(copyTimer);
+    esp_timer_start_once(copyTimer, waitUs > 0 ? (uint64_t)waitUs : 1);
+}
+
+// Runs in the esp_timer task
+static void copyTimerCallback(void *arg)
+{
+    uint32_t nowUs = (uint32_t)esp_timer_get_time();
+    bool freed = false;
+
+    xSemaphoreTake(senderLock, portMAX_DELAY);
+    if (!running)
+    {
+        xSemaphoreGive(senderLock);
+        return;
+    }
+    freed = dongleSenderPoll(&sender, nowUs);
+    scheduleSender(nowUs);
+    xSemaphoreGive(senderLock);
+
+    // Called without senderLock, the pipeline takes its own lock and sends again
+    if (freed && completeCallback != NULL)
+    {
+        completeCallback(completeOwner, REPORT_KEYBOARD);
+    }
+}
+
+static bool espnowInit(void *ctx, TransportCompleteFn complete, void *owner)
+{
+    const esp_timer_create_args_t timerArgs = {
+        .callback = copyTimerCallback,
+        .name = "dongleCopy",
+    };
+
+    if (senderLock == NULL)
+    {
+        senderLock = xSemaphoreCreateMutex();
+        configASSERT(senderLock);
+        ESP_ERROR_CHECK(esp_timer_create(&timerArgs, &copyTimer));
+    }
+    if (espnowRadioInit(NULL) != ESP_OK)
+    {
+        return false;
+    }
+
+    completeCallback = complete;
+    completeOwner = owner;
+    paused = false;
+
+    xSemaphoreTake(senderLock, portMAX_DELAY);
+    // Fresh session so the dongle does not take our sequence numbers for old copies
+    dongleSenderInit(&sender, getEspnowRadio(), (uint8_t)esp_random());
+    running = true;
+    scheduleSender((uint32_t)esp_timer_get_time());
+    xSemaphoreGive(senderLock);
+    return true;
+}
+
+// No ACKs, so there is no way to tell if the dongle listens
+static bool espnowConnected(void *ctx)
+{
+    return running;
+}
+
+static bool espnowReady(void *ctx, enum ReportType type)
+{
+    bool room = false;
+
+    if (paused || !running)
+    {
+        return false;
+    }
+    xSemaphoreTake(senderLock, portMAX_DELAY);
+    room = dongleSenderHasRoom(&sender);
+    xSemaphoreGive(senderLock);
+    return room;
+}
+
+static bool espnowSendKeyboard(void *ctx, const struct KeyboardData *data)
+{
+    uint32_t nowUs = (uint32_t)esp_timer_get_time();
+    bool sent = false;
+
+    xSemaphoreTake(senderLock, portMAX_DELAY);
+    sent = dongleSenderKeyboard(&sender, data, nowUs);
+    scheduleSender(nowUs);
+    xSemaphoreGive(senderLock);
+    return sent;
+}
+
+static bool espnowSendPointer(void *ctx, const struct MouseData *data)
+{
+    uint32_t nowUs = (uint32_t)esp_timer_get_time();
+    bool sent = false;
+
+    xSemaphoreTake(senderLock, portMAX_DELAY);
+    sent = dongleSenderPointer(&sender, data, nowUs);
+    scheduleSender(nowUs);
+    xSemaphoreGive(senderLock);
+    return sent;
+}
+
+static void espnowSuspend(void *ctx, bool suspended)
+{
+    paused = suspended;
+}
+
+static void espnowDeinit(void *ctx)
+{
+    xSemaphoreTake(senderLock, portMAX_DELAY);
+    running = false;
+    completeCallback = NULL;
+    esp_timer_stop(copyTimer);
+    xSemaphoreGive(senderLock);
+    espnowRadioDeinit();
+}
+
+static const struct Transport espnowTransport = {
+    .name = "ESPNOW",
+    .ctx = NULL,
+    .init = espnowInit,
+    .connected = espnowConnected,
+    .ready = espnowReady,
+    .sendKeyboard = espnowSendKeyboard,
+    .sendPointer = espnowSendPointer,
+    .suspend = espnowSuspend,
+    .deinit = espnowDeinit,
+};
+
+const struct Transport *getEspnowTransport()
+{
+    return &espnowTransport;
+}
+
+void getDongleSenderStats(struct DongleSenderStats *stats)
+{
+    *stats = sender.stats;
+}
@@ -0,0 +1,627 @@
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "tinyusb.h"
+#include "class/hid/hid_device.h"
+#include "tusb_cdc_acm.h"
+#include "tusb_console.h"
+#include "esp_timer.h"
+
+#include "comms_manager.h"
+#include "latency_stats.h"
+#include "transport_usb.h"
+#include "lock_state.h"
+#include "telemetry.h"
+#include "dlog_manager.h"
+#include "keymap_store.h"
+
+/* A combination of interfaces must have a unique product id, since PC will save device driver after the first plug.
+ * Same VID/PID with different interface e.g MSC (first), then CDC (later) will possibly cause system error on PC.
+ *
+ * Auto ProductID layout's Bitmap:
+ *   [MSB]         HID split | VENDOR | HID | CDC          [LSB]
+ */
+#define _PID_MAP(itf, n) ((CFG_TUD_##itf ? 1 : 0) << (n))
+#define USB_PID (0x4000 | _PID_MAP(CDC, 0) | _PID_MAP(HID, 1) | _PID_MAP(VENDOR, 2) | (USB_HID_SPLIT_INTERFACES << 3))
+#define USB_VID 0x303a
+#define USB_BCD 0x200
+
+#if USB_HID_SPLIT_INTERFACES
+#define HID_ITF_COUNT 2
+#define HID_INSTANCE_KEYBOARD 0
+#define HID_INSTANCE_MOUSE 1
+#define REPORT_ID_MOUSE 0 // alone on its interface, no report ID needed
+#else
+#define HID_ITF_COUNT 1
+#define HID_INSTANCE_KEYBOARD 0
+#define HID_INSTANCE_MOUSE 0
+#define REPORT_ID_MOUSE HID_ITF_PROTOCOL_MOUSE
+#endif
+
+_Static_assert(CFG_TUD_HID >= HID_ITF_COUNT, "CONFIG_TINYUSB_HID_COUNT is lower than the HID interface count");
+
+#define TUSB_DESC_TOTAL_LEN (TUD_CONFIG_DESC_LEN + HID_ITF_COUNT * TUD_HID_DESC_LEN + TUD_CDC_DESC_LEN)
+
+#define REPORT_ID_NKRO 3
+
+// Modifier byte followed by one bit per keycode, same layout as KeyboardData bitmap
+#define TUD_HID_REPORT_DESC_NKRO(...) \
+    HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP), \
+    HID_USAGE(HID_USAGE_DESKTOP_KEYBOARD), \
+    HID_COLLECTION(HID_COLLECTION_APPLICATION), \
+        __VA_ARGS__ \
+        HID_USAGE_PAGE(HID_USAGE_PAGE_KEYBOARD), \
+        HID_USAGE_MIN(224), \
+        HID_USAGE_MAX(231), \
+        HID_LOGICAL_MIN(0), \
+        HID_LOGICAL_MAX(1), \
+        HID_REPORT_COUNT(8), \
+        HID_REPORT_SIZE(1), \
+        HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
+        HID_USAGE_MIN(0), \
+        HID_USAGE_MAX(KB_NKRO_BYTES * 8 - 1), \
+        HID_REPORT_COUNT(KB_NKRO_BYTES * 8), \
+        HID_REPORT_SIZE(1), \
+        HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
+    HID_COLLECTION_END
+
+// Same as the TinyUSB mouse but with 16 bit X/Y, matches MouseData
+#define TUD_HID_REPORT_DESC_MOUSE16(...) \
+    HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP), \
+    HID_USAGE(HID_USAGE_DESKTOP_MOUSE), \
+    HID_COLLECTION(HID_COLLECTION_APPLICATION), \
+        __VA_ARGS__ \
+        HID_USAGE(HID_USAGE_DESKTOP_POINTER), \
+        HID_COLLECTION(HID_COLLECTION_PHYSICAL), \
+            HID_USAGE_PAGE(HID_USAGE_PAGE_BUTTON), \
+            HID_USAGE_MIN(1), \
+            HID_USAGE_MAX(5), \
+            HID_LOGICAL_MIN(0), \
+            HID_LOGICAL_MAX(1), \
+            HID_REPORT_COUNT(5), \
+            HID_REPORT_SIZE(1), \
+            HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
+            HID_REPORT_COUNT(1), \
+            HID_REPORT_SIZE(3), \
+            HID_INPUT(HID_CONSTANT), \
+            HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP), \
+            HID_USAGE(HID_USAGE_DESKTOP_X), \
+            HID_USAGE(HID_USAGE_DESKTOP_Y), \
+            HID_LOGICAL_MIN_N(-32767, 2), \
+            HID_LOGICAL_MAX_N(32767, 2), \
+            HID_REPORT_COUNT(2), \
+            HID_REPORT_SIZE(16), \
+            HID_INPUT(HID_DATA | HID_VARIABLE | HID_RELATIVE), \
+            HID_USAGE(HID_USAGE_DESKTOP_WHEEL), \
+            HID_LOGICAL_MIN(0x81), \
+            HID_LOGICAL_MAX(0x7f), \
+            HID_REPORT_COUNT(1), \
+            HID_REPORT_SIZE(8), \
+            HID_INPUT(HID_DATA | HID_VARIABLE | HID_RELATIVE), \
+            HID_USAGE_PAGE(HID_USAGE_PAGE_CONSUMER), \
+            HID_USAGE_N(HID_USAGE_CONSUMER_AC_PAN, 2), \
+            HID_LOGICAL_MIN(0x81), \
+            HID_LOGICAL_MAX(0x7f), \
+            HID_REPORT_COUNT(1), \
+            HID_REPORT_SIZE(8), \
+            HID_INPUT(HID_DATA | HID_VARIABLE | HID_RELATIVE), \
+        HID_COLLECTION_END, \
+    HID_COLLECTION_END
+
+typedef struct TU_ATTR_PACKED
+{
+    uint8_t modifier;
+    uint8_t bitmap[KB_NKRO_BYTES];
+} hid_nkro_report_t;
+
+typedef struct TU_ATTR_PACKED
+{
+    uint8_t buttons;
+    int16_t x;
+    int16_t y;
+    int8_t wheel;
+    int8_t pan;
+} hid_mouse16_report_t;
+
+enum KeyboardReportMode
+{
+    KB_REPORT_6KRO,
+    KB_REPORT_NKRO,
+    KB_REPORT_BOOT,
+};
+
+const char *TAG_USB = "usb";
+
+static volatile bool nkroEnabled = true;
+static volatile uint8_t hidProtocol = HID_PROTOCOL_REPORT;
+// Report format the host last saw keys in, starts as the power-on mode and is reset on every mount
+static volatile enum KeyboardReportMode lastKeyboardMode = KB_REPORT_NKRO;
+static struct LockState lockState = {0};
+
+static TransportCompleteFn completeCallback = NULL;
+static void *completeOwner = NULL;
+static volatile bool paused = false;
+static bool installed = false;
+
+static void releaseHost();
+static enum KeyboardReportMode getKeyboardReportMode();
+
+#define RELEASE_KEYBOARD 0x1
+#define RELEASE_MOUSE 0x2
+
+// Empty reports the host still has to get after the pipeline moved to another transport
+static volatile uint8_t releasePending = 0;
+
+// Report currently owned by each endpoint, used for latency tracing
+static uint32_t inflightScanUs[HID_ITF_COUNT] = {0};
+static uint32_t inflightSendUs[HID_ITF_COUNT] = {0};
+static bool inflight[HID_ITF_COUNT] = {0};
+
+#if USB_HID_SPLIT_INTERFACES
+const uint8_t hid_keyboard_report_descriptor[] = {
+    TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(HID_ITF_PROTOCOL_KEYBOARD)),
+    TUD_HID_REPORT_DESC_NKRO(HID_REPORT_ID(REPORT_ID_NKRO))};
+
+const uint8_t hid_mouse_report_descriptor[] = {
+    TUD_HID_REPORT_DESC_MOUSE16()};
+#else
+const uint8_t hid_report_descriptor[] = {
+    TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(HID_ITF_PROTOCOL_KEYBOARD)),
+    TUD_HID_REPORT_DESC_MOUSE16(HID_REPORT_ID(HID_ITF_PROTOCOL_MOUSE)),
+    TUD_HID_REPORT_DESC_NKRO(HID_REPORT_ID(REPORT_ID_NKRO))};
+#endif
+
+tusb_desc_device_t const desc_device =
+    {
+        .bLength = sizeof(tusb_desc_device_t),
+        .bDescriptorType = TUSB_DESC_DEVICE,
+        .bcdUSB = USB_BCD,
+        .bDeviceClass = 0x00,
+        .bDeviceSubClass = 0x00,
+        .bDeviceProtocol = 0x00,
+        .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+
+        .idVendor = USB_VID,
+        .idProduct = USB_PID,
+        .bcdDevice = 0x0100,
+
+        .iManufacturer = 0x01,
+        .iProduct = 0x02,
+        .iSerialNumber = 0x03,
+
+        .bNumConfigurations = 0x01};
+
+const char *hid_string_descriptor[7] = {
+    // array of pointer to string descriptors
+    (char[]){0x09, 0x04},        // 0: supported language is English (0x0409)
+    "RKBoard",                   // 1: Manufacturer
+    "RKBoard v1.0",              // 2: Product
+    "C0FFEE",                    // 3: Serials, should use chip ID
+    "Split keyboard with mouse", // 4: HID (keyboard when split)
+    "RKBoard debug",             // 5: CDC debug channel
+    "RKBoard pointer",           // 6: HID pointer when split
+};
+
+enum
+{
+    ITF_NUM_CDC = 0,
+    ITF_NUM_CDC_DATA,
+    ITF_HID,
+#if USB_HID_SPLIT_INTERFACES
+    ITF_HID_MOUSE,
+#endif
+    ITF_TOTAL,
+};
+
+static const uint8_t hid_configuration_descriptor[] = {
+    // Configuration number, interface count, string index, total length, attribute, power in mA
+    TUD_CONFIG_DESCRIPTOR(1, ITF_TOTAL, 0, TUSB_DESC_TOTAL_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 200),
+
+#if USB_HID_SPLIT_INTERFACES
+    // Interface number, string index, boot protocol, report descriptor len, EP In address, size & polling interval
+    TUD_HID_DESCRIPTOR(ITF_HID, 4, HID_ITF_PROTOCOL_KEYBOARD, sizeof(hid_keyboard_report_descriptor), 0x81, 64, USB_HID_POLL_INTERVAL_MS),
+    TUD_HID_DESCRIPTOR(ITF_HID_MOUSE, 6, HID_ITF_PROTOCOL_NONE, sizeof(hid_mouse_report_descriptor), 0x82, 16, USB_HID_POLL_INTERVAL_MS),
+#else
+    // Interface number, string index, boot protocol, report descriptor len, EP In address, size & polling interval
+    TUD_HID_DESCRIPTOR(ITF_HID, 4, HID_ITF_PROTOCOL_NONE, sizeof(hid_report_descriptor), 0x81, 64, USB_HID_POLL_INTERVAL_MS),
+#endif
+
+    // Interface number, string index, EP notification address and size, EP data address (out, in) and size.
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 5, 0x83, 8, 0x04, 0x84, 64),
+};
+
+_Static_assert(sizeof(hid_configuration_descriptor) == TUSB_DESC_TOTAL_LEN, "Configuration descriptor length mismatch");
+
+uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance)
+{
+#if USB_HID_SPLIT_INTERFACES
+    return instance == HID_INSTANCE_MOUSE ? hid_mouse_report_descriptor : hid_keyboard_report_descriptor;
+#else
+    // We use only one interface and one HID report descriptor, so we can ignore parameter 'instance'
+    return hid_report_descriptor;
+#endif
+}
+
+uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t *buffer, uint16_t reqlen)
+{
+    (void)instance;
+    (void)report_id;
+    (void)report_type;
+    (void)buffer;
+    (void)reqlen;
+
+    return 0;
+}
+
+// Only output report is the keyboard LED state, boot protocol sends it without a report ID
+void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const *buffer, uint16_t bufsize)
+{
+    uint8_t expectedId = hidProtocol == HID_PROTOCOL_BOOT ? 0 : HID_ITF_PROTOCOL_KEYBOARD;
+
+    if (instance != HID_INSTANCE_KEYBOARD || report_type != HID_REPORT_TYPE_OUTPUT)
+    {
+        return;
+    }
+    if (lockStateUpdate(&lockState, report_id, expectedId, buffer, bufsize))
+    {
+        DLOG(DLOG_LOCK_STATE, lockState.leds);
+    }
+}
+
+uint8_t getLockState()
+{
+    return lockState.leds;
+}
+
+/*
+Raw bytes on the console port. Goes around stdout, which would turn every \n
+into \r\n, so log lines printed at the same time may land in between.
+Returns false if the host stopped reading.
+*/
+bool usbConsoleWrite(const uint8_t *data, size_t length)
+{
+    size_t queued = 0;
+
+    while (length > 0)
+    {
+        queued = tinyusb_cdcacm_write_queue(TINYUSB_CDC_ACM_0, data, length);
+        if (queued == 0 && tinyusb_cdcacm_write_flush(TINYUSB_CDC_ACM_0, pdMS_TO_TICKS(USB_CONSOLE_WRITE_TIMEOUT_MS)) != ESP_OK)
+        {
+            return false;
+        }
+        data += queued;
+        length -= queued;
+    }
+    return tinyusb_cdcacm_write_flush(TINYUSB_CDC_ACM_0, pdMS_TO_TICKS(USB_CONSOLE_WRITE_TIMEOUT_MS)) == ESP_OK;
+}
+
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report, uint16_t len)
+{
+#if KVASS_LATENCY_TRACE
+    uint32_t now = LATENCY_TIMESTAMP();
+
+    if (instance < HID_ITF_COUNT && inflight[instance])
+    {
+        latencyRecord(LATENCY_SEND_TO_COMPLETE, inflightSendUs[instance], now);
+        latencyRecord(LATENCY_SCAN_TO_COMPLETE, inflightScanUs[instance], now);
+        inflight[instance] = false;
+    }
+#endif
+    telemetryCount(&telemetry, TELEMETRY_REPORTS_COMPLETED, 1);
+
+    // Endpoint is free again, send the freshest state right away, the other interface is not held back
+    if (releasePending)
+    {
+        releaseHost();
+    }
+    else if (completeCallback != NULL)
+    {
+        completeCallback(completeOwner, instance == HID_INSTANCE_MOUSE ? REPORT_MOUSE : REPORT_KEYBOARD);
+    }
+}
+
+void tud_suspend_cb(bool remote_wakeup_en)
+{
+    // Reports wait in the scheduler, the first one asks the host to wake up if it allows that
+    commsHostSuspend(true);
+}
+
+void tud_resume_cb(void)
+{
+    // Anything that woke the host is still waiting in the scheduler, resuming pumps it
+    commsHostSuspend(false);
+}
+
+void tud_mount_cb(void)
+{
+    // A fresh host holds no keys in any report format, nothing to release on the first report
+    lastKeyboardMode = getKeyboardReportMode();
+    // A bus reset ends a suspend without a resume
+    commsHostSuspend(false);
+}
+
+static void markReportSent(uint8_t instance, uint32_t scanUs, uint32_t queueUs)
+{
+#if KVASS_LATENCY_TRACE
+    inflightSendUs[instance] = LATENCY_TIMESTAMP();
+    inflightScanUs[instance] = scanUs;
+    inflight[instance] = true;
+    latencyRecord(LATENCY_QUEUE_TO_SEND, queueUs, inflightSendUs[instance]);
+#endif
+}
+
+// Image bytes go to the keymap store, the comms task writes it once it is complete
+static void feedKeymapUpload(const uint8_t *data, size_t length, uint32_t nowUs)
+{
+    enum KeymapUploadState state = KEYMAP_UPLOAD_RECEIVING;
+
+    keymapUploadFeed(data, length, nowUs, &state);
+    if (state != KEYMAP_UPLOAD_RECEIVING)
+    {
+        commsKeymapUploaded();
+    }
+}
+
+// Runs in the TinyUSB task, the command itself is handled by the comms task
+void consoleRxCallback(int itf, cdcacm_event_t *event)
+{
+    uint8_t buffer[CONFIG_TINYUSB_CDC_RX_BUFSIZE];
+    size_t rxSize = 0;
+    uint32_t nowUs = (uint32_t)esp_timer_get_time();
+
+    if (tinyusb_cdcacm_read(itf, buffer, sizeof(buffer), &rxSize) != ESP_OK)
+    {
+        return;
+    }
+
+    // Bytes after a 'k' are a keymap image as tools/keymap_compiler.py writes it, not commands
+    if (keymapUploadReceiving(nowUs))
+    {
+        feedKeymapUpload(buffer, rxSize, nowUs);
+        return;
+    }
+
+    for (size_t i = 0; i < rxSize; i++)
+    {
+        if (buffer[i] == CONSOLE_KEYMAP_UPLOAD)
+        {
+            if (keymapUploadBegin(nowUs))
+            {
+                feedKeymapUpload(&buffer[i + 1], rxSize - i - 1, nowUs);
+            }
+            break;
+        }
+        if (buffer[i] > ' ')
+        {
+            commsConsoleInput((char)buffer[i]);
+            break;
+        }
+    }
+}
+
+void tud_hid_set_protocol_cb(uint8_t instance, uint8_t protocol)
+{
+    // Boot protocol hosts (BIOS, bootloaders) only understand the plain 6KRO report
+    if (instance != HID_INSTANCE_KEYBOARD)
+    {
+        return;
+    }
+    hidProtocol = protocol;
+    DLOG(DLOG_HID_PROTOCOL, protocol);
+}
+
+void setKeyboardNkro(bool enabled)
+{
+    nkroEnabled = enabled;
+}
+
+static enum KeyboardReportMode getKeyboardReportMode()
+{
+    if (hidProtocol == HID_PROTOCOL_BOOT)
+    {
+        return KB_REPORT_BOOT;
+    }
+    return nkroEnabled ? KB_REPORT_NKRO : KB_REPORT_6KRO;
+}
+
+static bool sendKeyboardReportAs(enum KeyboardReportMode mode, const struct KeyboardData *kbData)
+{
+    hid_nkro_report_t nkroReport = {0};
+
+    switch (mode)
+    {
+    case KB_REPORT_BOOT:
+        return tud_hid_n_keyboard_report(HID_INSTANCE_KEYBOARD, 0, kbData->modifier, kbData->keycode);
+    case KB_REPORT_NKRO:
+        nkroReport.modifier = kbData->modifier;
+        memcpy(nkroReport.bitmap, kbData->bitmap, KB_NKRO_BYTES);
+        return tud_hid_n_report(HID_INSTANCE_KEYBOARD, REPORT_ID_NKRO, &nkroReport, sizeof(nkroReport));
+    default:
+        return tud_hid_n_keyboard_report(HID_INSTANCE_KEYBOARD, HID_ITF_PROTOCOL_KEYBOARD, kbData->modifier, kbData->keycode);
+    }
+}
+
+// Returns false if the report was not taken, the scheduler keeps it and retries on completion
+static bool sendKeyboardReport(const struct KeyboardData *kbData)
+{
+    static const struct KeyboardData emptyData = {0};
+    enum KeyboardReportMode mode = getKeyboardReportMode();
+
+    // Release everything on the old report first, otherwise keys would stay stuck there
+    if (mode != lastKeyboardMode && mode != KB_REPORT_BOOT && lastKeyboardMode != KB_REPORT_BOOT)
+    {
+        // Not taken, the release goes out on the next try
+        if (sendKeyboardReportAs(lastKeyboardMode, &emptyData))
+        {
+            lastKeyboardMode = mode;
+        }
+        return false;
+    }
+    lastKeyboardMode = mode;
+
+    return sendKeyboardReportAs(mode, kbData);
+}
+
+// Installs the stack once, it stays up across protocol switches so the host never re-enumerates
+esp_err_t usbInstall()
+{
+    esp_err_t err = ESP_OK;
+    const tinyusb_config_t tusb_cfg = {
+        .device_descriptor = &desc_device,
+        .string_descriptor = hid_string_descriptor,
+        .string_descriptor_count = sizeof(hid_string_descriptor) / sizeof(hid_string_descriptor[0]),
+        .external_phy = false,
+        .configuration_descriptor = hid_configuration_descriptor,
+    };
+    tinyusb_config_cdcacm_t acm_cfg = {
+        .usb_dev = TINYUSB_USBDEV_0,
+        .cdc_port = TINYUSB_CDC_ACM_0,
+        .callback_rx = &consoleRxCallback,
+    };
+
+    if (installed)
+    {
+        return ESP_OK;
+    }
+    err = tinyusb_driver_install(&tusb_cfg);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG_USB, "TinyUSB driver install failed");
+        return err;
+    }
+    err = tusb_cdc_acm_init(&acm_cfg);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG_USB, "CDC init failed");
+        tinyusb_driver_uninstall();
+        return err;
+    }
+    esp_tusb_init_console(TINYUSB_CDC_ACM_0);
+    installed = true;
+
+    vTaskDelay(pdMS_TO_TICKS(10));
+    ESP_LOGI(TAG_USB, "USB initialization DONE");
+    return ESP_OK;
+}
+
+// Sends whatever release is still owed and the endpoint takes right now
+static void releaseHost()
+{
+    static const struct KeyboardData emptyKeyboard = {0};
+    static const hid_mouse16_report_t emptyMouse = {0};
+
+    if (!tud_mounted() || tud_suspended())
+    {
+        // Host drops its key state itself on reset or resume
+        releasePending = 0;
+        return;
+    }
+    if ((releasePending & RELEASE_KEYBOARD) && tud_hid_n_ready(HID_INSTANCE_KEYBOARD) && sendKeyboardReport(&emptyKeyboard))
+    {
+        releasePending &= ~RELEASE_KEYBOARD;
+    }
+    if ((releasePending & RELEASE_MOUSE) && tud_hid_n_ready(HID_INSTANCE_MOUSE) &&
+        tud_hid_n_report(HID_INSTANCE_MOUSE, REPORT_ID_MOUSE, &emptyMouse, sizeof(emptyMouse)))
+    {
+        releasePending &= ~RELEASE_MOUSE;
+    }
+}
+
+// Only routes reports here, the stack itself is already up
+static bool usbInit(void *ctx, TransportCompleteFn complete, void *owner)
+{
+    if (usbInstall() != ESP_OK)
+    {
+        return false;
+    }
+    // Pipeline resends the held keys, an empty report after them would release them again
+    releasePending = 0;
+    completeCallback = complete;
+    completeOwner = owner;
+    paused = false;
+    return true;
+}
+
+static bool usbConnected(void *ctx)
+{
+    // Stays true while the bus is suspended, held keys then wake the host
+    return tud_mounted();
+}
+
+static bool usbReady(void *ctx, enum ReportType type)
+{
+    if (!tud_mounted())
+    {
+        return false;
+    }
+    if (tud_suspended())
+    {
+        // Reports are pending, tud_resume_cb pumps them once the host is back
+        tud_remote_wakeup();
+        return false;
+    }
+    if (paused)
+    {
+        return false;
+    }
+    return tud_hid_n_ready(type == REPORT_MOUSE ? HID_INSTANCE_MOUSE : HID_INSTANCE_KEYBOARD);
+}
+
+static bool usbSendKeyboard(void *ctx, const struct KeyboardData *data)
+{
+    if (!sendKeyboardReport(data))
+    {
+        return false;
+    }
+    markReportSent(HID_INSTANCE_KEYBOARD, data->scan_us, data->queue_us);
+    return true;
+}
+
+static bool usbSendPointer(void *ctx, const struct MouseData *data)
+{
+    hid_mouse16_report_t report = {
+        .buttons = data->button,
+        .x = data->delta_x,
+        .y = data->delta_y,
+        .wheel = data->scroll_vertical,
+        .pan = data->scroll_horizontal,
+    };
+
+    if (!tud_hid_n_report(HID_INSTANCE_MOUSE, REPORT_ID_MOUSE, &report, sizeof(report)))
+    {
+        return false;
+    }
+    markReportSent(HID_INSTANCE_MOUSE, data->scan_us, data->queue_us);
+    return true;
+}
+
+static void usbSuspend(void *ctx, bool suspended)
+{
+    paused = suspended;
+}
+
+// Keeps the stack and console, the host only gets its keys released
+static void usbDeinit(void *ctx)
+{
+    completeCallback = NULL;
+    releasePending = RELEASE_KEYBOARD | RELEASE_MOUSE;
+    releaseHost();
+}
+
+static const struct Transport usbTransport = {
+    .name = "USB",
+    .ctx = NULL,
+    .init = usbInit,
+    .connected = usbConnected,
+    .ready = usbReady,
+    .sendKeyboard = usbSendKeyboard,
+    .sendPointer = usbSendPointer,
+    .suspend = usbSuspend,
+    .deinit = usbDeinit,
+};
+
+const struct Transport *getUsbTransport()
+{
+    return &usbTransport;
+}
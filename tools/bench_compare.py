@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""
+Compares two host benchmark results (see host/bench/bench.c).
+
+    bench_compare.py base.json new.json                 table of every benchmark
+    bench_compare.py base.json new.json --threshold 25  exits 1 if any got 25 % slower
+
+Only ns_per_op decides a regression. Host timings move with the machine, so
+both files should come from the same machine and build type.
+
+Each file has the fastest and slowest of its repeats. A benchmark only counts
+as slower when:
+- the new fastest repeat is behind the old slowest one
+- the change beats both the threshold and the repeat spread of either run
+- it is at least --min-ns slower, a few ns is timer noise for the tiny benches
+"""
+
+import argparse
+import json
+import sys
+
+SCHEMA = 1
+
+
+def load(path):
+    with open(path) as f:
+        result = json.load(f)
+    if result.get("schema") != SCHEMA:
+        sys.exit(f"{path}: unsupported schema {result.get('schema')}")
+    return result
+
+
+def by_name(result):
+    return {bench["name"]: bench for bench in result["benchmarks"]}
+
+
+# Spread of the repeats in percent of the median
+def noise(bench):
+    if not bench["ns_per_op"]:
+        return 0.0
+    return (bench["ns_max"] - bench["ns_min"]) * 100.0 / bench["ns_per_op"]
+
+
+def regressed(old, new, threshold, min_ns):
+    change = (new["ns_per_op"] - old["ns_per_op"]) * 100.0 / old["ns_per_op"] if old["ns_per_op"] else 0.0
+    return (new["ns_min"] > old["ns_max"]
+            and change > max(threshold, noise(old), noise(new))
+            and new["ns_per_op"] - old["ns_per_op"] >= min_ns)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="KVASS host benchmark comparison")
+    parser.add_argument("base", help="JSON from the older firmware")
+    parser.add_argument("new", help="JSON from the newer firmware")
+    parser.add_argument("--threshold", type=float, default=25.0, help="slowdown in percent counted as a regression")
+    parser.add_argument("--min-ns", type=float, default=2.0, help="smallest slowdown in ns per op counted as a regression")
+    args = parser.parse_args()
+
+    base = load(args.base)
+    new = load(args.new)
+    if base.get("build_type") != new.get("build_type"):
+        print(f"warning: build types differ ({base.get('build_type')} vs {new.get('build_type')})", file=sys.stderr)
+
+    old_benches = by_name(base)
+    new_benches = by_name(new)
+    regressions = []
+
+    print(f"{'benchmark':28} {base['version'][:14]:>14} {new['version'][:14]:>14} {'change':>9} {'noise':>7}")
+    for name, bench in new_benches.items():
+        old = old_benches.get(name)
+        if old is None:
+            print(f"{name:28} {'-':>14} {bench['ns_per_op']:14.1f} {'new':>9}")
+            continue
+        change = (bench["ns_per_op"] - old["ns_per_op"]) * 100.0 / old["ns_per_op"] if old["ns_per_op"] else 0.0
+        flag = ""
+        if regressed(old, bench, args.threshold, args.min_ns):
+            regressions.append(name)
+            flag = "  REGRESSION"
+        spread = max(noise(old), noise(bench))
+        print(f"{name:28} {old['ns_per_op']:14.1f} {bench['ns_per_op']:14.1f} {change:+8.1f}% {spread:6.1f}%{flag}")
+    for name in old_benches.keys() - new_benches.keys():
+        print(f"{name:28} {old_benches[name]['ns_per_op']:14.1f} {'-':>14} {'gone':>9}")
+
+    if regressions:
+        print(f"{len(regressions)} benchmark(s) slower than {args.threshold:g} % and their noise: {', '.join(regressions)}", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
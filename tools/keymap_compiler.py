@@ -0,0 +1,302 @@
+#!/usr/bin/env python3
+"""
+Builds and checks KVASS keymap images (see main/include/keymap_image.h).
+
+    keymap_compiler.py compile tools/keymaps/default.json -o keymap.bin
+    keymap_compiler.py compile tools/keymaps/default.json --partition keymap_part.bin
+    keymap_compiler.py check keymap.bin
+
+A partition image has the keymap in slot A and slot B erased, flash it with
+    parttool.py write_partition --partition-name keymap --input keymap_part.bin
+or send a plain image to a running keyboard over its USB console
+    stty -F /dev/ttyACM0 raw && (printf k; cat keymap.bin) > /dev/ttyACM0
+
+Keymap JSON: {"layers": [{"name": "base", "keys": [[...7 actions...], ...]}, ...]}
+Rows go left half first, then the right half as wired, KB_ROWS rows per half.
+Actions:
+    A, KC(A), 0x04          plain key, names as in TinyUSB without HID_KEY_
+    KM(CTRL|SHIFT, Z)       key with modifiers
+    MO(fn) TG(fn) DF(base)  layer keys, by name or index
+    MT(CTRL, ESCAPE)        modifiers on hold, key on tap
+    LT(fn, SPACE)           layer on hold, key on tap
+    OSM(SHIFT)              one-shot modifiers
+    ____ / TRNS             falls through to the layer below
+    XXXX / NONE             does nothing
+default.json is the built-in keymap, home_row.json adds tap-hold and one-shot keys.
+"""
+
+import argparse
+import json
+import re
+import struct
+import sys
+import zlib
+
+MAGIC = 0x4D4B564B
+VERSION = 1
+SIDES, ROWS, COLS = 2, 5, 7
+KEYS = SIDES * ROWS * COLS
+MAX_LAYERS = 8
+SLOT_SIZE = 0x1000
+SLOTS = 2
+HEADER = struct.Struct("<IHHB3xII")
+
+KIND_KEY, KIND_MO, KIND_TG, KIND_DF, KIND_MT, KIND_LT, KIND_OSM = 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6
+TRANSPARENT = 0xF000
+MODS = {"CTRL": 0x1, "SHIFT": 0x2, "ALT": 0x4, "GUI": 0x8}
+
+
+def _keycodes():
+    codes = {}
+    for i, letter in enumerate("ABCDEFGHIJKLMNOPQRSTUVWXYZ"):
+        codes[letter] = 0x04 + i
+    for i, digit in enumerate("1234567890"):
+        codes[digit] = 0x1E + i
+    names = [
+        "ENTER", "ESCAPE", "BACKSPACE", "TAB", "SPACE", "MINUS", "EQUAL", "BRACKET_LEFT",
+        "BRACKET_RIGHT", "BACKSLASH", "EUROPE_1", "SEMICOLON", "APOSTROPHE", "GRAVE", "COMMA",
+        "PERIOD", "SLASH", "CAPS_LOCK",
+    ]
+    for i, name in enumerate(names):
+        codes[name] = 0x28 + i
+    for i in range(12):
+        codes["F%d" % (i + 1)] = 0x3A + i
+    names = [
+        "PRINT_SCREEN", "SCROLL_LOCK", "PAUSE", "INSERT", "HOME", "PAGE_UP", "DELETE", "END",
+        "PAGE_DOWN", "ARROW_RIGHT", "ARROW_LEFT", "ARROW_DOWN", "ARROW_UP", "NUM_LOCK",
+        "KEYPAD_DIVIDE", "KEYPAD_MULTIPLY", "KEYPAD_SUBTRACT", "KEYPAD_ADD", "KEYPAD_ENTER",
+        "KEYPAD_1", "KEYPAD_2", "KEYPAD_3", "KEYPAD_4", "KEYPAD_5", "KEYPAD_6", "KEYPAD_7",
+        "KEYPAD_8", "KEYPAD_9", "KEYPAD_0", "KEYPAD_DECIMAL", "EUROPE_2", "APPLICATION", "POWER",
+        "KEYPAD_EQUAL",
+    ]
+    for i, name in enumerate(names):
+        codes[name] = 0x46 + i
+    for i in range(12):
+        codes["F%d" % (i + 13)] = 0x68 + i
+    names = [
+        "CONTROL_LEFT", "SHIFT_LEFT", "ALT_LEFT", "GUI_LEFT",
+        "CONTROL_RIGHT", "SHIFT_RIGHT", "ALT_RIGHT", "GUI_RIGHT",
+    ]
+    for i, name in enumerate(names):
+        codes[name] = 0xE0 + i
+    return codes
+
+
+KEYCODES = _keycodes()
+KEYNAMES = {code: name for name, code in KEYCODES.items()}
+
+
+class KeymapError(Exception):
+    pass
+
+
+def parse_keycode(text):
+    text = text.strip().upper()
+    if text.startswith("HID_KEY_"):
+        text = text[len("HID_KEY_"):]
+    if text in KEYCODES:
+        return KEYCODES[text]
+    try:
+        value = int(text, 0)
+    except ValueError:
+        raise KeymapError("unknown keycode %r" % text)
+    if not 0 <= value <= 0xFF:
+        raise KeymapError("keycode %r out of range" % text)
+    return value
+
+
+def parse_mods(text):
+    mods = 0
+    for part in re.split(r"[|+]", text):
+        part = part.strip().upper()
+        if part.startswith("MOD_"):
+            part = part[len("MOD_"):]
+        if part not in MODS:
+            raise KeymapError("unknown modifier %r" % part)
+        mods |= MODS[part]
+    return mods
+
+
+def parse_layer(text, layer_names):
+    text = text.strip()
+    if text in layer_names:
+        return layer_names[text]
+    try:
+        layer = int(text, 0)
+    except ValueError:
+        raise KeymapError("unknown layer %r" % text)
+    if not 0 <= layer < MAX_LAYERS:
+        raise KeymapError("layer %r out of range" % text)
+    return layer
+
+
+def parse_action(text, layer_names):
+    text = str(text).strip()
+    upper = text.upper()
+    if upper in ("____", "TRNS", "_______"):
+        return TRANSPARENT
+    if upper in ("XXXX", "NONE", ""):
+        return 0
+    match = re.fullmatch(r"(\w+)\((.*)\)", text)
+    if match is None:
+        return parse_keycode(text)
+
+    name, args = match.group(1).upper(), [arg.strip() for arg in match.group(2).split(",")]
+    expected = {"KC": 1, "KM": 2, "MO": 1, "TG": 1, "DF": 1, "MT": 2, "LT": 2, "OSM": 1}
+    if name not in expected:
+        raise KeymapError("unknown action %r" % name)
+    if len(args) != expected[name]:
+        raise KeymapError("%s takes %d arguments" % (name, expected[name]))
+
+    if name == "KC":
+        return parse_keycode(args[0])
+    if name == "KM":
+        return (parse_mods(args[0]) << 8) | parse_keycode(args[1])
+    if name in ("MO", "TG", "DF"):
+        kind = {"MO": KIND_MO, "TG": KIND_TG, "DF": KIND_DF}[name]
+        return (kind << 12) | parse_layer(args[0], layer_names)
+    if name == "MT":
+        return (KIND_MT << 12) | (parse_mods(args[0]) << 8) | parse_keycode(args[1])
+    if name == "LT":
+        return (KIND_LT << 12) | (parse_layer(args[0], layer_names) << 8) | parse_keycode(args[1])
+    return (KIND_OSM << 12) | (parse_mods(args[0]) << 8)
+
+
+def flatten(keys):
+    for key in keys:
+        if isinstance(key, list):
+            yield from flatten(key)
+        else:
+            yield key
+
+
+def compile_keymap(source, generation=1):
+    layers = source.get("layers", [])
+    if not 0 < len(layers) <= MAX_LAYERS:
+        raise KeymapError("need 1 to %d layers, got %d" % (MAX_LAYERS, len(layers)))
+    layer_names = {layer.get("name", str(i)): i for i, layer in enumerate(layers)}
+
+    actions = []
+    for index, layer in enumerate(layers):
+        keys = list(flatten(layer.get("keys", [])))
+        if len(keys) != KEYS:
+            raise KeymapError("layer %d has %d keys, expected %d" % (index, len(keys), KEYS))
+        for key, text in enumerate(keys):
+            try:
+                actions.append(parse_action(text, layer_names))
+            except KeymapError as error:
+                side, rest = divmod(key, ROWS * COLS)
+                raise KeymapError("layer %d side %d row %d col %d: %s" % (index, side, rest // COLS, rest % COLS, error))
+    return build_image(actions, len(layers), generation)
+
+
+def build_image(actions, layers, generation):
+    payload = struct.pack("<%dH" % len(actions), *actions)
+    header = HEADER.pack(MAGIC, VERSION, KEYS, layers, generation, 0)
+    crc = zlib.crc32(header + payload) & 0xFFFFFFFF
+    return HEADER.pack(MAGIC, VERSION, KEYS, layers, generation, crc) + payload
+
+
+def check_image(image):
+    """Returns (layers, generation, actions) or raises KeymapError, same checks as keymapImageCheck"""
+    if len(image) < HEADER.size:
+        raise KeymapError("truncated")
+    magic, version, keys, layers, generation, crc = HEADER.unpack_from(image)
+    if magic != MAGIC:
+        raise KeymapError("bad magic")
+    if version != VERSION:
+        raise KeymapError("unsupported version %d" % version)
+    if keys != KEYS or not 0 < layers <= MAX_LAYERS:
+        raise KeymapError("wrong key or layer count (%d keys, %d layers)" % (keys, layers))
+    size = HEADER.size + layers * keys * 2
+    if len(image) < size:
+        raise KeymapError("truncated")
+    zeroed = HEADER.pack(magic, version, keys, layers, generation, 0)
+    if zlib.crc32(zeroed + image[HEADER.size:size]) & 0xFFFFFFFF != crc:
+        raise KeymapError("bad crc")
+    actions = struct.unpack_from("<%dH" % (layers * keys), image, HEADER.size)
+    return layers, generation, actions
+
+
+def describe_action(action):
+    kind, mods, code = action >> 12, (action >> 8) & 0xF, action & 0xFF
+    mod_names = "|".join(name for name, bit in MODS.items() if mods & bit)
+    key = KEYNAMES.get(code, "0x%02X" % code)
+    if action == TRANSPARENT:
+        return "____"
+    if action == 0:
+        return "XXXX"
+    if kind == KIND_KEY:
+        return key if mods == 0 else "KM(%s, %s)" % (mod_names, key)
+    if kind in (KIND_MO, KIND_TG, KIND_DF):
+        return "%s(%d)" % ({KIND_MO: "MO", KIND_TG: "TG", KIND_DF: "DF"}[kind], action & 0xF)
+    if kind == KIND_MT:
+        return "MT(%s, %s)" % (mod_names, key)
+    if kind == KIND_LT:
+        return "LT(%d, %s)" % (mods, key)
+    if kind == KIND_OSM:
+        return "OSM(%s)" % mod_names
+    return "0x%04X" % action
+
+
+def partition_image(image):
+    slot = image + b"\xff" * (SLOT_SIZE - len(image))
+    return slot + b"\xff" * (SLOT_SIZE * (SLOTS - 1))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="KVASS keymap image compiler")
+    commands = parser.add_subparsers(dest="command", required=True)
+    build = commands.add_parser("compile", help="JSON keymap to binary image")
+    build.add_argument("source")
+    build.add_argument("-o", "--output", help="slot image")
+    build.add_argument("--partition", help="whole keymap partition, image in slot A")
+    build.add_argument("--generation", type=lambda text: int(text, 0), default=1)
+    check = commands.add_parser("check", help="validate an image or partition and print it")
+    check.add_argument("image")
+    args = parser.parse_args()
+
+    try:
+        if args.command == "compile":
+            with open(args.source) as f:
+                image = compile_keymap(json.load(f), args.generation)
+            if len(image) > SLOT_SIZE:
+                raise KeymapError("image is %d bytes, a slot holds %d" % (len(image), SLOT_SIZE))
+            if args.output:
+                with open(args.output, "wb") as f:
+                    f.write(image)
+            if args.partition:
+                with open(args.partition, "wb") as f:
+                    f.write(partition_image(image))
+            print("%d bytes, crc 0x%08X" % (len(image), HEADER.unpack_from(image)[5]))
+        else:
+            with open(args.image, "rb") as f:
+                data = f.read()
+            slots = [data[i:i + SLOT_SIZE] for i in range(0, len(data), SLOT_SIZE)] if len(data) > SLOT_SIZE else [data]
+            valid = 0
+            for index, slot in enumerate(slots):
+                if len(slots) > 1 and slot[:4] == b"\xff\xff\xff\xff":
+                    print("slot %d: empty" % index)
+                    continue
+                try:
+                    layers, generation, actions = check_image(slot)
+                except KeymapError as error:
+                    print("slot %d: %s" % (index, error))
+                    continue
+                valid += 1
+                print("slot %d: %d layers, generation %d" % (index, layers, generation))
+                for layer in range(layers):
+                    print("  layer %d" % layer)
+                    for row in range(SIDES * ROWS):
+                        base = layer * KEYS + row * COLS
+                        print("    " + ", ".join(describe_action(a) for a in actions[base:base + COLS]))
+            if valid == 0:
+                raise KeymapError("no valid keymap")
+    except (KeymapError, OSError, ValueError) as error:
+        print("error: %s" % error, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
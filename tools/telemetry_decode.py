@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""
+Decodes KVASS telemetry snapshots (see main/include/telemetry.h).
+
+    telemetry_decode.py /dev/ttyACM0        sends 't' on the console and decodes the answer
+    telemetry_decode.py capture.bin         decodes every snapshot in a raw capture
+    telemetry_decode.py capture.bin --json
+
+Snapshots sit between normal console text, they are found by their sync bytes
+and checked with their CRC. Reading a port needs pyserial.
+"""
+
+import argparse
+import binascii
+import json
+import os
+import stat
+import struct
+import sys
+import time
+
+SYNC = b"KVTM"
+VERSION = 1
+HEADER = struct.Struct("<BBBBHHIB3x")
+
+# Same order as enum TelemetryCounter and enum TelemetryGauge
+COUNTERS = [
+    "matrixScans",
+    "reportsCompleted",
+    "keyboardSent",
+    "mouseSent",
+    "reportsMerged",
+    "reportQueueFull",
+    "ringDeferred",
+]
+GAUGES = [
+    "scanPeriodUs",
+    "ringHighWater",
+    "keyboardQueueHighWater",
+    "mouseQueueHighWater",
+    "heapFree",
+    "heapMin",
+]
+
+
+def crc16(data):
+    # CRC-16/CCITT-FALSE, same as splitCrc16
+    return binascii.crc_hqx(data, 0xFFFF)
+
+
+def names(known, count, prefix):
+    return [known[i] if i < len(known) else "%s%d" % (prefix, i) for i in range(count)]
+
+
+def parse_payload(payload):
+    version, counters, gauges, tasks, period_ms, count, written, name_length = HEADER.unpack_from(payload)
+    if version != VERSION:
+        raise ValueError("snapshot version %d, this decoder knows %d" % (version, VERSION))
+    offset = HEADER.size
+
+    task_list = []
+    for _ in range(tasks):
+        name = payload[offset:offset + name_length].split(b"\0", 1)[0].decode("ascii", "replace")
+        (stack_free,) = struct.unpack_from("<I", payload, offset + name_length)
+        task_list.append({"name": name, "stackFree": stack_free})
+        offset += name_length + 4
+
+    counter_names = names(COUNTERS, counters, "counter")
+    gauge_names = names(GAUGES, gauges, "gauge")
+    sample = struct.Struct("<I%dI%dI%dH" % (counters, gauges, tasks))
+    samples = []
+    for _ in range(count):
+        values = sample.unpack_from(payload, offset)
+        offset += sample.size
+        samples.append({
+            "timeMs": values[0],
+            "counters": dict(zip(counter_names, values[1:1 + counters])),
+            "gauges": dict(zip(gauge_names, values[1 + counters:1 + counters + gauges])),
+            "cpuPermille": dict(zip([task["name"] for task in task_list], values[1 + counters + gauges:])),
+        })
+    return {"periodMs": period_ms, "written": written, "tasks": task_list, "samples": samples}
+
+
+def find_snapshots(data):
+    snapshots = []
+    start = data.find(SYNC)
+    while start >= 0:
+        body = start + len(SYNC)
+        if body + 2 > len(data):
+            break
+        (length,) = struct.unpack_from("<H", data, body)
+        end = body + 2 + length + 2
+        if end > len(data):
+            # Cut off, or console text that happens to contain the sync bytes
+            start = data.find(SYNC, start + 1)
+            continue
+        payload = data[body + 2:body + 2 + length]
+        (crc,) = struct.unpack_from("<H", data, end - 2)
+        if crc == crc16(payload):
+            snapshots.append(parse_payload(payload))
+            start = data.find(SYNC, end)
+        else:
+            # Log text landed inside it or it is not a snapshot at all
+            print("skipping a snapshot with a bad CRC at byte %d" % start, file=sys.stderr)
+            start = data.find(SYNC, start + 1)
+    return snapshots
+
+
+def read_port(path, timeout):
+    import serial
+
+    with serial.Serial(path, 115200, timeout=0.1) as port:
+        port.reset_input_buffer()
+        port.write(b"t")
+        data = b""
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            data += port.read(4096)
+            if find_snapshots(data):
+                break
+        return data
+
+
+def rate(new, old, key, seconds):
+    return (new["counters"][key] - old["counters"][key]) / seconds if seconds > 0 else 0.0
+
+
+def print_snapshot(snapshot):
+    print("tasks (free stack bytes):")
+    for task in snapshot["tasks"]:
+        print("  %-16s %6d" % (task["name"], task["stackFree"]))
+
+    previous = None
+    for sample in snapshot["samples"]:
+        gauges = sample["gauges"]
+        line = "%9.3fs" % (sample["timeMs"] / 1000)
+        if previous is not None:
+            seconds = (sample["timeMs"] - previous["timeMs"]) / 1000
+            reports = rate(sample, previous, "keyboardSent", seconds) + rate(sample, previous, "mouseSent", seconds)
+            line += " scan=%6.0fHz reports=%5.0f/s completed=%5.0f/s merged=%4d queuefull=%4d deferred=%4d" % (
+                rate(sample, previous, "matrixScans", seconds), reports,
+                rate(sample, previous, "reportsCompleted", seconds),
+                sample["counters"]["reportsMerged"] - previous["counters"]["reportsMerged"],
+                sample["counters"]["reportQueueFull"] - previous["counters"]["reportQueueFull"],
+                sample["counters"]["ringDeferred"] - previous["counters"]["ringDeferred"])
+        line += " period=%4dus ring=%2d kbq=%2d mouseq=%d heap=%d/%d" % (
+            gauges["scanPeriodUs"], gauges["ringHighWater"], gauges["keyboardQueueHighWater"],
+            gauges["mouseQueueHighWater"], gauges["heapFree"], gauges["heapMin"])
+        line += " cpu " + " ".join("%s=%.1f%%" % (name, permille / 10) for name, permille in sample["cpuPermille"].items())
+        print(line)
+        previous = sample
+
+
+def main():
+    parser = argparse.ArgumentParser(description="KVASS telemetry snapshot decoder")
+    parser.add_argument("source", help="serial port or raw capture file")
+    parser.add_argument("--json", action="store_true", help="print the decoded snapshots as JSON")
+    parser.add_argument("--timeout", type=float, default=3.0, help="seconds to wait for an answer on a port")
+    args = parser.parse_args()
+
+    if stat.S_ISCHR(os.stat(args.source).st_mode):
+        data = read_port(args.source, args.timeout)
+    else:
+        with open(args.source, "rb") as source:
+            data = source.read()
+
+    snapshots = find_snapshots(data)
+    if not snapshots:
+        print("no snapshot found", file=sys.stderr)
+        return 1
+    if args.json:
+        json.dump(snapshots, sys.stdout, indent=2)
+        print()
+        return 0
+    for snapshot in snapshots:
+        print_snapshot(snapshot)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())